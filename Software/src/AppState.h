@@ -4,9 +4,14 @@
 // Defines the current active screen or view of the application.
 enum class AppScreen {
     SCREEN_BLUETOOTH_SELECTION,
+    SCREEN_ARTIST_BROWSE,
+    SCREEN_ALBUM_BROWSE,
+    SCREEN_ALBUM_TRACKS,
     SCREEN_TRACK_SELECTION,
+    SCREEN_SEARCH,
     SCREEN_NOW_PLAYING,
-    SCREEN_VOLUME_CONTROL
+    SCREEN_VOLUME_CONTROL,
+    SCREEN_SETTINGS
 };
 
 #endif // APP_STATE_H
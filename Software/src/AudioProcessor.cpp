@@ -1,49 +1,550 @@
 #include "AudioProcessor.h"
+#include "Mp3Parser.h"
+#include "libhelix-mp3/mp3common.h"
 
-AudioProcessor::AudioProcessor() : decoder(&current_file, &mp3) {
-    // Decoder is initialized with references to the file and mp3 objects.
+alignas(4) static uint8_t ring_storage[AUDIO_RING_BUFFER_SIZE];
+static uint8_t input_buffer[AUDIO_INPUT_BUFFER_SIZE];
+// Frames that cannot be decoded straight into the ring are staged here
+alignas(4) static uint8_t frame_pcm[AUDIO_FRAME_PCM_BYTES];
+alignas(4) static uint8_t output_chunk[AUDIO_OUTPUT_CHUNK_SIZE];
+
+AudioProcessor::AudioProcessor() : mp3(nullptr),
+    input_offset(0), input_length(0), discard_until(0),
+    pcm_position(0), decode_cycles(0), normalize_cycles(0), gain_cycles(0), eq_cycles(0), decoded_bytes(0),
+    seek_index_count(0), seek_index_interval_ms(1000), seek_index_growing(false),
+    ring(ring_storage, sizeof(ring_storage)),
+    decode_task(nullptr), end_of_track(false), flush_pending(false),
+    next_file_requested(false), next_file_wanted(false),
+    boundary_pending(false), track_boundary(0), track_change_pending(false),
+    played_bytes(0), position_base_ms(0),
+    underrun_count(0), high_water(0) {
+    current.skip_bytes = current.valid_bytes = 0;
+    next.skip_bytes = next.valid_bytes = 0;
+    decoder_mutex = xSemaphoreCreateMutex();
 }
 
-bool AudioProcessor::openFile(const String& filepath) {
-    if (current_file) {
-        current_file.close();
+bool AudioProcessor::begin() {
+    if (decode_task) return true;
+    // One decoder for the whole session; Helix allocates its state once here
+    if (!mp3) {
+        mp3 = MP3InitDecoder();
+        if (!mp3) {
+            Serial.println("Failed to allocate the MP3 decoder");
+            return false;
+        }
     }
-    
-    current_file = SD.open(filepath);
-    if (!current_file) {
-        Serial.println("Failed to open file: " + filepath);
+    BaseType_t result = xTaskCreatePinnedToCore(decodeTask, "Decode", AUDIO_DECODE_TASK_STACK, this,
+                                                AUDIO_DECODE_TASK_PRIORITY, &decode_task, AUDIO_DECODE_TASK_CORE);
+    if (result != pdPASS) {
+        Serial.println("Failed to start decode task");
+        decode_task = nullptr;
         return false;
     }
-    
-    decoder.transformationReader().resizeResultQueue(1024 * 8);
-    if (!decoder.begin()) {
-        Serial.println("Decoder begin() failed");
-        current_file.close();
+    return true;
+}
+
+void AudioProcessor::decodeTask(void* parameter) {
+    AudioProcessor* self = (AudioProcessor*)parameter;
+    for (;;) {
+        if (!self->decodeStep()) {
+            vTaskDelay(pdMS_TO_TICKS(AUDIO_DECODE_IDLE_MS));
+        }
+    }
+}
+
+// Opens a file and works out which part of its decoded PCM belongs to the track
+bool AudioProcessor::prepareSource(const char* filepath, AudioSource& source) {
+    memset(source.toc, 0, sizeof(source.toc));
+    source.skip_bytes = 0;
+    source.valid_bytes = 0;
+    source.sample_rate = 0;
+    source.bytes_per_second = 0;
+    source.bytes_per_sample = 0;
+    source.samples_per_frame = 0;
+    source.duration_ms = 0;
+    source.first_frame = 0;
+    source.stream_bytes = 0;
+    source.gain = 0;
+    source.is_vbr = false;
+    source.has_toc = false;
+    source.file = SD.open(filepath);
+    if (!source.file) {
+        Serial.printf("Failed to open file: %s\n", filepath);
+        return false;
+    }
+
+    uint32_t data_start = 0;
+    Mp3StreamInfo info;
+    if (Mp3Parser::readStreamInfo(source.file, info)) {
+        // Start the decoder on the first frame, so Helix never scans tags (cover art can be
+        // megabytes) for a sync word. The Xing/Info frame would decode to a frame of
+        // silence that is not part of the track.
+        data_start = info.first_frame;
+        if (info.has_info_frame) {
+            data_start += info.header.frame_length;
+        }
+        // LAME delay and padding let consecutive tracks join sample-accurately
+        uint64_t total_samples = (uint64_t)info.frame_count * info.header.samples_per_frame;
+        uint32_t trimmed = info.encoder_delay + info.encoder_padding;
+        source.bytes_per_sample = info.header.channels * sizeof(int16_t);
+        source.samples_per_frame = info.header.samples_per_frame;
+        if (info.has_gapless_info && total_samples > trimmed) {
+            source.skip_bytes = (info.encoder_delay + MP3_DECODER_DELAY) * source.bytes_per_sample;
+            source.valid_bytes = (total_samples - trimmed) * source.bytes_per_sample;
+        }
+
+        // What seeking needs: a TOC when the file has one, the byte range otherwise
+        source.sample_rate = info.header.sample_rate;
+        source.bytes_per_second = info.header.sample_rate * source.bytes_per_sample;
+        source.duration_ms = info.duration_ms;
+        source.first_frame = info.first_frame;
+        source.stream_bytes = info.stream_bytes;
+        source.is_vbr = info.frame_count > 0;
+        if (Mp3Parser::readVbriToc(source.file, info)) {
+            memcpy(source.toc, info.toc, sizeof(source.toc));
+            source.has_toc = true;
+        }
+    }
+
+    source.data_start = data_start;
+    if (!source.file.seek(data_start)) {
+        source.file.close();
+        return false;
+    }
+    return true;
+}
+
+// Switches the decoder to the queued file. Called with the decoder mutex held.
+bool AudioProcessor::startNextFile() {
+    if (!next.file) return false;
+
+    current.file.close();
+    current = next;
+    next.file = File();
+    pcm_position = 0;
+    next_file_requested = false;
+    // The filter history carries over for a seamless join; the reservoir does not
+    resetInput();
+    resetDecoder();
+    resetSeekIndex();
+    // Same format: the filter history carries over, so the join stays seamless
+    normalizer.configure(current.sample_rate, current.bytes_per_sample / sizeof(int16_t));
+    gain_stage.setGain(current.gain + equalizer.getHeadroomCdb());  // Ramps over the first frame
+    // The consumer reports the change once playback reaches this point
+    track_boundary = ring.getWriteCount();
+    boundary_pending = true;
+    return true;
+}
+
+void AudioProcessor::resetSeekIndex() {
+    seek_index[0].time_ms = 0;
+    seek_index[0].offset = current.data_start;
+    seek_index_count = 1;
+    seek_index_interval_ms = max((uint32_t)1000, current.duration_ms / AUDIO_SEEK_INDEX_SIZE + 1);
+    seek_index_growing = current.is_vbr && !current.has_toc;
+}
+
+// Notes where frames start at regular intervals, for seeking back in VBR files without a TOC
+void AudioProcessor::recordSeekPoint(uint32_t frame_offset) {
+    if (!seek_index_growing || seek_index_count >= AUDIO_SEEK_INDEX_SIZE ||
+        current.bytes_per_second == 0 || pcm_position < current.skip_bytes) {
+        return;
+    }
+    uint32_t time_ms = (uint64_t)(pcm_position - current.skip_bytes) * 1000 / current.bytes_per_second;
+    if (time_ms >= seek_index_count * seek_index_interval_ms) {
+        seek_index[seek_index_count].time_ms = time_ms;
+        seek_index[seek_index_count].offset = frame_offset;
+        seek_index_count++;
+    }
+}
+
+uint32_t AudioProcessor::seekOffset(uint32_t position_ms) const {
+    const AudioSource& source = current;
+    uint32_t offset;
+    if (source.has_toc) {
+        // Interpolate between the two percent points around the position, in 1/256 steps
+        uint32_t scaled = (uint64_t)position_ms * MP3_TOC_SIZE * 256 / source.duration_ms;
+        uint32_t index = min(scaled / 256, (uint32_t)MP3_TOC_SIZE - 1);
+        uint32_t fraction = min(scaled - index * 256, (uint32_t)255);
+        uint32_t from = source.toc[index];
+        uint32_t to = (index + 1 < MP3_TOC_SIZE) ? source.toc[index + 1] : 256;
+        uint64_t position = from * 256 + (to - from) * fraction;  // In 1/65536 of the stream
+        offset = source.first_frame + position * source.stream_bytes / 65536;
+    } else if (source.is_vbr) {
+        // Last recorded point before the position, then the average bitrate
+        int point = seek_index_count - 1;
+        while (point > 0 && seek_index[point].time_ms > position_ms) point--;
+        offset = seek_index[point].offset +
+                 (uint64_t)(position_ms - seek_index[point].time_ms) * source.stream_bytes / source.duration_ms;
+    } else {
+        // Constant bitrate: bytes are proportional to time
+        offset = source.first_frame + (uint64_t)position_ms * source.stream_bytes / source.duration_ms;
+    }
+    return max(offset, source.data_start);
+}
+
+// Moves the file and the PCM position to a time in the current file. The caller holds
+// the decoder mutex and resets the filters.
+bool AudioProcessor::jumpTo(uint32_t position_ms) {
+    position_ms = min(position_ms, current.duration_ms - 1);
+    uint32_t offset = seekOffset(position_ms);
+    if (!current.file.seek(offset)) return false;
+
+    // The decoder resyncs on the next frame header; nothing in between is decoded. The
+    // first frames may take bit reservoir data from before the jump, so they are dropped.
+    resetInput();
+    discard_until = offset + AUDIO_SEEK_RESERVOIR_BYTES;
+    uint32_t pcm_offset = (uint64_t)position_ms * current.bytes_per_second / 1000;
+    pcm_position = current.skip_bytes + pcm_offset - pcm_offset % current.bytes_per_sample;
+    seek_index_growing = false;  // Times after a seek are estimates
+    position_base_ms = position_ms;
+    return true;
+}
+
+bool AudioProcessor::seek(uint32_t position_ms) {
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    // While the ring holds the start of a queued track, the decoder is already past this one
+    if (!current.file || boundary_pending || current.duration_ms == 0 || !jumpTo(position_ms)) {
+        xSemaphoreGive(decoder_mutex);
+        return false;
+    }
+    normalizer.reset();
+    gain_stage.reset();
+    equalizer.reset();
+    end_of_track = false;
+    flush_pending = true;
+    xSemaphoreGive(decoder_mutex);
+    return true;
+}
+
+uint32_t AudioProcessor::getPositionMs() const {
+    // The ring always holds 44.1 kHz stereo, whatever the file's format
+    return position_base_ms + (uint64_t)played_bytes * 1000 / AUDIO_OUTPUT_BYTES_PER_SECOND;
+}
+
+// Decodes one frame into the ring. Returns false when there was nothing to do.
+bool AudioProcessor::decodeStep() {
+    // Room for the largest frame once converted, so a frame is never split
+    uint32_t frame_samples = current.samples_per_frame ? current.samples_per_frame : 1152;
+    size_t needed = normalizer.maxOutputFrames(frame_samples) * PCM_OUTPUT_CHANNELS * sizeof(int16_t);
+    if (flush_pending || ring.space() < needed) return false;
+
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    bool decoded = false;
+    if (end_of_track && next.file && !flush_pending) {
+        // Queued late, after the last file ran out: start it now
+        end_of_track = !startNextFile();
+    }
+    if (current.file && !end_of_track && !flush_pending) {
+        // Near the end, ask for the next track so it is open before this one runs out
+        if (!next_file_requested && !next.file && !boundary_pending &&
+            current.file.available() < AUDIO_NEXT_TRACK_LEAD_BYTES) {
+            next_file_requested = true;
+            next_file_wanted = true;
+        }
+
+        uint32_t start = ESP.getCycleCount();
+        uint32_t written = ring.getWriteCount();
+        bool finished = !decodeFrame();
+        decode_cycles += ESP.getCycleCount() - start;
+        decoded_bytes += ring.getWriteCount() - written;
+
+        decoded = true;
+        if (finished) {
+            if (!startNextFile()) end_of_track = true;
+        }
+    }
+    xSemaphoreGive(decoder_mutex);
+
+    size_t fill = ring.available();
+    if (fill > high_water) high_water = fill;
+    return decoded;
+}
+
+void AudioProcessor::resetInput() {
+    input_offset = 0;
+    input_length = 0;
+    discard_until = 0;
+}
+
+// Empties the bit reservoir, so a first frame that reaches back into it fails with
+// ERR_MP3_MAINDATA_UNDERFLOW instead of decoding bytes left over from the previous file
+void AudioProcessor::resetDecoder() {
+    MP3DecInfo* info = (MP3DecInfo*)mp3;
+    info->mainDataBegin = 0;
+    info->mainDataBytes = 0;
+}
+
+// Tops up the input buffer so Helix always sees a whole frame. False once the file is used up.
+bool AudioProcessor::fillInput() {
+    if (input_length < MAINBUF_SIZE && current.file.available()) {
+        memmove(input_buffer, input_buffer + input_offset, input_length);
+        input_offset = 0;
+        int len = current.file.read(input_buffer + input_length, sizeof(input_buffer) - input_length);
+        if (len > 0) input_length += len;
+    }
+    return input_length > 0;
+}
+
+// Decodes the next frame of the current file. Frames that need neither trimming nor
+// conversion are decoded straight into the ring; the others go through frame_pcm.
+// Returns false when the track has ended.
+bool AudioProcessor::decodeFrame() {
+    if (!fillInput()) return false;
+
+    int sync = MP3FindSyncWord(input_buffer + input_offset, input_length);
+    if (sync < 0) {
+        // No header here; keep the last bytes in case one starts in them
+        size_t keep = current.file.available() ? min(input_length, (size_t)3) : 0;
+        input_offset += input_length - keep;
+        input_length = keep;
+        return input_length > 0 || current.file.available();
+    }
+    input_offset += sync;
+    input_length -= sync;
+    uint32_t frame_offset = current.file.position() - input_length;
+
+    uint32_t frame_end = pcm_position + current.samples_per_frame * current.bytes_per_sample;
+    bool trimmed = pcm_position < current.skip_bytes || frame_offset < discard_until ||
+                   (current.valid_bytes > 0 && frame_end > current.skip_bytes + current.valid_bytes);
+    size_t contiguous;
+    uint8_t* target = ring.writeBuffer(contiguous);
+    bool direct = normalizer.isPassthrough() && !trimmed && contiguous >= AUDIO_FRAME_PCM_BYTES;
+    uint8_t* out = direct ? target : frame_pcm;
+
+    unsigned char* in = input_buffer + input_offset;
+    int left = input_length;
+    int result = MP3Decode(mp3, &in, &left, (short*)out, 0);
+    size_t consumed = input_length - left;
+    input_offset += consumed;
+    input_length = left;
+    if (result == ERR_MP3_INDATA_UNDERFLOW) {
+        // A partial frame is only possible at the end of the file
+        input_length = 0;
+        return current.file.available();
+    }
+    if (result == ERR_MP3_MAINDATA_UNDERFLOW) {
+        // Reservoir not filled yet: the frame is dropped, but its time still passes, so
+        // the delay and padding trim stays aligned with the file
+        pcm_position += current.samples_per_frame * current.bytes_per_sample;
+        return true;
+    }
+    if (result != ERR_MP3_NONE) {
+        // Corrupt frame or false sync: step past it and resync
+        if (consumed == 0) {
+            input_offset++;
+            input_length--;
+        }
+        return true;
+    }
+
+    MP3FrameInfo info;
+    MP3GetLastFrameInfo(mp3, &info);
+    size_t len = info.outputSamps * sizeof(int16_t);
+    recordSeekPoint(frame_offset);
+
+    // The format the decoder reports wins over what the first header said
+    if (info.nChans > 0 && (info.samprate != (int)normalizer.getSampleRate() || info.nChans != normalizer.getChannels())) {
+        normalizer.configure(info.samprate, info.nChans);
+        current.bytes_per_sample = info.nChans * sizeof(int16_t);
+        current.samples_per_frame = info.outputSamps / info.nChans;
+        if (direct) {
+            memcpy(frame_pcm, out, len);  // Needs converting after all
+            direct = false;
+        }
+    }
+
+    uint32_t chunk_start = pcm_position;
+    pcm_position += len;
+    if (frame_offset < discard_until) return true;
+
+    uint32_t gain_start = ESP.getCycleCount();
+    gain_stage.process((int16_t*)(direct ? out : frame_pcm), info.outputSamps / info.nChans, info.nChans);
+    gain_cycles += ESP.getCycleCount() - gain_start;
+    if (direct) {
+        equalize(out, len);
+        ring.commit(len);
+        return true;
+    }
+
+    // Keep only the track's own samples: drop the encoder and decoder delay in
+    // front and the padding after the last real sample
+    uint32_t keep_from = max(chunk_start, current.skip_bytes);
+    uint32_t keep_to = pcm_position;
+    bool finished = false;
+    if (current.valid_bytes > 0 && keep_to >= current.skip_bytes + current.valid_bytes) {
+        keep_to = current.skip_bytes + current.valid_bytes;
+        finished = true;
+    }
+    if (keep_to > keep_from) {
+        writePcm(frame_pcm + (keep_from - chunk_start), keep_to - keep_from);
+    }
+    return !finished;
+}
+
+// Converts kept decoder output to 44.1 kHz stereo and queues it for playback
+void AudioProcessor::writePcm(uint8_t* data, size_t len) {
+    if (normalizer.isPassthrough()) {
+        equalize(data, len);
+        ring.write(data, len);
+        return;
+    }
+    uint32_t start = ESP.getCycleCount();
+    const int16_t* samples = (const int16_t*)data;
+    size_t frames = len / current.bytes_per_sample;
+    size_t slice = max(normalizer.maxInputFrames(sizeof(output_chunk) / (PCM_OUTPUT_CHANNELS * sizeof(int16_t))), (size_t)1);
+    while (frames > 0) {
+        // Normally one slice; more only if the format changed after the read was sized
+        size_t count = min(frames, slice);
+        size_t produced = normalizer.process(samples, count, (int16_t*)output_chunk);
+        size_t bytes = produced * PCM_OUTPUT_CHANNELS * sizeof(int16_t);
+        uint32_t eq_start = ESP.getCycleCount();
+        equalize(output_chunk, bytes);
+        start += ESP.getCycleCount() - eq_start;  // Counted as equalising, not converting
+        ring.write(output_chunk, bytes);
+        samples += count * normalizer.getChannels();
+        frames -= count;
+    }
+    normalize_cycles += ESP.getCycleCount() - start;
+}
+
+// Runs the equaliser over 44.1 kHz stereo about to enter the ring
+void AudioProcessor::equalize(uint8_t* data, size_t len) {
+    if (equalizer.isFlat()) return;
+    uint32_t start = ESP.getCycleCount();
+    equalizer.process((int16_t*)data, len / (PCM_OUTPUT_CHANNELS * sizeof(int16_t)));
+    eq_cycles += ESP.getCycleCount() - start;
+}
+
+void AudioProcessor::setEqualizerPreset(int preset) {
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    equalizer.setPreset(preset);
+    gain_stage.setGain(current.gain + equalizer.getHeadroomCdb());
+    xSemaphoreGive(decoder_mutex);
+    Serial.printf("Equaliser: %s, %d.%02d dB headroom\n", Equalizer::getPreset(preset).name,
+                  (int)(-equalizer.getHeadroomCdb() / 100), (int)(-equalizer.getHeadroomCdb() % 100));
+}
+
+bool AudioProcessor::openFile(const char* filepath, int32_t gain, uint32_t start_ms) {
+    AudioSource source;
+    bool opened = prepareSource(filepath, source);
+    source.gain = gain;
+
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    if (current.file) {
+        current.file.close();
+    }
+    if (next.file) {
+        next.file.close();
+    }
+    // Whatever is left of the previous track is dropped by the consumer before decoding resumes
+    flush_pending = true;
+    end_of_track = !opened;
+    next_file_requested = false;
+    next_file_wanted = false;
+    boundary_pending = false;
+    track_change_pending = false;
+
+    Serial.printf("Audio buffer: %u underruns, peak %u of %u bytes\n",
+                  underrun_count, high_water, (unsigned)ring.size());
+    uint32_t audio_ms = (uint64_t)decoded_bytes * 1000 / AUDIO_OUTPUT_BYTES_PER_SECOND;
+    if (audio_ms > 0) {
+        // Cycles per ms of audio are kilocycles per second
+        Serial.printf("Decode: %u kcycles per second of audio, %u of them converting, %u applying gain, %u equalising\n",
+                      (unsigned)(decode_cycles / audio_ms), (unsigned)(normalize_cycles / audio_ms),
+                      (unsigned)(gain_cycles / audio_ms), (unsigned)(eq_cycles / audio_ms));
+    }
+    if (gain_stage.getLimitedBlocks() > 0) {
+        Serial.printf("Limiter: %u blocks turned down since boot\n", gain_stage.getLimitedBlocks());
+    }
+    decode_cycles = 0;
+    normalize_cycles = 0;
+    gain_cycles = 0;
+    eq_cycles = 0;
+    decoded_bytes = 0;
+
+    if (!opened) {
+        xSemaphoreGive(decoder_mutex);
         return false;
     }
+    current = source;
+    pcm_position = 0;
+    resetInput();
+    resetDecoder();
+    resetSeekIndex();
+    position_base_ms = 0;
+    // Before the decode task sees the file, so the part skipped is never decoded. If the
+    // file cannot seek, it plays from the start.
+    if (start_ms > 0 && current.duration_ms > 0) jumpTo(start_ms);
+    normalizer.configure(current.sample_rate, current.bytes_per_sample / sizeof(int16_t));
+    normalizer.reset();
+    gain_stage.setGain(current.gain + equalizer.getHeadroomCdb());
+    gain_stage.reset();
+    equalizer.reset();
+    xSemaphoreGive(decoder_mutex);
     
-    Serial.printf("Opened file: %s\n", filepath.c_str());
+    Serial.printf("Opened file: %s\n", filepath);
+    return true;
+}
+
+bool AudioProcessor::queueFile(const char* filepath, int32_t gain) {
+    AudioSource source;
+    if (!prepareSource(filepath, source)) return false;
+    source.gain = gain;
+
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    if (next.file) {
+        next.file.close();
+    }
+    next = source;
+    xSemaphoreGive(decoder_mutex);
+
+    Serial.printf("Queued file: %s\n", filepath);
     return true;
 }
 
 void AudioProcessor::closeFile() {
-    if (current_file) {
-        current_file.close();
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    if (current.file) {
+        current.file.close();
+    }
+    if (next.file) {
+        next.file.close();
     }
-    decoder.end();
+    flush_pending = true;
+    end_of_track = true;
+    boundary_pending = false;
+    xSemaphoreGive(decoder_mutex);
 }
 
 int32_t AudioProcessor::readAudioData(uint8_t* buffer, int32_t len) {
-    if (!current_file || !current_file.available()) {
+    if (flush_pending) {
+        // Only the consumer moves the read side, so the flush happens here
+        ring.discard();
+        played_bytes = 0;
+        flush_pending = false;
+        memset(buffer, 0, len);
+        return len;
+    }
+
+    int32_t bytes_read = ring.read(buffer, len);
+    played_bytes += bytes_read;
+    if (boundary_pending && (int32_t)(ring.getReadCount() - track_boundary) >= 0) {
+        // Playback has reached the queued track
+        played_bytes = ring.getReadCount() - track_boundary;
+        position_base_ms = 0;
+        boundary_pending = false;
+        track_change_pending = true;
+    }
+    if (bytes_read == 0 && end_of_track) {
         return 0; // Signal end of track
     }
-    
-    int32_t bytes_read = decoder.readBytes(buffer, len);
-    
+
     // If we didn't get the full buffer, fill the rest with silence
     if (bytes_read < len) {
+        if (!end_of_track) underrun_count++;
         memset(buffer + bytes_read, 0, len - bytes_read);
     }
     
     return len; // Always return the requested length for A2DP
-}
\ No newline at end of file
+}
@@ -3,22 +3,135 @@
 
 #include <Arduino.h>
 #include <SD.h>
-#include "AudioTools.h"
-#include "AudioTools/AudioCodecs/CodecMP3Helix.h"
+#include "libhelix-mp3/mp3dec.h"
+#include "PcmRingBuffer.h"
+#include "PcmNormalizer.h"
+#include "GainStage.h"
+#include "Equalizer.h"
+#include "Mp3Parser.h"
+
+// Decoding runs in its own task, ahead of the A2DP callback
+#define AUDIO_RING_BUFFER_SIZE 32768   // Decoded PCM kept ready, about 185 ms at 44.1 kHz stereo (power of two)
+#define AUDIO_INPUT_BUFFER_SIZE 4096   // MP3 data read ahead of the decoder, at least MAINBUF_SIZE
+#define AUDIO_FRAME_PCM_BYTES (1152 * 2 * sizeof(int16_t))  // Largest decoded frame
+#define AUDIO_OUTPUT_CHUNK_SIZE 4096   // Normalized PCM per conversion, after resampling up to 44.1 kHz stereo
+#define AUDIO_SEEK_RESERVOIR_BYTES 600 // After a seek, frames this close may use stale bit reservoir data
+#define AUDIO_OUTPUT_BYTES_PER_SECOND (PCM_OUTPUT_SAMPLE_RATE * PCM_OUTPUT_CHANNELS * sizeof(int16_t))
+#define AUDIO_DECODE_IDLE_MS 5         // Wait while the ring is full or there is nothing to decode
+#define AUDIO_DECODE_TASK_STACK 8192
+#define AUDIO_DECODE_TASK_PRIORITY 2   // Above the UI loop, below the Bluetooth stack
+#define AUDIO_DECODE_TASK_CORE 1       // App core; the Bluetooth controller runs on core 0
+#define AUDIO_NEXT_TRACK_LEAD_BYTES 65536  // Ask for the next track when this much of the file is left
+#define AUDIO_SEEK_INDEX_SIZE 128      // Points recorded while playing VBR files that have no TOC
+
+// A file feeding the decoder, with the PCM range that belongs to the track
+struct AudioSource {
+    File file;
+    uint32_t skip_bytes;   // PCM dropped at the start: encoder delay plus decoder delay
+    uint32_t valid_bytes;  // PCM kept after that, 0 to play until the file ends
+    uint32_t sample_rate;
+    uint32_t bytes_per_second;  // Decoded PCM rate
+    uint16_t bytes_per_sample;
+    uint16_t samples_per_frame;
+    uint32_t duration_ms;
+    uint32_t data_start;   // First byte handed to the decoder
+    uint32_t first_frame;  // Seek offsets are relative to this
+    uint32_t stream_bytes;
+    int32_t gain;          // ReplayGain for the gain stage, 1/100 dB
+    bool is_vbr;           // Byte offsets are not proportional to time
+    bool has_toc;
+    uint8_t toc[MP3_TOC_SIZE];
+};
+
+// Time and file offset of a frame decoded earlier
+struct SeekPoint {
+    uint32_t time_ms;
+    uint32_t offset;
+};
 
 class AudioProcessor {
 private:
-    File current_file;
-    MP3DecoderHelix mp3;
-    EncodedAudioStream decoder;
-    
+    AudioSource current;   // The decoder reads from current.file
+    HMP3Decoder mp3;
+    AudioSource next;      // Pre-opened track that follows without a gap
+    size_t input_offset;   // Unread MP3 data in the input buffer
+    size_t input_length;
+    uint32_t discard_until;    // Frames starting before this file offset are decoded but not played
+    uint32_t pcm_position; // PCM bytes decoded from the current file
+    PcmNormalizer normalizer;  // Decoder output to the 44.1 kHz stereo the ring holds
+    GainStage gain_stage;      // Applied to decoder output, before conversion
+    Equalizer equalizer;       // Applied to normalized output, on its way into the ring
+    uint64_t decode_cycles;    // CPU cycles spent decoding, for the per-track log
+    uint64_t normalize_cycles;
+    uint64_t gain_cycles;
+    uint64_t eq_cycles;
+    uint32_t decoded_bytes;    // Output those cycles produced
+    SeekPoint seek_index[AUDIO_SEEK_INDEX_SIZE];
+    int seek_index_count;
+    uint32_t seek_index_interval_ms;
+    bool seek_index_growing;  // Decoding continuously from the start, so new points are exact
+
+    PcmRingBuffer ring;
+    SemaphoreHandle_t decoder_mutex;  // Held by the decode task while it touches the files
+    TaskHandle_t decode_task;
+    volatile bool end_of_track;       // File fully decoded; the ring drains before playback stops
+    volatile bool flush_pending;      // New file opened: the consumer drops what is left of the old one
+    volatile bool next_file_requested;
+    volatile bool next_file_wanted;   // Raised once per track, near its end
+    volatile bool boundary_pending;   // The ring holds the start of a queued track
+    volatile uint32_t track_boundary; // Ring position where it starts
+    volatile bool track_change_pending;
+    volatile uint32_t played_bytes;   // PCM played since the position below, counted by the consumer
+    volatile uint32_t position_base_ms;
+    volatile uint32_t underrun_count;
+    volatile uint32_t high_water;     // Peak ring fill in bytes
+
+    static void decodeTask(void* parameter);
+    bool decodeStep();
+    bool decodeFrame();
+    bool fillInput();
+    void resetInput();
+    void resetDecoder();
+    void writePcm(uint8_t* data, size_t len);
+    void equalize(uint8_t* data, size_t len);
+    bool startNextFile();
+    void resetSeekIndex();
+    void recordSeekPoint(uint32_t frame_offset);
+    uint32_t seekOffset(uint32_t position_ms) const;
+    bool jumpTo(uint32_t position_ms);
+    static bool prepareSource(const char* filepath, AudioSource& source);
+
 public:
     AudioProcessor();
-    
-    bool openFile(const String& filepath);
+
+    bool begin();  // Starts the decode task
+
+    // gain: ReplayGain in 1/100 dB, applied from the file's first sample
+    // start_ms: where playback starts; decoding begins there, as after a seek
+    bool openFile(const char* filepath, int32_t gain = 0, uint32_t start_ms = 0);  // Plays a file now, dropping anything queued
+    bool queueFile(const char* filepath, int32_t gain = 0);  // Plays a file right after the current one
     void closeFile();
-    
+    bool seek(uint32_t position_ms);  // Jumps within the current file without decoding what is skipped
+    uint32_t getPositionMs() const;   // Position of the audio being heard
+    bool isFinished() const { return end_of_track && ring.available() == 0; }  // Played to the end
+
+    // Switches the equaliser; the gain stage makes room for its largest boost
+    void setEqualizerPreset(int preset);
+    int getEqualizerPreset() const { return equalizer.getPresetIndex(); }
+
+    // Gapless handover, polled by the main loop: the decoder wants the next file, and
+    // the queued file has started playing
+    bool hasNextFileRequest() const { return next_file_wanted; }
+    void consumeNextFileRequest() { next_file_wanted = false; }
+    bool hasTrackChangeEvent() const { return track_change_pending; }
+    void consumeTrackChangeEvent() { track_change_pending = false; }
+
+    // Called from the A2DP callback: copies decoded PCM and never blocks
     int32_t readAudioData(uint8_t* buffer, int32_t len);
+
+    uint32_t getUnderrunCount() const { return underrun_count; }
+    uint32_t getHighWater() const { return high_water; }
+    size_t getBufferedBytes() const { return ring.available(); }
 };
 
 #endif
@@ -0,0 +1,81 @@
+#include "BlockCache.h"
+
+BlockCache::BlockCache(uint8_t* storage, size_t storage_size, BlockLoader loader, void* context) :
+    storage(storage),
+    block_count(min(storage_size / BLOCK_CACHE_BLOCK_SIZE, (size_t)BLOCK_CACHE_MAX_BLOCKS)),
+    loader(loader), context(context),
+    use_counter(0), hits(0), misses(0), prefetches(0) {
+    clear();
+}
+
+void BlockCache::clear() {
+    for (size_t i = 0; i < BLOCK_CACHE_MAX_BLOCKS; i++) {
+        slots[i].valid = false;
+    }
+}
+
+// Returns the slot holding at least the first needed bytes of the block, loading it into
+// the least recently used slot if it is missing or too short. -1 on failure.
+int BlockCache::lookup(uint8_t file, uint32_t block, size_t needed, bool count_access) {
+    int victim = -1;
+    for (size_t i = 0; i < block_count; i++) {
+        Slot& slot = slots[i];
+        if (slot.valid && slot.file == file && slot.block == block) {
+            if (slot.length >= needed) {
+                if (count_access) hits++;
+                slot.last_use = ++use_counter;
+                return i;
+            }
+            victim = i;  // Cached before the file grew: reload in place
+            break;
+        }
+        if (victim < 0 || !slot.valid || (slots[victim].valid && slot.last_use < slots[victim].last_use)) {
+            victim = i;
+        }
+    }
+    if (victim < 0) return -1;
+
+    if (count_access) {
+        misses++;
+    } else {
+        prefetches++;
+    }
+    Slot& slot = slots[victim];
+    slot.valid = false;
+    int len = loader(context, file, block, storage + victim * BLOCK_CACHE_BLOCK_SIZE);
+    if (len < (int)needed) return -1;
+
+    slot.file = file;
+    slot.block = block;
+    slot.length = len;
+    slot.valid = true;
+    slot.last_use = ++use_counter;
+    return victim;
+}
+
+bool BlockCache::read(uint8_t file, uint32_t offset, void* buffer, size_t len) {
+    uint8_t* out = (uint8_t*)buffer;
+    while (len > 0) {
+        uint32_t block = offset / BLOCK_CACHE_BLOCK_SIZE;
+        size_t start = offset % BLOCK_CACHE_BLOCK_SIZE;
+        size_t chunk = min(len, BLOCK_CACHE_BLOCK_SIZE - start);
+        int slot = lookup(file, block, start + chunk, true);
+        if (slot < 0) return false;
+
+        memcpy(out, storage + slot * BLOCK_CACHE_BLOCK_SIZE + start, chunk);
+        out += chunk;
+        offset += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+bool BlockCache::prefetch(uint8_t file, uint32_t offset, size_t len) {
+    if (len == 0) return true;
+    uint32_t last_block = (offset + len - 1) / BLOCK_CACHE_BLOCK_SIZE;
+    for (uint32_t block = offset / BLOCK_CACHE_BLOCK_SIZE; block <= last_block; block++) {
+        size_t needed = (block == last_block) ? (offset + len - 1) % BLOCK_CACHE_BLOCK_SIZE + 1 : BLOCK_CACHE_BLOCK_SIZE;
+        if (lookup(file, block, needed, false) < 0) return false;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <Arduino.h>
+
+#define BLOCK_CACHE_BLOCK_SIZE 512  // One SD sector
+#define BLOCK_CACHE_MAX_BLOCKS 32
+
+// Fills data with up to BLOCK_CACHE_BLOCK_SIZE bytes of a file block. Returns the number
+// of bytes read (short at the end of the file), or -1 on failure.
+typedef int (*BlockLoader)(void* context, uint8_t file, uint32_t block, uint8_t* data);
+
+// Least-recently-used cache of fixed-size file blocks, keyed by a small file id. Block
+// storage is the caller's buffer. Not thread-safe: callers serialize access.
+class BlockCache {
+public:
+    BlockCache(uint8_t* storage, size_t storage_size, BlockLoader loader, void* context);
+
+    bool read(uint8_t file, uint32_t offset, void* buffer, size_t len);
+    bool prefetch(uint8_t file, uint32_t offset, size_t len);  // Loads missing blocks without copying
+    void clear();  // Forget all blocks, e.g. when the files are replaced
+
+    uint32_t getHits() const { return hits; }
+    uint32_t getMisses() const { return misses; }
+    uint32_t getPrefetches() const { return prefetches; }
+
+private:
+    struct Slot {
+        uint32_t block;
+        uint32_t last_use;
+        uint16_t length;  // Valid bytes; blocks at the end of a growing file may be short
+        uint8_t file;
+        bool valid;
+    };
+
+    uint8_t* storage;
+    size_t block_count;
+    BlockLoader loader;
+    void* context;
+    Slot slots[BLOCK_CACHE_MAX_BLOCKS];
+    uint32_t use_counter;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t prefetches;
+
+    int lookup(uint8_t file, uint32_t block, size_t needed, bool count_access);
+};
+
+#endif
@@ -15,6 +15,7 @@ BluetoothManager::BluetoothManager() :
     discovering(false),
     connecting(false),
     _connection_event_pending(false),
+    _track_finished_pending(false),
     _cached_volume(64),      // Default to ~50% (64/127)
     _last_polled_volume(64),
     _volume_change_pending(false) {
@@ -115,6 +116,14 @@ void BluetoothManager::consumeConnectionEvent() {
     _connection_event_pending = false;
 }
 
+bool BluetoothManager::hasTrackFinishedEvent() const {
+    return _track_finished_pending;
+}
+
+void BluetoothManager::consumeTrackFinishedEvent() {
+    _track_finished_pending = false;
+}
+
 // --- Volume Control ---
 
 void BluetoothManager::setVolume(uint8_t volume) {
@@ -211,7 +220,7 @@ void BluetoothManager::connectionStateCallback(esp_a2d_connection_state_t state,
             instance->connected = false;
             instance->connecting = false;
             memset(&instance->connected_device, 0, sizeof(BluetoothDevice));
-            if (instance->music_player) instance->music_player->notifyConnectionStateChanged(false);
+            if (instance->music_player) instance->music_player->postCommand(PlayerCommand::CONNECTION_CHANGED, 0);
             instance->startDiscovery();
             break;
         case ESP_A2D_CONNECTION_STATE_CONNECTING:
@@ -226,7 +235,7 @@ void BluetoothManager::connectionStateCallback(esp_a2d_connection_state_t state,
             instance->connected_device = instance->connecting_device;
             Serial.printf("Stored connected device: %s\n", instance->connected_device.name.c_str());
             instance->setVolume(instance->_cached_volume); // Set initial volume to 50%
-            if (instance->music_player) instance->music_player->notifyConnectionStateChanged(true);
+            if (instance->music_player) instance->music_player->postCommand(PlayerCommand::CONNECTION_CHANGED, 1);
             instance->_connection_event_pending = true; // Signal the event
             break;
         case ESP_A2D_CONNECTION_STATE_DISCONNECTING:
@@ -256,10 +265,18 @@ int32_t BluetoothManager::audioDataCallback(uint8_t* data, int32_t len) {
         return len;
     }
     
+    // Only copies decoded PCM; SD reads and decoding happen in the decode task
     int32_t result = audio_processor.readAudioData(data, len);
     
     if (result == 0) {
-        if (instance->music_player) instance->music_player->notifyTrackFinished();
+        // Opening the next file would block here, so the player task does it. Posted once;
+        // the player clears the flag after the switch, or right away if the queue was full.
+        if (!instance->_track_finished_pending) {
+            instance->_track_finished_pending = true;
+            if (!instance->music_player->postCommand(PlayerCommand::TRACK_FINISHED)) {
+                instance->_track_finished_pending = false;
+            }
+        }
         memset(data, 0, len);
         return len;
     }
@@ -267,17 +284,17 @@ int32_t BluetoothManager::audioDataCallback(uint8_t* data, int32_t len) {
 }
 
 void BluetoothManager::avrcCommandCallback(uint8_t key, bool isReleased) {
-    if (!instance || !instance->music_player || !isReleased || instance->music_player->isBusy()) return;
+    if (!instance || !instance->music_player || !isReleased) return;
     
     Serial.print("AVRC Command: ");
     switch (key) {
-        case ESP_AVRC_PT_CMD_PLAY:     Serial.println("PLAY"); instance->music_player->executeCommand(PlayerCommand::PLAY); break;
-        case ESP_AVRC_PT_CMD_PAUSE:    Serial.println("PAUSE"); instance->music_player->executeCommand(PlayerCommand::PAUSE); break;
-        case ESP_AVRC_PT_CMD_STOP:     Serial.println("STOP"); instance->music_player->executeCommand(PlayerCommand::STOP); break;
-        case ESP_AVRC_PT_CMD_FORWARD:  Serial.println("NEXT"); instance->music_player->executeCommand(PlayerCommand::NEXT_TRACK); break;
-        case ESP_AVRC_PT_CMD_BACKWARD: Serial.println("PREVIOUS"); instance->music_player->executeCommand(PlayerCommand::PREV_TRACK); break;
-        case ESP_AVRC_PT_CMD_VOL_UP:   Serial.println("VOLUME UP"); instance->music_player->executeCommand(PlayerCommand::VOLUME_UP); break;
-        case ESP_AVRC_PT_CMD_VOL_DOWN: Serial.println("VOLUME DOWN"); instance->music_player->executeCommand(PlayerCommand::VOLUME_DOWN); break;
+        case ESP_AVRC_PT_CMD_PLAY:     Serial.println("PLAY"); instance->music_player->postCommand(PlayerCommand::PLAY); break;
+        case ESP_AVRC_PT_CMD_PAUSE:    Serial.println("PAUSE"); instance->music_player->postCommand(PlayerCommand::PAUSE); break;
+        case ESP_AVRC_PT_CMD_STOP:     Serial.println("STOP"); instance->music_player->postCommand(PlayerCommand::STOP); break;
+        case ESP_AVRC_PT_CMD_FORWARD:  Serial.println("NEXT"); instance->music_player->postCommand(PlayerCommand::NEXT_TRACK); break;
+        case ESP_AVRC_PT_CMD_BACKWARD: Serial.println("PREVIOUS"); instance->music_player->postCommand(PlayerCommand::PREV_TRACK); break;
+        case ESP_AVRC_PT_CMD_VOL_UP:   Serial.println("VOLUME UP"); instance->music_player->postCommand(PlayerCommand::VOLUME_UP); break;
+        case ESP_AVRC_PT_CMD_VOL_DOWN: Serial.println("VOLUME DOWN"); instance->music_player->postCommand(PlayerCommand::VOLUME_DOWN); break;
         default: Serial.printf("Unknown: 0x%02X\n", key); break;
     }
 }
\ No newline at end of file
@@ -36,6 +36,8 @@ public:
     String getConnectingDeviceName() const;
     bool hasConnectionEvent() const;
     void consumeConnectionEvent();
+    bool hasTrackFinishedEvent() const;   // Raised by the audio callback, cleared by the player task
+    void consumeTrackFinishedEvent();
 
     // --- Volume Control ---
     void setVolume(uint8_t volume);
@@ -66,6 +68,7 @@ private:
     BluetoothDevice connected_device;
     BluetoothDevice connecting_device; // Temporarily store device info during connection attempt
     bool _connection_event_pending;
+    volatile bool _track_finished_pending;
 
     // --- Volume State ---
     uint8_t _cached_volume;
@@ -1,5 +1,6 @@
 #include "DisplayManager.h"
 #include "settings.h"
+#include <math.h>
 
 DisplayManager::DisplayManager() : 
     u8g2(U8G2_CONSTRUCTOR_ARGS),
@@ -19,7 +20,33 @@ DisplayManager::DisplayManager() :
     playlist_last_selection_time(0),
     playlist_last_scroll_time(0),
     playlist_text_scroll_offset_pixels(0),
+    playlist_fast_scrolling(false),
     playlist_cache_start_index(-1),
+    playlist_cache_track_count(0),
+    browse_level(BrowseLevel::ARTISTS),
+    browse_parent_index(-1),
+    browse_menu_selected_index(0),
+    browse_menu_scroll_offset(0),
+    prev_browse_menu_selected_index(0),
+    browse_last_selection_time(0),
+    browse_last_scroll_time(0),
+    browse_text_scroll_offset_pixels(0),
+    browse_parent(),
+    browse_cache_start_index(-1),
+    browse_cache_generation(0),
+    search_query(""),
+    search_cursor(0),
+    search_editing(true),
+    search_id(0),
+    search_results(nullptr),
+    search_result_count(0),
+    search_menu_selected_index(0),
+    search_menu_scroll_offset(0),
+    search_cache_start_index(-1),
+    search_cache_count(0),
+    search_cache_id(0),
+    settings_eq_preset(0),
+    eq_curve_preset(-1),
     last_displayed_track(""),
     last_bt_status(false),
     last_player_state(PlayerState::STOPPED)
@@ -77,6 +104,7 @@ void DisplayManager::setPlaylistMenuState(int selected_index, int scroll_offset)
 
     // If the selection has truly changed, reset the horizontal scroll state
     if (playlist_menu_selected_index != selected_index) {
+        playlist_fast_scrolling = millis() - playlist_last_selection_time < MENU_SETTLE_DELAY;
         playlist_text_scroll_offset_pixels = 0;
         playlist_last_selection_time = millis();
     }
@@ -85,6 +113,44 @@ void DisplayManager::setPlaylistMenuState(int selected_index, int scroll_offset)
     // The incoming scroll_offset is ignored, as we will calculate it internally.
 }
 
+void DisplayManager::setBrowseMenuState(BrowseLevel level, int parent_index, int selected_index) {
+    // Switching lists reloads the parent record and scrolls down to the selection from the top
+    if (level != browse_level || parent_index != browse_parent_index) {
+        browse_level = level;
+        browse_parent_index = parent_index;
+        browse_menu_scroll_offset = 0;
+        browse_menu_selected_index = 0;
+        browse_cache_generation = 0;
+    }
+    prev_browse_menu_selected_index = browse_menu_selected_index;
+
+    if (browse_menu_selected_index != selected_index) {
+        browse_text_scroll_offset_pixels = 0;
+        browse_last_selection_time = millis();
+    }
+
+    browse_menu_selected_index = selected_index;
+}
+
+void DisplayManager::setSearchState(const char* query, int cursor, bool editing, uint32_t id,
+                                    const int* results, int result_count, int selected_index) {
+    if (id != search_id) {
+        search_menu_scroll_offset = 0;
+        search_cache_start_index = -1;
+    }
+    search_query = query;
+    search_cursor = cursor;
+    search_editing = editing;
+    search_id = id;
+    search_results = results;
+    search_result_count = result_count;
+    search_menu_selected_index = selected_index;
+}
+
+void DisplayManager::setSettingsState(int eq_preset) {
+    settings_eq_preset = eq_preset;
+}
+
 // --- Cache Methods ---
 void DisplayManager::updatePlaylistCache(int start_index) {
     if (!playlist_manager) return;
@@ -92,6 +158,42 @@ void DisplayManager::updatePlaylistCache(int start_index) {
     // Usa batch read: una sola apertura file per tutti i nomi
     playlist_manager->getTrackNames(start_index, PLAYLIST_VISIBLE_ITEMS, playlist_cached_names);
     playlist_cache_start_index = start_index;
+    playlist_cache_track_count = playlist_manager->getTrackCount();
+}
+
+void DisplayManager::updateEqCurve() {
+    if (eq_curve_preset == settings_eq_preset) return;
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+        float frequency = 20.0f * powf(1000.0f, (float)x / (SCREEN_WIDTH - 1));
+        // 2 pixels per dB, +-8 dB fits between the text and the bottom edge
+        int offset = lroundf(Equalizer::getResponseDb(settings_eq_preset, frequency) * 2);
+        eq_curve[x] = constrain(offset, -16, 16);
+    }
+    eq_curve_preset = settings_eq_preset;
+}
+
+void DisplayManager::updateBrowseParent() {
+    memset(&browse_parent, 0, sizeof(browse_parent));
+    browse_cache_start_index = -1;
+    browse_cache_generation = playlist_manager->getIndexGeneration();
+
+    if (browse_level == BrowseLevel::ARTISTS) {
+        strcpy(browse_parent.name, "Artists");
+        browse_parent.child_count = playlist_manager->getArtistCount();
+    } else {
+        BrowseLevel parent_level = (browse_level == BrowseLevel::ALBUMS) ? BrowseLevel::ARTISTS : BrowseLevel::ALBUMS;
+        if (!playlist_manager->getBrowseRecord(parent_level, browse_parent_index, browse_parent)) {
+            memset(&browse_parent, 0, sizeof(browse_parent));
+        }
+        browse_parent.name[sizeof(browse_parent.name) - 1] = '\0';
+    }
+}
+
+void DisplayManager::updateBrowseCache(int start_index) {
+    playlist_manager->getBrowseNames(browse_level, browse_parent.first_child + start_index,
+                                     min(PLAYLIST_VISIBLE_ITEMS, (int)browse_parent.child_count - start_index),
+                                     browse_cached_names);
+    browse_cache_start_index = start_index;
 }
 
 // --- Core Update Method ---
@@ -105,15 +207,26 @@ void DisplayManager::update(AppScreen current_screen) {
         case AppScreen::SCREEN_BLUETOOTH_SELECTION:
             drawBluetoothMenu();
             break;
+        case AppScreen::SCREEN_ARTIST_BROWSE:
+        case AppScreen::SCREEN_ALBUM_BROWSE:
+        case AppScreen::SCREEN_ALBUM_TRACKS:
+            drawBrowseMenu();
+            break;
         case AppScreen::SCREEN_TRACK_SELECTION:
             drawPlaylistMenu();
             break;
+        case AppScreen::SCREEN_SEARCH:
+            drawSearchScreen();
+            break;
         case AppScreen::SCREEN_NOW_PLAYING:
             drawNowPlayingScreen();
             break;
         case AppScreen::SCREEN_VOLUME_CONTROL:
             drawVolumeScreen();
             break;
+        case AppScreen::SCREEN_SETTINGS:
+            drawSettingsScreen();
+            break;
     }
 
     u8g2.sendBuffer();
@@ -261,11 +374,29 @@ void DisplayManager::drawBluetoothMenu() {
 void DisplayManager::drawPlaylistMenu() {
     if (!playlist_manager) return;
 
-    u8g2.drawStr(0, 12, "Playlist");
-
     const int list_size = playlist_manager->getTrackCount();
+    bool scanning = playlist_manager->isScanning();
+
+    // Title, with the letter group of the selection when the playlist is sorted
+    char jump_label = playlist_manager->getJumpLabel(playlist_menu_selected_index);
+    if (jump_label != 0) {
+        char title_str[16];
+        snprintf(title_str, sizeof(title_str), "Playlist [%c]", jump_label);
+        u8g2.drawStr(0, 12, title_str);
+    } else {
+        u8g2.drawStr(0, 12, "Playlist");
+    }
+    if (scanning) {
+        // Progress indicator: tracks found so far, with an animated marker
+        static const char spinner[] = "|/-\\";
+        char progress_str[16];
+        snprintf(progress_str, sizeof(progress_str), "%d %c", list_size, spinner[(millis() / 250) % 4]);
+        u8g2_uint_t progress_width = u8g2.getStrWidth(progress_str);
+        u8g2.drawStr(SCREEN_WIDTH - progress_width, 12, progress_str);
+    }
+
     if (list_size == 0) {
-        u8g2.drawStr(0, 32, "No tracks on SD card.");
+        u8g2.drawStr(0, 32, scanning ? "Scanning SD card..." : "No tracks on SD card.");
     } else {
         const int max_items_on_screen = 4;
 
@@ -289,8 +420,16 @@ void DisplayManager::drawPlaylistMenu() {
             playlist_menu_scroll_offset = 0;
         }
 
-        // Update cache only when scroll position changes
-        if (playlist_cache_start_index != playlist_menu_scroll_offset) {
+        // Update cache only when scroll position changes, or when a running scan
+        // has added tracks that may belong in the visible window. While the selection
+        // is racing through the list, wait for it to settle instead of reading the card.
+        if (playlist_fast_scrolling && millis() - playlist_last_selection_time >= MENU_SETTLE_DELAY) {
+            playlist_fast_scrolling = false;
+        }
+        if (!playlist_fast_scrolling &&
+            (playlist_cache_start_index != playlist_menu_scroll_offset ||
+             (playlist_cache_track_count != list_size &&
+              playlist_cache_track_count < playlist_menu_scroll_offset + max_items_on_screen))) {
             updatePlaylistCache(playlist_menu_scroll_offset);
         }
 
@@ -303,9 +442,12 @@ void DisplayManager::drawPlaylistMenu() {
                 break;
             }
 
-            // Use cached track name instead of reading from SD card every frame
-            int cache_index = item_index - playlist_menu_scroll_offset;
-            String& track_name = playlist_cached_names[cache_index];
+            // Use cached track name instead of reading from SD card every frame.
+            // Rows the cache does not cover yet (fast scrolling) show a placeholder.
+            static const String placeholder = "...";
+            int cache_index = item_index - playlist_cache_start_index;
+            bool cached = playlist_cache_start_index >= 0 && cache_index >= 0 && cache_index < PLAYLIST_VISIBLE_ITEMS;
+            const String& track_name = cached ? playlist_cached_names[cache_index] : placeholder;
 
             if (item_index == playlist_menu_selected_index) {
                 // --- Horizontal Scrolling Logic for Selected Item ---
@@ -364,6 +506,182 @@ void DisplayManager::drawPlaylistMenu() {
     }
 }
 
+void DisplayManager::drawBrowseMenu() {
+    if (!playlist_manager) return;
+
+    // A rescan swaps in a new index: reload the parent and the visible names
+    if (browse_cache_generation != playlist_manager->getIndexGeneration()) {
+        updateBrowseParent();
+    }
+
+    u8g2.setClipWindow(0, 0, SCREEN_WIDTH, 14);
+    u8g2.drawStr(0, 12, browse_parent.name);
+    u8g2.setMaxClipWindow();
+
+    const int list_size = browse_parent.child_count;
+    if (list_size == 0) {
+        u8g2.drawStr(0, 32, playlist_manager->isScanning() ? "Scanning SD card..." : "Nothing to browse.");
+        return;
+    }
+
+    const int max_items_on_screen = PLAYLIST_VISIBLE_ITEMS;
+    int available_width = (list_size > max_items_on_screen) ? SCREEN_WIDTH - 4 : SCREEN_WIDTH;
+
+    // --- Vertical Scrolling Logic ---
+    int direction = browse_menu_selected_index - prev_browse_menu_selected_index;
+    if (direction > 0) { // Moving Down
+        if (browse_menu_selected_index >= browse_menu_scroll_offset + max_items_on_screen) {
+            browse_menu_scroll_offset = browse_menu_selected_index - max_items_on_screen + 1;
+        }
+    } else if (direction < 0) { // Moving Up
+        if (browse_menu_selected_index < browse_menu_scroll_offset) {
+            browse_menu_scroll_offset = browse_menu_selected_index;
+        }
+    }
+    browse_menu_scroll_offset = constrain(browse_menu_scroll_offset, 0, max(0, list_size - max_items_on_screen));
+
+    // One batched read per window move
+    if (browse_cache_start_index != browse_menu_scroll_offset) {
+        updateBrowseCache(browse_menu_scroll_offset);
+    }
+
+    int y = 29; // Starting Y for the list
+    const int line_height = 11;
+
+    for (int i = 0; i < max_items_on_screen; ++i) {
+        int item_index = browse_menu_scroll_offset + i;
+        if (item_index >= list_size) {
+            break;
+        }
+
+        String& item_name = browse_cached_names[i];
+
+        if (item_index == browse_menu_selected_index) {
+            // --- Horizontal Scrolling Logic for Selected Item ---
+            u8g2_uint_t text_width = u8g2.getStrWidth(item_name.c_str());
+            int text_area_width = available_width - 2; // -2 for padding at x=2
+
+            if (text_width > text_area_width) {
+                int max_scroll_offset = text_width - text_area_width;
+                if (browse_text_scroll_offset_pixels > max_scroll_offset) {
+                    if (millis() - browse_last_scroll_time > MENU_SCROLL_DELAY) {
+                        browse_text_scroll_offset_pixels = 0;
+                        browse_last_selection_time = millis();
+                    }
+                }
+                else {
+                    if (millis() - browse_last_selection_time > MENU_SCROLL_DELAY) {
+                        if (millis() - browse_last_scroll_time > MENU_SCROLL_SPEED) {
+                            browse_last_scroll_time = millis();
+                            browse_text_scroll_offset_pixels++;
+                        }
+                    }
+                }
+            } else {
+                browse_text_scroll_offset_pixels = 0;
+            }
+
+            u8g2.drawBox(0, y - line_height + 2, SCREEN_WIDTH, line_height);
+            u8g2.setDrawColor(0);
+            u8g2.drawStr(2 - browse_text_scroll_offset_pixels, y, item_name.c_str());
+            u8g2.setDrawColor(1);
+        } else {
+            // Clip non-selected items to prevent drawing over the scrollbar
+            u8g2.setClipWindow(0, y - line_height, available_width, y + 2);
+            u8g2.drawStr(2, y, item_name.c_str());
+            u8g2.setMaxClipWindow(); // Reset clipping
+        }
+        y += line_height;
+    }
+
+    if (list_size > max_items_on_screen) {
+        // --- Scrollbar Drawing ---
+        const int scrollbar_y_start = 20;
+        const int scrollbar_area_height = SCREEN_HEIGHT - scrollbar_y_start;
+        int handle_height = (float)scrollbar_area_height * ((float)max_items_on_screen / list_size);
+        handle_height = max(2, handle_height);
+        float scroll_percent = (float)browse_menu_scroll_offset / (list_size - max_items_on_screen);
+        int handle_y_offset = (scrollbar_area_height - handle_height) * scroll_percent;
+
+        u8g2.setDrawColor(0);
+        u8g2.drawBox(SCREEN_WIDTH - 4, scrollbar_y_start, 4, scrollbar_area_height);
+        u8g2.setDrawColor(1);
+        u8g2.drawLine(SCREEN_WIDTH - 2, scrollbar_y_start, SCREEN_WIDTH - 2, SCREEN_HEIGHT);
+        u8g2.drawBox(SCREEN_WIDTH - 3, scrollbar_y_start + handle_y_offset, 3, handle_height);
+    }
+}
+
+void DisplayManager::drawSearchScreen() {
+    if (!playlist_manager) return;
+
+    // Query line: the character being picked is shown inverted while editing
+    u8g2.drawStr(0, 12, "Find:");
+    int x = u8g2.getStrWidth("Find: ");
+    for (int i = 0; search_query[i] != '\0'; i++) {
+        char ch[2] = { search_query[i], '\0' };
+        int w = u8g2.getStrWidth(ch);
+        if (w == 0) w = u8g2.getStrWidth("_");
+        if (search_editing && i == search_cursor) {
+            u8g2.drawBox(x, 3, w + 1, 11);
+            u8g2.setDrawColor(0);
+            u8g2.drawStr(x, 12, ch);
+            u8g2.setDrawColor(1);
+        } else {
+            u8g2.drawStr(x, 12, ch);
+        }
+        x += w + 1;
+    }
+
+    // Match count, with a spinner while the search is still running
+    char count_str[16];
+    if (playlist_manager->isSearchDone()) {
+        snprintf(count_str, sizeof(count_str), "%d", search_result_count);
+    } else {
+        static const char spinner[] = "|/-\\";
+        snprintf(count_str, sizeof(count_str), "%d %c", search_result_count, spinner[(millis() / 250) % 4]);
+    }
+    u8g2.drawStr(SCREEN_WIDTH - u8g2.getStrWidth(count_str), 12, count_str);
+
+    if (search_result_count == 0) {
+        u8g2.drawStr(0, 32, playlist_manager->isSearchDone() ? "No matches." : "Searching...");
+        return;
+    }
+
+    const int max_items_on_screen = PLAYLIST_VISIBLE_ITEMS;
+    if (search_menu_selected_index >= search_menu_scroll_offset + max_items_on_screen) {
+        search_menu_scroll_offset = search_menu_selected_index - max_items_on_screen + 1;
+    } else if (search_menu_selected_index < search_menu_scroll_offset) {
+        search_menu_scroll_offset = search_menu_selected_index;
+    }
+
+    // Names are read once per window, and again only when new matches fill it further
+    int visible = min(max_items_on_screen, search_result_count - search_menu_scroll_offset);
+    if (search_cache_id != search_id || search_cache_start_index != search_menu_scroll_offset ||
+        search_cache_count < search_menu_scroll_offset + visible) {
+        for (int i = 0; i < visible; i++) {
+            search_cached_names[i] = playlist_manager->getTrackName(search_results[search_menu_scroll_offset + i]);
+        }
+        search_cache_id = search_id;
+        search_cache_start_index = search_menu_scroll_offset;
+        search_cache_count = search_result_count;
+    }
+
+    int y = 29;
+    const int line_height = 11;
+    for (int i = 0; i < visible; ++i) {
+        const char* name = search_cached_names[i].c_str();
+        if (!search_editing && search_menu_scroll_offset + i == search_menu_selected_index) {
+            u8g2.drawBox(0, y - line_height + 2, SCREEN_WIDTH, line_height);
+            u8g2.setDrawColor(0);
+            u8g2.drawStr(2, y, name);
+            u8g2.setDrawColor(1);
+        } else {
+            u8g2.drawStr(2, y, name);
+        }
+        y += line_height;
+    }
+}
+
 void DisplayManager::drawNowPlayingScreen() {
     if (!music_player || !bluetooth_manager) {
         u8g2.drawStr(0, 32, "Managers not set!");
@@ -397,15 +715,48 @@ void DisplayManager::drawNowPlayingScreen() {
     u8g2.setCursor(0, 28);
     u8g2.print((last_displayed_track != "None") ? last_displayed_track : "No track playing");
 
-    // 3. Player Status (Bottom-left)
-    String player_status_text = "Status: ";
+    // 3. Artist (from tags, if any)
+    TrackMetadata metadata;
+    music_player->getCurrentTrackMetadata(metadata);
+    if (last_displayed_track != "None" && metadata.artist[0] != '\0') {
+        u8g2.drawStr(0, 40, metadata.artist);
+    }
+
+    // 4. Progress bar. Elapsed time comes from the played PCM, the total from the
+    //    frame count or the bitrate, so neither needs any decoding here.
+    uint32_t duration_ms = (last_displayed_track != "None") ? metadata.duration_ms : 0;
+    uint32_t elapsed_ms = min(music_player->getPositionMs(), duration_ms);
+    const int bar_x = 0;
+    const int bar_y = 44;
+    const int bar_width = SCREEN_WIDTH;
+    const int bar_height = 5;
+    u8g2.drawFrame(bar_x, bar_y, bar_width, bar_height);
+    if (duration_ms > 0) {
+        int fill_width = (uint64_t)(bar_width - 2) * elapsed_ms / duration_ms;
+        if (fill_width > 0) {
+            u8g2.drawBox(bar_x + 1, bar_y + 1, fill_width, bar_height - 2);
+        }
+    }
+
+    // 5. Elapsed (bottom-left), player status (centered), duration (bottom-right)
+    char time_str[12];
+    snprintf(time_str, sizeof(time_str), "%u:%02u", (unsigned)(elapsed_ms / 60000), (unsigned)(elapsed_ms / 1000 % 60));
+    u8g2.drawStr(0, 60, time_str);
+
+    if (duration_ms > 0) {
+        snprintf(time_str, sizeof(time_str), "%u:%02u", (unsigned)(duration_ms / 60000), (unsigned)(duration_ms / 1000 % 60));
+        u8g2.drawStr(SCREEN_WIDTH - u8g2.getStrWidth(time_str), 60, time_str);
+    }
+
+    const char* player_status_text = "";
     switch(last_player_state) {
-        case PlayerState::PLAYING: player_status_text += "Playing"; break;
-        case PlayerState::PAUSED:  player_status_text += "Paused"; break;
-        case PlayerState::STOPPED: player_status_text += "Stopped"; break;
+        case PlayerState::PLAYING: player_status_text = "Playing"; break;
+        case PlayerState::PAUSED:  player_status_text = "Paused"; break;
+        case PlayerState::STOPPED: player_status_text = "Stopped"; break;
     }
-    u8g2.setCursor(0, 60);
-    u8g2.print(player_status_text);
+    char status[24];
+    snprintf(status, sizeof(status), music_player->isShuffleEnabled() ? "%s, shuffled" : "%s", player_status_text);
+    u8g2.drawStr((SCREEN_WIDTH - u8g2.getStrWidth(status)) / 2, 60, status);
 }
 
 void DisplayManager::drawVolumeScreen() {
@@ -442,3 +793,22 @@ void DisplayManager::drawVolumeScreen() {
         u8g2.drawBox(bar_x + 1, bar_y + 1, fill_width, bar_height - 2);
     }
 }
+
+void DisplayManager::drawSettingsScreen() {
+    u8g2.drawStr(0, 12, "Settings");
+
+    char line[32];
+    snprintf(line, sizeof(line), "EQ: %s", Equalizer::getPreset(settings_eq_preset).name);
+    u8g2.drawStr(0, 26, line);
+
+    // Response from 20 Hz to 20 kHz around a dotted 0 dB line
+    updateEqCurve();
+    const int zero_y = 47;
+    for (int x = 0; x < SCREEN_WIDTH; x += 4) {
+        u8g2.drawPixel(x, zero_y);
+    }
+    for (int x = 1; x < SCREEN_WIDTH; x++) {
+        u8g2.drawLine(x - 1, zero_y - eq_curve[x - 1], x, zero_y - eq_curve[x]);
+    }
+}
+
@@ -7,6 +7,7 @@
 #include "MusicPlayer.h"
 #include "BluetoothManager.h"
 #include "PlaylistManager.h"
+#include "Equalizer.h"
 
 class DisplayManager {
 public:
@@ -26,6 +27,10 @@ public:
     // These will be called from the main loop to update the UI state
     void setBluetoothMenuState(int selected_index, int scroll_offset);
     void setPlaylistMenuState(int selected_index, int scroll_offset);
+    void setBrowseMenuState(BrowseLevel level, int parent_index, int selected_index);
+    void setSearchState(const char* query, int cursor, bool editing, uint32_t search_id,
+                        const int* results, int result_count, int selected_index);
+    void setSettingsState(int eq_preset);
 
 private:
     // --- Managers ---
@@ -54,20 +59,61 @@ private:
     unsigned long playlist_last_selection_time;
     unsigned long playlist_last_scroll_time;
     int playlist_text_scroll_offset_pixels;
+    bool playlist_fast_scrolling;  // Selection is moving too quickly to be worth reading names
 
     // Track name cache for playlist menu
     static const int PLAYLIST_VISIBLE_ITEMS = 4;
     String playlist_cached_names[PLAYLIST_VISIBLE_ITEMS];
     int playlist_cache_start_index;  // -1 = cache invalid
+    int playlist_cache_track_count;  // Track count when the cache was filled (grows while scanning)
+
+    // Artist/album browsing. The selection is relative to the parent's child range.
+    BrowseLevel browse_level;
+    int browse_parent_index;       // Artist for ALBUMS, album for TRACKS
+    int browse_menu_selected_index;
+    int browse_menu_scroll_offset;
+    int prev_browse_menu_selected_index;
+    unsigned long browse_last_selection_time;
+    unsigned long browse_last_scroll_time;
+    int browse_text_scroll_offset_pixels;
+    BrowseRecord browse_parent;    // Cached parent record: title and child range
+    String browse_cached_names[PLAYLIST_VISIBLE_ITEMS];
+    int browse_cache_start_index;  // -1 = cache invalid
+    uint32_t browse_cache_generation;
+
+    // Search screen. Results are owned by the main loop and only grow for a given search_id.
+    const char* search_query;
+    int search_cursor;             // Position of the character being picked
+    bool search_editing;
+    uint32_t search_id;
+    const int* search_results;
+    int search_result_count;
+    int search_menu_selected_index;
+    int search_menu_scroll_offset;
+    String search_cached_names[PLAYLIST_VISIBLE_ITEMS];
+    int search_cache_start_index;  // -1 = cache invalid
+    int search_cache_count;        // Results available when the cache was filled
+    uint32_t search_cache_id;
+
+    // Settings screen. The response curve is worked out once per preset.
+    int settings_eq_preset;
+    int eq_curve_preset;           // -1 = curve invalid
+    int8_t eq_curve[SCREEN_WIDTH]; // Pixel offset from the 0 dB line per column
 
     // --- Drawing Methods ---
     void drawBluetoothMenu();
     void drawPlaylistMenu();
+    void drawBrowseMenu();
+    void drawSearchScreen();
     void drawNowPlayingScreen();
     void drawVolumeScreen();
+    void drawSettingsScreen();
 
     // --- Cache Methods ---
     void updatePlaylistCache(int start_index);
+    void updateBrowseParent();
+    void updateBrowseCache(int start_index);
+    void updateEqCurve();
 
     // --- "Now Playing" screen state tracking ---
     String last_displayed_track;
@@ -0,0 +1,196 @@
+#include "Equalizer.h"
+#include <math.h>
+
+#define EQ_ROUND (1 << (EQ_SIGNAL_SHIFT - 1))
+
+// Shelves use Q 0.7, the flattest corner without a bump
+static const EqPreset PRESETS[] = {
+    {"Flat", 0, {}},
+    {"Bass boost", 1, {{EqBandType::LOW_SHELF, 100, 6, 7}}},
+    {"Treble boost", 1, {{EqBandType::HIGH_SHELF, 6000, 5, 7}}},
+    {"Earbuds", 3, {{EqBandType::LOW_SHELF, 120, 5, 7}, {EqBandType::PEAKING, 2500, -2, 10},
+                    {EqBandType::HIGH_SHELF, 10000, 4, 7}}},
+    {"Voice", 2, {{EqBandType::LOW_SHELF, 150, -3, 7}, {EqBandType::PEAKING, 2000, 3, 8}}},
+    {"Loudness", 2, {{EqBandType::LOW_SHELF, 80, 7, 7}, {EqBandType::HIGH_SHELF, 10000, 5, 7}}},
+    {"Warm", 2, {{EqBandType::LOW_SHELF, 200, 3, 7}, {EqBandType::HIGH_SHELF, 6000, -3, 7}}},
+};
+static const int PRESET_COUNT = sizeof(PRESETS) / sizeof(PRESETS[0]);
+
+// Band input and output between passes of the kernel; only the decode task filters
+static int32_t work[EQ_SLICE_FRAMES * 2];
+
+static inline int32_t saturate16(int32_t value) {
+#if defined(__XTENSA__)
+    int32_t result;
+    asm("clamps %0, %1, 15" : "=a"(result) : "a"(value));
+    return result;
+#else
+    return constrain(value, (int32_t)-32768, (int32_t)32767);
+#endif
+}
+
+Equalizer::Equalizer() : band_count(0), preset(0), headroom_cdb(0) {
+    memset(coefficients, 0, sizeof(coefficients));
+    reset();
+}
+
+int Equalizer::getPresetCount() {
+    return PRESET_COUNT;
+}
+
+const EqPreset& Equalizer::getPreset(int index) {
+    return PRESETS[constrain(index, 0, PRESET_COUNT - 1)];
+}
+
+// Audio EQ cookbook (R. Bristow-Johnson) shelves and peaks, normalized by a0
+void Equalizer::design(const EqBand& band, double* normalized) {
+    double a = pow(10.0, band.gain_db / 40.0);
+    double w0 = 2 * M_PI * band.frequency / EQ_SAMPLE_RATE;
+    double cw = cos(w0);
+    double alpha = sin(w0) / (2 * band.q10 / 10.0);
+    double shelf = 2 * sqrt(a) * alpha;
+    double b0, b1, b2, a0, a1, a2;
+    switch (band.type) {
+        case EqBandType::LOW_SHELF:
+            b0 = a * ((a + 1) - (a - 1) * cw + shelf);
+            b1 = 2 * a * ((a - 1) - (a + 1) * cw);
+            b2 = a * ((a + 1) - (a - 1) * cw - shelf);
+            a0 = (a + 1) + (a - 1) * cw + shelf;
+            a1 = -2 * ((a - 1) + (a + 1) * cw);
+            a2 = (a + 1) + (a - 1) * cw - shelf;
+            break;
+        case EqBandType::HIGH_SHELF:
+            b0 = a * ((a + 1) + (a - 1) * cw + shelf);
+            b1 = -2 * a * ((a - 1) + (a + 1) * cw);
+            b2 = a * ((a + 1) + (a - 1) * cw - shelf);
+            a0 = (a + 1) - (a - 1) * cw + shelf;
+            a1 = 2 * ((a - 1) - (a + 1) * cw);
+            a2 = (a + 1) - (a - 1) * cw - shelf;
+            break;
+        default:
+            b0 = 1 + alpha * a;
+            b1 = -2 * cw;
+            b2 = 1 - alpha * a;
+            a0 = 1 + alpha / a;
+            a1 = -2 * cw;
+            a2 = 1 - alpha / a;
+            break;
+    }
+    normalized[0] = b0 / a0;
+    normalized[1] = b1 / a0;
+    normalized[2] = b2 / a0;
+    normalized[3] = a1 / a0;
+    normalized[4] = a2 / a0;
+}
+
+float Equalizer::getResponseDb(int index, float frequency) {
+    const EqPreset& p = getPreset(index);
+    double w = 2 * M_PI * frequency / EQ_SAMPLE_RATE;
+    double c1 = cos(w), s1 = sin(w), c2 = cos(2 * w), s2 = sin(2 * w);
+    double db = 0;
+    for (int i = 0; i < p.band_count; i++) {
+        double k[5];
+        design(p.bands[i], k);
+        // |H(e^jw)| with z^-1 = cos w - j sin w
+        double nr = k[0] + k[1] * c1 + k[2] * c2, ni = -(k[1] * s1 + k[2] * s2);
+        double dr = 1 + k[3] * c1 + k[4] * c2, di = -(k[3] * s1 + k[4] * s2);
+        db += 10 * log10((nr * nr + ni * ni) / (dr * dr + di * di));
+    }
+    return db;
+}
+
+void Equalizer::setPreset(int index) {
+    preset = constrain(index, 0, PRESET_COUNT - 1);
+    const EqPreset& p = PRESETS[preset];
+    band_count = p.band_count;
+    for (int i = 0; i < band_count; i++) {
+        double k[5];
+        design(p.bands[i], k);
+        const double scale = 1 << EQ_COEFF_SHIFT;
+        coefficients[i].b0 = lround(k[0] * scale);
+        coefficients[i].b1 = lround(k[1] * scale);
+        coefficients[i].b2 = lround(k[2] * scale);
+        coefficients[i].a1 = lround(k[3] * scale);
+        coefficients[i].a2 = lround(k[4] * scale);
+    }
+
+    // Largest boost across the audio band, log-spaced from 20 Hz to 20 kHz
+    float peak_db = 0;
+    for (int i = 0; i < EQ_RESPONSE_POINTS && band_count > 0; i++) {
+        float frequency = 20.0f * powf(1000.0f, (float)i / (EQ_RESPONSE_POINTS - 1));
+        peak_db = max(peak_db, getResponseDb(preset, frequency));
+    }
+    headroom_cdb = -lroundf(peak_db * 100);
+    reset();
+}
+
+void Equalizer::reset() {
+    memset(state, 0, sizeof(state));
+}
+
+void Equalizer::process(int16_t* samples, size_t frames) {
+    if (band_count == 0) return;
+
+    while (frames > 0) {
+        size_t count = min(frames, (size_t)EQ_SLICE_FRAMES);
+        for (size_t i = 0; i < count * 2; i++) {
+            work[i] = (int32_t)samples[i] << EQ_SIGNAL_SHIFT;
+        }
+
+        for (int band = 0; band < band_count; band++) {
+            const int32_t b0 = coefficients[band].b0, b1 = coefficients[band].b1, b2 = coefficients[band].b2;
+            const int32_t a1 = coefficients[band].a1, a2 = coefficients[band].a2;
+            for (int channel = 0; channel < 2; channel++) {
+                State& s = state[band][channel];
+                int32_t x1 = s.x1, x2 = s.x2, y1 = s.y1, y2 = s.y2, error = s.error;
+                int32_t* p = work + channel;
+                for (size_t i = 0; i < count; i++, p += 2) {
+                    // Portable C; GCC lowers each 32x32->64 product to MULL and MULSH on the Xtensa
+                    int32_t x = *p;
+                    int64_t acc = (int64_t)b0 * x + (int64_t)b1 * x1 + (int64_t)b2 * x2 -
+                                  (int64_t)a1 * y1 - (int64_t)a2 * y2 + error;
+                    int32_t y = acc >> EQ_COEFF_SHIFT;
+                    error = acc - ((int64_t)y << EQ_COEFF_SHIFT);
+                    x2 = x1;
+                    x1 = x;
+                    y2 = y1;
+                    y1 = y;
+                    *p = y;
+                }
+                s.x1 = x1;
+                s.x2 = x2;
+                s.y1 = y1;
+                s.y2 = y2;
+                s.error = error;
+            }
+        }
+
+        for (size_t i = 0; i < count * 2; i++) {
+            samples[i] = saturate16((work[i] + EQ_ROUND) >> EQ_SIGNAL_SHIFT);
+        }
+        samples += count * 2;
+        frames -= count;
+    }
+}
+
+void Equalizer::processReference(int16_t* samples, size_t frames) {
+    if (band_count == 0) return;
+
+    for (size_t i = 0; i < frames * 2; i++) {
+        int32_t value = (int32_t)samples[i] << EQ_SIGNAL_SHIFT;
+        for (int band = 0; band < band_count; band++) {
+            const Coefficients& c = coefficients[band];
+            State& s = state[band][i % 2];
+            int64_t acc = (int64_t)c.b0 * value + (int64_t)c.b1 * s.x1 + (int64_t)c.b2 * s.x2 -
+                          (int64_t)c.a1 * s.y1 - (int64_t)c.a2 * s.y2 + s.error;
+            int32_t y = acc >> EQ_COEFF_SHIFT;
+            s.error = acc - ((int64_t)y << EQ_COEFF_SHIFT);
+            s.x2 = s.x1;
+            s.x1 = value;
+            s.y2 = s.y1;
+            s.y1 = y;
+            value = y;
+        }
+        samples[i] = constrain((value + EQ_ROUND) >> EQ_SIGNAL_SHIFT, (int32_t)-32768, (int32_t)32767);
+    }
+}
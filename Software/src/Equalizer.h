@@ -0,0 +1,74 @@
+#ifndef EQUALIZER_H
+#define EQUALIZER_H
+
+#include <Arduino.h>
+
+#define EQ_MAX_BANDS 4
+#define EQ_SAMPLE_RATE 44100        // Runs on the normalized output
+#define EQ_COEFF_SHIFT 28           // Coefficients are Q28, room for the +-4 of boosting shelves
+#define EQ_SIGNAL_SHIFT 8           // Fraction bits carried between bands: 48 dB of headroom
+#define EQ_SLICE_FRAMES 256         // Frames per pass of the band-at-a-time kernel
+#define EQ_RESPONSE_POINTS 64       // Frequencies checked for the largest boost
+
+enum class EqBandType : uint8_t {
+    LOW_SHELF,
+    PEAKING,
+    HIGH_SHELF
+};
+
+struct EqBand {
+    EqBandType type;
+    uint16_t frequency;  // Hz: corner of a shelf, centre of a peak
+    int8_t gain_db;
+    uint8_t q10;         // Q times 10
+};
+
+struct EqPreset {
+    const char* name;
+    uint8_t band_count;
+    EqBand bands[EQ_MAX_BANDS];
+};
+
+// Cascade of fixed-point biquads for 44.1 kHz interleaved stereo, in direct form I with
+// 64-bit accumulators and first-order error feedback, so low shelves stay quiet.
+// Coefficients are worked out only when the preset changes. Not thread-safe: the
+// audio processor changes presets under its decoder lock.
+class Equalizer {
+public:
+    Equalizer();
+
+    static int getPresetCount();
+    static const EqPreset& getPreset(int index);
+    static float getResponseDb(int preset, float frequency);  // Designed response, for the UI and tests
+
+    void setPreset(int index);   // Recomputes the coefficients and clears the filter state
+    int getPresetIndex() const { return preset; }
+    bool isFlat() const { return band_count == 0; }
+    int32_t getHeadroomCdb() const { return headroom_cdb; }  // Cut that keeps the largest boost from clipping, 1/100 dB
+    void reset();
+
+    // Filters frames in place, saturating at 16 bits. Works one band and channel at a time
+    // over a slice, keeping coefficients and state in registers.
+    void process(int16_t* samples, size_t frames);
+    // Same result, one sample at a time through every band; the tests check process() against it
+    void processReference(int16_t* samples, size_t frames);
+
+private:
+    struct Coefficients {
+        int32_t b0, b1, b2, a1, a2;  // Normalized so a0 = 1
+    };
+    struct State {
+        int32_t x1, x2, y1, y2;  // Q(EQ_SIGNAL_SHIFT)
+        int32_t error;           // Bits dropped from the last output, fed into the next
+    };
+
+    Coefficients coefficients[EQ_MAX_BANDS];
+    State state[EQ_MAX_BANDS][2];
+    uint8_t band_count;
+    int preset;
+    int32_t headroom_cdb;
+
+    static void design(const EqBand& band, double* normalized);  // b0 b1 b2 a1 a2
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "ExternalSort.h"
+
+// One run being merged, with its slice of the shared buffer
+struct MergeInput {
+    File file;
+    uint8_t* data;
+    uint32_t remaining;  // Records still on the card
+    size_t count;        // Records in data
+    size_t pos;
+};
+
+ExternalSorter::ExternalSorter(size_t record_size, RecordCompare compare, uint8_t* buffer, size_t buffer_size) :
+    record_size(record_size), compare(compare), buffer(buffer),
+    buffer_records(buffer_size / record_size),
+    run_path(nullptr), merge_path(nullptr),
+    buffered(0), total_records(0), bytes_read(0), bytes_written(0) {
+}
+
+bool ExternalSorter::begin(const char* runs, const char* merge) {
+    run_path = runs;
+    merge_path = merge;
+    buffered = 0;
+    total_records = 0;
+    bytes_read = 0;
+    bytes_written = 0;
+
+    // Merging needs at least one record per input and one for the output
+    if (buffer_records < EXTERNAL_SORT_FAN_IN + 1) return false;
+
+    SD.remove(run_path);
+    SD.remove(merge_path);
+    run_writer = SD.open(run_path, FILE_WRITE);
+    return run_writer;
+}
+
+bool ExternalSorter::add(const void* record) {
+    memcpy(buffer + buffered * record_size, record, record_size);
+    buffered++;
+    total_records++;
+    return buffered < buffer_records || flushRun();
+}
+
+bool ExternalSorter::flushRun() {
+    if (buffered == 0) return true;
+
+    qsort(buffer, buffered, record_size, compare);
+    size_t len = buffered * record_size;
+    bool ok = run_writer.write(buffer, len) == len;
+    bytes_written += len;
+    buffered = 0;
+    return ok;
+}
+
+bool ExternalSorter::finish(const char* output_path) {
+    bool ok = flushRun();
+    run_writer.close();
+    if (!ok) return false;
+
+    // All runs but the last hold a full buffer; each pass merges groups of them
+    const char* in_path = run_path;
+    const char* out_path = merge_path;
+    for (uint32_t run_length = buffer_records; run_length < total_records; run_length *= EXTERNAL_SORT_FAN_IN) {
+        if (!mergePass(in_path, out_path, run_length)) return false;
+        const char* swap = in_path;
+        in_path = out_path;
+        out_path = swap;
+    }
+
+    SD.remove(out_path);
+    SD.remove(output_path);
+    return SD.rename(in_path, output_path);
+}
+
+bool ExternalSorter::mergePass(const char* in_path, const char* out_path, uint32_t run_length) {
+    File out = SD.open(out_path, FILE_WRITE);
+    if (!out) return false;
+
+    // The buffer is split evenly between the inputs and the output
+    const size_t slice_records = buffer_records / (EXTERNAL_SORT_FAN_IN + 1);
+    uint8_t* out_data = buffer + EXTERNAL_SORT_FAN_IN * slice_records * record_size;
+    size_t out_count = 0;
+    bool ok = true;
+
+    MergeInput inputs[EXTERNAL_SORT_FAN_IN];
+    const uint32_t group_length = run_length * EXTERNAL_SORT_FAN_IN;
+    for (uint32_t group_start = 0; ok && group_start < total_records; group_start += group_length) {
+        int input_count = 0;
+        for (int i = 0; i < EXTERNAL_SORT_FAN_IN; i++) {
+            uint32_t run_start = group_start + i * run_length;
+            if (run_start >= total_records) break;
+
+            MergeInput& input = inputs[input_count++];
+            input.file = SD.open(in_path, FILE_READ);
+            input.data = buffer + i * slice_records * record_size;
+            input.remaining = min(run_length, total_records - run_start);
+            input.count = 0;
+            input.pos = 0;
+            if (!input.file || !input.file.seek(run_start * record_size)) ok = false;
+        }
+
+        while (ok) {
+            // Refill drained inputs, then pick the smallest head
+            MergeInput* smallest = nullptr;
+            for (int i = 0; i < input_count; i++) {
+                MergeInput& input = inputs[i];
+                if (input.pos == input.count && input.remaining > 0) {
+                    input.count = min((uint32_t)slice_records, input.remaining);
+                    size_t len = input.count * record_size;
+                    if (input.file.read(input.data, len) != len) {
+                        ok = false;
+                        break;
+                    }
+                    bytes_read += len;
+                    input.remaining -= input.count;
+                    input.pos = 0;
+                }
+                if (input.pos < input.count &&
+                    (!smallest || compare(input.data + input.pos * record_size,
+                                          smallest->data + smallest->pos * record_size) < 0)) {
+                    smallest = &input;
+                }
+            }
+            if (!ok || !smallest) break;
+
+            memcpy(out_data + out_count * record_size, smallest->data + smallest->pos * record_size, record_size);
+            smallest->pos++;
+            if (++out_count == slice_records) {
+                size_t len = out_count * record_size;
+                ok = out.write(out_data, len) == len;
+                bytes_written += len;
+                out_count = 0;
+            }
+        }
+
+        for (int i = 0; i < input_count; i++) {
+            if (inputs[i].file) inputs[i].file.close();
+        }
+    }
+
+    if (ok && out_count > 0) {
+        size_t len = out_count * record_size;
+        ok = out.write(out_data, len) == len;
+        bytes_written += len;
+    }
+    out.close();
+    SD.remove(in_path);
+    return ok;
+}
@@ -0,0 +1,45 @@
+#ifndef EXTERNALSORT_H
+#define EXTERNALSORT_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+#define EXTERNAL_SORT_FAN_IN 4  // Runs merged per pass; each one holds an open file handle
+
+typedef int (*RecordCompare)(const void* a, const void* b);
+
+// Sorts fixed-size records that do not fit in RAM. Records are collected into the
+// caller's buffer, each full buffer is sorted and appended to a run file, and runs are
+// then merged EXTERNAL_SORT_FAN_IN at a time until one sorted file remains. Memory use
+// is the caller's buffer and nothing else, whatever the number of records.
+class ExternalSorter {
+public:
+    ExternalSorter(size_t record_size, RecordCompare compare, uint8_t* buffer, size_t buffer_size);
+
+    bool begin(const char* run_path, const char* merge_path);
+    bool add(const void* record);
+    bool finish(const char* output_path);  // Leaves the sorted records in output_path
+
+    uint32_t getRecordCount() const { return total_records; }
+    uint32_t getBytesRead() const { return bytes_read; }
+    uint32_t getBytesWritten() const { return bytes_written; }
+
+private:
+    size_t record_size;
+    RecordCompare compare;
+    uint8_t* buffer;
+    size_t buffer_records;
+
+    const char* run_path;
+    const char* merge_path;
+    File run_writer;
+    size_t buffered;
+    uint32_t total_records;
+    uint32_t bytes_read;
+    uint32_t bytes_written;
+
+    bool flushRun();
+    bool mergePass(const char* in_path, const char* out_path, uint32_t run_length);
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "GainStage.h"
+#include <math.h>
+
+#define GAIN_ROUND (1 << (GAIN_SHIFT - 1))
+
+GainStage::GainStage() : target(GAIN_UNITY), current(GAIN_UNITY), limiting(false), limited_blocks(0) {
+}
+
+void GainStage::setGain(int32_t gain_cdb) {
+    gain_cdb = min(gain_cdb, (int32_t)GAIN_MAX_DB * 100);
+    target = lroundf(GAIN_UNITY * powf(10.0f, gain_cdb / 2000.0f));
+}
+
+void GainStage::reset() {
+    current = target;
+    limiting = false;
+}
+
+void GainStage::process(int16_t* samples, size_t frames, uint8_t channels) {
+    if (frames == 0 || isUnity()) return;
+    size_t count = frames * channels;
+
+    // The most gain this block takes without clipping
+    int32_t peak = 0;
+    for (size_t i = 0; i < count; i++) {
+        int32_t value = samples[i];
+        if (value < 0) value = -value;
+        if (value > peak) peak = value;
+    }
+    int32_t limit = peak > 0 ? ((int32_t)32767 << GAIN_SHIFT) / peak : INT32_MAX;
+
+    // A new gain is reached within the block; a limited gain is released toward it
+    // gradually. A block that takes less than the last one ended on starts lower.
+    int32_t end = target;
+    if (limiting && target > current) {
+        int32_t step = (int64_t)(target - current) * min(frames, (size_t)GAIN_RELEASE_FRAMES) / GAIN_RELEASE_FRAMES;
+        if (step > 0) end = current + step;
+    }
+    int32_t start = min(current, limit);
+    limiting = end > limit || end < target;
+    if (end > limit) {
+        end = limit;
+        limited_blocks++;
+    }
+
+    // Ramp from start to end in Q8 steps of the gain. Rounding toward the start keeps
+    // every step at or below the larger of the two, and at or below the limit a product
+    // rounds to at most 32767, so nothing can clip.
+    int32_t gain = start << 8;
+    int32_t delta = ((end - start) << 8) / (int32_t)frames;
+    if (channels == 2) {
+        for (size_t i = 0; i < frames; i++) {
+            int32_t g = gain >> 8;
+            samples[2 * i] = (samples[2 * i] * g + GAIN_ROUND) >> GAIN_SHIFT;
+            samples[2 * i + 1] = (samples[2 * i + 1] * g + GAIN_ROUND) >> GAIN_SHIFT;
+            gain += delta;
+        }
+    } else {
+        int16_t* sample = samples;
+        for (size_t i = 0; i < frames; i++) {
+            int32_t g = gain >> 8;
+            for (uint8_t c = 0; c < channels; c++, sample++) {
+                *sample = (*sample * g + GAIN_ROUND) >> GAIN_SHIFT;
+            }
+            gain += delta;
+        }
+    }
+    current = end;
+}
@@ -0,0 +1,35 @@
+#ifndef GAINSTAGE_H
+#define GAINSTAGE_H
+
+#include <Arduino.h>
+
+#define GAIN_SHIFT 12                  // Gains are Q12: 4096 is unity
+#define GAIN_UNITY (1 << GAIN_SHIFT)
+#define GAIN_MAX_DB 12                 // Most boost allowed; keeps sample * gain within 32 bits
+#define GAIN_RELEASE_FRAMES 22050      // The limiter gives back about 63% of its reduction in this many frames
+
+// Fixed-point gain with a peak limiter, applied in place to 16-bit PCM. Gain changes ramp
+// across a block instead of stepping. A block that would clip at the set gain is turned
+// down before it is scaled, so the output never clips, and the reduction is released
+// gradually over the blocks that follow. At unity gain nothing is touched.
+class GainStage {
+public:
+    GainStage();
+
+    void setGain(int32_t gain_cdb);  // 1/100 dB; reached by ramping over the next block
+    void reset();                    // Jump to the set gain without ramping, e.g. after a seek
+
+    // Scales interleaved frames in place
+    void process(int16_t* samples, size_t frames, uint8_t channels);
+
+    bool isUnity() const { return target == GAIN_UNITY && current == GAIN_UNITY; }
+    uint32_t getLimitedBlocks() const { return limited_blocks; }  // Blocks the limiter turned down
+
+private:
+    int32_t target;   // Set gain, Q12
+    int32_t current;  // Gain the last block ended on
+    bool limiting;    // current is below target because a block would have clipped
+    uint32_t limited_blocks;
+};
+
+#endif
@@ -1,6 +1,6 @@
 #include "InputManager.h"
 
-InputManager::InputManager() {
+InputManager::InputManager() : last_event_button(-1) {
     // Initialize all state-tracking arrays
     for (int i = 0; i < NUM_BUTTONS; i++) {
         last_button_state[i] = HIGH; // Buttons are pulled up, so HIGH is the idle state
@@ -44,6 +44,7 @@ InputEvent InputManager::handleInputs() {
                     // --- BUTTON RELEASED ---
                     if (!is_long_press_registered[i]) {
                         // If a long press was never registered, it's a short press
+                        last_event_button = i;
                         return short_press_events[i];
                     }
                 }
@@ -56,11 +57,14 @@ InputEvent InputManager::handleInputs() {
             if (!is_long_press_registered[i] && (current_millis - press_start_time[i]) > LONG_PRESS_DURATION) {
                 is_long_press_registered[i] = true;
                 last_repeat_time[i] = current_millis;
+                last_event_button = i;
                 return long_press_events[i];
             }
-            // Check for subsequent repeat events
-            else if (is_long_press_registered[i] && (current_millis - last_repeat_time[i]) > LONG_PRESS_REPEAT_DELAY) {
+            // Check for subsequent repeat events, coming faster the longer the button is held
+            else if (is_long_press_registered[i] &&
+                     (current_millis - last_repeat_time[i]) > (unsigned long)(LONG_PRESS_REPEAT_DELAY >> getAccelerationLevel(i, current_millis))) {
                 last_repeat_time[i] = current_millis;
+                last_event_button = i;
                 return repeat_events[i];
             }
         }
@@ -69,3 +73,20 @@ InputEvent InputManager::handleInputs() {
     // If no event was generated, return NONE
     return InputEvent::INPUT_EVENT_NONE;
 }
+
+int InputManager::getAccelerationLevel(int button, unsigned long current_millis) const {
+    unsigned long held_time = current_millis - press_start_time[button];
+    return min((unsigned long)LONG_PRESS_ACCEL_LEVELS, held_time / LONG_PRESS_ACCEL_TIME);
+}
+
+bool InputManager::isButtonHeld() const {
+    for (int i = 0; i < NUM_BUTTONS; i++) {
+        if (button_state[i] == LOW) return true;
+    }
+    return false;
+}
+
+int InputManager::getRepeatStep() const {
+    if (last_event_button < 0 || button_state[last_event_button] != LOW) return 1;
+    return 1 << (2 * getAccelerationLevel(last_event_button, millis()));
+}
@@ -12,6 +12,8 @@ public:
     InputManager();
     void initialize();
     InputEvent handleInputs();
+    int getRepeatStep() const;  // List step for the last repeat event, grows while the button is held
+    bool isButtonHeld() const;  // A debounced press is in progress: poll fast so repeats keep their pace
 
 private:
     const int button_pins[NUM_BUTTONS] = {BTN_UP, BTN_DOWN, BTN_LEFT, BTN_RIGHT, BTN_ENTER};
@@ -46,6 +48,9 @@ private:
     unsigned long press_start_time[NUM_BUTTONS];
     unsigned long last_repeat_time[NUM_BUTTONS];
     bool is_long_press_registered[NUM_BUTTONS];
+    int last_event_button;
+
+    int getAccelerationLevel(int button, unsigned long current_millis) const;
 };
 
 #endif // INPUT_MANAGER_H
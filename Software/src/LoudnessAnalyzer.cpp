@@ -0,0 +1,229 @@
+#include "LoudnessAnalyzer.h"
+#include "Mp3Parser.h"
+#include "libhelix-mp3/mp3common.h"
+#include <math.h>
+
+#define HISTOGRAM_BINS ((LOUDNESS_HISTOGRAM_MAX - LOUDNESS_HISTOGRAM_MIN) * LOUDNESS_HISTOGRAM_STEPS)
+
+// The pass runs in one task at a time, so the buffers are shared
+static uint8_t input_buffer[LOUDNESS_INPUT_BUFFER_SIZE];
+static int16_t frame_pcm[1152 * 2];
+static uint16_t histogram[HISTOGRAM_BINS];  // 400 ms blocks per 0.1 LU of loudness
+
+// Block loudness in LUFS from its mean square, 1.0 being a full-scale square wave
+static inline float blockLoudness(float energy) {
+    return -0.691f + 10.0f * log10f(energy);
+}
+
+// Mean square at the centre of a histogram bin
+static inline float binEnergy(int bin) {
+    float loudness = LOUDNESS_HISTOGRAM_MIN + (bin + 0.5f) / LOUDNESS_HISTOGRAM_STEPS;
+    return powf(10.0f, (loudness + 0.691f) / 10.0f);
+}
+
+LoudnessAnalyzer::LoudnessAnalyzer() : mp3(nullptr), sample_rate(0), channels(0),
+    sum(0), sub_block_frames(0), sub_block_fill(0), sub_blocks(0), peak_sample(0) {
+}
+
+LoudnessAnalyzer::~LoudnessAnalyzer() {
+    end();
+}
+
+bool LoudnessAnalyzer::begin() {
+    if (!mp3) mp3 = MP3InitDecoder();
+    return mp3 != nullptr;
+}
+
+void LoudnessAnalyzer::end() {
+    if (mp3) {
+        MP3FreeDecoder(mp3);
+        mp3 = nullptr;
+    }
+}
+
+// Empties the bit reservoir, so a first frame that reaches back into it fails with
+// ERR_MP3_MAINDATA_UNDERFLOW instead of decoding bytes left over from the previous file
+void LoudnessAnalyzer::resetDecoder() {
+    MP3DecInfo* info = (MP3DecInfo*)mp3;
+    info->mainDataBegin = 0;
+    info->mainDataBytes = 0;
+}
+
+// K-weighting filters for any sample rate, from the BS.1770 analogue prototypes
+void LoudnessAnalyzer::configure(uint32_t rate, uint8_t channel_count) {
+    sample_rate = rate;
+    channels = min(channel_count, (uint8_t)2);
+
+    float k = tanf(PI * 1681.974450955533f / rate);
+    float q = 0.7071752369554196f;
+    float vh = powf(10.0f, 3.999843853973347f / 20.0f);
+    float vb = powf(vh, 0.4996667741545416f);
+    float a0 = 1.0f + k / q + k * k;
+    shelf.b0 = (vh + vb * k / q + k * k) / a0;
+    shelf.b1 = 2.0f * (k * k - vh) / a0;
+    shelf.b2 = (vh - vb * k / q + k * k) / a0;
+    shelf.a1 = 2.0f * (k * k - 1.0f) / a0;
+    shelf.a2 = (1.0f - k / q + k * k) / a0;
+
+    k = tanf(PI * 38.13547087602444f / rate);
+    q = 0.5003270373238773f;
+    a0 = 1.0f + k / q + k * k;
+    highpass.b0 = 1.0f;
+    highpass.b1 = -2.0f;
+    highpass.b2 = 1.0f;
+    highpass.a1 = 2.0f * (k * k - 1.0f) / a0;
+    highpass.a2 = (1.0f - k / q + k * k) / a0;
+
+    memset(state, 0, sizeof(state));
+    memset(block_energy, 0, sizeof(block_energy));
+    memset(histogram, 0, sizeof(histogram));
+    sum = 0;
+    sub_block_frames = rate / 10;
+    sub_block_fill = 0;
+    sub_blocks = 0;
+    peak_sample = 0;
+}
+
+void LoudnessAnalyzer::measure(const int16_t* pcm, size_t frames) {
+    const float scale = 1.0f / 32768.0f;
+    for (size_t i = 0; i < frames; i++) {
+        for (uint8_t c = 0; c < channels; c++) {
+            int32_t sample = pcm[i * channels + c];
+            int32_t magnitude = sample < 0 ? -sample : sample;
+            if (magnitude > peak_sample) peak_sample = magnitude;
+
+            // Both stages in transposed direct form II
+            float* z = state[c];
+            float x = sample * scale;
+            float y = shelf.b0 * x + z[0];
+            z[0] = shelf.b1 * x - shelf.a1 * y + z[1];
+            z[1] = shelf.b2 * x - shelf.a2 * y;
+            x = y;
+            y = highpass.b0 * x + z[2];
+            z[2] = highpass.b1 * x - highpass.a1 * y + z[3];
+            z[3] = highpass.b2 * x - highpass.a2 * y;
+            sum += y * y;
+        }
+
+        if (++sub_block_fill == sub_block_frames) {
+            // Each 100 ms step completes a 400 ms block made of the last four
+            block_energy[sub_blocks % 4] = sum / sub_block_frames;
+            sum = 0;
+            sub_block_fill = 0;
+            if (++sub_blocks >= 4) {
+                float energy = (block_energy[0] + block_energy[1] + block_energy[2] + block_energy[3]) / 4;
+                if (energy > 0) {
+                    int bin = floorf((blockLoudness(energy) - LOUDNESS_HISTOGRAM_MIN) * LOUDNESS_HISTOGRAM_STEPS);
+                    if (bin >= 0) {
+                        bin = min(bin, HISTOGRAM_BINS - 1);
+                        if (histogram[bin] < UINT16_MAX) histogram[bin]++;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Integrated loudness: the mean of the blocks above the absolute gate sets a relative gate
+// 10 LU below it, and the mean of the blocks above both is the result
+bool LoudnessAnalyzer::finish(int16_t& gain, uint16_t& peak) {
+    double total = 0;
+    uint32_t count = 0;
+    for (int bin = 0; bin < HISTOGRAM_BINS; bin++) {
+        total += (double)histogram[bin] * binEnergy(bin);
+        count += histogram[bin];
+    }
+    if (count == 0) return false;  // Silent, or shorter than one block
+
+    float gate = blockLoudness(total / count) - 10.0f;
+    int first = max(0, (int)ceilf((gate - LOUDNESS_HISTOGRAM_MIN) * LOUDNESS_HISTOGRAM_STEPS - 0.5f));
+    total = 0;
+    count = 0;
+    for (int bin = first; bin < HISTOGRAM_BINS; bin++) {
+        total += (double)histogram[bin] * binEnergy(bin);
+        count += histogram[bin];
+    }
+    if (count == 0) return false;
+
+    float loudness = blockLoudness(total / count);
+    gain = constrain(lroundf((LOUDNESS_REFERENCE_LUFS - loudness) * 100), -32768L, 32767L);
+    peak = min(peak_sample, (int32_t)UINT16_MAX);
+    return true;
+}
+
+bool LoudnessAnalyzer::analyze(const char* path, int16_t& gain, uint16_t& peak, const volatile bool* cancel) {
+    if (!mp3) return false;
+    File file = SD.open(path);
+    if (!file) return false;
+
+    // Start on the first audio frame, past the tags and the Xing/Info frame
+    Mp3StreamInfo info;
+    uint32_t start = 0;
+    if (Mp3Parser::readStreamInfo(file, info)) {
+        start = info.first_frame + (info.has_info_frame ? info.header.frame_length : 0);
+    }
+    if (!file.seek(start)) {
+        file.close();
+        return false;
+    }
+
+    resetDecoder();
+    sample_rate = 0;
+    size_t offset = 0;
+    size_t length = 0;
+    while (!*cancel) {
+        if (length < MAINBUF_SIZE && file.available()) {
+            memmove(input_buffer, input_buffer + offset, length);
+            offset = 0;
+            int len = file.read(input_buffer + length, sizeof(input_buffer) - length);
+            if (len > 0) length += len;
+        }
+        if (length == 0) break;
+
+        int sync = MP3FindSyncWord(input_buffer + offset, length);
+        if (sync < 0) {
+            if (!file.available()) break;
+            size_t keep = min(length, (size_t)3);  // A header may start in the last bytes
+            offset += length - keep;
+            length = keep;
+            continue;
+        }
+        offset += sync;
+        length -= sync;
+
+        unsigned char* in = input_buffer + offset;
+        int left = length;
+        int result = MP3Decode(mp3, &in, &left, frame_pcm, 0);
+        size_t consumed = length - left;
+        offset += consumed;
+        length = left;
+        if (result == ERR_MP3_INDATA_UNDERFLOW) {
+            if (!file.available()) break;  // A partial frame at the end
+            length = 0;
+            continue;
+        }
+        if (result != ERR_MP3_NONE) {
+            // Reservoir not filled yet, a corrupt frame or a false sync
+            if (result != ERR_MP3_MAINDATA_UNDERFLOW && consumed == 0) {
+                offset++;
+                length--;
+            }
+            continue;
+        }
+
+        MP3FrameInfo frame;
+        MP3GetLastFrameInfo(mp3, &frame);
+        if (frame.nChans < 1 || frame.nChans > 2) continue;
+        if (sample_rate == 0) {
+            configure(frame.samprate, frame.nChans);
+        }
+        // Frames of another format are junk that happened to sync
+        if ((uint32_t)frame.samprate == sample_rate && frame.nChans == channels) {
+            measure(frame_pcm, frame.outputSamps / frame.nChans);
+        }
+    }
+    file.close();
+
+    if (*cancel || sample_rate == 0) return false;
+    return finish(gain, peak);
+}
@@ -0,0 +1,54 @@
+#ifndef LOUDNESSANALYZER_H
+#define LOUDNESSANALYZER_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "libhelix-mp3/mp3dec.h"
+
+#define LOUDNESS_REFERENCE_LUFS -18     // ReplayGain 2.0 target level
+#define LOUDNESS_INPUT_BUFFER_SIZE 2048 // MP3 data read ahead of the decoder, at least MAINBUF_SIZE
+#define LOUDNESS_HISTOGRAM_MIN -70      // Absolute gate, LUFS
+#define LOUDNESS_HISTOGRAM_MAX 5
+#define LOUDNESS_HISTOGRAM_STEPS 10     // Bins per LU
+
+// Measures a track's loudness the way ReplayGain 2.0 does (EBU R128 integrated loudness:
+// K-weighting, 400 ms blocks every 100 ms, absolute and relative gates) by decoding the
+// whole file. Meant for a background pass; playback never analyses audio. Blocks are
+// counted in a histogram, so memory does not grow with the track length.
+class LoudnessAnalyzer {
+public:
+    LoudnessAnalyzer();
+    ~LoudnessAnalyzer();
+
+    bool begin();  // Allocates a decoder of its own on first use; it is kept for later passes
+    void end();    // Frees the decoder
+
+    // Decodes a file and works out the gain that brings it to the reference level, in
+    // 1/100 dB, and its sample peak (32768 = full scale). Gives up as soon as *cancel is set.
+    bool analyze(const char* path, int16_t& gain, uint16_t& peak, const volatile bool* cancel);
+
+private:
+    struct Biquad {
+        float b0, b1, b2, a1, a2;
+    };
+
+    HMP3Decoder mp3;
+    uint32_t sample_rate;
+    uint8_t channels;
+    Biquad shelf;     // K-weighting stage 1: head diffraction
+    Biquad highpass;  // Stage 2: RLB high-pass
+    float state[2][4];          // Filter memory per channel, two values per stage
+    float block_energy[4];      // Mean square of the last four 100 ms sub-blocks
+    float sum;                  // Squares summed over the sub-block being filled
+    uint32_t sub_block_frames;
+    uint32_t sub_block_fill;
+    uint32_t sub_blocks;
+    int32_t peak_sample;
+
+    void resetDecoder();
+    void configure(uint32_t rate, uint8_t channel_count);
+    void measure(const int16_t* pcm, size_t frames);
+    bool finish(int16_t& gain, uint16_t& peak);
+};
+
+#endif
@@ -0,0 +1,493 @@
+#include "Mp3Parser.h"
+#include <math.h>
+
+// Layer III bitrates in kbps, indexed by [MPEG-1 ? 0 : 1][bitrate index]
+static const uint16_t LAYER3_BITRATES[2][16] = {
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0},
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0}
+};
+static const uint32_t MPEG1_SAMPLE_RATES[3] = {44100, 48000, 32000};
+
+static uint32_t readSyncsafe(const uint8_t* data) {
+    return ((uint32_t)(data[0] & 0x7F) << 21) | ((uint32_t)(data[1] & 0x7F) << 14) |
+           ((uint32_t)(data[2] & 0x7F) << 7) | (data[3] & 0x7F);
+}
+
+static uint32_t readBigEndian(const uint8_t* data, int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+// Appends a code point as UTF-8 if it fits entirely, so strings are never cut mid-character
+static bool appendUtf8(char* out, size_t& pos, size_t out_size, uint32_t cp) {
+    char encoded[4];
+    size_t len;
+    if (cp < 0x80) {
+        encoded[0] = cp;
+        len = 1;
+    } else if (cp < 0x800) {
+        encoded[0] = 0xC0 | (cp >> 6);
+        encoded[1] = 0x80 | (cp & 0x3F);
+        len = 2;
+    } else {
+        encoded[0] = 0xE0 | (cp >> 12);
+        encoded[1] = 0x80 | ((cp >> 6) & 0x3F);
+        encoded[2] = 0x80 | (cp & 0x3F);
+        len = 3;
+    }
+    if (pos + len >= out_size) return false;
+    memcpy(out + pos, encoded, len);
+    pos += len;
+    return true;
+}
+
+// Converts ID3 text in any of its encodings (0 = Latin-1, 1 = UTF-16 with BOM,
+// 2 = UTF-16BE, 3 = UTF-8) to a NUL-terminated UTF-8 string with trailing spaces removed
+static void copyText(uint8_t encoding, const uint8_t* data, size_t len, char* out, size_t out_size) {
+    size_t pos = 0;
+
+    if (encoding == 1 || encoding == 2) {
+        bool big_endian = true;
+        if (encoding == 1 && len >= 2) {
+            big_endian = !(data[0] == 0xFF && data[1] == 0xFE);
+            if ((data[0] == 0xFF && data[1] == 0xFE) || (data[0] == 0xFE && data[1] == 0xFF)) {
+                data += 2;
+                len -= 2;
+            }
+        }
+        for (size_t i = 0; i + 1 < len; i += 2) {
+            uint32_t cp = big_endian ? (data[i] << 8) | data[i + 1] : (data[i + 1] << 8) | data[i];
+            if (cp == 0) break;
+            if (cp >= 0xD800 && cp <= 0xDFFF) cp = '?';  // Outside the BMP, not drawable anyway
+            if (!appendUtf8(out, pos, out_size, cp)) break;
+        }
+    } else if (encoding == 3) {
+        for (size_t i = 0; i < len && data[i] != 0 && pos + 1 < out_size; i++) {
+            out[pos++] = data[i];
+        }
+        // Drop a multi-byte sequence that was cut short
+        size_t end = pos;
+        while (end > 0 && (out[end - 1] & 0xC0) == 0x80) end--;
+        if (end > 0 && (uint8_t)out[end - 1] >= 0xC0) {
+            uint8_t lead = out[end - 1];
+            size_t expected = (lead >= 0xF0) ? 4 : (lead >= 0xE0) ? 3 : 2;
+            if (pos - (end - 1) < expected) pos = end - 1;
+        }
+    } else {
+        for (size_t i = 0; i < len && data[i] != 0; i++) {
+            if (!appendUtf8(out, pos, out_size, data[i])) break;
+        }
+    }
+
+    while (pos > 0 && out[pos - 1] == ' ') pos--;
+    out[pos] = '\0';
+}
+
+// Reads a TXXX frame (encoding, description, value) and keeps it if it is ReplayGain
+static void readReplayGainFrame(const uint8_t* data, size_t len, TrackMetadata& metadata) {
+    uint8_t encoding = data[0];
+    bool wide = (encoding == 1 || encoding == 2);
+    size_t end = 1;
+    while (end + (wide ? 1 : 0) < len && (data[end] != 0 || (wide && data[end + 1] != 0))) {
+        end += wide ? 2 : 1;
+    }
+    size_t value_start = end + (wide ? 2 : 1);
+    if (value_start >= len) return;
+
+    char description[24];
+    char value[16];
+    copyText(encoding, data + 1, end - 1, description, sizeof(description));
+    copyText(encoding, data + value_start, len - value_start, value, sizeof(value));
+
+    // "-6.54 dB" for gains, "0.988831" for peaks
+    float number = strtof(value, nullptr);
+    if (strcasecmp(description, "REPLAYGAIN_TRACK_GAIN") == 0) {
+        metadata.track_gain = constrain(lroundf(number * 100), -32768L, 32767L);
+        metadata.flags |= METADATA_TRACK_GAIN;
+    } else if (strcasecmp(description, "REPLAYGAIN_ALBUM_GAIN") == 0) {
+        metadata.album_gain = constrain(lroundf(number * 100), -32768L, 32767L);
+        metadata.flags |= METADATA_ALBUM_GAIN;
+    } else if (strcasecmp(description, "REPLAYGAIN_TRACK_PEAK") == 0) {
+        metadata.track_peak = constrain(lroundf(number * 32768), 0L, 65535L);
+    }
+}
+
+// LAME stores a radio (track) and an audiophile (album) gain: a 3-bit name code, a 3-bit
+// originator that is zero when unset, a sign bit and the gain in 1/10 dB
+static bool readLameGain(const uint8_t* field, uint8_t name_code, int16_t& gain) {
+    uint16_t value = (field[0] << 8) | field[1];
+    if ((value >> 13) != name_code || ((value >> 10) & 0x07) == 0) return false;
+    gain = (value & 0x1FF) * 10;
+    if (value & 0x200) gain = -gain;
+    return true;
+}
+
+bool Mp3Parser::parseFrameHeader(const uint8_t* data, Mp3FrameHeader& header) {
+    if (data[0] != 0xFF || (data[1] & 0xE0) != 0xE0) return false;
+
+    uint8_t version_bits = (data[1] >> 3) & 0x03;
+    uint8_t layer_bits = (data[1] >> 1) & 0x03;
+    uint8_t bitrate_index = data[2] >> 4;
+    uint8_t sample_rate_index = (data[2] >> 2) & 0x03;
+    uint8_t padding = (data[2] >> 1) & 0x01;
+
+    // Only Layer III is supported by the decoder; free-format bitrate is rejected
+    if (version_bits == 1 || layer_bits != 1) return false;
+    if (bitrate_index == 0 || bitrate_index == 15 || sample_rate_index == 3) return false;
+
+    header.version = (version_bits == 3) ? 1 : (version_bits == 2) ? 2 : 3;
+    header.layer = 3;
+    header.channels = ((data[3] >> 6) == 3) ? 1 : 2;
+    header.bitrate_kbps = LAYER3_BITRATES[header.version == 1 ? 0 : 1][bitrate_index];
+    header.sample_rate = MPEG1_SAMPLE_RATES[sample_rate_index] >> (header.version - 1);
+    header.samples_per_frame = (header.version == 1) ? 1152 : 576;
+    header.frame_length = (header.samples_per_frame / 8) * header.bitrate_kbps * 1000 / header.sample_rate + padding;
+    return true;
+}
+
+uint32_t Mp3Parser::readId3v2Size(File& file, uint32_t offset) {
+    uint8_t header[ID3V2_HEADER_SIZE];
+    if (!file.seek(offset) || file.read(header, sizeof(header)) != sizeof(header)) return 0;
+    if (memcmp(header, "ID3", 3) != 0 || header[3] == 0xFF || header[4] == 0xFF) return 0;
+    if ((header[6] | header[7] | header[8] | header[9]) & 0x80) return 0;
+
+    // The size field already covers the extended header, frames and padding
+    uint32_t size = ID3V2_HEADER_SIZE + readSyncsafe(header + 6);
+    if (header[3] >= 4 && (header[5] & 0x10)) {
+        size += ID3V2_HEADER_SIZE;  // Footer
+    }
+    return size;
+}
+
+void Mp3Parser::readId3v2Tags(File& file, TrackMetadata& metadata) {
+    uint8_t header[ID3V2_HEADER_SIZE];
+    if (!file.seek(0) || file.read(header, sizeof(header)) != sizeof(header)) return;
+    if (memcmp(header, "ID3", 3) != 0) return;
+
+    const uint8_t major = header[3];
+    const uint8_t flags = header[5];
+    if (major < 2 || major > 4) return;
+
+    const uint32_t tag_end = ID3V2_HEADER_SIZE + readSyncsafe(header + 6);
+    const size_t frame_header_size = (major == 2) ? 6 : 10;
+    uint32_t pos = ID3V2_HEADER_SIZE;
+
+    // Extended header: v2.3 size excludes its own size field, v2.4 includes it
+    if (major >= 3 && (flags & 0x40)) {
+        uint8_t size_bytes[4];
+        if (!file.seek(pos) || file.read(size_bytes, 4) != 4) return;
+        pos += (major == 3) ? 4 + readBigEndian(size_bytes, 4) : readSyncsafe(size_bytes);
+    }
+
+    uint8_t data[128];
+    while (pos + frame_header_size <= tag_end) {
+        uint8_t frame_header[10];
+        if (!file.seek(pos) || file.read(frame_header, frame_header_size) != frame_header_size) return;
+        if (frame_header[0] == 0) return;  // Padding
+
+        uint32_t frame_size;
+        bool skip_frame = false;
+        uint32_t data_offset = 0;
+        if (major == 2) {
+            frame_size = readBigEndian(frame_header + 3, 3);
+        } else if (major == 3) {
+            frame_size = readBigEndian(frame_header + 4, 4);
+            skip_frame = frame_header[9] & 0xC0;  // Compressed or encrypted
+        } else {
+            frame_size = readSyncsafe(frame_header + 4);
+            skip_frame = frame_header[9] & 0x0C;  // Compressed or encrypted
+            if (frame_header[9] & 0x01) data_offset = 4;  // Data length indicator
+        }
+
+        uint32_t data_start = pos + frame_header_size;
+        if (frame_size == 0 || data_start + frame_size > tag_end) return;
+
+        char* field = nullptr;
+        size_t field_size = 0;
+        char track_text[8];
+        bool replay_gain = false;
+        const char* id = (const char*)frame_header;
+        if (major == 2 ? memcmp(id, "TT2", 3) == 0 : memcmp(id, "TIT2", 4) == 0) {
+            field = metadata.title;
+            field_size = sizeof(metadata.title);
+        } else if (major == 2 ? memcmp(id, "TP1", 3) == 0 : memcmp(id, "TPE1", 4) == 0) {
+            field = metadata.artist;
+            field_size = sizeof(metadata.artist);
+        } else if (major == 2 ? memcmp(id, "TAL", 3) == 0 : memcmp(id, "TALB", 4) == 0) {
+            field = metadata.album;
+            field_size = sizeof(metadata.album);
+        } else if (major == 2 ? memcmp(id, "TRK", 3) == 0 : memcmp(id, "TRCK", 4) == 0) {
+            field = track_text;
+            field_size = sizeof(track_text);
+        } else if (major == 2 ? memcmp(id, "TXX", 3) == 0 : memcmp(id, "TXXX", 4) == 0) {
+            replay_gain = true;
+        }
+
+        // Only the frames we want are read, and only as much as fits: everything else,
+        // including embedded cover art, is skipped with a seek
+        if ((field || replay_gain) && !skip_frame && frame_size > data_offset + 1) {
+            size_t len = min((size_t)(frame_size - data_offset), sizeof(data));
+            if (file.seek(data_start + data_offset) && file.read(data, len) == len) {
+                // Unsynchronisation inserts a zero after every 0xFF
+                if ((flags & 0x80) || (major == 4 && (frame_header[9] & 0x02))) {
+                    size_t out = 0;
+                    for (size_t i = 0; i < len; i++) {
+                        data[out++] = data[i];
+                        if (data[i] == 0xFF && i + 1 < len && data[i + 1] == 0x00) i++;
+                    }
+                    len = out;
+                }
+                if (replay_gain) {
+                    readReplayGainFrame(data, len, metadata);
+                } else {
+                    copyText(data[0], data + 1, len - 1, field, field_size);
+                }
+                if (field == track_text) {
+                    metadata.track_number = atoi(track_text);
+                }
+            }
+        }
+
+        pos = data_start + frame_size;
+    }
+}
+
+void Mp3Parser::readId3v1Tags(File& file, TrackMetadata& metadata) {
+    size_t size = file.size();
+    if (size < ID3V1_TAG_SIZE) return;
+
+    uint8_t tag[ID3V1_TAG_SIZE];
+    if (!file.seek(size - ID3V1_TAG_SIZE) || file.read(tag, sizeof(tag)) != sizeof(tag)) return;
+    if (memcmp(tag, "TAG", 3) != 0) return;
+
+    // ID3v1 only fills in what the ID3v2 tag did not provide
+    if (metadata.title[0] == '\0') copyText(0, tag + 3, 30, metadata.title, sizeof(metadata.title));
+    if (metadata.artist[0] == '\0') copyText(0, tag + 33, 30, metadata.artist, sizeof(metadata.artist));
+    if (metadata.album[0] == '\0') copyText(0, tag + 63, 30, metadata.album, sizeof(metadata.album));
+    if (metadata.track_number == 0 && tag[125] == 0 && tag[126] != 0) {
+        metadata.track_number = tag[126];  // ID3v1.1
+    }
+}
+
+void Mp3Parser::readVbrHeader(const uint8_t* frame, size_t len, Mp3StreamInfo& info) {
+    const Mp3FrameHeader& header = info.header;
+
+    // Xing/Info sits right after the side information
+    size_t xing_offset = 4;
+    if (header.version == 1) {
+        xing_offset += (header.channels == 1) ? 17 : 32;
+    } else {
+        xing_offset += (header.channels == 1) ? 9 : 17;
+    }
+    if (xing_offset + 12 <= len &&
+        (memcmp(frame + xing_offset, "Xing", 4) == 0 || memcmp(frame + xing_offset, "Info", 4) == 0)) {
+        uint32_t flags = readBigEndian(frame + xing_offset + 4, 4);
+        size_t field = xing_offset + 8;
+        if ((flags & 0x01) && field + 4 <= len) {
+            info.frame_count = readBigEndian(frame + field, 4);
+            field += 4;
+        }
+        if ((flags & 0x02) && field + 4 <= len) {
+            info.stream_bytes = readBigEndian(frame + field, 4);
+            field += 4;
+        }
+        if ((flags & 0x04) && field + MP3_TOC_SIZE <= len) {
+            memcpy(info.toc, frame + field, MP3_TOC_SIZE);
+            info.has_toc = true;
+        }
+        info.has_info_frame = true;
+
+        // A LAME (or FFmpeg "Lavc") extension follows the optional fields: frames, bytes,
+        // TOC and quality. Delay and padding are two 12-bit values 21 bytes into it.
+        size_t lame_offset = xing_offset + 8;
+        if (flags & 0x01) lame_offset += 4;
+        if (flags & 0x02) lame_offset += 4;
+        if (flags & 0x04) lame_offset += 100;
+        if (flags & 0x08) lame_offset += 4;
+        if (lame_offset + 24 <= len &&
+            (memcmp(frame + lame_offset, "LAME", 4) == 0 || memcmp(frame + lame_offset, "Lavc", 4) == 0)) {
+            const uint8_t* delay = frame + lame_offset + 21;
+            info.encoder_delay = (delay[0] << 4) | (delay[1] >> 4);
+            info.encoder_padding = ((delay[1] & 0x0F) << 8) | delay[2];
+            info.has_gapless_info = info.frame_count > 0;
+            if (memcmp(frame + lame_offset, "LAME", 4) == 0) {
+                info.has_lame_track_gain = readLameGain(frame + lame_offset + 15, 1, info.lame_track_gain);
+                info.has_lame_album_gain = readLameGain(frame + lame_offset + 17, 2, info.lame_album_gain);
+            }
+        }
+        return;
+    }
+
+    // VBRI sits at a fixed offset
+    const size_t vbri_offset = 4 + 32;
+    if (vbri_offset + 18 <= len && memcmp(frame + vbri_offset, "VBRI", 4) == 0) {
+        info.stream_bytes = readBigEndian(frame + vbri_offset + 10, 4);
+        info.frame_count = readBigEndian(frame + vbri_offset + 14, 4);
+        info.vbri_offset = info.first_frame + vbri_offset;
+        info.has_info_frame = true;
+    }
+}
+
+// A real frame is followed by more frames of the same stream, each starting exactly where
+// the previous one ends. Chains cut short by the end of the audio are accepted.
+bool Mp3Parser::checkFrameChain(File& file, uint32_t pos, uint32_t end, const Mp3FrameHeader& first) {
+    Mp3FrameHeader header = first;
+    for (int i = 1; i < MP3_SYNC_CHECK_FRAMES; i++) {
+        pos += header.frame_length;
+        if (pos + 4 > end) return true;
+
+        uint8_t data[4];
+        if (!file.seek(pos) || file.read(data, 4) != 4) return false;
+        if (!parseFrameHeader(data, header)) return false;
+        if (header.version != first.version || header.sample_rate != first.sample_rate) return false;
+    }
+    return true;
+}
+
+bool Mp3Parser::readStreamInfo(File& file, Mp3StreamInfo& info) {
+    memset(&info, 0, sizeof(info));
+    size_t size = file.size();
+
+    // Some taggers prepend a new tag in front of an old one instead of replacing it
+    uint32_t tag_size;
+    while ((tag_size = readId3v2Size(file, info.audio_start)) > 0 && info.audio_start + tag_size < size) {
+        info.audio_start += tag_size;
+    }
+    info.audio_end = size;
+    if (size >= info.audio_start + ID3V1_TAG_SIZE) {
+        uint8_t marker[3];
+        if (file.seek(size - ID3V1_TAG_SIZE) && file.read(marker, 3) == 3 && memcmp(marker, "TAG", 3) == 0) {
+            info.audio_end -= ID3V1_TAG_SIZE;
+        }
+    }
+    if (info.audio_start >= info.audio_end) return false;
+
+    // Find the first frame header after the tag
+    uint8_t buffer[256];
+    uint32_t pos = info.audio_start;
+    uint32_t search_end = min(info.audio_end, info.audio_start + MP3_SYNC_SEARCH_LIMIT);
+    bool found = false;
+    while (pos + 4 <= search_end) {
+        size_t len = min((uint32_t)sizeof(buffer), search_end - pos);
+        if (!file.seek(pos) || file.read(buffer, len) != len) return false;
+
+        size_t i = 0;
+        for (; i + 4 <= len; i++) {
+            // Cover art and other junk can hold byte patterns that look like a header
+            if (parseFrameHeader(buffer + i, info.header) &&
+                checkFrameChain(file, pos + i, info.audio_end, info.header)) {
+                found = true;
+                break;
+            }
+        }
+        if (found) {
+            pos += i;
+            break;
+        }
+        pos += len - 3;  // Next chunk overlaps the last three bytes
+    }
+    if (!found) return false;
+    info.first_frame = pos;
+
+    size_t len = min((uint32_t)sizeof(buffer), info.audio_end - info.first_frame);
+    if (file.seek(info.first_frame) && file.read(buffer, len) == len) {
+        readVbrHeader(buffer, len, info);
+    }
+    if (info.stream_bytes == 0 || info.stream_bytes > info.audio_end - info.first_frame) {
+        info.stream_bytes = info.audio_end - info.first_frame;
+    }
+
+    if (info.frame_count > 0) {
+        // Encoder delay and padding are not part of the track
+        uint64_t samples = (uint64_t)info.frame_count * info.header.samples_per_frame;
+        uint32_t trimmed = info.encoder_delay + info.encoder_padding;
+        if (info.has_gapless_info && samples > trimmed) samples -= trimmed;
+        info.duration_ms = samples * 1000 / info.header.sample_rate;
+    } else {
+        // Constant bitrate: the size tells the length (bytes * 8 / kbps = ms)
+        info.duration_ms = (uint64_t)(info.audio_end - info.first_frame) * 8 / info.header.bitrate_kbps;
+    }
+    return true;
+}
+
+bool Mp3Parser::readVbriToc(File& file, Mp3StreamInfo& info) {
+    if (info.has_toc || info.vbri_offset == 0 || info.frame_count == 0) return info.has_toc;
+
+    uint8_t header[26];
+    if (!file.seek(info.vbri_offset) || file.read(header, sizeof(header)) != sizeof(header)) return false;
+    uint32_t entry_count = readBigEndian(header + 18, 2);
+    uint32_t scale = readBigEndian(header + 20, 2);
+    uint32_t entry_size = readBigEndian(header + 22, 2);
+    uint32_t frames_per_entry = readBigEndian(header + 24, 2);
+    if (entry_count == 0 || entry_size == 0 || entry_size > 4 || frames_per_entry == 0) return false;
+
+    // Each entry is the byte size of the next frames_per_entry frames. Walk the table once,
+    // noting where each percent of the frames starts, interpolated inside its entry.
+    uint8_t buffer[64];
+    size_t buffered = 0;
+    size_t pos = 0;
+    uint64_t bytes = 0;
+    uint32_t entry = 0;
+    for (int percent = 0; percent < MP3_TOC_SIZE; percent++) {
+        uint64_t target_frame = (uint64_t)info.frame_count * percent / MP3_TOC_SIZE;
+        uint32_t entry_bytes = 0;
+        while (entry < entry_count) {
+            if (pos + entry_size > buffered) {
+                // Refill whole entries, keeping the part of the buffer not used yet
+                memmove(buffer, buffer + pos, buffered - pos);
+                buffered -= pos;
+                pos = 0;
+                size_t want = min((size_t)(entry_count - entry) * entry_size, sizeof(buffer) - buffered);
+                want -= want % entry_size;
+                if (file.read(buffer + buffered, want) != want) return false;
+                buffered += want;
+            }
+            entry_bytes = readBigEndian(buffer + pos, entry_size) * scale;
+            if ((uint64_t)(entry + 1) * frames_per_entry > target_frame) break;
+            bytes += entry_bytes;
+            pos += entry_size;
+            entry++;
+            entry_bytes = 0;
+        }
+        uint64_t into_entry = target_frame - min(target_frame, (uint64_t)entry * frames_per_entry);
+        uint64_t offset = bytes + (uint64_t)entry_bytes * into_entry / frames_per_entry;
+        info.toc[percent] = min((uint64_t)255, offset * 256 / info.stream_bytes);
+    }
+    info.has_toc = true;
+    return true;
+}
+
+bool Mp3Parser::readMetadata(File& file, TrackMetadata& metadata) {
+    memset(&metadata, 0, sizeof(metadata));
+
+    readId3v2Tags(file, metadata);
+    readId3v1Tags(file, metadata);
+    if (metadata.title[0] || metadata.artist[0] || metadata.album[0]) {
+        metadata.flags |= METADATA_HAS_TAGS;
+    }
+
+    Mp3StreamInfo info;
+    if (!readStreamInfo(file, info)) return false;
+
+    metadata.duration_ms = info.duration_ms;
+    if (info.frame_count > 0) {
+        metadata.flags |= METADATA_VBR;
+        metadata.bitrate_kbps = info.duration_ms ? (uint64_t)(info.audio_end - info.first_frame) * 8 / info.duration_ms : 0;
+    } else {
+        metadata.bitrate_kbps = info.header.bitrate_kbps;
+    }
+
+    // Tags win over the gain LAME worked out while encoding
+    if (!(metadata.flags & METADATA_TRACK_GAIN) && info.has_lame_track_gain) {
+        metadata.track_gain = info.lame_track_gain;
+        metadata.flags |= METADATA_TRACK_GAIN;
+    }
+    if (!(metadata.flags & METADATA_ALBUM_GAIN) && info.has_lame_album_gain) {
+        metadata.album_gain = info.lame_album_gain;
+        metadata.flags |= METADATA_ALBUM_GAIN;
+    }
+    return true;
+}
@@ -0,0 +1,94 @@
+#ifndef MP3PARSER_H
+#define MP3PARSER_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+#define ID3V2_HEADER_SIZE 10
+#define ID3V1_TAG_SIZE 128
+#define MP3_SYNC_SEARCH_LIMIT 4096  // Bytes searched for the first frame after the tag
+#define MP3_SYNC_CHECK_FRAMES 3     // Consecutive matching headers that confirm a sync word
+#define MP3_DECODER_DELAY 529       // Samples of delay added by the synthesis filterbank
+#define MP3_TOC_SIZE 100            // Seek points in a Xing table of contents, one per percent
+
+// Metadata flags
+#define METADATA_HAS_TAGS 0x01      // Title/artist/album came from ID3 tags
+#define METADATA_VBR      0x02      // Duration came from a Xing/VBRI header
+#define METADATA_TRACK_GAIN 0x04    // track_gain is set, from tags, the LAME header or the loudness pass
+#define METADATA_ALBUM_GAIN 0x08    // album_gain is set
+#define METADATA_ANALYSED   0x10    // The loudness pass has been over this track, whatever it found
+
+// Fixed-size metadata record, stored per track next to the track index
+struct __attribute__((packed)) TrackMetadata {
+    char title[48];
+    char artist[32];
+    char album[32];
+    uint32_t duration_ms;
+    uint16_t track_number;
+    uint16_t flags;
+    uint16_t bitrate_kbps;  // Average bitrate
+    int16_t track_gain;     // ReplayGain in 1/100 dB
+    int16_t album_gain;
+    uint16_t track_peak;    // Largest sample, 32768 = full scale; 0 if unknown
+};
+
+// Decoded MPEG audio frame header
+struct Mp3FrameHeader {
+    uint8_t version;           // 1 = MPEG-1, 2 = MPEG-2, 3 = MPEG-2.5
+    uint8_t layer;
+    uint8_t channels;
+    uint16_t bitrate_kbps;
+    uint32_t sample_rate;
+    uint16_t samples_per_frame;
+    uint16_t frame_length;     // Bytes, including the header
+};
+
+// Where the audio is in a file and how long it plays
+struct Mp3StreamInfo {
+    uint32_t audio_start;      // First byte after the ID3v2 tag
+    uint32_t audio_end;        // First byte of a trailing ID3v1 tag, or the file size
+    uint32_t first_frame;      // Offset of the first frame header
+    uint32_t frame_count;      // From a Xing/VBRI header, 0 if unknown
+    uint32_t duration_ms;
+    uint16_t encoder_delay;    // Samples of silence the encoder added in front, from a LAME tag
+    uint16_t encoder_padding;  // Samples it added at the end to fill the last frame
+    bool has_info_frame;       // The first frame is a Xing/Info/VBRI header, not audio
+    bool has_gapless_info;     // encoder_delay and encoder_padding are valid
+    uint32_t stream_bytes;     // Audio bytes from the first frame, from the header when it has them
+    uint32_t vbri_offset;      // Offset of a VBRI header, 0 if none
+    bool has_lame_track_gain;  // ReplayGain LAME stored in its tag, in 1/100 dB
+    bool has_lame_album_gain;
+    int16_t lame_track_gain;
+    int16_t lame_album_gain;
+    bool has_toc;
+    uint8_t toc[MP3_TOC_SIZE]; // Byte position at each percent of the duration, in 1/256 of stream_bytes
+    Mp3FrameHeader header;     // Header of the first frame
+};
+
+class Mp3Parser {
+public:
+    // Reads tags and stream information. The file position is left undefined.
+    static bool readMetadata(File& file, TrackMetadata& metadata);
+
+    // Locates the audio data and computes the duration without decoding
+    static bool readStreamInfo(File& file, Mp3StreamInfo& info);
+
+    // Size of the ID3v2 tag at the given offset (header, extended header, footer and
+    // padding included), 0 if none
+    static uint32_t readId3v2Size(File& file, uint32_t offset = 0);
+
+    // Fills info.toc from a VBRI table, which takes more reads than the rest of the
+    // header and so is only done when a file is opened for playback
+    static bool readVbriToc(File& file, Mp3StreamInfo& info);
+
+    static bool parseFrameHeader(const uint8_t* data, Mp3FrameHeader& header);
+
+private:
+    static void readId3v2Tags(File& file, TrackMetadata& metadata);
+    static void readId3v1Tags(File& file, TrackMetadata& metadata);
+    static void readVbrHeader(const uint8_t* frame, size_t len, Mp3StreamInfo& info);
+    static bool checkFrameChain(File& file, uint32_t pos, uint32_t end, const Mp3FrameHeader& first);
+    static void copyTextFrame(const uint8_t* data, size_t len, char* out, size_t out_size);
+};
+
+#endif
@@ -2,6 +2,8 @@
 #include "PlaylistManager.h"
 #include "AudioProcessor.h"
 #include "BluetoothManager.h"
+#include "settings.h"
+#include <math.h>
 
 // Global objects defined in main.cpp
 extern PlaylistManager playlist_manager;
@@ -11,31 +13,95 @@ extern BluetoothManager bluetooth_manager;
 MusicPlayer::MusicPlayer() :
     current_state(PlayerState::STOPPED),
     current_track_index(-1),
+    queued_track_index(-1),
     current_track_name("None"),
-    is_busy(false) {
+    is_busy(false),
+    player_task(nullptr),
+    reported_drops(0),
+    skip_target(-1),
+    skip_deadline(0),
+    shuffle_enabled(false),
+    resume_pending(false),
+    resume_position_ms(0),
+    resume_path_hash(0) {
+    memset(&current_track_metadata, 0, sizeof(current_track_metadata));
+    // Sized once so track changes overwrite the name in place instead of reallocating it
+    current_track_name.reserve(MUSIC_PLAYER_NAME_RESERVE);
+    info_mutex = xSemaphoreCreateMutex();
 }
 
-void MusicPlayer::addStateChangeCallback(StateChangeCallback callback) {
-    state_callbacks.push_back(callback);
+bool MusicPlayer::begin() {
+    if (player_task) return true;
+    if (xTaskCreatePinnedToCore(playerTask, "Player", PLAYER_TASK_STACK, this,
+                                PLAYER_TASK_PRIORITY, &player_task, PLAYER_TASK_CORE) != pdPASS) {
+        Serial.println("Failed to start player task");
+        player_task = nullptr;
+        return false;
+    }
+    return true;
 }
 
-void MusicPlayer::addLogCallback(LogCallback callback) {
-    log_callbacks.push_back(callback);
+void MusicPlayer::setResumePoint(int track_index, uint32_t position_ms, uint32_t path_hash) {
+    resume_path_hash = path_hash;
+    track_index = findResumeTrack(track_index);
+    if (track_index < 0) return;
+    current_track_index = track_index;
+    showTrackInfo(track_index);
+    resume_position_ms = position_ms;
+    resume_pending = true;
 }
 
-bool MusicPlayer::executeCommand(PlayerCommand cmd, int parameter) {
-    if (is_busy) return false; // Don't accept commands while busy
+void MusicPlayer::restoreShuffle(bool enabled, uint32_t seed) {
+    shuffle.setSeed(seed);
+    shuffle_enabled = enabled;
+}
 
+bool MusicPlayer::postCommand(PlayerCommand cmd, int parameter) {
+    if (!commands.push({cmd, parameter})) return false;
+    TaskHandle_t task = player_task;
+    if (task) xTaskNotifyGive(task);
+    return true;
+}
+
+// The only task that changes tracks, so file opens never overlap
+void MusicPlayer::playerTask(void* parameter) {
+    MusicPlayer* self = (MusicPlayer*)parameter;
+    for (;;) {
+        // Drains before the first wait too: commands posted before the task existed
+        // came with no notification
+        PlayerMessage message;
+        while (self->commands.pop(message)) {
+            self->executeCommand(message.command, message.parameter);
+        }
+        uint32_t drops = self->commands.getDroppedCount();
+        if (drops != self->reported_drops) {
+            Serial.printf("Player: %u commands dropped, queue full\n", (unsigned)(drops - self->reported_drops));
+            self->reported_drops = drops;
+        }
+
+        // Open a coalesced skip once the buttons have been quiet long enough
+        TickType_t wait = portMAX_DELAY;
+        if (self->skip_target >= 0) {
+            int32_t remaining = (int32_t)(self->skip_deadline - millis());
+            if (remaining <= 0) {
+                self->finishSkip();
+                continue;
+            }
+            wait = pdMS_TO_TICKS(remaining) + 1;
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+bool MusicPlayer::executeCommand(PlayerCommand cmd, int parameter) {
     switch (cmd) {
         case PlayerCommand::PLAY:
             if (current_state == PlayerState::PAUSED) {
                 current_state = PlayerState::PLAYING;
-                logMessage("Resumed");
                 notifyStateChange();
                 return true;
             } else if (current_track_index >= 0) {
                 current_state = PlayerState::PLAYING;
-                logMessage("Playing");
                 notifyStateChange();
                 return true;
             }
@@ -44,7 +110,6 @@ bool MusicPlayer::executeCommand(PlayerCommand cmd, int parameter) {
         case PlayerCommand::PAUSE:
             if (current_state == PlayerState::PLAYING) {
                 current_state = PlayerState::PAUSED;
-                logMessage("Paused");
                 notifyStateChange();
                 return true;
             }
@@ -52,16 +117,15 @@ bool MusicPlayer::executeCommand(PlayerCommand cmd, int parameter) {
             
         case PlayerCommand::STOP:
             current_state = PlayerState::STOPPED;
-            logMessage("Stopped");
             notifyStateChange();
             return true;
             
         case PlayerCommand::NEXT_TRACK:
-            nextTrack();
+            skipTrack(1);
             return true;
             
         case PlayerCommand::PREV_TRACK:
-            prevTrack();
+            skipTrack(-1);
             return true;
             
         case PlayerCommand::PLAY_TRACK:
@@ -76,25 +140,99 @@ bool MusicPlayer::executeCommand(PlayerCommand cmd, int parameter) {
         case PlayerCommand::VOLUME_DOWN:
             bluetooth_manager.volumeDown();
             return true;
+
+        case PlayerCommand::SEEK:
+            if (skip_target >= 0) finishSkip();  // The position is within the track being skipped to
+            if (current_track_index >= 0 && parameter >= 0 && audio_processor.seek(parameter)) {
+                publish(PlayerEventType::SEEKED, current_track_index, parameter);
+                return true;
+            }
+            return false;
+
+        case PlayerCommand::TRACK_FINISHED:
+            notifyTrackFinished();
+            return true;
+        case PlayerCommand::QUEUE_NEXT_TRACK:
+            // Whatever follows the current track no longer matters while a skip is pending
+            if (skip_target < 0) queueNextTrack();
+            return true;
+        case PlayerCommand::TRACK_ADVANCED:
+            notifyTrackAdvanced();
+            return true;
+        case PlayerCommand::CONNECTION_CHANGED:
+            notifyConnectionStateChanged(parameter != 0);
+            return true;
+
+        case PlayerCommand::SHUFFLE:
+            // Reshuffling only takes a new key. A track already queued still plays next;
+            // the order applies from there on.
+            if (parameter != 0) shuffle.setSeed(esp_random());
+            shuffle_enabled = parameter != 0;
+            notifyStateChange();
+            return true;
     }
     return false;
 }
 
+int MusicPlayer::followingTrack(int index, int direction) {
+    int count = playlist_manager.getTrackCount();
+    if (count == 0) return -1;
+    if (shuffle_enabled) {
+        if (index < 0 || index >= count) return shuffle.trackAt(0, count);
+        return shuffle.step(index, direction, count);
+    }
+    return ((index + direction) % count + count) % count;
+}
+
 void MusicPlayer::nextTrack() {
-    if (playlist_manager.getTrackCount() == 0) return;
-    
-    int next_index = (current_track_index + 1) % playlist_manager.getTrackCount();
-    openTrack(next_index);
+    int next_index = followingTrack(current_track_index, 1);
+    if (next_index >= 0) openTrack(next_index);
 }
 
-void MusicPlayer::prevTrack() {
-    if (playlist_manager.getTrackCount() == 0) return;
-    
-    int prev_index = (current_track_index - 1 + playlist_manager.getTrackCount()) % playlist_manager.getTrackCount();
-    openTrack(prev_index);
+// Moves the pending target without opening anything; only its name is loaded, so a
+// burst of skips costs one open once input settles
+void MusicPlayer::skipTrack(int direction) {
+    int target = followingTrack((skip_target >= 0) ? skip_target : current_track_index, direction);
+    if (target < 0) return;
+
+    skip_target = target;
+    skip_deadline = millis() + PLAYER_SKIP_SETTLE_MS;
+    showTrackInfo(skip_target);
+    notifyStateChange();
+}
+
+void MusicPlayer::finishSkip() {
+    int target = skip_target;
+    if (target >= 0 && !openTrack(target)) {
+        // Keep showing what is actually playing
+        if (current_track_index >= 0) showTrackInfo(current_track_index);
+        notifyStateChange();
+    }
 }
 
-bool MusicPlayer::openTrack(int index) {
+// The saved index first; the whole list only if a rescan renumbered it
+int MusicPlayer::findResumeTrack(int index) const {
+    if (resume_path_hash == 0) return -1;
+    if (playlist_manager.getTrackPathHash(index) == resume_path_hash) return index;
+    return playlist_manager.findTrackByPathHash(resume_path_hash);
+}
+
+void MusicPlayer::resumeTrack() {
+    uint32_t position_ms = resume_position_ms;
+    // The background rescan may have finished since setup and moved the file
+    int index = findResumeTrack(current_track_index);
+    if (index < 0) {
+        openTrack(0);
+        return;
+    }
+    if (openTrack(index, position_ms) && position_ms > 0) {
+        publish(PlayerEventType::SEEKED, index, position_ms);
+    }
+}
+
+bool MusicPlayer::openTrack(int index, uint32_t position_ms) {
+    skip_target = -1;  // Any open replaces a pending skip or resume
+    resume_pending = false;
     setBusy(true);
 
     if (!playlist_manager.isValidIndex(index)) {
@@ -102,54 +240,134 @@ bool MusicPlayer::openTrack(int index) {
         return false;
     }
 
-    String track_path = playlist_manager.getTrackPath(index);
-    if (!audio_processor.openFile(track_path)) {
-        logMessage("Failed to open: " + track_path);
+    char track_path[PLAYLIST_MAX_PATH];
+    if (!playlist_manager.getTrackPath(index, track_path, sizeof(track_path)) ||
+        !audio_processor.openFile(track_path, trackGain(index), position_ms)) {
+        publish(PlayerEventType::TRACK_OPEN_FAILED, index);
         setBusy(false);
         return false;
     }
 
-    current_track_index = index;
-    current_track_name = playlist_manager.getTrackName(index);  // Cache nome
+    queued_track_index = -1;  // Opening a file drops anything queued behind the old one
+    loadTrackInfo(index);
     current_state = PlayerState::PLAYING;
-
-    logMessage("Playing: " + current_track_name);
     notifyStateChange();
 
     setBusy(false);
     return true;
 }
 
-void MusicPlayer::notifyStateChange() {
-    String track_name = getCurrentTrackName();
-    for (auto& callback : state_callbacks) {
-        callback(current_state, current_track_index, track_name);
+void MusicPlayer::loadTrackInfo(int index) {
+    current_track_index = index;
+    showTrackInfo(index);
+    publish(PlayerEventType::TRACK_STARTED, index);
+}
+
+void MusicPlayer::showTrackInfo(int index) {
+    // Read from the SD card first, so the UI never waits on it for the lock
+    TrackMetadata metadata;
+    if (!playlist_manager.getTrackMetadata(index, metadata)) {
+        memset(&metadata, 0, sizeof(metadata));
+    }
+    // Cache nome: tag title if present, file name otherwise
+    char name[256];
+    const char* track_name = metadata.title;
+    if (!metadata.title[0]) {
+        track_name = playlist_manager.getTrackName(index, name, sizeof(name)) ? name : "Invalid";
     }
+
+    xSemaphoreTake(info_mutex, portMAX_DELAY);
+    current_track_metadata = metadata;
+    current_track_name = track_name;
+    xSemaphoreGive(info_mutex);
 }
 
-void MusicPlayer::logMessage(const String& message) {
-    for (auto& callback : log_callbacks) {
-        callback(message);
+int32_t MusicPlayer::trackGain(int index) const {
+    if (!REPLAYGAIN_ENABLED) return 0;
+
+    TrackMetadata metadata;
+    if (!playlist_manager.getTrackMetadata(index, metadata)) return REPLAYGAIN_MISSING_DB * 100;
+    bool album = REPLAYGAIN_PREFER_ALBUM && (metadata.flags & METADATA_ALBUM_GAIN);
+    int32_t gain;
+    if (album) {
+        gain = metadata.album_gain;
+    } else if (metadata.flags & METADATA_TRACK_GAIN) {
+        gain = metadata.track_gain;
+    } else {
+        return REPLAYGAIN_MISSING_DB * 100;
+    }
+    gain += REPLAYGAIN_PREAMP_DB * 100;
+
+    // No more gain than the peak allows, so the limiter rarely acts. Only the track peak
+    // is stored, which would vary an album's gain from track to track.
+    if (!album && metadata.track_peak > 0) {
+        gain = min(gain, (int32_t)lroundf(-2000.0f * log10f(metadata.track_peak / 32768.0f)));
     }
+    return gain;
+}
+
+void MusicPlayer::queueNextTrack() {
+    if (current_track_index < 0) return;
+    int next_index = followingTrack(current_track_index, 1);
+    if (next_index < 0) return;
+
+    // Not busy: the callback keeps playing the current track while the next one opens
+    char track_path[PLAYLIST_MAX_PATH];
+    if (playlist_manager.getTrackPath(next_index, track_path, sizeof(track_path)) &&
+        audio_processor.queueFile(track_path, trackGain(next_index))) {
+        queued_track_index = next_index;
+    }
+}
+
+void MusicPlayer::notifyTrackAdvanced() {
+    if (queued_track_index < 0) return;
+    if (skip_target >= 0) {
+        // Queued before the skip started: the screen keeps showing the target
+        current_track_index = queued_track_index;
+        queued_track_index = -1;
+        return;
+    }
+
+    loadTrackInfo(queued_track_index);
+    queued_track_index = -1;
+    notifyStateChange();
+}
+
+void MusicPlayer::notifyStateChange() {
+    // Subscribers see the track on screen, which leads the one playing during a skip
+    publish(PlayerEventType::STATE_CHANGED, (skip_target >= 0) ? skip_target : current_track_index);
+}
+
+void MusicPlayer::publish(PlayerEventType type, int32_t track_index, int32_t value) {
+    PlayerEvent event = {type, current_state, track_index, value};
+    events.publish(event);
 }
 
 void MusicPlayer::notifyTrackFinished() {
-    if (is_busy) return;
-    logMessage("Track finished");
-    nextTrack();
+    // A command queued ahead of this one may already have started another track
+    if (skip_target >= 0) {
+        finishSkip();  // Nothing left to play while waiting for input to settle
+    } else if (audio_processor.isFinished()) {
+        publish(PlayerEventType::TRACK_FINISHED, current_track_index);
+        nextTrack();
+    }
+    // Cleared only now, so callbacks that ran dry while the next file opened cannot skip it too
+    bluetooth_manager.consumeTrackFinishedEvent();
 }
 
 void MusicPlayer::notifyConnectionStateChanged(bool connected) {
     if (connected) {
-        logMessage("Bluetooth connected");
-        if (playlist_manager.getTrackCount() > 0 && current_track_index == -1) {
+        publish(PlayerEventType::CONNECTION_CHANGED, current_track_index, 1);
+        if (resume_pending) {
+            resumeTrack();
+        } else if (playlist_manager.getTrackCount() > 0 && current_track_index == -1) {
             openTrack(0);
         }else{
             current_state = PlayerState::PLAYING;
             notifyStateChange();
         }
     } else {
-        logMessage("Bluetooth disconnected");
+        publish(PlayerEventType::CONNECTION_CHANGED, current_track_index, 0);
         current_state = PlayerState::STOPPED;
         notifyStateChange();
     }
@@ -159,6 +377,21 @@ int MusicPlayer::getTrackCount() const {
     return playlist_manager.getTrackCount();
 }
 
+uint32_t MusicPlayer::getPositionMs() const {
+    if (resume_pending) return resume_position_ms;
+    // While a skip is pending the screen shows the target, which has not started
+    return (current_track_index >= 0 && skip_target < 0) ? audio_processor.getPositionMs() : 0;
+}
+
 String MusicPlayer::getCurrentTrackName() const {
-    return current_track_name;  // Ritorna cache, nessuna lettura SD
+    xSemaphoreTake(info_mutex, portMAX_DELAY);
+    String name = current_track_name;  // Ritorna cache, nessuna lettura SD
+    xSemaphoreGive(info_mutex);
+    return name;
+}
+
+void MusicPlayer::getCurrentTrackMetadata(TrackMetadata& metadata) const {
+    xSemaphoreTake(info_mutex, portMAX_DELAY);
+    metadata = current_track_metadata;
+    xSemaphoreGive(info_mutex);
 }
\ No newline at end of file
@@ -2,66 +2,87 @@
 #define MUSICPLAYER_H
 
 #include <Arduino.h>
-#include <vector>
+#include "Mp3Parser.h"
+#include "PlayerCommandQueue.h"
+#include "PlayerEventBus.h"
+#include "TrackShuffle.h"
 
-enum class PlayerState {
-    STOPPED,
-    PLAYING,
-    PAUSED
-};
-
-enum class PlayerCommand {
-    PLAY,
-    PAUSE,
-    STOP,
-    NEXT_TRACK,
-    PREV_TRACK,
-    PLAY_TRACK,
-    VOLUME_UP,
-    VOLUME_DOWN
-};
-
-// Callback to notify state changes
-typedef std::function<void(PlayerState state, int track_index, const String& track_name)> StateChangeCallback;
-typedef std::function<void(const String& message)> LogCallback;
+#define MUSIC_PLAYER_NAME_RESERVE 128  // Bytes kept for the current track name
+#define PLAYER_TASK_STACK 8192
+#define PLAYER_TASK_PRIORITY 1         // Same as the UI loop, below decoding
+#define PLAYER_TASK_CORE 1
 
 class MusicPlayer {
 private:
-    PlayerState current_state;
-    int current_track_index;
+    volatile PlayerState current_state;
+    volatile int current_track_index;
+    int queued_track_index;  // Pre-opened to follow the current track, -1 if none
     String current_track_name;  // Cache del nome traccia corrente
-    std::vector<StateChangeCallback> state_callbacks;
-    std::vector<LogCallback> log_callbacks;
-    volatile bool is_busy; // Concurrency flag
+    TrackMetadata current_track_metadata;
+    SemaphoreHandle_t info_mutex;  // Guards the name and metadata, read by the UI while the player task writes them
+    PlayerEventBus events;
+    volatile bool is_busy; // Opening a file: the audio callback plays silence
+    PlayerCommandQueue commands;
+    TaskHandle_t player_task;
+    uint32_t reported_drops;
+    volatile int skip_target;  // Track that Next/Prev presses add up to, -1 if none pending
+    uint32_t skip_deadline;    // millis() at which it is opened, pushed back by every press
+    TrackShuffle shuffle;
+    volatile bool shuffle_enabled;
+    volatile bool resume_pending;  // Restored track waits for a connection to open
+    uint32_t resume_position_ms;
+    uint32_t resume_path_hash;  // The restored file, found again if a rescan renumbered it
     
 public:
     MusicPlayer();
+
+    bool begin();  // Starts the player task; commands posted earlier wait for it
+
+    // State restored after a reboot; call before begin(). The track opens at the position
+    // once a device connects, decoding from there rather than from the start. The path
+    // hash names the file, so a rescan that moves it in the list is followed.
+    void setResumePoint(int track_index, uint32_t position_ms, uint32_t path_hash);
+    void restoreShuffle(bool enabled, uint32_t seed);
     
-    // Callback management
-    void addStateChangeCallback(StateChangeCallback callback);
-    void addLogCallback(LogCallback callback);
+    // Events are published on the player task; subscribe during setup
+    bool subscribe(PlayerEventHandler handler, void* context = nullptr) { return events.subscribe(handler, context); }
     
-    // Main controls
-    bool executeCommand(PlayerCommand cmd, int parameter = -1);
+    // Main controls. Buttons, AVRC, A2DP and the audio pipeline all post here; the player
+    // task runs the commands one at a time in order. Never blocks or allocates, so it is
+    // safe from Bluetooth callbacks. False if the queue is full.
+    bool postCommand(PlayerCommand cmd, int parameter = -1);
     
     // Player status
     PlayerState getState() const { return current_state; }
     int getCurrentTrackIndex() const { return current_track_index; }
+    uint32_t getPositionMs() const;
     int getTrackCount() const;
     String getCurrentTrackName() const;
+    void getCurrentTrackMetadata(TrackMetadata& metadata) const;
     bool isBusy() const { return is_busy; }
+    bool isShuffleEnabled() const { return shuffle_enabled; }
+    uint32_t getShuffleSeed() const { return shuffle.getSeed(); }
     
-    // For internal use (calls from A2DP callbacks)
+private:
+    static void playerTask(void* parameter);
+    bool executeCommand(PlayerCommand cmd, int parameter);
     void notifyTrackFinished();
+    void queueNextTrack();       // Pre-open the following track for gapless playback
+    void notifyTrackAdvanced();  // The queued track has started playing
     void notifyConnectionStateChanged(bool connected);
-    
-private:
     void setBusy(bool busy_state) { is_busy = busy_state; }
     void notifyStateChange();
-    void logMessage(const String& message);
-    bool openTrack(int index);
+    void publish(PlayerEventType type, int32_t track_index, int32_t value = 0);
+    bool openTrack(int index, uint32_t position_ms = 0);
+    void loadTrackInfo(int index);
+    void showTrackInfo(int index);  // Name and metadata the UI shows
+    int32_t trackGain(int index) const;  // ReplayGain to play a track with, 1/100 dB
+    int followingTrack(int index, int direction);  // Next or previous in play order, -1 if no tracks
     void nextTrack();
-    void prevTrack();
+    int findResumeTrack(int index) const;  // Where the restored file is now, -1 if it is gone
+    void resumeTrack();
+    void skipTrack(int direction);
+    void finishSkip();
 };
 
 #endif
@@ -0,0 +1,154 @@
+#include "PcmNormalizer.h"
+#include <math.h>
+
+#define RESAMPLER_PHASE_BITS 7          // log2(PCM_RESAMPLER_PHASES)
+#define RESAMPLER_PASSBAND 0.9f         // Fraction of the lower Nyquist frequency kept
+#define RESAMPLER_KAISER_BETA 8.5f
+
+// One row per phase, plus a last row so every phase has a neighbour to interpolate with.
+// Coefficients are Q15 and each row sums to 1.
+static int16_t filter[PCM_RESAMPLER_PHASES + 1][PCM_RESAMPLER_TAPS];
+// Deinterleaved input: the history kept from the previous call followed by the new frames
+static int16_t work[PCM_OUTPUT_CHANNELS][PCM_RESAMPLER_TAPS + PCM_NORMALIZER_MAX_INPUT];
+
+static float besselI0(float x) {
+    float sum = 1.0f, term = 1.0f;
+    for (int k = 1; k < 20; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static inline int32_t dotProduct(const int16_t* samples, const int16_t* coefficients) {
+    int32_t acc = 0;
+    for (int k = 0; k < PCM_RESAMPLER_TAPS; k++) {
+        acc += (int32_t)samples[k] * coefficients[k];
+    }
+    return acc;
+}
+
+PcmNormalizer::PcmNormalizer() :
+    sample_rate(PCM_OUTPUT_SAMPLE_RATE), channels(PCM_OUTPUT_CHANNELS),
+    step(1ULL << 32), position(0), history(0) {
+}
+
+void PcmNormalizer::configure(uint32_t rate, uint8_t channel_count) {
+    if (rate == 0 || channel_count == 0) return;
+    if (rate == sample_rate && channel_count == channels) return;
+
+    sample_rate = rate;
+    channels = min(channel_count, (uint8_t)PCM_OUTPUT_CHANNELS);
+    step = ((uint64_t)sample_rate << 32) / PCM_OUTPUT_SAMPLE_RATE;
+    if (isResampling()) {
+        buildFilter();
+    }
+    reset();
+    Serial.printf("PCM normalizer: %u Hz %s -> %u Hz stereo\n", sample_rate,
+                  channels == 1 ? "mono" : "stereo", PCM_OUTPUT_SAMPLE_RATE);
+}
+
+void PcmNormalizer::reset() {
+    // Half a filter of silence, so output time 0 is centred on the first input sample
+    history = PCM_RESAMPLER_TAPS / 2 - 1;
+    position = 0;
+    memset(work, 0, sizeof(work));
+}
+
+// Kaiser-windowed sinc low-pass, cut below whichever Nyquist frequency is lower
+void PcmNormalizer::buildFilter() {
+    float cutoff = 0.5f * RESAMPLER_PASSBAND * min(1.0f, (float)PCM_OUTPUT_SAMPLE_RATE / sample_rate);
+    float window_scale = 1.0f / besselI0(RESAMPLER_KAISER_BETA);
+    const float half = PCM_RESAMPLER_TAPS / 2;
+
+    for (int p = 0; p <= PCM_RESAMPLER_PHASES; p++) {
+        float taps[PCM_RESAMPLER_TAPS];
+        float sum = 0;
+        for (int k = 0; k < PCM_RESAMPLER_TAPS; k++) {
+            float x = half - 1 + (float)p / PCM_RESAMPLER_PHASES - k;
+            float t = x / half;
+            float window = (t * t < 1.0f) ? besselI0(RESAMPLER_KAISER_BETA * sqrtf(1.0f - t * t)) * window_scale : 0;
+            float arg = 2 * cutoff * x;
+            float sinc = (fabsf(arg) < 1e-6f) ? 1.0f : sinf(PI * arg) / (PI * arg);
+            taps[k] = 2 * cutoff * sinc * window;
+            sum += taps[k];
+        }
+
+        // Unity gain at DC; rounding error goes to the largest tap
+        int32_t total = 0;
+        int largest = 0;
+        for (int k = 0; k < PCM_RESAMPLER_TAPS; k++) {
+            filter[p][k] = (int16_t)lroundf(taps[k] / sum * 32768.0f);
+            total += filter[p][k];
+            if (abs(filter[p][k]) > abs(filter[p][largest])) largest = k;
+        }
+        filter[p][largest] += 32768 - total;
+    }
+}
+
+size_t PcmNormalizer::maxOutputFrames(size_t in_frames) const {
+    if (!isResampling()) return in_frames;
+    return (uint64_t)(in_frames + PCM_RESAMPLER_TAPS) * PCM_OUTPUT_SAMPLE_RATE / sample_rate + 1;
+}
+
+size_t PcmNormalizer::maxInputFrames(size_t out_frames) const {
+    if (!isResampling()) return min(out_frames, (size_t)PCM_NORMALIZER_MAX_INPUT);
+    if (out_frames < 1) return 0;
+    uint64_t frames = (uint64_t)(out_frames - 1) * sample_rate / PCM_OUTPUT_SAMPLE_RATE;
+    if (frames <= PCM_RESAMPLER_TAPS) return 0;
+    return min((size_t)(frames - PCM_RESAMPLER_TAPS), (size_t)PCM_NORMALIZER_MAX_INPUT);
+}
+
+size_t PcmNormalizer::process(const int16_t* in, size_t in_frames, int16_t* out) {
+    in_frames = min(in_frames, (size_t)PCM_NORMALIZER_MAX_INPUT);
+
+    if (!isResampling()) {
+        if (channels == PCM_OUTPUT_CHANNELS) {
+            memmove(out, in, in_frames * PCM_OUTPUT_CHANNELS * sizeof(int16_t));
+        } else {
+            for (size_t i = 0; i < in_frames; i++) {
+                out[2 * i] = out[2 * i + 1] = in[i];
+            }
+        }
+        return in_frames;
+    }
+
+    // Append the new frames to the history, one row per channel
+    for (size_t i = 0; i < in_frames; i++) {
+        for (uint8_t c = 0; c < channels; c++) {
+            work[c][history + i] = in[i * channels + c];
+        }
+    }
+    size_t available = history + in_frames;
+
+    // Each output sample is the filter phase nearest its time, blended with the next one
+    size_t produced = 0;
+    size_t n = position >> 32;
+    while (n + PCM_RESAMPLER_TAPS <= available) {
+        uint32_t fraction = (uint32_t)position;
+        uint32_t phase = fraction >> (32 - RESAMPLER_PHASE_BITS);
+        int32_t blend = (fraction << RESAMPLER_PHASE_BITS) >> 16;  // Position between phases, Q16
+
+        for (uint8_t c = 0; c < channels; c++) {
+            int32_t a = dotProduct(&work[c][n], filter[phase]);
+            int32_t b = dotProduct(&work[c][n], filter[phase + 1]);
+            int32_t value = a + (int32_t)(((int64_t)(b - a) * blend) >> 16);
+            value = (value + (1 << 14)) >> 15;
+            out[2 * produced + c] = (int16_t)constrain(value, -32768, 32767);
+        }
+        if (channels == 1) {
+            out[2 * produced + 1] = out[2 * produced];
+        }
+        produced++;
+        position += step;
+        n = position >> 32;
+    }
+
+    // Keep what the next call still needs
+    history = available - n;
+    for (uint8_t c = 0; c < channels; c++) {
+        memmove(work[c], &work[c][n], history * sizeof(int16_t));
+    }
+    position -= (uint64_t)n << 32;
+    return produced;
+}
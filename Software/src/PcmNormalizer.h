@@ -0,0 +1,44 @@
+#ifndef PCMNORMALIZER_H
+#define PCMNORMALIZER_H
+
+#include <Arduino.h>
+
+#define PCM_OUTPUT_SAMPLE_RATE 44100   // What the A2DP stream is configured for
+#define PCM_OUTPUT_CHANNELS 2
+#define PCM_RESAMPLER_TAPS 32          // Filter length in input samples
+#define PCM_RESAMPLER_PHASES 128       // Filter phases per input sample, interpolated in between
+#define PCM_NORMALIZER_MAX_INPUT 512   // Input frames per call
+
+// Converts decoded 16-bit PCM of any rate and channel count to 44.1 kHz interleaved
+// stereo. Rates other than 44.1 kHz go through a fixed-point polyphase FIR resampler;
+// mono is duplicated to both channels. Not thread-safe: the decode task owns it.
+class PcmNormalizer {
+public:
+    PcmNormalizer();
+
+    // Keeps the filter history when the format is unchanged, so gapless tracks join cleanly
+    void configure(uint32_t sample_rate, uint8_t channels);
+    void reset();  // Forget the history, e.g. after a seek
+
+    // Converts up to PCM_NORMALIZER_MAX_INPUT interleaved input frames. out must hold
+    // maxOutputFrames(in_frames) stereo frames. Returns the stereo frames written.
+    size_t process(const int16_t* in, size_t in_frames, int16_t* out);
+    size_t maxOutputFrames(size_t in_frames) const;
+    size_t maxInputFrames(size_t out_frames) const;  // Largest input whose output fits
+
+    uint32_t getSampleRate() const { return sample_rate; }
+    uint8_t getChannels() const { return channels; }
+    bool isResampling() const { return sample_rate != PCM_OUTPUT_SAMPLE_RATE; }
+    bool isPassthrough() const { return !isResampling() && channels == PCM_OUTPUT_CHANNELS; }
+
+private:
+    uint32_t sample_rate;
+    uint8_t channels;
+    uint64_t step;      // Input samples per output sample, 32.32 fixed point
+    uint64_t position;  // Next output time, relative to the first frame of history
+    size_t history;     // Input frames kept from the previous call
+
+    void buildFilter();
+};
+
+#endif
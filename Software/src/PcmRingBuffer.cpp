@@ -0,0 +1,57 @@
+#include "PcmRingBuffer.h"
+
+PcmRingBuffer::PcmRingBuffer(uint8_t* storage, size_t size) :
+    storage(storage), capacity(size), write_count(0), read_count(0) {
+}
+
+size_t PcmRingBuffer::space() const {
+    return capacity - (write_count.load(std::memory_order_relaxed) - read_count.load(std::memory_order_acquire));
+}
+
+size_t PcmRingBuffer::available() const {
+    return write_count.load(std::memory_order_acquire) - read_count.load(std::memory_order_relaxed);
+}
+
+size_t PcmRingBuffer::write(const uint8_t* data, size_t len) {
+    uint32_t head = write_count.load(std::memory_order_relaxed);
+    len = min(len, space());
+
+    // Copy in up to two pieces when the data wraps around the end
+    size_t start = head & (capacity - 1);
+    size_t first = min(len, capacity - start);
+    memcpy(storage + start, data, first);
+    memcpy(storage, data + first, len - first);
+
+    // Publish only once the bytes are in place
+    write_count.store(head + len, std::memory_order_release);
+    return len;
+}
+
+uint8_t* PcmRingBuffer::writeBuffer(size_t& contiguous) {
+    size_t start = write_count.load(std::memory_order_relaxed) & (capacity - 1);
+    contiguous = min(space(), capacity - start);
+    return storage + start;
+}
+
+void PcmRingBuffer::commit(size_t len) {
+    uint32_t head = write_count.load(std::memory_order_relaxed);
+    write_count.store(head + min(len, space()), std::memory_order_release);
+}
+
+size_t PcmRingBuffer::read(uint8_t* data, size_t len) {
+    uint32_t tail = read_count.load(std::memory_order_relaxed);
+    len = min(len, available());
+
+    size_t start = tail & (capacity - 1);
+    size_t first = min(len, capacity - start);
+    memcpy(data, storage + start, first);
+    memcpy(data + first, storage, len - first);
+
+    // Hand the space back only once the bytes are copied out
+    read_count.store(tail + len, std::memory_order_release);
+    return len;
+}
+
+void PcmRingBuffer::discard() {
+    read_count.store(write_count.load(std::memory_order_acquire), std::memory_order_release);
+}
@@ -0,0 +1,37 @@
+#ifndef PCMRINGBUFFER_H
+#define PCMRINGBUFFER_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Single-producer/single-consumer byte ring for decoded PCM. The producer only moves
+// the write counter and the consumer only moves the read counter, so neither side
+// ever waits on a lock. Counters run freely; the size must be a power of two.
+class PcmRingBuffer {
+public:
+    PcmRingBuffer(uint8_t* storage, size_t size);
+
+    // Producer side
+    size_t write(const uint8_t* data, size_t len);  // Bytes written, up to the free space
+    size_t space() const;
+    // Zero-copy writes: fill the free space at the write position, then publish it
+    uint8_t* writeBuffer(size_t& contiguous);       // contiguous: free bytes before the wrap
+    void commit(size_t len);
+
+    // Consumer side
+    size_t read(uint8_t* data, size_t len);         // Bytes read, up to what is buffered
+    size_t available() const;
+    void discard();                                 // Drop everything buffered so far
+
+    size_t size() const { return capacity; }
+    uint32_t getWriteCount() const { return write_count.load(std::memory_order_acquire); }  // Bytes ever written
+    uint32_t getReadCount() const { return read_count.load(std::memory_order_acquire); }    // Bytes ever read
+
+private:
+    uint8_t* storage;
+    size_t capacity;
+    std::atomic<uint32_t> write_count;
+    std::atomic<uint32_t> read_count;
+};
+
+#endif
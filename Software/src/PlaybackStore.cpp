@@ -0,0 +1,67 @@
+#include "PlaybackStore.h"
+#include "esp_system.h"
+
+PlaybackStore* PlaybackStore::instance = nullptr;
+
+PlaybackStore::PlaybackStore() : started(false), loaded(false), dirty(false), last_write_ms(0), flush_requested(false) {
+    memset(&saved, 0, sizeof(saved));
+    saved.version = PLAYBACK_STATE_VERSION;
+    saved.volume = 64;
+    saved.track_index = -1;
+    current = saved;
+}
+
+bool PlaybackStore::begin() {
+    if (!preferences.begin(PLAYBACK_NVS_NAMESPACE, false)) {
+        Serial.println("Failed to open the playback state in NVS");
+        return false;
+    }
+    started = true;
+
+    PlaybackState state;
+    if (preferences.getBytes(PLAYBACK_NVS_KEY, &state, sizeof(state)) == sizeof(state) &&
+        state.version == PLAYBACK_STATE_VERSION) {
+        saved = state;
+        loaded = true;
+        Serial.printf("Playback state: track %d at %u ms, volume %u\n",
+                      (int)saved.track_index, (unsigned)saved.position_ms, saved.volume);
+    }
+    current = saved;
+    last_write_ms = millis();
+
+    // esp_restart() runs this before rebooting, so a software restart loses nothing
+    instance = this;
+    esp_register_shutdown_handler(shutdownHandler);
+    return true;
+}
+
+void PlaybackStore::update(const PlaybackState& state) {
+    PlaybackState next = state;
+    next.version = PLAYBACK_STATE_VERSION;
+    if (memcmp(&next, &current, sizeof(next)) != 0) {
+        current = next;
+        dirty = true;
+    }
+}
+
+void PlaybackStore::service() {
+    if (flush_requested) {
+        flush_requested = false;
+        flush();
+    } else if (dirty && millis() - last_write_ms >= PLAYBACK_SAVE_INTERVAL_MS) {
+        flush();
+    }
+}
+
+void PlaybackStore::flush() {
+    if (!started || !dirty) return;
+    if (preferences.putBytes(PLAYBACK_NVS_KEY, &current, sizeof(current)) != sizeof(current)) {
+        Serial.println("Failed to save the playback state");
+    }
+    dirty = false;
+    last_write_ms = millis();
+}
+
+void PlaybackStore::shutdownHandler() {
+    if (instance) instance->flush();
+}
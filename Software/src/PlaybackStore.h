@@ -0,0 +1,54 @@
+#ifndef PLAYBACKSTORE_H
+#define PLAYBACKSTORE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+#define PLAYBACK_NVS_NAMESPACE "playback"
+#define PLAYBACK_NVS_KEY "state"
+#define PLAYBACK_STATE_VERSION 1
+#define PLAYBACK_SAVE_INTERVAL_MS 15000  // Fewest ms between NVS writes; the position changes constantly
+
+// What the player needs to carry on after a reboot
+struct PlaybackState {
+    uint8_t version;
+    uint8_t volume;          // 0-127
+    uint8_t shuffle;         // Play mode: 1 shuffled
+    uint8_t eq_preset;
+    int32_t track_index;     // -1 if none
+    uint32_t track_path_hash;  // The index is only trusted if the file behind it matches
+    uint32_t position_ms;
+    uint32_t shuffle_seed;   // The shuffled order survives too
+};
+
+// Keeps the playback state in NVS. Updates only mark a copy in RAM dirty; it is written
+// at most once per interval, and right away when a flush is requested (pause, stop,
+// disconnection, restart), so flash wear stays low and the main loop rarely waits on it.
+class PlaybackStore {
+public:
+    PlaybackStore();
+
+    bool begin();  // Loads the saved state, defaults if there is none
+    bool hasSavedState() const { return loaded; }
+    const PlaybackState& getSaved() const { return saved; }  // As found at boot
+
+    void update(const PlaybackState& state);  // Marks the state dirty if anything changed
+    void requestFlush() { flush_requested = true; }  // Safe from any task; written on the next service()
+    void service();  // Main loop: writes the state once it is due
+    void flush();    // Writes now if dirty
+
+private:
+    Preferences preferences;
+    PlaybackState saved;    // Loaded at boot
+    PlaybackState current;  // Latest state, written when due
+    bool started;
+    bool loaded;
+    bool dirty;
+    uint32_t last_write_ms;
+    volatile bool flush_requested;
+
+    static PlaybackStore* instance;  // For the shutdown handler
+    static void shutdownHandler();
+};
+
+#endif
@@ -0,0 +1,42 @@
+#include "PlayerCommandQueue.h"
+
+#define PLAYER_COMMAND_QUEUE_MASK (PLAYER_COMMAND_QUEUE_SIZE - 1)
+
+PlayerCommandQueue::PlayerCommandQueue() : write_position(0), read_position(0), dropped(0) {
+    for (uint32_t i = 0; i < PLAYER_COMMAND_QUEUE_SIZE; i++) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool PlayerCommandQueue::push(const PlayerMessage& message) {
+    uint32_t position = write_position.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots[position & PLAYER_COMMAND_QUEUE_MASK];
+        int32_t lag = (int32_t)(slot->sequence.load(std::memory_order_acquire) - position);
+        if (lag == 0) {
+            // Free: claim it, or retry from wherever the winning producer left the counter
+            if (write_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        } else if (lag < 0) {
+            // Still holds a command from one lap ago
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            position = write_position.load(std::memory_order_relaxed);
+        }
+    }
+    slot->message = message;
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool PlayerCommandQueue::pop(PlayerMessage& message) {
+    Slot& slot = slots[read_position & PLAYER_COMMAND_QUEUE_MASK];
+    // A producer that claimed this slot but has not filled it yet holds back the ones after it
+    if (slot.sequence.load(std::memory_order_acquire) != read_position + 1) return false;
+    message = slot.message;
+    // Free the slot for the producer one lap ahead
+    slot.sequence.store(read_position + PLAYER_COMMAND_QUEUE_SIZE, std::memory_order_release);
+    read_position++;
+    return true;
+}
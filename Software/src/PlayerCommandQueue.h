@@ -0,0 +1,56 @@
+#ifndef PLAYERCOMMANDQUEUE_H
+#define PLAYERCOMMANDQUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#define PLAYER_COMMAND_QUEUE_SIZE 16  // Commands waiting for the player task (power of two)
+
+enum class PlayerCommand : uint8_t {
+    PLAY,
+    PAUSE,
+    STOP,
+    NEXT_TRACK,
+    PREV_TRACK,
+    PLAY_TRACK,
+    VOLUME_UP,
+    VOLUME_DOWN,
+    SEEK,               // Parameter: position in ms
+    TRACK_FINISHED,     // The audio callback drained the last track
+    QUEUE_NEXT_TRACK,   // The decoder wants the next file for gapless playback
+    TRACK_ADVANCED,     // The queued file has started playing
+    CONNECTION_CHANGED, // Parameter: 1 connected, 0 disconnected
+    SHUFFLE             // Parameter: 1 on with a fresh order, 0 off
+};
+
+struct PlayerMessage {
+    PlayerCommand command;
+    int32_t parameter;
+};
+
+// Bounded multi-producer/single-consumer queue of player commands. Each slot carries a
+// sequence number: producers claim a slot with one compare-and-swap on the write counter
+// and publish it by bumping the slot's sequence, so posting never blocks, never
+// allocates and is safe from any task. Only the player task pops.
+class PlayerCommandQueue {
+public:
+    PlayerCommandQueue();
+
+    bool push(const PlayerMessage& message);  // False when full; the command is dropped
+    bool pop(PlayerMessage& message);         // Consumer only. False when nothing is published yet
+
+    uint32_t getDroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> sequence;  // Equals the position when free, position + 1 once filled
+        PlayerMessage message;
+    };
+
+    Slot slots[PLAYER_COMMAND_QUEUE_SIZE];
+    std::atomic<uint32_t> write_position;
+    uint32_t read_position;
+    std::atomic<uint32_t> dropped;
+};
+
+#endif
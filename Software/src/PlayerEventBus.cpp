@@ -0,0 +1,45 @@
+#include "PlayerEventBus.h"
+
+PlayerEventBus::PlayerEventBus() : subscriber_count(0) {
+}
+
+bool PlayerEventBus::subscribe(PlayerEventHandler handler, void* context) {
+    if (!handler || subscriber_count >= PLAYER_EVENT_MAX_SUBSCRIBERS) return false;
+    subscribers[subscriber_count++] = {handler, context};
+    return true;
+}
+
+void PlayerEventBus::publish(const PlayerEvent& event) const {
+    for (uint8_t i = 0; i < subscriber_count; i++) {
+        subscribers[i].handler(event, subscribers[i].context);
+    }
+}
+
+#define PLAYER_EVENT_QUEUE_MASK (PLAYER_EVENT_QUEUE_SIZE - 1)
+
+PlayerEventQueue::PlayerEventQueue() : write_position(0), read_position(0), dropped(0) {
+}
+
+bool PlayerEventQueue::push(const PlayerEvent& event) {
+    uint32_t position = write_position.load(std::memory_order_relaxed);
+    if (position - read_position.load(std::memory_order_acquire) >= PLAYER_EVENT_QUEUE_SIZE) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    events[position & PLAYER_EVENT_QUEUE_MASK] = event;
+    write_position.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool PlayerEventQueue::pop(PlayerEvent& event) {
+    uint32_t position = read_position.load(std::memory_order_relaxed);
+    if (position == write_position.load(std::memory_order_acquire)) return false;
+    event = events[position & PLAYER_EVENT_QUEUE_MASK];
+    // Hands the slot back to the producer
+    read_position.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+void PlayerEventQueue::handler(const PlayerEvent& event, void* context) {
+    ((PlayerEventQueue*)context)->push(event);
+}
@@ -0,0 +1,76 @@
+#ifndef PLAYEREVENTBUS_H
+#define PLAYEREVENTBUS_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#define PLAYER_EVENT_MAX_SUBSCRIBERS 4
+#define PLAYER_EVENT_QUEUE_SIZE 16  // Events waiting for a slower consumer (power of two)
+
+enum class PlayerState : uint8_t {
+    STOPPED,
+    PLAYING,
+    PAUSED
+};
+
+enum class PlayerEventType : uint8_t {
+    STATE_CHANGED,       // State or shown track changed
+    TRACK_STARTED,       // track_index began playing
+    TRACK_OPEN_FAILED,   // track_index could not be opened
+    TRACK_FINISHED,      // Played to the end; the next one follows
+    SEEKED,              // value: position in ms
+    CONNECTION_CHANGED   // value: 1 connected, 0 disconnected
+};
+
+// Plain data, copied by value: formatting is up to whoever receives it
+struct PlayerEvent {
+    PlayerEventType type;
+    PlayerState state;
+    int32_t track_index;  // Track shown on screen, -1 if none
+    int32_t value;
+};
+
+typedef void (*PlayerEventHandler)(const PlayerEvent& event, void* context);
+
+// Fixed list of subscribers called in order, on the publishing task. Subscribe at startup,
+// before events flow: the list is not guarded. Publishing touches no heap.
+class PlayerEventBus {
+public:
+    PlayerEventBus();
+
+    bool subscribe(PlayerEventHandler handler, void* context = nullptr);  // False when full
+    void publish(const PlayerEvent& event) const;
+
+private:
+    struct Subscriber {
+        PlayerEventHandler handler;
+        void* context;
+    };
+
+    Subscriber subscribers[PLAYER_EVENT_MAX_SUBSCRIBERS];
+    uint8_t subscriber_count;
+};
+
+// Bounded single-producer/single-consumer queue of events, for subscribers whose work
+// (Serial output, SD reads) must not hold up the publishing task: the handler pushes,
+// another task pops and does the slow part. Never blocks and never allocates.
+class PlayerEventQueue {
+public:
+    PlayerEventQueue();
+
+    bool push(const PlayerEvent& event);  // Producer only. False when full; the event is dropped
+    bool pop(PlayerEvent& event);         // Consumer only. False when empty
+
+    uint32_t getDroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+    // A PlayerEventHandler that pushes into the queue given as the context
+    static void handler(const PlayerEvent& event, void* context);
+
+private:
+    PlayerEvent events[PLAYER_EVENT_QUEUE_SIZE];
+    std::atomic<uint32_t> write_position;
+    std::atomic<uint32_t> read_position;
+    std::atomic<uint32_t> dropped;
+};
+
+#endif
@@ -1,41 +1,448 @@
 #include "PlaylistManager.h"
+#include "LoudnessAnalyzer.h"
+
+// Scoped lock for the shared index read handles
+class IndexLock {
+public:
+    explicit IndexLock(SemaphoreHandle_t mutex) : mutex(mutex) { xSemaphoreTakeRecursive(mutex, portMAX_DELAY); }
+    ~IndexLock() { xSemaphoreGiveRecursive(mutex); }
+private:
+    SemaphoreHandle_t mutex;
+};
+
+// FNV-1a, used for directory path hashes and listing fingerprints
+static uint32_t fnv1a(const char* data, size_t len, uint32_t hash = 2166136261u) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Sorting happens once per scan, in the scan task; the buffer is never needed twice at once
+static uint8_t sort_buffer[PLAYLIST_SORT_BUFFER_SIZE];
+static uint8_t cache_storage[PLAYLIST_CACHE_SIZE];
+// Only the scan task runs loudness passes; its decoder is allocated once and reused
+static LoudnessAnalyzer analyzer;
+
+static int compareBrowseKeys(const void* a, const void* b) {
+    const BrowseKey* key_a = (const BrowseKey*)a;
+    const BrowseKey* key_b = (const BrowseKey*)b;
+    int result = strncasecmp(key_a->artist, key_b->artist, sizeof(key_a->artist));
+    if (result == 0) result = strncasecmp(key_a->album, key_b->album, sizeof(key_a->album));
+    if (result == 0) result = (int)key_a->track_number - (int)key_b->track_number;
+    if (result == 0) result = (key_a->track > key_b->track) - (key_a->track < key_b->track);
+    return result;
+}
+
+// Natural order: case-insensitive, with digit runs compared by value so "2 - x" comes
+// before "10 - x". A string marked as cut continues past len; if the result depends on
+// the missing part, undecided is set and 0 returned.
+static int naturalCompare(const char* a, size_t a_len, bool a_cut,
+                          const char* b, size_t b_len, bool b_cut, bool& undecided) {
+    size_t i = 0, j = 0;
+    while (i < a_len && j < b_len) {
+        if (isdigit((uint8_t)a[i]) && isdigit((uint8_t)b[j])) {
+            while (i < a_len && a[i] == '0') i++;
+            while (j < b_len && b[j] == '0') j++;
+            size_t a_end = i, b_end = j;
+            while (a_end < a_len && isdigit((uint8_t)a[a_end])) a_end++;
+            while (b_end < b_len && isdigit((uint8_t)b[b_end])) b_end++;
+            if ((a_end == a_len && a_cut) || (b_end == b_len && b_cut)) {
+                undecided = true;
+                return 0;
+            }
+            // More significant digits is a bigger number; equal lengths compare digit by digit
+            if (a_end - i != b_end - j) return (a_end - i < b_end - j) ? -1 : 1;
+            int result = strncmp(a + i, b + j, a_end - i);
+            if (result != 0) return result;
+            i = a_end;
+            j = b_end;
+            continue;
+        }
+
+        // '/' sorts first so a folder's subfolders come before its siblings ("A/x" < "A b")
+        int ca = (a[i] == '/') ? 1 : tolower((uint8_t)a[i]);
+        int cb = (b[j] == '/') ? 1 : tolower((uint8_t)b[j]);
+        if (ca != cb) return ca - cb;
+        i++;
+        j++;
+    }
+
+    if ((i == a_len && a_cut) || (j == b_len && b_cut)) {
+        undecided = true;
+        return 0;
+    }
+    if (i < a_len || j < b_len) return (i < a_len) ? 1 : -1;
+
+    // Naturally equal but spelled differently ("01" and "1"): fall back to the bytes
+    size_t len = min(a_len, b_len);
+    int result = memcmp(a, b, len);
+    if (result == 0 && a_len != b_len) result = (a_len < b_len) ? -1 : 1;
+    return result;
+}
+
+// Compares two relative paths folder first, then file name. The name starts right after
+// the folder; avail is how much of the path is in memory.
+static int comparePaths(const char* a, size_t a_dir, size_t a_length, size_t a_avail,
+                        const char* b, size_t b_dir, size_t b_length, size_t b_avail, bool& undecided) {
+    int result = naturalCompare(a, min(a_dir, a_avail), a_dir > a_avail,
+                                b, min(b_dir, b_avail), b_dir > b_avail, undecided);
+    if (result != 0 || undecided) return result;
+
+    size_t a_start = min(a_dir > 0 ? a_dir + 1 : 0, a_avail);
+    size_t b_start = min(b_dir > 0 ? b_dir + 1 : 0, b_avail);
+    return naturalCompare(a + a_start, a_avail - a_start, a_length > a_avail,
+                          b + b_start, b_avail - b_start, b_length > b_avail, undecided);
+}
+
+// Heap handle used to build sort keys and settle ties between long paths while sorting
+static File sort_heap_reader;
+
+static size_t sortPathLength(const TrackSortKey& key) {
+    return (key.dir_length > 0 ? key.dir_length + 1 : 0) + key.record.name_length;
+}
+
+// Reassembles "folder/name" from the heap, returns its length (0 on failure)
+static size_t readSortPath(const TrackSortKey& key, char* buffer, size_t buffer_size) {
+    size_t len = sortPathLength(key);
+    size_t name_start = len - key.record.name_length;
+    if (len > buffer_size) return 0;
+    if (key.dir_length > 0) {
+        if (!sort_heap_reader.seek(key.dir_offset) ||
+            sort_heap_reader.read((uint8_t*)buffer, key.dir_length) != key.dir_length) {
+            return 0;
+        }
+        buffer[key.dir_length] = '/';
+    }
+    if (!sort_heap_reader.seek(key.record.name_offset) ||
+        sort_heap_reader.read((uint8_t*)buffer + name_start, key.record.name_length) != key.record.name_length) {
+        return 0;
+    }
+    return len;
+}
+
+static int compareTrackKeys(const void* a, const void* b) {
+    const TrackSortKey* key_a = (const TrackSortKey*)a;
+    const TrackSortKey* key_b = (const TrackSortKey*)b;
+    size_t a_length = sortPathLength(*key_a);
+    size_t b_length = sortPathLength(*key_b);
+    bool undecided = false;
+    int result = comparePaths(key_a->prefix, key_a->dir_length, a_length, min(a_length, sizeof(key_a->prefix)),
+                              key_b->prefix, key_b->dir_length, b_length, min(b_length, sizeof(key_b->prefix)),
+                              undecided);
+    if (undecided) {
+        // Rare: both paths share the whole prefix, so compare them in full
+        static char path_a[512];
+        static char path_b[512];
+        undecided = false;
+        result = 0;
+        if (readSortPath(*key_a, path_a, sizeof(path_a)) && readSortPath(*key_b, path_b, sizeof(path_b))) {
+            result = comparePaths(path_a, key_a->dir_length, a_length, a_length,
+                                  path_b, key_b->dir_length, b_length, b_length, undecided);
+        }
+    }
+    if (result == 0) result = (key_a->track > key_b->track) - (key_a->track < key_b->track);
+    return result;
+}
+
+static bool copyFile(const char* from, const char* to) {
+    File in = SD.open(from, FILE_READ);
+    File out = SD.open(to, FILE_WRITE);
+    bool ok = in && out;
+    uint8_t buffer[256];
+    while (ok) {
+        size_t len = in.read(buffer, sizeof(buffer));
+        if (len == 0) break;
+        ok = out.write(buffer, len) == len;
+    }
+    if (in) in.close();
+    if (out) out.close();
+    return ok;
+}
+
+// Lowercases ASCII and maps accented Latin-1 letters (two-byte UTF-8, C3 xx) to their
+// base letter, so "Beyoncé" is found by "beyonce". Returns the folded length.
+static size_t foldName(const char* in, size_t len, char* out) {
+    static const char latin1[] = "aaaaaaaceeeeiiiidnooooox0uuuuytsaaaaaaaceeeeiiiidnooooo/ouuuuyty";
+    size_t out_len = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = in[i];
+        if (c == 0xC3 && i + 1 < len && (uint8_t)in[i + 1] >= 0x80 && (uint8_t)in[i + 1] <= 0xBF) {
+            out[out_len++] = latin1[(uint8_t)in[++i] - 0x80];
+        } else {
+            out[out_len++] = tolower(c);
+        }
+    }
+    return out_len;
+}
+
+// Name column blocks are read into a static buffer: only the UI loop searches
+static uint8_t search_block[PLAYLIST_SEARCH_BLOCK_SIZE];
+
+static char jumpLabel(char c) {
+    if (isalpha((uint8_t)c)) return toupper((uint8_t)c);
+    return isdigit((uint8_t)c) ? '#' : '*';
+}
+
+static void copyBrowseName(char* out, size_t out_size, const char* name, const char* fallback) {
+    snprintf(out, out_size, "%s", name[0] != '\0' ? name : fallback);
+}
+
+static bool fingerprintMatches(const DirRecord& record, const DirFingerprint& fingerprint) {
+    return record.entry_count == fingerprint.entry_count &&
+           record.names_hash == fingerprint.names_hash &&
+           record.size_sum == fingerprint.size_sum &&
+           record.last_write == fingerprint.last_write;
+}
 
 PlaylistManager::PlaylistManager(const String& root) :
-    music_root(root), track_count(0),
-    current_chunk_index(0), tracks_in_current_chunk(0) {
+    music_root(root), track_count(0), scan_track_count(0),
+    scan_depth(0), scanning(false), scan_incremental(false), publish_partial(false),
+    scan_start_time(0), scan_task(nullptr),
+    heap_size(0), heap_live_bytes(0), full_path_bytes(0), completed_track_count(0), dir_count(0),
+    artist_count(0), album_count(0), index_generation(1), jump_count(0),
+    reuse_old_index(false), build_failed(false), tracks_sorted(false),
+    old_dir_count(0), old_dir_cursor(0),
+    dirs_reused(0), dirs_rescanned(0),
+    active_index_path(PLAYLIST_INDEX_FILE), active_meta_path(PLAYLIST_META_FILE), active_dirs_path(PLAYLIST_DIRS_FILE),
+    active_heap_path(PLAYLIST_NAMES_FILE), build_heap_path(PLAYLIST_NAMES_FILE),
+    block_cache(cache_storage, sizeof(cache_storage), loadCacheBlock, this),
+    names_window_start(-1), prefetch_start(0), prefetch_count(0),
+    search_offset(0), search_track(0), search_line_matched(false), search_done(true),
+    search_state(0), search_query_len(0), search_generation(0), search_start_time(0) {
     if (!music_root.endsWith("/")) {
         music_root += "/";
     }
     path_buffer[0] = '\0';
+    search_query[0] = '\0';
+    index_mutex = xSemaphoreCreateRecursiveMutex();
 }
 
-String PlaylistManager::getChunkFilePath(int chunk_index) const {
-    char buffer[32];
-    snprintf(buffer, sizeof(buffer), "%s/all.%04d", PLAYLIST_DIR, chunk_index);
-    return String(buffer);
+void PlaylistManager::deleteOldIndexFiles(bool with_heap) {
+    SD.remove(PLAYLIST_INDEX_FILE);
+    if (with_heap) SD.remove(PLAYLIST_NAMES_FILE);
+    SD.remove(PLAYLIST_DIRS_FILE);
+    SD.remove(PLAYLIST_META_FILE);
+    SD.remove(PLAYLIST_ARTISTS_FILE);
+    SD.remove(PLAYLIST_ALBUMS_FILE);
+    SD.remove(PLAYLIST_ALBUM_TRACKS_FILE);
+    SD.remove(PLAYLIST_JUMPS_FILE);
+    SD.remove(PLAYLIST_SEARCH_FILE);
+
+    // Remove chunk files left over from the old text index format
+    char legacy_path[32];
+    for (int chunk = 0; ; chunk++) {
+        snprintf(legacy_path, sizeof(legacy_path), "%s/all.%04d", PLAYLIST_DIR, chunk);
+        if (!SD.exists(legacy_path)) break;
+        SD.remove(legacy_path);
+    }
 }
 
-void PlaylistManager::deleteOldIndexFiles() {
-    // Delete all chunk files
-    int chunk = 0;
-    while (true) {
-        String path = getChunkFilePath(chunk);
-        if (!SD.exists(path.c_str())) break;
-        SD.remove(path.c_str());
-        chunk++;
+bool PlaylistManager::begin() {
+    // An existing index is usable straight away; checking it against the card happens
+    // in the background along with any rescan it needs
+    bool loaded = loadIndex();
+    if (!loaded) {
+        Serial.println("No valid index found, scanning...");
     }
+    return startScanTask(loaded);
 }
 
 bool PlaylistManager::scanForMP3Files() {
-    track_count = 0;
+    return startScanTask(false);
+}
+
+bool PlaylistManager::updateIndex() {
+    return startScanTask(true);
+}
+
+bool PlaylistManager::startScanTask(bool incremental) {
+    IndexLock lock(index_mutex);
+    if (scanning) return false;
+
+    scanning = true;
+    scan_incremental = incremental;
+    if (scan_task) return true;  // In the loudness pass, which stops and runs the scan
+    if (xTaskCreatePinnedToCore(scanTask, "playlist_scan", PLAYLIST_SCAN_TASK_STACK, this,
+                                PLAYLIST_SCAN_TASK_PRIORITY, &scan_task, PLAYLIST_SCAN_TASK_CORE) != pdPASS) {
+        Serial.println("Failed to start playlist scan task");
+        scanning = false;
+        return false;
+    }
+    return true;
+}
+
+bool PlaylistManager::isIdle() const {
+    IndexLock lock(index_mutex);
+    return scan_task == nullptr;  // Cleared under the lock as the task ends
+}
+
+void PlaylistManager::scanTask(void* parameter) {
+    PlaylistManager* self = static_cast<PlaylistManager*>(parameter);
+    for (;;) {
+        self->runScan(self->scan_incremental);
+        self->scanning = false;
+
+        // Then measure the tracks that came without ReplayGain, until a new scan is asked for
+        self->runLoudnessPass();
+        IndexLock lock(self->index_mutex);
+        if (!self->scanning) {
+            self->scan_task = nullptr;
+            break;
+        }
+    }
+    vTaskDelete(nullptr);
+}
+
+// Decodes every track that has neither a ReplayGain tag nor an earlier measurement and
+// stores its gain in the metadata record. Runs at the lowest priority and stops as soon
+// as a scan is requested; the tracks it did not reach are picked up next time.
+void PlaylistManager::runLoudnessPass() {
+    unsigned long start_time = millis();
+    uint32_t measured = 0;
+    uint32_t failed = 0;
+    for (int index = 0; index < (int)track_count && !scanning; index++) {
+        TrackMetadata metadata;
+        if (!getTrackMetadata(index, metadata) || (metadata.flags & (METADATA_TRACK_GAIN | METADATA_ANALYSED))) {
+            continue;
+        }
+        char path[PLAYLIST_MAX_PATH];
+        if (!getTrackPath(index, path, sizeof(path))) continue;
+
+        if (measured + failed == 0) {
+            if (!analyzer.begin()) {
+                Serial.println("Loudness pass: no memory for a decoder");
+                return;
+            }
+            vTaskPrioritySet(nullptr, PLAYLIST_LOUDNESS_TASK_PRIORITY);
+        }
+        int16_t gain;
+        uint16_t peak;
+        bool ok = analyzer.analyze(path, gain, peak, &scanning);
+        if (scanning) break;  // Cut short; the track is measured again next time
+
+        // Unreadable tracks are marked too, so they are not decoded on every pass
+        metadata.flags |= METADATA_ANALYSED;
+        if (ok) {
+            metadata.track_gain = gain;
+            metadata.track_peak = peak;
+            metadata.flags |= METADATA_TRACK_GAIN;
+            measured++;
+        } else {
+            failed++;
+        }
+        if (!writeTrackMetadata(index, metadata)) break;
+    }
+    vTaskPrioritySet(nullptr, PLAYLIST_SCAN_TASK_PRIORITY);
+
+    if (measured + failed > 0) {
+        Serial.printf("Loudness pass: %u tracks measured, %u unreadable, in %lu s\n",
+                      measured, failed, (millis() - start_time) / 1000);
+    }
+}
+
+// Rewrites one metadata record in place
+bool PlaylistManager::writeTrackMetadata(int index, const TrackMetadata& metadata) {
+    IndexLock lock(index_mutex);
+    if (!isValidIndex(index)) return false;
+    closeReaders();  // Reopen on next lookup so the cache sees the new record
+    File meta = SD.open(active_meta_path, "r+");
+    bool ok = meta && meta.seek(index * sizeof(TrackMetadata)) &&
+              meta.write((const uint8_t*)&metadata, sizeof(metadata)) == sizeof(metadata);
+    if (meta) meta.close();
+    return ok;
+}
+
+void PlaylistManager::runScan(bool incremental) {
+    if (incremental && isIndexCurrent()) {
+        Serial.println("Index is up to date");
+        return;
+    }
+    if (incremental) {
+        Serial.println("Card contents changed, updating index...");
+    }
+
+    bool needs_build = true;
+    while (needs_build) {
+        if (!startBuild(incremental)) return;
+
+        // Hold the index lock for one slice at a time so lookups from the UI and the
+        // player are never blocked for long
+        bool more = true;
+        while (more) {
+            {
+                IndexLock lock(index_mutex);
+                unsigned long slice_start = millis();
+                while (more && millis() - slice_start < PLAYLIST_SCAN_SLICE_MS) {
+                    more = stepBuild();
+                }
+                if (publish_partial) {
+                    index_writer.flush();
+                    heap_writer.flush();
+                    meta_writer.flush();
+                    dirs_writer.flush();
+                    closeReaders();  // Reopen on next lookup so no stale sectors are cached
+                    track_count = completed_track_count;  // Paths need the directory record
+                }
+            }
+            vTaskDelay(1);
+        }
+
+        // Sorting works on the finished tmp files. This takes a while on big libraries,
+        // so lookups keep using the current index meanwhile.
+        closeBuild();
+        tracks_sorted = !build_failed && sortTracks();
+        if (!build_failed && !tracks_sorted) {
+            Serial.println("Failed to sort playlist, keeping scan order");
+        }
+        if (!build_failed && !buildBrowseIndex(tracks_sorted ? PLAYLIST_META_SORTED : PLAYLIST_META_TMP)) {
+            Serial.println("Failed to build browse index");
+        }
+        if (!build_failed && !buildSearchColumn(tracks_sorted ? PLAYLIST_INDEX_SORTED : PLAYLIST_INDEX_TMP)) {
+            Serial.println("Failed to build search index");
+        }
+
+        needs_build = !finishBuild();
+        incremental = false;  // A failed update or an overgrown heap falls back to a full rebuild
+    }
+}
+
+bool PlaylistManager::startBuild(bool incremental) {
+    IndexLock lock(index_mutex);
+    scan_start_time = millis();
 
     // Create playlist directory if it doesn't exist
     if (!SD.exists(PLAYLIST_DIR)) {
         SD.mkdir(PLAYLIST_DIR);
     }
 
-    // Delete old index files
-    deleteOldIndexFiles();
+    // The new index is built next to the current one, which stays in use until
+    // finishBuild() swaps them. An update also reads it to carry unchanged directories
+    // over; a full rebuild writes a fresh heap as well.
+    bool has_index = track_count > 0 && openReaders() && openDirsReader();
+    reuse_old_index = incremental && has_index;
+    build_heap_path = reuse_old_index ? PLAYLIST_NAMES_FILE : PLAYLIST_NAMES_TMP;
+    old_dir_count = 0;
+    old_dir_cursor = 0;
+    if (reuse_old_index) {
+        PlaylistDirsHeader old_header;
+        dirs_reader.seek(0);
+        if (dirs_reader.read((uint8_t*)&old_header, sizeof(old_header)) == sizeof(old_header)) {
+            old_dir_count = old_header.dir_count;
+        }
+    } else if (!has_index) {
+        closeReaders();
+        track_count = 0;
+        artist_count = 0;
+        album_count = 0;
+        jump_count = 0;
+        index_generation++;
+    }
+    SD.remove(PLAYLIST_INDEX_TMP);
+    SD.remove(PLAYLIST_DIRS_TMP);
+    SD.remove(PLAYLIST_META_TMP);
+    SD.remove(PLAYLIST_NAMES_TMP);
 
     File root = SD.open(music_root);
     if (!root || !root.isDirectory()) {
@@ -43,181 +450,927 @@ bool PlaylistManager::scanForMP3Files() {
         return false;
     }
 
-    // Initialize first chunk file
-    current_chunk_index = 0;
-    tracks_in_current_chunk = 0;
-    current_chunk_file = SD.open(getChunkFilePath(0).c_str(), FILE_WRITE);
-    if (!current_chunk_file) {
-        Serial.println("Failed to create chunk file");
+    index_writer = SD.open(PLAYLIST_INDEX_TMP, FILE_WRITE);
+    dirs_writer = SD.open(PLAYLIST_DIRS_TMP, FILE_WRITE);
+    heap_writer = SD.open(build_heap_path, reuse_old_index ? FILE_APPEND : FILE_WRITE);
+    meta_writer = SD.open(PLAYLIST_META_TMP, FILE_WRITE);
+    if (!index_writer || !dirs_writer || !heap_writer || !meta_writer) {
+        Serial.println("Failed to create index files");
+        abortBuild();
         root.close();
         return false;
     }
 
-    Serial.println("Scanning for MP3 files...");
-    scanDirectory(root, 0);
-    root.close();
+    // Placeholder headers: an interrupted build leaves files that loadIndex() rejects
+    PlaylistIndexHeader header = {};
+    PlaylistDirsHeader dirs_header = {};
+    index_writer.write((const uint8_t*)&header, sizeof(header));
+    dirs_writer.write((const uint8_t*)&dirs_header, sizeof(dirs_header));
+
+    scan_track_count = 0;
+    heap_size = heap_writer.size();
+    heap_live_bytes = 0;
+    full_path_bytes = 0;
+    completed_track_count = 0;
+    dir_count = 0;
+    dirs_reused = 0;
+    dirs_rescanned = 0;
+    build_failed = false;
+    tracks_sorted = false;
+    scan_depth = 0;
 
-    // Close last chunk file
-    if (current_chunk_file) {
-        current_chunk_file.close();
+    // Without an old index there is nothing better to show, so lookups read the new one
+    publish_partial = !has_index;
+    if (publish_partial) {
+        active_index_path = PLAYLIST_INDEX_TMP;
+        active_meta_path = PLAYLIST_META_TMP;
+        active_dirs_path = PLAYLIST_DIRS_TMP;
+        active_heap_path = build_heap_path;
     }
 
-    Serial.printf("Found %d MP3 files, %d chunk files created\n",
-                  track_count, current_chunk_index + 1);
-    return track_count > 0;
+    Serial.println(reuse_old_index ? "Checking for changed directories..." : "Scanning for MP3 files...");
+    path_buffer[0] = '\0';
+    pushDirectory(root, 0);
+    return true;
 }
 
-void PlaylistManager::scanDirectory(File dir, size_t base_len) {
-    while (true) {
-        File entry = dir.openNextFile();
-        if (!entry) break;
+void PlaylistManager::abortBuild() {
+    while (scan_depth > 0) {
+        scan_stack[--scan_depth].dir.close();
+    }
+    if (index_writer) index_writer.close();
+    if (dirs_writer) dirs_writer.close();
+    if (heap_writer) heap_writer.close();
+    if (meta_writer) meta_writer.close();
+}
 
-        const char* entry_name = entry.name();
-        size_t name_len = strlen(entry_name);
+bool PlaylistManager::pushDirectory(File dir, size_t base_len) {
+    if (scan_depth >= PLAYLIST_SCAN_MAX_DEPTH) {
+        Serial.printf("Skipping folder nested too deep: %s\n", path_buffer);
+        dir.close();
+        return false;
+    }
 
-        // Build full path in path_buffer (no stack allocation)
-        size_t new_len;
-        if (base_len == 0) {
-            if (name_len < sizeof(path_buffer)) {
-                strcpy(path_buffer, entry_name);
-                new_len = name_len;
-            } else {
-                entry.close();
-                continue;
+    ScanFrame& frame = scan_stack[scan_depth++];
+    frame.dir = dir;
+    frame.base_len = base_len;
+    frame.phase = ScanPhase::FINGERPRINT;
+    memset(&frame.fingerprint, 0, sizeof(frame.fingerprint));
+    frame.fingerprint.names_hash = 2166136261u;
+    memset(&frame.record, 0, sizeof(frame.record));
+    frame.record.path_hash = fnv1a(path_buffer, base_len);
+    frame.record.path_length = base_len;
+    return true;
+}
+
+bool PlaylistManager::stepBuild() {
+    if (scan_depth == 0) return false;
+
+    ScanFrame& frame = scan_stack[scan_depth - 1];
+    File entry = frame.dir.openNextFile();
+
+    switch (frame.phase) {
+        case ScanPhase::FINGERPRINT:
+            if (entry) {
+                accumulateFingerprint(entry, frame.fingerprint);
+                break;
             }
-        } else {
-            if (base_len + 1 + name_len < sizeof(path_buffer)) {
-                path_buffer[base_len] = '/';
-                strcpy(path_buffer + base_len + 1, entry_name);
-                new_len = base_len + 1 + name_len;
-            } else {
-                entry.close();
-                continue;
+
+            // Listing complete: decide whether the old index still covers this directory
+            {
+                DirRecord& record = frame.record;
+                record.entry_count = frame.fingerprint.entry_count;
+                record.names_hash = frame.fingerprint.names_hash;
+                record.size_sum = frame.fingerprint.size_sum;
+                record.last_write = frame.fingerprint.last_write;
+                record.first_track = scan_track_count;
+
+                path_buffer[frame.base_len] = '\0';
+                DirRecord old_record;
+                if (reuse_old_index && findOldDirectory(record.path_hash, old_record) &&
+                    fingerprintMatches(old_record, frame.fingerprint)) {
+                    // Unchanged: carry its tracks over without listing the files again
+                    record.path_offset = old_record.path_offset;
+                    if (!copyOldTracks(old_record)) build_failed = true;
+                    dirs_reused++;
+                    finishDirectoryTracks(frame);
+                } else {
+                    record.path_offset = heap_size;
+                    heap_writer.write((const uint8_t*)path_buffer, frame.base_len);
+                    heap_size += frame.base_len;
+                    dirs_rescanned++;
+                    frame.phase = ScanPhase::TRACKS;
+                    frame.dir.rewindDirectory();
+                }
             }
+            break;
+
+        case ScanPhase::TRACKS:
+            if (entry) {
+                const char* entry_name = entry.name();
+                if (entry_name[0] != '.' && !entry.isDirectory() && hasMP3Extension(entry_name)) {
+                    size_t new_len = appendPath(frame.base_len, entry_name);
+                    if (new_len > 0) {
+                        addTrack(new_len, entry);
+                    }
+                }
+                break;
+            }
+            finishDirectoryTracks(frame);
+            break;
+
+        case ScanPhase::SUBDIRS:
+            if (entry) {
+                if (entry.isDirectory() && entry.name()[0] != '.') {
+                    size_t new_len = appendPath(frame.base_len, entry.name());
+                    if (new_len > 0) {
+                        pushDirectory(entry, new_len);  // Frame reference is stale past this point
+                        return true;
+                    }
+                }
+                break;
+            }
+            frame.dir.close();
+            scan_depth--;
+            break;
+    }
+
+    if (entry) entry.close();
+    return scan_depth > 0;
+}
+
+void PlaylistManager::finishDirectoryTracks(ScanFrame& frame) {
+    path_buffer[frame.base_len] = '\0';
+    heap_live_bytes += frame.base_len;
+    frame.record.track_count = scan_track_count - frame.record.first_track;
+    dirs_writer.write((const uint8_t*)&frame.record, sizeof(frame.record));
+    dir_count++;
+    completed_track_count = scan_track_count;
+
+    if (frame.fingerprint.has_subdirs) {
+        frame.phase = ScanPhase::SUBDIRS;
+        frame.dir.rewindDirectory();
+    } else {
+        frame.dir.close();
+        scan_depth--;
+    }
+}
+
+void PlaylistManager::closeBuild() {
+    IndexLock lock(index_mutex);
+
+    // Finalize headers now that the counts are known
+    PlaylistIndexHeader header;
+    header.magic = PLAYLIST_INDEX_MAGIC;
+    header.version = PLAYLIST_INDEX_VERSION;
+    header.record_size = sizeof(TrackRecord);
+    header.track_count = scan_track_count;
+    header.heap_size = heap_size;
+    index_writer.seek(0);
+    index_writer.write((const uint8_t*)&header, sizeof(header));
+
+    PlaylistDirsHeader dirs_header;
+    dirs_header.magic = PLAYLIST_DIRS_MAGIC;
+    dirs_header.version = PLAYLIST_INDEX_VERSION;
+    dirs_header.record_size = sizeof(DirRecord);
+    dirs_header.dir_count = dir_count;
+    dirs_header.track_count = scan_track_count;
+    dirs_header.card_used_kb = 0;
+    dirs_writer.seek(0);
+    dirs_writer.write((const uint8_t*)&dirs_header, sizeof(dirs_header));
+
+    abortBuild();
+    closeReaders();  // Partial lookups must not keep sectors cached from before the headers
+}
+
+bool PlaylistManager::finishBuild() {
+    {
+        IndexLock lock(index_mutex);
+        closeReaders();
+        active_index_path = PLAYLIST_INDEX_FILE;
+        active_meta_path = PLAYLIST_META_FILE;
+        active_dirs_path = PLAYLIST_DIRS_FILE;
+        active_heap_path = PLAYLIST_NAMES_FILE;
+
+        if (build_failed) {
+            SD.remove(PLAYLIST_INDEX_TMP);
+            SD.remove(PLAYLIST_DIRS_TMP);
+            SD.remove(PLAYLIST_META_TMP);
+            SD.remove(PLAYLIST_NAMES_TMP);
+            SD.remove(PLAYLIST_INDEX_SORTED);
+            SD.remove(PLAYLIST_DIRS_SORTED);
+            SD.remove(PLAYLIST_META_SORTED);
+            SD.remove(PLAYLIST_JUMPS_TMP);
+            SD.remove(PLAYLIST_SEARCH_TMP);
+            removeBrowseTmpFiles();
+            Serial.println("Index update failed, rebuilding...");
+            return false;
+        }
+
+        // Swap the new index in. Only now is the old one, and its heap after a full rebuild, removed.
+        deleteOldIndexFiles(!reuse_old_index);
+        if (!reuse_old_index) {
+            SD.rename(PLAYLIST_NAMES_TMP, PLAYLIST_NAMES_FILE);
         }
+        if (tracks_sorted) {
+            SD.rename(PLAYLIST_INDEX_SORTED, PLAYLIST_INDEX_FILE);
+            SD.rename(PLAYLIST_JUMPS_TMP, PLAYLIST_JUMPS_FILE);
+            SD.rename(PLAYLIST_DIRS_SORTED, PLAYLIST_DIRS_FILE);
+            SD.rename(PLAYLIST_META_SORTED, PLAYLIST_META_FILE);
+            SD.remove(PLAYLIST_INDEX_TMP);
+            SD.remove(PLAYLIST_DIRS_TMP);
+            SD.remove(PLAYLIST_META_TMP);
+        } else {
+            SD.rename(PLAYLIST_INDEX_TMP, PLAYLIST_INDEX_FILE);
+            SD.rename(PLAYLIST_DIRS_TMP, PLAYLIST_DIRS_FILE);
+            SD.rename(PLAYLIST_META_TMP, PLAYLIST_META_FILE);
+        }
+        SD.rename(PLAYLIST_SEARCH_TMP, PLAYLIST_SEARCH_FILE);
+        SD.rename(PLAYLIST_ARTISTS_TMP, PLAYLIST_ARTISTS_FILE);
+        SD.rename(PLAYLIST_ALBUMS_TMP, PLAYLIST_ALBUMS_FILE);
+        SD.rename(PLAYLIST_ALBUM_TRACKS_TMP, PLAYLIST_ALBUM_TRACKS_FILE);
+        track_count = scan_track_count;
+        loadBrowseIndex();
+        loadJumpTable();
+        index_generation++;
+    }
 
-        if (entry.isDirectory()) {
-            scanDirectory(entry, new_len);
-        } else if (hasMP3Extension(entry_name)) {
-            // Write track path to current chunk
-            current_chunk_file.print(music_root);
-            current_chunk_file.println(path_buffer);
-            track_count++;
-            tracks_in_current_chunk++;
-
-            // Rotate to new chunk file if current one is full
-            if (tracks_in_current_chunk >= PLAYLIST_CHUNK_SIZE) {
-                current_chunk_file.close();
-                current_chunk_index++;
-                current_chunk_file = SD.open(getChunkFilePath(current_chunk_index).c_str(), FILE_WRITE);
-                tracks_in_current_chunk = 0;
+    // The card fingerprint must be taken after the index itself has been written. Adding
+    // up a big card's used space takes a while, so lookups are not held up for it.
+    uint32_t used_kb = cardUsedKB();
+    {
+        IndexLock lock(index_mutex);
+        PlaylistDirsHeader dirs_header;
+        File dirs_file = SD.open(PLAYLIST_DIRS_FILE, "r+");
+        if (dirs_file) {
+            if (dirs_file.read((uint8_t*)&dirs_header, sizeof(dirs_header)) == sizeof(dirs_header)) {
+                dirs_header.card_used_kb = used_kb;
+                dirs_file.seek(0);
+                dirs_file.write((const uint8_t*)&dirs_header, sizeof(dirs_header));
             }
+            dirs_file.close();
         }
+    }
+
+    Serial.printf("Indexed %d MP3 files in %u directories (%u reused, %u rescanned) in %lu ms\n",
+                  track_count, dir_count, dirs_reused, dirs_rescanned, millis() - scan_start_time);
+    Serial.printf("Path storage: %u KB of names and folders, %u KB as full paths\n",
+                  heap_live_bytes / 1024, full_path_bytes / 1024);
+
+    uint32_t garbage = heap_size - heap_live_bytes;
+    if (reuse_old_index && garbage > (uint64_t)heap_size * PLAYLIST_HEAP_MAX_GARBAGE_PERCENT / 100) {
+        Serial.println("Compacting playlist index...");
+        return false;
+    }
+    return true;
+}
+
+size_t PlaylistManager::appendPath(size_t base_len, const char* name) {
+    size_t name_len = strlen(name);
+
+    // Build full path in path_buffer (no stack allocation)
+    if (base_len == 0) {
+        if (name_len >= sizeof(path_buffer)) return 0;
+        strcpy(path_buffer, name);
+        return name_len;
+    }
+    if (base_len + 1 + name_len >= sizeof(path_buffer)) return 0;
+    path_buffer[base_len] = '/';
+    strcpy(path_buffer + base_len + 1, name);
+    return base_len + 1 + name_len;
+}
+
+void PlaylistManager::accumulateFingerprint(File& entry, DirFingerprint& fingerprint) {
+    const char* entry_name = entry.name();
+    if (entry_name[0] == '.') return;  // Skip hidden entries, including the index directory
+
+    fingerprint.entry_count++;
+    fingerprint.names_hash = fnv1a(entry_name, strlen(entry_name), fingerprint.names_hash);
+    if (entry.isDirectory()) {
+        fingerprint.has_subdirs = true;
+    } else {
+        fingerprint.size_sum += entry.size();
+        fingerprint.last_write = max(fingerprint.last_write, (uint32_t)entry.getLastWrite());
+    }
+}
+
+void PlaylistManager::computeFingerprint(File& dir, DirFingerprint& fingerprint) {
+    memset(&fingerprint, 0, sizeof(fingerprint));
+    fingerprint.names_hash = 2166136261u;
+
+    while (true) {
+        File entry = dir.openNextFile();
+        if (!entry) break;
+        accumulateFingerprint(entry, fingerprint);
         entry.close();
     }
 }
 
+void PlaylistManager::addTrack(size_t path_len, File& file) {
+    // Only the file name goes to the heap: the folder path was stored with the directory.
+    // The display name is the file name without its extension.
+    const char* name_start = strrchr(path_buffer, '/');
+    name_start = name_start ? name_start + 1 : path_buffer;
+    size_t name_len = path_len - (name_start - path_buffer);
+    const char* dot = strrchr(name_start, '.');
+    size_t title_len = dot ? (dot - name_start) : name_len;
+
+    TrackRecord record;
+    record.name_offset = heap_size;
+    record.dir_index = dir_count;  // The directory's record is written once its tracks are done
+    record.name_length = name_len;
+    record.title_length = title_len;
+
+    // Tags are read while the entry is open anyway; cover art is seeked over, not read
+    // Best effort: whatever could be read is kept even if no audio frame was found
+    TrackMetadata metadata;
+    Mp3Parser::readMetadata(file, metadata);
+
+    heap_writer.write((const uint8_t*)name_start, name_len);
+    index_writer.write((const uint8_t*)&record, sizeof(record));
+    meta_writer.write((const uint8_t*)&metadata, sizeof(metadata));
+    heap_size += name_len;
+    heap_live_bytes += name_len;
+    full_path_bytes += path_len;
+    scan_track_count++;
+}
+
+bool PlaylistManager::sortTracks() {
+    unsigned long start_time = millis();
+    SD.remove(PLAYLIST_INDEX_SORTED);
+    SD.remove(PLAYLIST_DIRS_SORTED);
+    SD.remove(PLAYLIST_META_SORTED);
+    SD.remove(PLAYLIST_JUMPS_TMP);
+
+    // One key per track: its record plus the start of its path. Directory records are
+    // in the same order as the track ranges they describe, so both files read sequentially.
+    ExternalSorter sorter(sizeof(TrackSortKey), compareTrackKeys, sort_buffer, sizeof(sort_buffer));
+    File dirs = SD.open(PLAYLIST_DIRS_TMP, FILE_READ);
+    File index = SD.open(PLAYLIST_INDEX_TMP, FILE_READ);
+    sort_heap_reader = SD.open(build_heap_path, FILE_READ);
+    bool ok = dirs && index && sort_heap_reader &&
+              dirs.seek(sizeof(PlaylistDirsHeader)) && index.seek(sizeof(PlaylistIndexHeader)) &&
+              sorter.begin(PLAYLIST_SORT_RUNS_TMP, PLAYLIST_SORT_MERGE_TMP);
+    TrackSortKey key;
+    DirRecord dir;
+    char path[512];
+    for (uint32_t dir_index = 0; ok && dir_index < dir_count; dir_index++) {
+        ok = dirs.read((uint8_t*)&dir, sizeof(dir)) == sizeof(dir);
+        key.dir_offset = dir.path_offset;
+        key.dir_length = dir.path_length;
+        for (uint32_t i = 0; ok && i < dir.track_count; i++) {
+            ok = index.read((uint8_t*)&key.record, sizeof(key.record)) == sizeof(key.record);
+            size_t path_len = ok ? readSortPath(key, path, sizeof(path)) : 0;
+            ok = path_len > 0;
+            memset(key.prefix, 0, sizeof(key.prefix));
+            memcpy(key.prefix, path, min(path_len, sizeof(key.prefix)));
+            key.track = dir.first_track + i;
+            ok = ok && sorter.add(&key);
+        }
+    }
+    if (dirs) dirs.close();
+    if (index) index.close();
+    ok = ok && sorter.getRecordCount() == scan_track_count && sorter.finish(PLAYLIST_SORTED_TMP);
+
+    // Copy the directory manifest, then write the index and metadata in sorted order.
+    // A directory's tracks stay contiguous, only its first track moves.
+    File sorted = ok ? SD.open(PLAYLIST_SORTED_TMP, FILE_READ) : File();
+    File meta = ok ? SD.open(PLAYLIST_META_TMP, FILE_READ) : File();
+    File sorted_index = ok ? SD.open(PLAYLIST_INDEX_SORTED, FILE_WRITE) : File();
+    File sorted_meta = ok ? SD.open(PLAYLIST_META_SORTED, FILE_WRITE) : File();
+    ok = sorted && meta && sorted_index && sorted_meta && copyFile(PLAYLIST_DIRS_TMP, PLAYLIST_DIRS_SORTED);
+    File sorted_dirs = ok ? SD.open(PLAYLIST_DIRS_SORTED, "r+") : File();
+    File jumps = ok ? SD.open(PLAYLIST_JUMPS_TMP, FILE_WRITE) : File();
+    ok = ok && sorted_dirs && jumps;
+
+    PlaylistIndexHeader header;
+    header.magic = PLAYLIST_INDEX_MAGIC;
+    header.version = PLAYLIST_INDEX_VERSION;
+    header.record_size = sizeof(TrackRecord);
+    header.track_count = scan_track_count;
+    header.heap_size = heap_size;
+    if (ok) sorted_index.write((const uint8_t*)&header, sizeof(header));
+
+    TrackMetadata metadata;
+    JumpEntry jump = {};
+    uint32_t jump_dir = UINT32_MAX;
+    uint32_t current_dir = UINT32_MAX;
+    for (uint32_t position = 0; ok && position < scan_track_count; position++) {
+        ok = sorted.read((uint8_t*)&key, sizeof(key)) == sizeof(key) &&
+             meta.seek(key.track * sizeof(TrackMetadata)) &&
+             meta.read((uint8_t*)&metadata, sizeof(metadata)) == sizeof(metadata);
+        if (ok && key.record.dir_index != current_dir) {
+            current_dir = key.record.dir_index;
+            ok = sorted_dirs.seek(sizeof(PlaylistDirsHeader) + current_dir * sizeof(DirRecord) + offsetof(DirRecord, first_track)) &&
+                 sorted_dirs.write((const uint8_t*)&position, sizeof(position)) == sizeof(position);
+        }
+        sorted_index.write((const uint8_t*)&key.record, sizeof(key.record));
+        sorted_meta.write((const uint8_t*)&metadata, sizeof(metadata));
+
+        // A new letter group starts wherever the first character of the file name changes.
+        // A name starting past the sort prefix is looked up in the heap.
+        size_t name_start = key.dir_length > 0 ? key.dir_length + 1 : 0;
+        char first = 0;
+        if (name_start < sizeof(key.prefix)) {
+            first = key.prefix[name_start];
+        } else if (ok) {
+            ok = sort_heap_reader.seek(key.record.name_offset) && sort_heap_reader.read((uint8_t*)&first, 1) == 1;
+        }
+        char label = jumpLabel(first);
+        if (ok && (position == 0 || label != jump.label || key.record.dir_index != jump_dir)) {
+            jump.first_track = position;
+            jump.label = label;
+            jump_dir = key.record.dir_index;
+            ok = jumps.write((const uint8_t*)&jump, sizeof(jump)) == sizeof(jump);
+        }
+    }
+    ok = ok && sorted_index.size() == sizeof(header) + scan_track_count * sizeof(TrackRecord) &&
+         sorted_meta.size() == scan_track_count * sizeof(TrackMetadata);
+
+    if (sorted) sorted.close();
+    if (meta) meta.close();
+    if (sorted_index) sorted_index.close();
+    if (sorted_meta) sorted_meta.close();
+    if (sorted_dirs) sorted_dirs.close();
+    if (jumps) jumps.close();
+    if (sort_heap_reader) sort_heap_reader.close();
+    SD.remove(PLAYLIST_SORTED_TMP);
+    if (!ok) {
+        SD.remove(PLAYLIST_SORT_RUNS_TMP);
+        SD.remove(PLAYLIST_SORT_MERGE_TMP);
+        SD.remove(PLAYLIST_INDEX_SORTED);
+        SD.remove(PLAYLIST_DIRS_SORTED);
+        SD.remove(PLAYLIST_META_SORTED);
+        SD.remove(PLAYLIST_JUMPS_TMP);
+        return false;
+    }
+
+    Serial.printf("Sorted %u tracks in %lu ms (%u KB read, %u KB written while sorting)\n",
+                  scan_track_count, millis() - start_time,
+                  sorter.getBytesRead() / 1024, sorter.getBytesWritten() / 1024);
+    return true;
+}
+
+bool PlaylistManager::buildSearchColumn(const char* index_path) {
+    // One folded display name per line, in the final playlist order
+    SD.remove(PLAYLIST_SEARCH_TMP);
+    File index = SD.open(index_path, FILE_READ);
+    File heap = SD.open(build_heap_path, FILE_READ);
+    File column = SD.open(PLAYLIST_SEARCH_TMP, FILE_WRITE);
+    bool ok = index && heap && column && index.seek(sizeof(PlaylistIndexHeader));
+
+    TrackRecord record;
+    char name[256];
+    char folded[257];
+    for (uint32_t track = 0; ok && track < scan_track_count; track++) {
+        ok = index.read((uint8_t*)&record, sizeof(record)) == sizeof(record) &&
+             record.title_length < sizeof(name) &&
+             heap.seek(record.name_offset) &&
+             heap.read((uint8_t*)name, record.title_length) == record.title_length;
+        if (!ok) break;
+        size_t len = foldName(name, record.title_length, folded);
+        folded[len++] = '\n';
+        ok = column.write((const uint8_t*)folded, len) == len;
+    }
+
+    if (index) index.close();
+    if (heap) heap.close();
+    if (column) column.close();
+    if (!ok) SD.remove(PLAYLIST_SEARCH_TMP);
+    return ok;
+}
+
+bool PlaylistManager::buildBrowseIndex(const char* meta_path) {
+    unsigned long start_time = millis();
+    removeBrowseTmpFiles();
+
+    // Sort one key per track by artist, album and track number
+    ExternalSorter sorter(sizeof(BrowseKey), compareBrowseKeys, sort_buffer, sizeof(sort_buffer));
+    File meta = SD.open(meta_path, FILE_READ);
+    bool ok = meta && sorter.begin(PLAYLIST_SORT_RUNS_TMP, PLAYLIST_SORT_MERGE_TMP);
+    TrackMetadata metadata;
+    BrowseKey key;
+    for (uint32_t track = 0; ok && track < scan_track_count; track++) {
+        ok = meta.read((uint8_t*)&metadata, sizeof(metadata)) == sizeof(metadata);
+        copyBrowseName(key.artist, sizeof(key.artist), metadata.artist, "Unknown Artist");
+        copyBrowseName(key.album, sizeof(key.album), metadata.album, "Unknown Album");
+        key.track_number = metadata.track_number;
+        key.track = track;
+        ok = ok && sorter.add(&key);
+    }
+    if (meta) meta.close();
+    ok = ok && sorter.finish(PLAYLIST_SORTED_TMP);
+
+    // Group the sorted keys: each change of album closes an album record, each change
+    // of artist closes an artist record
+    File sorted = ok ? SD.open(PLAYLIST_SORTED_TMP, FILE_READ) : File();
+    File artists = ok ? SD.open(PLAYLIST_ARTISTS_TMP, FILE_WRITE) : File();
+    File albums = ok ? SD.open(PLAYLIST_ALBUMS_TMP, FILE_WRITE) : File();
+    File album_tracks = ok ? SD.open(PLAYLIST_ALBUM_TRACKS_TMP, FILE_WRITE) : File();
+    ok = sorted && artists && albums && album_tracks;
+
+    PlaylistBrowseHeader header = {};
+    BrowseRecord artist = {};
+    BrowseRecord album = {};
+    if (ok) artists.write((const uint8_t*)&header, sizeof(header));
+    for (uint32_t i = 0; ok && i < sorter.getRecordCount(); i++) {
+        if (sorted.read((uint8_t*)&key, sizeof(key)) != sizeof(key)) {
+            ok = false;
+            break;
+        }
+
+        bool new_artist = i == 0 || strncasecmp(key.artist, artist.name, sizeof(artist.name)) != 0;
+        bool new_album = new_artist || strncasecmp(key.album, album.name, sizeof(album.name)) != 0;
+        if (new_album && i > 0) {
+            albums.write((const uint8_t*)&album, sizeof(album));
+            header.album_count++;
+            artist.child_count++;
+        }
+        if (new_artist && i > 0) {
+            artists.write((const uint8_t*)&artist, sizeof(artist));
+            header.artist_count++;
+        }
+        if (new_artist) {
+            memcpy(artist.name, key.artist, sizeof(artist.name));
+            artist.first_child = header.album_count;
+            artist.child_count = 0;
+        }
+        if (new_album) {
+            memcpy(album.name, key.album, sizeof(album.name));
+            album.first_child = i;
+            album.child_count = 0;
+        }
+
+        album_tracks.write((const uint8_t*)&key.track, sizeof(key.track));
+        album.child_count++;
+    }
+    if (ok && sorter.getRecordCount() > 0) {
+        albums.write((const uint8_t*)&album, sizeof(album));
+        header.album_count++;
+        artist.child_count++;
+        artists.write((const uint8_t*)&artist, sizeof(artist));
+        header.artist_count++;
+    }
+
+    if (ok) {
+        header.magic = PLAYLIST_BROWSE_MAGIC;
+        header.version = PLAYLIST_INDEX_VERSION;
+        header.record_size = sizeof(BrowseRecord);
+        header.track_count = sorter.getRecordCount();
+        artists.seek(0);
+        ok = artists.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+             album_tracks.size() == header.track_count * sizeof(uint32_t);
+    }
+
+    if (sorted) sorted.close();
+    if (artists) artists.close();
+    if (albums) albums.close();
+    if (album_tracks) album_tracks.close();
+    SD.remove(PLAYLIST_SORTED_TMP);
+    if (!ok) {
+        removeBrowseTmpFiles();
+        return false;
+    }
+
+    Serial.printf("Browse index: %u artists, %u albums in %lu ms (%u KB read, %u KB written while sorting)\n",
+                  header.artist_count, header.album_count, millis() - start_time,
+                  sorter.getBytesRead() / 1024, sorter.getBytesWritten() / 1024);
+    return true;
+}
+
+void PlaylistManager::removeBrowseTmpFiles() {
+    SD.remove(PLAYLIST_ARTISTS_TMP);
+    SD.remove(PLAYLIST_ALBUMS_TMP);
+    SD.remove(PLAYLIST_ALBUM_TRACKS_TMP);
+    SD.remove(PLAYLIST_SORT_RUNS_TMP);
+    SD.remove(PLAYLIST_SORT_MERGE_TMP);
+    SD.remove(PLAYLIST_SORTED_TMP);
+}
+
+bool PlaylistManager::findOldDirectory(uint32_t path_hash, DirRecord& record) {
+    // Directories are listed in a stable order, so the expected record is usually
+    // the one right after the previous match
+    char old_path[256];
+    size_t path_len = strlen(path_buffer);
+    for (uint32_t i = 0; i < old_dir_count; i++) {
+        uint32_t dir_index = (old_dir_cursor + i) % old_dir_count;
+        if (!readDirRecord(dir_index, record)) return false;
+        if (record.path_hash != path_hash || record.path_length != path_len) continue;
+        if (!readHeap(record.path_offset, old_path, path_len) || memcmp(old_path, path_buffer, path_len) != 0) continue;
+
+        old_dir_cursor = dir_index + 1;
+        return true;
+    }
+    return false;
+}
+
+bool PlaylistManager::copyOldTracks(const DirRecord& record) {
+    const int batch_size = 8;
+    TrackRecord records[batch_size];
+    TrackMetadata metadata[batch_size];
+
+    for (uint32_t copied = 0; copied < record.track_count; copied += batch_size) {
+        int batch_count = min((uint32_t)batch_size, record.track_count - copied);
+        if (!readTrackRecords(record.first_track + copied, batch_count, records)) return false;
+        if (!readMetadataRecords(record.first_track + copied, batch_count, metadata)) return false;
+
+        // Names stay where they are in the heap; only the directory number changes
+        for (int i = 0; i < batch_count; i++) {
+            records[i].dir_index = dir_count;
+            heap_live_bytes += records[i].name_length;
+            full_path_bytes += (record.path_length > 0 ? record.path_length + 1 : 0) + records[i].name_length;
+        }
+        index_writer.write((const uint8_t*)records, batch_count * sizeof(TrackRecord));
+        meta_writer.write((const uint8_t*)metadata, batch_count * sizeof(TrackMetadata));
+        scan_track_count += batch_count;
+    }
+    return true;
+}
+
 bool PlaylistManager::loadIndex() {
+    IndexLock lock(index_mutex);
+    closeReaders();
     track_count = 0;
 
-    // Count tracks from all chunk files
-    int chunk_index = 0;
-    while (true) {
-        String chunk_path = getChunkFilePath(chunk_index);
-        if (!SD.exists(chunk_path.c_str())) break;
-
-        // Count lines in this chunk
-        File f = SD.open(chunk_path.c_str(), FILE_READ);
-        if (f) {
-            while (f.available()) {
-                if (f.read() == '\n') track_count++;
-            }
-            f.close();
+    if (openReaders() && openDirsReader()) {
+        PlaylistIndexHeader header;
+        PlaylistDirsHeader dirs_header;
+        index_reader.seek(0);
+        dirs_reader.seek(0);
+        bool valid = index_reader.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                     dirs_reader.read((uint8_t*)&dirs_header, sizeof(dirs_header)) == sizeof(dirs_header) &&
+                     header.magic == PLAYLIST_INDEX_MAGIC &&
+                     header.version == PLAYLIST_INDEX_VERSION &&
+                     header.record_size == sizeof(TrackRecord) &&
+                     dirs_header.magic == PLAYLIST_DIRS_MAGIC &&
+                     dirs_header.version == PLAYLIST_INDEX_VERSION &&
+                     dirs_header.record_size == sizeof(DirRecord) &&
+                     dirs_header.track_count == header.track_count &&
+                     index_reader.size() >= sizeof(header) + header.track_count * sizeof(TrackRecord) &&
+                     dirs_reader.size() >= sizeof(dirs_header) + dirs_header.dir_count * sizeof(DirRecord) &&
+                     heap_reader.size() >= header.heap_size &&
+                     meta_reader.size() >= header.track_count * sizeof(TrackMetadata);
+        if (valid) {
+            track_count = header.track_count;
+            heap_size = header.heap_size;
         }
-        chunk_index++;
     }
 
     if (track_count == 0) {
-        Serial.println("No chunk files found, scanning...");
-        return scanForMP3Files();
+        closeReaders();
+        return false;
     }
+    loadBrowseIndex();
+    loadJumpTable();
+    index_generation++;
 
-    Serial.printf("Index loaded: %d tracks from %d chunks\n", track_count, chunk_index);
+    Serial.printf("Index loaded: %d tracks, %u artists\n", track_count, artist_count);
     return true;
 }
 
-String PlaylistManager::getTrackPath(int index) const {
-    if (!isValidIndex(index)) return "";
+bool PlaylistManager::loadBrowseIndex() {
+    // A missing or stale browse index only disables browsing; the next scan rebuilds it
+    PlaylistBrowseHeader header;
+    artist_count = 0;
+    album_count = 0;
+    if (!readBrowseFile(CacheFile::ARTISTS, 0, &header, sizeof(header)) ||
+        header.magic != PLAYLIST_BROWSE_MAGIC ||
+        header.version != PLAYLIST_INDEX_VERSION ||
+        header.record_size != sizeof(BrowseRecord) ||
+        header.track_count != track_count) {
+        return false;
+    }
+
+    artist_count = header.artist_count;
+    album_count = header.album_count;
+    return true;
+}
 
-    int chunk = getChunkIndex(index);
-    int local = getLocalIndex(index);
+bool PlaylistManager::loadJumpTable() {
+    // Only a sorted index has one; without it jumping is simply unavailable
+    jump_count = 0;
+    File file = SD.open(PLAYLIST_JUMPS_FILE, FILE_READ);
+    if (!file) return false;
+    size_t len = file.size();
+    int count = (len % sizeof(JumpEntry) == 0) ? len / sizeof(JumpEntry) : 0;
 
-    File f = SD.open(getChunkFilePath(chunk).c_str(), FILE_READ);
-    if (!f) return "";
+    // Groups are only read one at a time later, so check the whole file once here
+    JumpEntry entry;
+    uint32_t previous = 0;
+    bool ok = count > 0;
+    for (int i = 0; ok && i < count; i++) {
+        ok = file.read((uint8_t*)&entry, sizeof(entry)) == sizeof(entry) &&
+             entry.first_track < track_count && (i == 0 || entry.first_track > previous);
+        previous = entry.first_track;
+    }
+    file.close();
+
+    jump_count = ok ? count : 0;
+    return jump_count > 0;
+}
 
-    // Skip only 'local' lines (not 'index' lines!)
-    int line = 0;
-    while (line < local && f.available()) {
-        if (f.read() == '\n') line++;
+bool PlaylistManager::isIndexCurrent() {
+    // Adding up the used space reads the whole FAT on a big card; no lock is needed for it
+    uint32_t used_kb = cardUsedKB();
+
+    // Nearly any change to the card moves the used cluster count
+    uint32_t stored_dirs;
+    {
+        IndexLock lock(index_mutex);
+        if (track_count == 0 || !openDirsReader()) return false;
+        PlaylistDirsHeader dirs_header;
+        dirs_reader.seek(0);
+        if (dirs_reader.read((uint8_t*)&dirs_header, sizeof(dirs_header)) != sizeof(dirs_header) ||
+            dirs_header.card_used_kb != used_kb) {
+            return false;
+        }
+        stored_dirs = dirs_header.dir_count;
     }
 
-    if (line != local) {
-        f.close();
-        return "";
+    // Same-size replacements and renames are caught by the listings: every directory is
+    // fingerprinted again and compared with its record. A folder added or removed changes
+    // its parent's listing. The lock is only held to read each record.
+    char path[PLAYLIST_MAX_PATH];
+    size_t root_length = music_root.length();
+    for (uint32_t dir_index = 0; dir_index < stored_dirs; dir_index++) {
+        DirRecord record;
+        {
+            IndexLock lock(index_mutex);
+            if (!readDirRecord(dir_index, record) || root_length + record.path_length >= sizeof(path)) return false;
+            memcpy(path, music_root.c_str(), root_length);
+            if (record.path_length > 0 && !readHeap(record.path_offset, path + root_length, record.path_length)) {
+                return false;
+            }
+        }
+        path[root_length + record.path_length] = '\0';
+
+        File dir = SD.open(path);
+        if (!dir || !dir.isDirectory()) return false;
+        DirFingerprint fingerprint;
+        computeFingerprint(dir, fingerprint);
+        dir.close();
+        if (!fingerprintMatches(record, fingerprint)) return false;
+    }
+    return true;
+}
+
+uint32_t PlaylistManager::cardUsedKB() const {
+    return (uint32_t)(SD.usedBytes() / 1024);
+}
+
+bool PlaylistManager::openReaders() const {
+    if (!index_reader) index_reader = SD.open(active_index_path, FILE_READ);
+    if (!heap_reader) heap_reader = SD.open(active_heap_path, FILE_READ);
+    if (!meta_reader) meta_reader = SD.open(active_meta_path, FILE_READ);
+    return index_reader && heap_reader && meta_reader;
+}
+
+bool PlaylistManager::openDirsReader() const {
+    if (!dirs_reader) dirs_reader = SD.open(active_dirs_path, FILE_READ);
+    return dirs_reader;
+}
+
+void PlaylistManager::closeReaders() const {
+    if (index_reader) index_reader.close();
+    if (heap_reader) heap_reader.close();
+    if (dirs_reader) dirs_reader.close();
+    if (meta_reader) meta_reader.close();
+    if (search_reader) search_reader.close();  // A running search reopens it at its offset
+    block_cache.clear();
+    prefetch_count = 0;
+}
+
+int PlaylistManager::loadCacheBlock(void* context, uint8_t file, uint32_t block, uint8_t* data) {
+    const PlaylistManager* self = (const PlaylistManager*)context;
+    File* reader = nullptr;
+    const char* browse_path = nullptr;
+    switch ((CacheFile)file) {
+        case CacheFile::INDEX: reader = &self->index_reader; break;
+        case CacheFile::NAMES: reader = &self->heap_reader; break;
+        case CacheFile::META: reader = &self->meta_reader; break;
+        case CacheFile::DIRS: reader = &self->dirs_reader; break;
+        case CacheFile::ARTISTS: browse_path = PLAYLIST_ARTISTS_FILE; break;
+        case CacheFile::ALBUMS: browse_path = PLAYLIST_ALBUMS_FILE; break;
+        case CacheFile::ALBUM_TRACKS: browse_path = PLAYLIST_ALBUM_TRACKS_FILE; break;
+        case CacheFile::JUMPS: browse_path = PLAYLIST_JUMPS_FILE; break;
     }
 
-    String path = f.readStringUntil('\n');
-    f.close();
+    uint32_t offset = block * BLOCK_CACHE_BLOCK_SIZE;
+    if (browse_path) {
+        // Browse files are opened per miss rather than held, to stay within the open file budget
+        File browse_file = SD.open(browse_path, FILE_READ);
+        if (!browse_file) return -1;
+        int len = browse_file.seek(offset) ? browse_file.read(data, BLOCK_CACHE_BLOCK_SIZE) : -1;
+        browse_file.close();
+        return len;
+    }
 
-    path.trim();
-    return path;
+    bool open = (reader == &self->dirs_reader) ? self->openDirsReader() : self->openReaders();
+    if (!open || !reader->seek(offset)) return -1;
+    return reader->read(data, BLOCK_CACHE_BLOCK_SIZE);
 }
 
-String PlaylistManager::getTrackName(int index) const {
-    if (!isValidIndex(index)) return "Invalid";
+bool PlaylistManager::readTrackRecords(int start_index, int count, TrackRecord* records) const {
+    return block_cache.read((uint8_t)CacheFile::INDEX, sizeof(PlaylistIndexHeader) + start_index * sizeof(TrackRecord),
+                            records, count * sizeof(TrackRecord));
+}
+
+bool PlaylistManager::readDirRecord(uint32_t dir_index, DirRecord& record) const {
+    return block_cache.read((uint8_t)CacheFile::DIRS, sizeof(PlaylistDirsHeader) + dir_index * sizeof(DirRecord),
+                            &record, sizeof(record));
+}
 
-    int chunk = getChunkIndex(index);
-    int local = getLocalIndex(index);
+bool PlaylistManager::readMetadataRecords(int start_index, int count, TrackMetadata* records) const {
+    return block_cache.read((uint8_t)CacheFile::META, start_index * sizeof(TrackMetadata),
+                            records, count * sizeof(TrackMetadata));
+}
+
+bool PlaylistManager::readHeap(uint32_t offset, char* buffer, size_t len) const {
+    return block_cache.read((uint8_t)CacheFile::NAMES, offset, buffer, len);
+}
 
-    File f = SD.open(getChunkFilePath(chunk).c_str(), FILE_READ);
-    if (!f) return "Invalid";
+bool PlaylistManager::readBrowseFile(CacheFile file, uint32_t offset, void* buffer, size_t len) const {
+    return block_cache.read((uint8_t)file, offset, buffer, len);
+}
 
-    // Skip only 'local' lines
-    int line = 0;
-    while (line < local && f.available()) {
-        if (f.read() == '\n') line++;
+size_t PlaylistManager::readTrackPath(const TrackRecord& record, char* buffer, size_t buffer_size) const {
+    // Folder path from the directory record, then the file name
+    DirRecord dir;
+    if (!readDirRecord(record.dir_index, dir)) return 0;
+    size_t name_start = dir.path_length > 0 ? dir.path_length + 1 : 0;
+    size_t len = name_start + record.name_length;
+    if (len > buffer_size) return 0;
+    if (dir.path_length > 0) {
+        if (!readHeap(dir.path_offset, buffer, dir.path_length)) return 0;
+        buffer[dir.path_length] = '/';
     }
+    return readHeap(record.name_offset, buffer + name_start, record.name_length) ? len : 0;
+}
+
+String PlaylistManager::getTrackPath(int index) const {
+    char buffer[PLAYLIST_MAX_PATH];
+    return getTrackPath(index, buffer, sizeof(buffer)) ? String(buffer) : String("");
+}
+
+size_t PlaylistManager::getTrackPath(int index, char* buffer, size_t buffer_size) const {
+    if (buffer_size == 0) return 0;
+    buffer[0] = '\0';
+    size_t root_length = music_root.length();
+    if (!isValidIndex(index) || root_length >= buffer_size) return 0;
+    memcpy(buffer, music_root.c_str(), root_length);
 
-    if (line != local) {
-        f.close();
-        return "Invalid";
+    IndexLock lock(index_mutex);
+    TrackRecord record;
+    size_t len = readTrackRecords(index, 1, &record) ?
+                 readTrackPath(record, buffer + root_length, buffer_size - root_length - 1) : 0;
+    if (len == 0) {
+        buffer[0] = '\0';
+        return 0;
     }
+    buffer[root_length + len] = '\0';
+    return root_length + len;
+}
+
+uint32_t PlaylistManager::getTrackPathHash(int index) const {
+    char path[PLAYLIST_MAX_PATH];
+    size_t len = getTrackPath(index, path, sizeof(path));
+    return len > 0 ? fnv1a(path, len) : 0;
+}
+
+int PlaylistManager::findTrackByPathHash(uint32_t path_hash) const {
+    if (path_hash == 0) return -1;
+    for (int i = 0; i < (int)getTrackCount(); i++) {
+        if (getTrackPathHash(i) == path_hash) return i;
+    }
+    return -1;
+}
 
-    // Read path into char buffer
+String PlaylistManager::getTrackName(int index) const {
     char buffer[256];
-    size_t len = 0;
-    while (f.available() && len < sizeof(buffer) - 1) {
-        char c = f.read();
-        if (c == '\n' || c == '\r') break;
-        buffer[len++] = c;
-    }
-    buffer[len] = '\0';
-    f.close();
-
-    // Find last slash
-    const char* name_start = strrchr(buffer, '/');
-    if (name_start) {
-        name_start++;
-    } else {
-        name_start = buffer;
+    return getTrackName(index, buffer, sizeof(buffer)) ? String(buffer) : String("Invalid");
+}
+
+size_t PlaylistManager::getTrackName(int index, char* buffer, size_t buffer_size) const {
+    if (buffer_size == 0) return 0;
+    buffer[0] = '\0';
+    if (!isValidIndex(index)) return 0;
+
+    IndexLock lock(index_mutex);
+    TrackRecord record;
+    if (!readTrackRecords(index, 1, &record) || record.title_length >= buffer_size ||
+        !readHeap(record.name_offset, buffer, record.title_length)) {
+        buffer[0] = '\0';
+        return 0;
     }
+    buffer[record.title_length] = '\0';
+    return record.title_length;
+}
 
-    // Find extension dot
-    const char* dot = strrchr(name_start, '.');
-    size_t name_len = dot ? (dot - name_start) : strlen(name_start);
+bool PlaylistManager::getTrackMetadata(int index, TrackMetadata& metadata) const {
+    if (!isValidIndex(index)) return false;
 
-    // Single String allocation
-    return String(name_start).substring(0, name_len);
+    IndexLock lock(index_mutex);
+    return readMetadataRecords(index, 1, &metadata);
 }
 
 bool PlaylistManager::isValidIndex(int index) const {
@@ -233,66 +1386,249 @@ void PlaylistManager::getTrackNames(int start_index, int count, String* output)
     if (start_index < 0 || start_index >= (int)track_count || count <= 0) {
         return;
     }
+    count = min(count, (int)track_count - start_index);
+
+    // Records for consecutive tracks are contiguous: fetch them with one read
+    const int batch_size = 8;
+    TrackRecord records[batch_size];
+    char buffer[256];
 
-    int current_chunk = getChunkIndex(start_index);
-    int local_index = getLocalIndex(start_index);
+    IndexLock lock(index_mutex);
+    // Queue the next window in the scroll direction for prefetch()
+    if (names_window_start >= 0 && start_index != names_window_start) {
+        prefetch_start = (start_index > names_window_start) ? start_index + count
+                                                            : start_index - PLAYLIST_PREFETCH_TRACKS;
+        prefetch_count = PLAYLIST_PREFETCH_TRACKS;
+    }
+    names_window_start = start_index;
 
-    File f = SD.open(getChunkFilePath(current_chunk).c_str(), FILE_READ);
-    if (!f) return;
+    for (int batch_start = 0; batch_start < count; batch_start += batch_size) {
+        int batch_count = min(batch_size, count - batch_start);
+        if (!readTrackRecords(start_index + batch_start, batch_count, records)) return;
 
-    // Skip to local_index within the chunk
-    int line = 0;
-    while (line < local_index && f.available()) {
-        if (f.read() == '\n') line++;
+        for (int i = 0; i < batch_count; i++) {
+            const TrackRecord& record = records[i];
+            if (record.title_length >= sizeof(buffer) ||
+                !readHeap(record.name_offset, buffer, record.title_length)) {
+                continue;
+            }
+            buffer[record.title_length] = '\0';
+            output[batch_start + i] = String(buffer);
+        }
     }
+}
 
-    // Read count names
-    char buffer[256];
-    for (int i = 0; i < count; i++) {
-        int track_idx = start_index + i;
-        if (track_idx >= (int)track_count) break;
+void PlaylistManager::prefetch() {
+    IndexLock lock(index_mutex);
+    int start = max(prefetch_start, 0);
+    int end = min(prefetch_start + prefetch_count, (int)track_count);
+    prefetch_count = 0;
+    if (start >= end) return;
 
-        // Check if we need to switch to next chunk
-        int needed_chunk = getChunkIndex(track_idx);
-        if (needed_chunk != current_chunk) {
-            f.close();
-            current_chunk = needed_chunk;
-            f = SD.open(getChunkFilePath(current_chunk).c_str(), FILE_READ);
-            if (!f) break;
-            // At beginning of new chunk, no lines to skip
+    // Records first, then the names they point to
+    uint32_t first = sizeof(PlaylistIndexHeader) + start * sizeof(TrackRecord);
+    if (!block_cache.prefetch((uint8_t)CacheFile::INDEX, first, (end - start) * sizeof(TrackRecord))) return;
+    TrackRecord record;
+    for (int i = start; i < end; i++) {
+        if (!readTrackRecords(i, 1, &record) ||
+            !block_cache.prefetch((uint8_t)CacheFile::NAMES, record.name_offset, record.title_length)) {
+            return;
         }
+    }
+}
+
+bool PlaylistManager::readJump(int jump, JumpEntry& entry) const {
+    return readBrowseFile(CacheFile::JUMPS, jump * sizeof(JumpEntry), &entry, sizeof(entry));
+}
 
-        // Read line into buffer
+int PlaylistManager::findJump(int index) const {
+    // Last group starting at or before the track
+    int low = 0, high = jump_count - 1;
+    JumpEntry entry;
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (!readJump(mid, entry)) return -1;
+        if ((int)entry.first_track <= index) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+int PlaylistManager::getJumpTarget(int index, int direction) const {
+    IndexLock lock(index_mutex);
+    if (jump_count == 0 || !isValidIndex(index)) return index;
+
+    int jump = findJump(index);
+    JumpEntry entry;
+    if (jump < 0 || !readJump(jump, entry)) return index;
+    if (direction > 0) {
+        jump = (jump + 1 < jump_count) ? jump + 1 : 0;
+    } else if ((int)entry.first_track == index) {
+        // Back to the start of the current group first, then group by group
+        jump = (jump > 0) ? jump - 1 : jump_count - 1;
+    } else {
+        return entry.first_track;
+    }
+    return readJump(jump, entry) ? entry.first_track : index;
+}
+
+char PlaylistManager::getJumpLabel(int index) const {
+    IndexLock lock(index_mutex);
+    if (jump_count == 0 || !isValidIndex(index)) return 0;
+    int jump = findJump(index);
+    JumpEntry entry;
+    return (jump >= 0 && readJump(jump, entry)) ? entry.label : 0;
+}
+
+bool PlaylistManager::startSearch(const char* query) {
+    stopSearch();
+    search_query_len = foldName(query, min(strlen(query), (size_t)PLAYLIST_SEARCH_MAX_QUERY), search_query);
+    search_query[search_query_len] = '\0';
+    if (search_query_len == 0 || track_count == 0) return false;
+
+    // KMP failure function: a mismatch never moves back in the name column, so blocks
+    // are streamed strictly forward
+    search_failure[0] = 0;
+    for (uint8_t i = 1, k = 0; i < search_query_len; i++) {
+        while (k > 0 && search_query[i] != search_query[k]) k = search_failure[k - 1];
+        if (search_query[i] == search_query[k]) k++;
+        search_failure[i] = k;
+    }
+
+    search_offset = 0;
+    search_track = 0;
+    search_state = 0;
+    search_line_matched = false;
+    search_generation = index_generation;
+    search_start_time = millis();
+    search_done = false;
+    return true;
+}
+
+void PlaylistManager::stopSearch() {
+    IndexLock lock(index_mutex);
+    if (search_reader) search_reader.close();
+    search_done = true;
+}
+
+int PlaylistManager::continueSearch(int* results, int max_results, unsigned long time_budget_ms) {
+    int found = 0;
+    unsigned long slice_start = millis();
+    while (!search_done && found < max_results && millis() - slice_start < time_budget_ms) {
         size_t len = 0;
-        while (f.available() && len < sizeof(buffer) - 1) {
-            char c = f.read();
-            if (c == '\n' || c == '\r') {
-                if (c == '\r' && f.available()) {
-                    char next = f.peek();
-                    if (next == '\n') f.read();
-                }
+        {
+            IndexLock lock(index_mutex);
+            // A new index invalidates the line numbers
+            if (search_generation != index_generation) {
+                if (search_reader) search_reader.close();
+                search_done = true;
                 break;
             }
-            buffer[len++] = c;
+            if (!search_reader) search_reader = SD.open(PLAYLIST_SEARCH_FILE, FILE_READ);
+            if (search_reader && search_reader.seek(search_offset)) {
+                len = search_reader.read(search_block, sizeof(search_block));
+            }
+        }
+        if (len == 0) {
+            stopSearch();
+            Serial.printf("Search \"%s\" finished in %lu ms\n", search_query, millis() - search_start_time);
+            break;
         }
-        buffer[len] = '\0';
 
-        // Extract filename (after last /)
-        const char* name_start = strrchr(buffer, '/');
-        if (name_start) {
-            name_start++;
-        } else {
-            name_start = buffer;
+        size_t pos = 0;
+        while (pos < len && found < max_results) {
+            char c = search_block[pos++];
+            if (c == '\n') {
+                search_track++;
+                search_state = 0;
+                search_line_matched = false;
+                continue;
+            }
+            if (search_line_matched) continue;
+
+            while (search_state > 0 && c != search_query[search_state]) {
+                search_state = search_failure[search_state - 1];
+            }
+            if (c == search_query[search_state]) search_state++;
+            if (search_state == search_query_len) {
+                if (isValidIndex(search_track)) results[found++] = search_track;
+                search_line_matched = true;
+            }
         }
+        search_offset += pos;
+    }
+    return found;
+}
+
+bool PlaylistManager::getBrowseRecord(BrowseLevel level, int index, BrowseRecord& record) const {
+    IndexLock lock(index_mutex);
+    if (level == BrowseLevel::ARTISTS && index >= 0 && index < (int)artist_count) {
+        return readBrowseFile(CacheFile::ARTISTS, sizeof(PlaylistBrowseHeader) + index * sizeof(BrowseRecord),
+                              &record, sizeof(record));
+    }
+    if (level == BrowseLevel::ALBUMS && index >= 0 && index < (int)album_count) {
+        return readBrowseFile(CacheFile::ALBUMS, index * sizeof(BrowseRecord), &record, sizeof(record));
+    }
+    return false;
+}
+
+int PlaylistManager::getAlbumTrack(int position) const {
+    IndexLock lock(index_mutex);
+    uint32_t track;
+    if (artist_count == 0 || !isValidIndex(position) ||
+        !readBrowseFile(CacheFile::ALBUM_TRACKS, position * sizeof(track), &track, sizeof(track))) {
+        return -1;
+    }
+    return isValidIndex(track) ? (int)track : -1;  // A stale browse file can point past the index
+}
+
+void PlaylistManager::getBrowseNames(BrowseLevel level, int start_index, int count, String* output) const {
+    for (int i = 0; i < count; i++) {
+        output[i] = "";
+    }
 
-        // Remove extension
-        const char* dot = strrchr(name_start, '.');
-        size_t name_len = dot ? (dot - name_start) : strlen(name_start);
+    const int batch_size = 8;
+    IndexLock lock(index_mutex);
+    if (artist_count == 0 || start_index < 0 || count <= 0) return;
+    count = min(count, batch_size);
 
-        output[i] = String(name_start).substring(0, name_len);
+    if (level == BrowseLevel::TRACKS) {
+        // Album tracks show their tag title, falling back to the file name
+        if (start_index >= (int)track_count) return;
+        count = min(count, (int)track_count - start_index);
+        uint32_t tracks[batch_size];
+        if (!readBrowseFile(CacheFile::ALBUM_TRACKS, start_index * sizeof(uint32_t), tracks, count * sizeof(uint32_t))) {
+            return;
+        }
+        TrackMetadata metadata;
+        for (int i = 0; i < count; i++) {
+            if (!isValidIndex(tracks[i])) continue;  // A stale browse file; the row stays blank
+            if (readMetadataRecords(tracks[i], 1, &metadata) && metadata.title[0] != '\0') {
+                output[i] = String(metadata.title);
+            } else {
+                output[i] = getTrackName(tracks[i]);
+            }
+        }
+        return;
     }
 
-    f.close();
+    // Consecutive artist or album records are contiguous: fetch them with one read
+    uint32_t record_count = (level == BrowseLevel::ARTISTS) ? artist_count : album_count;
+    if (start_index >= (int)record_count) return;
+    count = min(count, (int)record_count - start_index);
+    CacheFile file = (level == BrowseLevel::ARTISTS) ? CacheFile::ARTISTS : CacheFile::ALBUMS;
+    uint32_t offset = (level == BrowseLevel::ARTISTS) ? sizeof(PlaylistBrowseHeader) : 0;
+    BrowseRecord records[batch_size];
+    if (!readBrowseFile(file, offset + start_index * sizeof(BrowseRecord), records, count * sizeof(BrowseRecord))) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        records[i].name[sizeof(records[i].name) - 1] = '\0';
+        output[i] = String(records[i].name);
+    }
 }
 
 bool PlaylistManager::hasMP3Extension(const char* filename) {
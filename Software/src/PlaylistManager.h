@@ -3,42 +3,356 @@
 
 #include <Arduino.h>
 #include <SD.h>
+#include "Mp3Parser.h"
+#include "ExternalSort.h"
+#include "BlockCache.h"
 
 #define PLAYLIST_DIR "/.playlist"
-#define PLAYLIST_CHUNK_SIZE 10  // Tracks per chunk file
+#define PLAYLIST_INDEX_FILE PLAYLIST_DIR "/tracks.idx"  // Header + fixed-width track records
+#define PLAYLIST_NAMES_FILE PLAYLIST_DIR "/names.dat"   // Packed string heap (append-only)
+#define PLAYLIST_DIRS_FILE  PLAYLIST_DIR "/dirs.idx"    // Directory manifest with fingerprints
+#define PLAYLIST_META_FILE  PLAYLIST_DIR "/meta.dat"    // TrackMetadata records, same order as the index
+#define PLAYLIST_INDEX_TMP  PLAYLIST_DIR "/tracks.tmp"
+#define PLAYLIST_META_TMP   PLAYLIST_DIR "/meta.tmp"
+#define PLAYLIST_NAMES_TMP  PLAYLIST_DIR "/names.tmp"   // Heap of a full rebuild, swapped in when it is done
+#define PLAYLIST_DIRS_TMP   PLAYLIST_DIR "/dirs.tmp"
+#define PLAYLIST_JUMPS_FILE PLAYLIST_DIR "/jumps.idx"    // JumpEntry per letter group of the sorted playlist
+#define PLAYLIST_JUMPS_TMP  PLAYLIST_DIR "/jumps.tmp"
+#define PLAYLIST_SEARCH_FILE PLAYLIST_DIR "/search.dat"  // Folded display names, one line per track in playlist order
+#define PLAYLIST_SEARCH_TMP  PLAYLIST_DIR "/search.tmp"
+#define PLAYLIST_INDEX_SORTED PLAYLIST_DIR "/tracks.srt"  // Scan results rewritten in playlist order
+#define PLAYLIST_META_SORTED  PLAYLIST_DIR "/meta.srt"
+#define PLAYLIST_DIRS_SORTED  PLAYLIST_DIR "/dirs.srt"
+
+// Browse indexes, derived from the metadata at the end of each scan
+#define PLAYLIST_ARTISTS_FILE      PLAYLIST_DIR "/artists.idx"  // Header + one BrowseRecord per artist, sorted
+#define PLAYLIST_ALBUMS_FILE       PLAYLIST_DIR "/albums.idx"   // One BrowseRecord per album, grouped by artist
+#define PLAYLIST_ALBUM_TRACKS_FILE PLAYLIST_DIR "/albumtr.idx"  // Track indexes, grouped by album
+#define PLAYLIST_ARTISTS_TMP       PLAYLIST_DIR "/artists.tmp"
+#define PLAYLIST_ALBUMS_TMP        PLAYLIST_DIR "/albums.tmp"
+#define PLAYLIST_ALBUM_TRACKS_TMP  PLAYLIST_DIR "/albumtr.tmp"
+#define PLAYLIST_SORT_RUNS_TMP     PLAYLIST_DIR "/sort1.tmp"
+#define PLAYLIST_SORT_MERGE_TMP    PLAYLIST_DIR "/sort2.tmp"
+#define PLAYLIST_SORTED_TMP        PLAYLIST_DIR "/sorted.tmp"
+
+#define PLAYLIST_INDEX_MAGIC 0x5849504D  // "MPIX"
+#define PLAYLIST_DIRS_MAGIC  0x5844504D  // "MPDX"
+#define PLAYLIST_BROWSE_MAGIC 0x5842504D // "MPBX"
+#define PLAYLIST_INDEX_VERSION 6
+
+// Rebuild from scratch once stale strings make up this share of the heap
+#define PLAYLIST_HEAP_MAX_GARBAGE_PERCENT 50
+
+// Background scanning
+#define PLAYLIST_SCAN_MAX_DEPTH 8        // Deepest folder level scanned (one open handle per level)
+#define PLAYLIST_SCAN_SLICE_MS 20        // Work done per slice before releasing the index lock
+#define PLAYLIST_SCAN_TASK_STACK 8192  // Room for the MP3 decoder in the loudness pass
+#define PLAYLIST_SCAN_TASK_PRIORITY 1
+#define PLAYLIST_LOUDNESS_TASK_PRIORITY 0  // The loudness pass only gets time nothing else wants
+#define PLAYLIST_SCAN_TASK_CORE 1
+#define PLAYLIST_SORT_BUFFER_SIZE 8192   // RAM used for sorting, whatever the library size
+#define PLAYLIST_SEARCH_MAX_QUERY 16
+#define PLAYLIST_SEARCH_BLOCK_SIZE 2048  // Bytes of the name column read at a time while searching
+#define PLAYLIST_SORT_PREFIX 48          // Path bytes kept in a sort key; longer ties are settled from the heap
+#define PLAYLIST_MAX_PATH 512            // Full path of a track, music root included
+#define PLAYLIST_CACHE_SIZE 8192         // RAM for cached index blocks, shared by all lookups
+#define PLAYLIST_PREFETCH_TRACKS 16      // Names loaded ahead of the list in the scroll direction
+
+// On-disk header at the start of the track index file
+struct __attribute__((packed)) PlaylistIndexHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t track_count;
+    uint32_t heap_size;
+};
+
+// One fixed-width record per track. Only the file name lives in the string heap; the
+// folder path is stored once, in the track's directory record.
+struct __attribute__((packed)) TrackRecord {
+    uint32_t name_offset;   // Offset of the file name in the string heap
+    uint32_t dir_index;     // Directory record holding the folder path
+    uint16_t name_length;   // File name length, extension included
+    uint16_t title_length;  // Display name: the file name without its extension
+};
+
+// On-disk header at the start of the directory manifest
+struct __attribute__((packed)) PlaylistDirsHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t dir_count;
+    uint32_t track_count;   // Must match the track index, catches half-written updates
+    uint32_t card_used_kb;  // Quick whole-card fingerprint checked at boot
+};
+
+// Cheap summary of a directory listing, used to detect changes without reading files
+struct DirFingerprint {
+    uint32_t entry_count;
+    uint32_t names_hash;
+    uint32_t size_sum;
+    uint32_t last_write;
+    bool has_subdirs;
+};
+
+// Where the scanner is within a directory. Each directory is listed once to
+// fingerprint it, once more to add its tracks if it changed, and once to descend.
+enum class ScanPhase : uint8_t {
+    FINGERPRINT,
+    TRACKS,
+    SUBDIRS
+};
+
+// One record per scanned directory, in scan order. The tracks of a directory are
+// stored contiguously in the track index, so an unchanged directory can be carried
+// over into a rebuilt index by copying its record range.
+struct __attribute__((packed)) DirRecord {
+    uint32_t path_hash;
+    uint32_t path_offset;  // Offset of the relative directory path in the string heap
+    uint16_t path_length;
+    uint16_t reserved;
+    uint32_t entry_count;
+    uint32_t names_hash;
+    uint32_t size_sum;
+    uint32_t last_write;
+    uint32_t first_track;
+    uint32_t track_count;
+};
+
+// On-disk header at the start of the artist index
+struct __attribute__((packed)) PlaylistBrowseHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t artist_count;
+    uint32_t album_count;
+    uint32_t track_count;  // Must match the track index
+};
+
+// An artist or an album. Its children (the artist's albums, or the album's tracks)
+// are a contiguous range of the next level down.
+struct __attribute__((packed)) BrowseRecord {
+    char name[32];
+    uint32_t first_child;
+    uint32_t child_count;
+};
+
+// Sort key for the playlist order. Tracks are ordered folder by folder, then by file
+// name, both in natural order. The key carries the track record so the sorted index
+// can be written straight from the sorted keys.
+struct __attribute__((packed)) TrackSortKey {
+    char prefix[PLAYLIST_SORT_PREFIX];  // Leading bytes of the relative path
+    TrackRecord record;
+    uint32_t track;       // Position in scan order
+    uint32_t dir_offset;  // Folder path in the string heap, to rebuild long paths
+    uint16_t dir_length;
+};
+
+// Start of a run of tracks whose file name begins with the same letter, in playlist
+// order. Digits share the label '#', anything else '*'. Each folder has its own groups,
+// so there is no fixed limit on their number and they are read through the block cache.
+struct __attribute__((packed)) JumpEntry {
+    uint32_t first_track;
+    char label;
+    uint8_t reserved[3];
+};
+
+// Sort key for the browse indexes: artist, album, track number, then scan order
+struct __attribute__((packed)) BrowseKey {
+    char artist[32];
+    char album[32];
+    uint16_t track_number;
+    uint32_t track;
+};
+
+// Index files read through the block cache
+enum class CacheFile : uint8_t {
+    INDEX,
+    NAMES,
+    DIRS,
+    META,
+    ARTISTS,
+    ALBUMS,
+    ALBUM_TRACKS,
+    JUMPS
+};
+
+enum class BrowseLevel : uint8_t {
+    ARTISTS,
+    ALBUMS,
+    TRACKS
+};
+
+// One level of the explicit directory stack used by the scanner
+struct ScanFrame {
+    File dir;
+    uint16_t base_len;  // Length of this directory's path in path_buffer
+    ScanPhase phase;
+    DirFingerprint fingerprint;
+    DirRecord record;
+};
 
 class PlaylistManager {
 private:
     String music_root;
-    size_t track_count;
+    volatile size_t track_count;  // Published count, grows while a full scan runs
+    size_t scan_track_count;
     char path_buffer[256];  // Static buffer to avoid heap allocations
 
-    // Used during scanForMP3Files()
-    File current_chunk_file;
-    int current_chunk_index;
-    int tracks_in_current_chunk;
+    // Used while building the index
+    ScanFrame scan_stack[PLAYLIST_SCAN_MAX_DEPTH];
+    int scan_depth;
+    volatile bool scanning;
+    bool scan_incremental;
+    bool publish_partial;  // Full scans expose tracks as they are found
+    unsigned long scan_start_time;
+    TaskHandle_t scan_task;
+    File index_writer;
+    File dirs_writer;
+    File heap_writer;
+    File meta_writer;
+    uint32_t heap_size;
+    uint32_t heap_live_bytes;
+    uint32_t full_path_bytes;  // What the live paths would take stored whole, for the log
+    volatile size_t completed_track_count;  // Tracks of fully scanned directories
+    volatile uint32_t dir_count;
+    uint32_t artist_count;
+    uint32_t album_count;
+    volatile uint32_t index_generation;  // Bumped whenever a new index is swapped in
+    int jump_count;  // Entries in PLAYLIST_JUMPS_FILE
+    bool reuse_old_index;
+    bool build_failed;
+    bool tracks_sorted;  // Sorted copies of the tmp files are ready to be swapped in
+    uint32_t old_dir_count;
+    uint32_t old_dir_cursor;
+    uint32_t dirs_reused;
+    uint32_t dirs_rescanned;
+
+    // Read handles, kept open between lookups. Guarded by index_mutex since lookups
+    // come from both the UI loop and the Bluetooth task.
+    mutable File index_reader;
+    mutable File heap_reader;
+    mutable File dirs_reader;
+    mutable File meta_reader;
+    const char* active_index_path;
+    const char* active_meta_path;
+    const char* active_dirs_path;
+    const char* active_heap_path;
+    const char* build_heap_path;  // Heap the running build appends to
+    mutable BlockCache block_cache;  // Sits below every lookup except the streamed search
+    mutable int names_window_start;  // Last window asked for, to tell the scroll direction
+    mutable int prefetch_start;
+    mutable int prefetch_count;
+    SemaphoreHandle_t index_mutex;
+
+    // Substring search, streamed over the folded name column
+    mutable File search_reader;
+    uint32_t search_offset;
+    int search_track;          // Track of the line being matched
+    bool search_line_matched;
+    bool search_done;
+    uint8_t search_state;      // Matched query prefix length
+    uint8_t search_query_len;
+    char search_query[PLAYLIST_SEARCH_MAX_QUERY + 1];
+    uint8_t search_failure[PLAYLIST_SEARCH_MAX_QUERY];  // KMP failure function of the query
+    uint32_t search_generation;
+    unsigned long search_start_time;
 
 public:
     PlaylistManager(const String& root = "/");
 
-    bool scanForMP3Files();      // Scan and create index files
+    bool begin();                // Load the index and refresh it in the background if needed
+    bool scanForMP3Files();      // Start a background rebuild of the whole index
+    bool updateIndex();          // Start a background rescan of changed directories only
     bool loadIndex();            // Load track count from existing files
+    bool isIndexCurrent();       // Quick check that the card matches the loaded index
+
+    bool isScanning() const { return scanning; }
+    bool isIdle() const;         // Neither a scan nor the loudness pass after it is running
+    uint32_t getScannedDirCount() const { return dir_count; }
+    uint32_t getIndexGeneration() const { return index_generation; }
 
     size_t getTrackCount() const { return track_count; }
     String getTrackPath(int index) const;   // Read from file on-demand
     String getTrackName(int index) const;
+    // Same, into the caller's buffer so the playback path does not touch the heap.
+    // Return the length, 0 on failure.
+    size_t getTrackPath(int index, char* buffer, size_t buffer_size) const;
+    size_t getTrackName(int index, char* buffer, size_t buffer_size) const;
+    uint32_t getTrackPathHash(int index) const;  // Tells whether an index still names the same file; 0 on failure
+    int findTrackByPathHash(uint32_t path_hash) const;  // Reads every path; -1 if no track matches
     void getTrackNames(int start_index, int count, String* output) const;  // Batch read
+    bool getTrackMetadata(int index, TrackMetadata& metadata) const;
     bool isValidIndex(int index) const;
+    void prefetch();  // Loads the names the list will likely show next; call when idle
+
+    uint32_t getCacheHits() const { return block_cache.getHits(); }
+    uint32_t getCacheMisses() const { return block_cache.getMisses(); }
+
+    // Letter groups of the sorted playlist, for jumping through long lists
+    int getJumpCount() const { return jump_count; }
+    int getJumpTarget(int index, int direction) const;  // Start of the current/previous (-1) or next (+1) group
+    char getJumpLabel(int index) const;                 // Label of the group holding a track, 0 if none
+
+    // Case- and accent-insensitive substring search over the display names. Matches are
+    // reported in playlist order, a time slice at a time, without per-track allocations.
+    bool startSearch(const char* query);
+    int continueSearch(int* results, int max_results, unsigned long time_budget_ms);  // Number of matches added
+    bool isSearchDone() const { return search_done; }
+    void stopSearch();
+
+    // Artist -> album -> track browsing. Records are read on demand, one small read per call.
+    size_t getArtistCount() const { return artist_count; }
+    bool getBrowseRecord(BrowseLevel level, int index, BrowseRecord& record) const;  // ARTISTS or ALBUMS
+    int getAlbumTrack(int position) const;  // Track index at a position of the album track list
+    void getBrowseNames(BrowseLevel level, int start_index, int count, String* output) const;  // Batch read
 
 private:
     bool hasMP3Extension(const char* filename);
-    void scanDirectory(File dir, size_t base_len);
+    bool startScanTask(bool incremental);
+    static void scanTask(void* parameter);
+    void runScan(bool incremental);
+    void runLoudnessPass();
+    bool writeTrackMetadata(int index, const TrackMetadata& metadata);
+
+    // Incremental index build, driven one directory entry at a time
+    bool startBuild(bool incremental);
+    bool stepBuild();
+    void closeBuild();
+    bool finishBuild();
+    void abortBuild();
+    bool pushDirectory(File dir, size_t base_len);
+    void finishDirectoryTracks(ScanFrame& frame);
+    size_t appendPath(size_t base_len, const char* name);
+    void accumulateFingerprint(File& entry, DirFingerprint& fingerprint);
+    void computeFingerprint(File& dir, DirFingerprint& fingerprint);
+    void addTrack(size_t path_len, File& file);
+    bool sortTracks();
+    bool buildSearchColumn(const char* index_path);
+    bool buildBrowseIndex(const char* meta_path);
+    void removeBrowseTmpFiles();
+
+    // Old index reuse during updateIndex()
+    bool findOldDirectory(uint32_t path_hash, DirRecord& record);
+    bool copyOldTracks(const DirRecord& record);
 
-    // Chunk file helpers
-    String getChunkFilePath(int chunk_index) const;
-    int getChunkIndex(int track_index) const { return track_index / PLAYLIST_CHUNK_SIZE; }
-    int getLocalIndex(int track_index) const { return track_index % PLAYLIST_CHUNK_SIZE; }
-    void deleteOldIndexFiles();
+    // Index file helpers
+    bool openReaders() const;
+    bool openDirsReader() const;
+    void closeReaders() const;
+    bool readTrackRecords(int start_index, int count, TrackRecord* records) const;
+    bool readDirRecord(uint32_t dir_index, DirRecord& record) const;
+    bool readMetadataRecords(int start_index, int count, TrackMetadata* records) const;
+    bool readHeap(uint32_t offset, char* buffer, size_t len) const;
+    size_t readTrackPath(const TrackRecord& record, char* buffer, size_t buffer_size) const;  // Length, 0 on failure
+    bool loadBrowseIndex();
+    bool loadJumpTable();
+    bool readJump(int jump, JumpEntry& entry) const;
+    int findJump(int index) const;  // -1 on failure
+    bool readBrowseFile(CacheFile file, uint32_t offset, void* buffer, size_t len) const;
+    static int loadCacheBlock(void* context, uint8_t file, uint32_t block, uint8_t* data);
+    uint32_t cardUsedKB() const;
+    void deleteOldIndexFiles(bool with_heap);
 };
 
 #endif
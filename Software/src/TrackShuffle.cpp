@@ -0,0 +1,82 @@
+#include "TrackShuffle.h"
+
+TrackShuffle::TrackShuffle() : domain_count(0), half_bits(1), half_mask(1) {
+    setSeed(0);
+}
+
+void TrackShuffle::setSeed(uint32_t new_seed) {
+    seed = new_seed;
+    // SplitMix32-style expansion into independent round keys
+    uint32_t state = new_seed;
+    for (int i = 0; i < SHUFFLE_ROUNDS; i++) {
+        state += 0x9E3779B9;
+        uint32_t key = state;
+        key = (key ^ (key >> 16)) * 0x85EBCA6B;
+        key = (key ^ (key >> 13)) * 0xC2B2AE35;
+        keys[i] = key ^ (key >> 16);
+    }
+}
+
+// Smallest even number of bits that covers every index, split into two halves
+void TrackShuffle::resize(uint32_t track_count) {
+    if (track_count == domain_count) return;
+    uint8_t bits = 2;
+    while (bits < 32 && (1UL << bits) < track_count) bits += 2;
+    half_bits = bits / 2;
+    half_mask = (1UL << half_bits) - 1;
+    domain_count = track_count;
+}
+
+// Murmur3 finaliser of the half mixed with the round key
+uint32_t TrackShuffle::round(uint32_t half, int index) const {
+    uint32_t x = half ^ keys[index];
+    x = (x ^ (x >> 16)) * 0x7FEB352D;
+    x = (x ^ (x >> 15)) * 0x846CA68B;
+    return (x ^ (x >> 16)) & half_mask;
+}
+
+uint32_t TrackShuffle::encrypt(uint32_t value) const {
+    uint32_t left = value >> half_bits;
+    uint32_t right = value & half_mask;
+    for (int i = 0; i < SHUFFLE_ROUNDS; i++) {
+        uint32_t next = left ^ round(right, i);
+        left = right;
+        right = next;
+    }
+    return (left << half_bits) | right;
+}
+
+uint32_t TrackShuffle::decrypt(uint32_t value) const {
+    uint32_t left = value >> half_bits;
+    uint32_t right = value & half_mask;
+    for (int i = SHUFFLE_ROUNDS - 1; i >= 0; i--) {
+        uint32_t previous = right ^ round(left, i);
+        right = left;
+        left = previous;
+    }
+    return (left << half_bits) | right;
+}
+
+uint32_t TrackShuffle::trackAt(uint32_t position, uint32_t track_count) {
+    if (track_count <= 1) return 0;
+    resize(track_count);
+    // Walking the cycle always comes back inside the range, at the latest at the start
+    uint32_t track = encrypt(position % track_count);
+    while (track >= track_count) track = encrypt(track);
+    return track;
+}
+
+uint32_t TrackShuffle::positionOf(uint32_t track, uint32_t track_count) {
+    if (track_count <= 1) return 0;
+    resize(track_count);
+    uint32_t position = decrypt(track % track_count);
+    while (position >= track_count) position = decrypt(position);
+    return position;
+}
+
+uint32_t TrackShuffle::step(uint32_t track, int direction, uint32_t track_count) {
+    if (track_count <= 1) return 0;
+    uint32_t position = positionOf(track, track_count);
+    position = (direction >= 0) ? (position + 1) % track_count : (position + track_count - 1) % track_count;
+    return trackAt(position, track_count);
+}
@@ -0,0 +1,40 @@
+#ifndef TRACKSHUFFLE_H
+#define TRACKSHUFFLE_H
+
+#include <Arduino.h>
+
+#define SHUFFLE_ROUNDS 4
+
+// Shuffled play order over [0, track_count) without a table: a keyed Feistel network
+// permutes a power-of-four domain just above the track count, and cycle-walking
+// re-encrypts values that land outside it. Both directions are O(1) on average (under
+// four walks), so next and previous need no history. A new seed is a new order.
+class TrackShuffle {
+public:
+    TrackShuffle();
+
+    void setSeed(uint32_t seed);
+    uint32_t getSeed() const { return seed; }
+
+    // Position in the shuffled order to track index, and back. The count may change
+    // between calls, for example while a scan adds tracks.
+    uint32_t trackAt(uint32_t position, uint32_t track_count);
+    uint32_t positionOf(uint32_t track, uint32_t track_count);
+
+    // The track before or after another one in the shuffled order, wrapping at the ends
+    uint32_t step(uint32_t track, int direction, uint32_t track_count);
+
+private:
+    uint32_t seed;
+    uint32_t keys[SHUFFLE_ROUNDS];
+    uint32_t domain_count;  // Track count the domain below was sized for
+    uint8_t half_bits;
+    uint32_t half_mask;
+
+    void resize(uint32_t track_count);
+    uint32_t encrypt(uint32_t value) const;
+    uint32_t decrypt(uint32_t value) const;
+    uint32_t round(uint32_t half, int index) const;
+};
+
+#endif
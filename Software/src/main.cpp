@@ -11,6 +11,7 @@
 #include "DisplayManager.h"
 #include "AppState.h"
 #include "InputEvents.h"
+#include "PlaybackStore.h"
 
 // --- Global Objects ---
 MusicPlayer music_player;
@@ -19,6 +20,8 @@ BluetoothManager bluetooth_manager;
 AudioProcessor audio_processor;
 InputManager input_manager;
 DisplayManager display_manager;
+PlaybackStore playback_store;
+PlayerEventQueue log_events;  // Player events waiting to be logged by loop()
 
 // --- Global UI State ---
 AppScreen current_screen = AppScreen::SCREEN_BLUETOOTH_SELECTION;
@@ -26,6 +29,143 @@ int bt_menu_selected = 0;
 int bt_menu_offset = 0;
 int playlist_menu_selected = 0;
 int playlist_menu_offset = 0;
+int artist_menu_selected = 0;
+int album_menu_selected = 0;      // Relative to the artist's albums
+int album_track_menu_selected = 0; // Relative to the album's tracks
+int browse_artist = 0;            // Artist whose albums are listed
+int browse_album = 0;             // Album whose tracks are listed
+
+// Search: the query is the entered characters plus the one being picked with Up/Down
+char search_query[PLAYLIST_SEARCH_MAX_QUERY + 1] = "";
+int search_query_len = 0;
+int search_char = 1;              // Index into SEARCH_CHARSET of the character being picked
+bool search_editing = true;       // Editing the query, or picking from the results
+int search_results[SEARCH_MAX_RESULTS];
+int search_result_count = 0;
+int search_menu_selected = 0;
+uint32_t search_id = 0;           // Bumped on every new query
+
+int eq_preset = EQ_DEFAULT_PRESET;
+
+// Restarts the search for the query as currently shown
+void restartSearch() {
+    static const char charset[] = SEARCH_CHARSET;
+    search_query[search_query_len] = charset[search_char];
+    search_query[search_query_len + 1] = '\0';
+
+    // A space still being picked is not searched for, so the results stay put until a
+    // real character follows it
+    char query[PLAYLIST_SEARCH_MAX_QUERY + 1];
+    strcpy(query, search_query);
+    if (charset[search_char] == ' ') query[search_query_len] = '\0';
+
+    search_result_count = 0;
+    search_menu_selected = 0;
+    search_id++;
+    playlist_manager.startSearch(query);
+}
+
+// Moves the playback position by a step that grows the longer the button is held
+void scrub(int direction) {
+    int32_t step = SCRUB_STEP_MS * input_manager.getRepeatStep();
+    int32_t target = (int32_t)music_player.getPositionMs() + direction * step;
+    music_player.postCommand(PlayerCommand::SEEK, max(target, (int32_t)0));
+}
+
+// Serial log of what the player does. The player task only queues its plain events; the
+// text is put together here, on the UI loop, so UART and SD reads never hold it up
+void logPlayerEvent(const PlayerEvent& event) {
+    static const char* const state_names[] = {"Stopped", "Playing", "Paused"};
+    char name[128];
+    switch (event.type) {
+        case PlayerEventType::STATE_CHANGED:
+            Serial.printf("Player: %s, track %d%s\n", state_names[(int)event.state], (int)event.track_index,
+                          music_player.isShuffleEnabled() ? ", shuffled" : "");
+            break;
+        case PlayerEventType::TRACK_STARTED:
+            if (!playlist_manager.getTrackName(event.track_index, name, sizeof(name))) strcpy(name, "?");
+            Serial.printf("Playing: %s\n", name);
+            Serial.printf("Index cache: %u hits, %u misses\n",
+                          (unsigned)playlist_manager.getCacheHits(), (unsigned)playlist_manager.getCacheMisses());
+            // Watermarks to spot fragmentation: the largest block shrinks long before free space runs out
+            Serial.printf("Heap: %u free, %u lowest, %u largest block\n",
+                          (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMinFreeHeap(), (unsigned)ESP.getMaxAllocHeap());
+            break;
+        case PlayerEventType::TRACK_OPEN_FAILED:
+            if (!playlist_manager.getTrackName(event.track_index, name, sizeof(name))) strcpy(name, "?");
+            Serial.printf("Failed to open: %s\n", name);
+            break;
+        case PlayerEventType::TRACK_FINISHED:
+            Serial.println("Track finished");
+            break;
+        case PlayerEventType::SEEKED:
+            Serial.printf("Seek to %d:%02d\n", (int)(event.value / 60000), (int)(event.value / 1000 % 60));
+            break;
+        case PlayerEventType::CONNECTION_CHANGED:
+            Serial.println(event.value ? "Bluetooth connected" : "Bluetooth disconnected");
+            break;
+    }
+}
+
+void logPlayerEvents() {
+    static uint32_t reported_drops = 0;
+    PlayerEvent event;
+    while (log_events.pop(event)) {
+        logPlayerEvent(event);
+    }
+    uint32_t drops = log_events.getDroppedCount();
+    if (drops != reported_drops) {
+        Serial.printf("Player: %u events not logged, the log queue was full\n", (unsigned)(drops - reported_drops));
+        reported_drops = drops;
+    }
+}
+
+// Pausing, stopping or losing the connection often comes before power-off: save right away.
+// A new track is saved too, so a reboot never goes back more than one track.
+void flushPlaybackOnEvent(const PlayerEvent& event, void* context) {
+    bool idle = event.type == PlayerEventType::STATE_CHANGED && event.state != PlayerState::PLAYING;
+    bool disconnected = event.type == PlayerEventType::CONNECTION_CHANGED && event.value == 0;
+    if (idle || disconnected || event.type == PlayerEventType::TRACK_STARTED) {
+        playback_store.requestFlush();
+    }
+}
+
+// Hands the playback state to the store, which writes it to NVS only when due
+void savePlaybackState() {
+    static int hashed_track = -1;
+    static uint32_t track_hash = 0;
+    int track = music_player.getCurrentTrackIndex();
+    if (track != hashed_track) {
+        track_hash = (track >= 0) ? playlist_manager.getTrackPathHash(track) : 0;
+        hashed_track = track;
+    }
+
+    PlaybackState state;
+    memset(&state, 0, sizeof(state));
+    state.volume = bluetooth_manager.getVolume();
+    state.shuffle = music_player.isShuffleEnabled();
+    state.eq_preset = eq_preset;
+    state.track_index = track;
+    state.track_path_hash = track_hash;
+    state.position_ms = music_player.getPositionMs();
+    state.shuffle_seed = music_player.getShuffleSeed();
+    playback_store.update(state);
+    playback_store.service();
+}
+
+// Number of entries on a browse screen, read from the parent record
+int getBrowseListSize(AppScreen screen, BrowseRecord& parent) {
+    memset(&parent, 0, sizeof(parent));
+    if (screen == AppScreen::SCREEN_ARTIST_BROWSE) {
+        return playlist_manager.getArtistCount();
+    }
+    if (screen == AppScreen::SCREEN_ALBUM_BROWSE) {
+        playlist_manager.getBrowseRecord(BrowseLevel::ARTISTS, browse_artist, parent);
+    } else {
+        playlist_manager.getBrowseRecord(BrowseLevel::ALBUMS, browse_album, parent);
+    }
+    return parent.child_count;
+}
 
 void setup() {
     Serial.begin(SERIAL_BAUD_RATE);
@@ -42,14 +182,24 @@ void setup() {
     display_manager.setBluetoothManager(&bluetooth_manager);
     display_manager.setPlaylistManager(&playlist_manager);
     
-    if (!SD.begin(SD_CS_PIN)) {
+    if (!SD.begin(SD_CS_PIN, SPI, SD_SPI_FREQUENCY, "/sd", SD_MAX_OPEN_FILES)) {
         Serial.println("SD card initialization failed!");
         return;
     }
     Serial.println("SD card initialized successfully");
     
-    if (!playlist_manager.scanForMP3Files() || playlist_manager.getTrackCount() == 0) {
-        Serial.println("No MP3 files found on SD card!");
+    // Loads the existing index if there is one; scanning continues in the background
+    if (!playlist_manager.begin()) {
+        Serial.println("Failed to start library scan!");
+    }
+
+    // Carry on where the last session stopped, if the file is still in the library
+    playback_store.begin();
+    const PlaybackState& saved = playback_store.getSaved();
+    if (playback_store.hasSavedState()) {
+        eq_preset = constrain((int)saved.eq_preset, 0, Equalizer::getPresetCount() - 1);
+        music_player.restoreShuffle(saved.shuffle, saved.shuffle_seed);
+        music_player.setResumePoint(saved.track_index, saved.position_ms, saved.track_path_hash);
     }
     
     bluetooth_manager.setMusicPlayer(&music_player);
@@ -57,8 +207,21 @@ void setup() {
         Serial.println("Failed to initialize Bluetooth");
         return;
     }
+    if (playback_store.hasSavedState()) {
+        bluetooth_manager.setVolume(saved.volume);
+    }
     
     input_manager.initialize();
+
+    if (!audio_processor.begin()) {
+        Serial.println("Failed to start audio decoding!");
+    }
+    music_player.subscribe(PlayerEventQueue::handler, &log_events);
+    music_player.subscribe(flushPlaybackOnEvent);
+    if (!music_player.begin()) {
+        Serial.println("Failed to start the player!");
+    }
+    audio_processor.setEqualizerPreset(eq_preset);
     
     Serial.println("System ready! Starting Bluetooth discovery...");
     bluetooth_manager.startDiscovery();
@@ -79,10 +242,10 @@ void loop() {
                         bluetooth_manager.disconnect(); // Disconnecting aborts the connection attempt
                         break;
                     case InputEvent::INPUT_EVENT_RIGHT:
-                        current_screen = AppScreen::SCREEN_TRACK_SELECTION;
+                        current_screen = AppScreen::SCREEN_ARTIST_BROWSE;
                         break;
                     case InputEvent::INPUT_EVENT_LEFT:
-                        current_screen = AppScreen::SCREEN_VOLUME_CONTROL;
+                        current_screen = AppScreen::SCREEN_SETTINGS;
                         break;
                     default: break;
                 }
@@ -98,10 +261,10 @@ void loop() {
                         break;
                     // In connected state, other navigation buttons do nothing for this screen
                     case InputEvent::INPUT_EVENT_RIGHT:
-                        current_screen = AppScreen::SCREEN_TRACK_SELECTION;
+                        current_screen = AppScreen::SCREEN_ARTIST_BROWSE;
                         break;
                     case InputEvent::INPUT_EVENT_LEFT:
-                        current_screen = AppScreen::SCREEN_VOLUME_CONTROL;
+                        current_screen = AppScreen::SCREEN_SETTINGS;
                         break;
                     default: break;
                 }
@@ -125,10 +288,10 @@ void loop() {
                         }
                         break;
                     case InputEvent::INPUT_EVENT_RIGHT:
-                        current_screen = AppScreen::SCREEN_TRACK_SELECTION;
+                        current_screen = AppScreen::SCREEN_ARTIST_BROWSE;
                         break;
                     case InputEvent::INPUT_EVENT_LEFT:
-                        current_screen = AppScreen::SCREEN_VOLUME_CONTROL;
+                        current_screen = AppScreen::SCREEN_SETTINGS;
                         break;
                     case InputEvent::INPUT_EVENT_ENTER:
                         if (device_count > 0 && bt_menu_selected < device_count) {
@@ -145,32 +308,129 @@ void loop() {
             break;
         }
 
+        case AppScreen::SCREEN_ARTIST_BROWSE:
+        case AppScreen::SCREEN_ALBUM_BROWSE:
+        case AppScreen::SCREEN_ALBUM_TRACKS: {
+            // Each level lists the children of the entry picked one level up
+            int* selected = &artist_menu_selected;
+            if (current_screen == AppScreen::SCREEN_ALBUM_BROWSE) selected = &album_menu_selected;
+            if (current_screen == AppScreen::SCREEN_ALBUM_TRACKS) selected = &album_track_menu_selected;
+
+            if (event != InputEvent::INPUT_EVENT_NONE) {
+                BrowseRecord parent;
+                int list_size = getBrowseListSize(current_screen, parent);
+                *selected = (list_size > 0) ? constrain(*selected, 0, list_size - 1) : 0;
+
+                switch (event) {
+                    case InputEvent::INPUT_EVENT_UP:
+                    case InputEvent::INPUT_EVENT_UP_LONG_PRESS:
+                    case InputEvent::INPUT_EVENT_UP_REPEAT:
+                        if (list_size > 0) {
+                            *selected = (*selected > 0) ? *selected - 1 : list_size - 1;
+                        }
+                        break;
+                    case InputEvent::INPUT_EVENT_DOWN:
+                    case InputEvent::INPUT_EVENT_DOWN_LONG_PRESS:
+                    case InputEvent::INPUT_EVENT_DOWN_REPEAT:
+                        if (list_size > 0) {
+                            *selected = (*selected < list_size - 1) ? *selected + 1 : 0;
+                        }
+                        break;
+                    case InputEvent::INPUT_EVENT_RIGHT:
+                        // Artists sit between Bluetooth and the full track list; deeper levels only go back
+                        if (current_screen == AppScreen::SCREEN_ARTIST_BROWSE) {
+                            current_screen = AppScreen::SCREEN_TRACK_SELECTION;
+                        }
+                        break;
+                    case InputEvent::INPUT_EVENT_LEFT:
+                        if (current_screen == AppScreen::SCREEN_ARTIST_BROWSE) {
+                            current_screen = AppScreen::SCREEN_BLUETOOTH_SELECTION;
+                        } else if (current_screen == AppScreen::SCREEN_ALBUM_BROWSE) {
+                            current_screen = AppScreen::SCREEN_ARTIST_BROWSE;
+                        } else {
+                            current_screen = AppScreen::SCREEN_ALBUM_BROWSE;
+                        }
+                        break;
+                    case InputEvent::INPUT_EVENT_ENTER:
+                        if (list_size == 0) break;
+                        if (current_screen == AppScreen::SCREEN_ARTIST_BROWSE) {
+                            browse_artist = *selected;
+                            album_menu_selected = 0;
+                            current_screen = AppScreen::SCREEN_ALBUM_BROWSE;
+                        } else if (current_screen == AppScreen::SCREEN_ALBUM_BROWSE) {
+                            browse_album = parent.first_child + *selected;
+                            album_track_menu_selected = 0;
+                            current_screen = AppScreen::SCREEN_ALBUM_TRACKS;
+                        } else {
+                            int track = playlist_manager.getAlbumTrack(parent.first_child + *selected);
+                            if (track >= 0) {
+                                music_player.postCommand(PlayerCommand::PLAY_TRACK, track);
+                                current_screen = AppScreen::SCREEN_NOW_PLAYING;
+                            }
+                        }
+                        break;
+                    default: break;
+                }
+            }
+
+            switch (current_screen) {
+                case AppScreen::SCREEN_ARTIST_BROWSE:
+                    display_manager.setBrowseMenuState(BrowseLevel::ARTISTS, -1, artist_menu_selected);
+                    break;
+                case AppScreen::SCREEN_ALBUM_BROWSE:
+                    display_manager.setBrowseMenuState(BrowseLevel::ALBUMS, browse_artist, album_menu_selected);
+                    break;
+                case AppScreen::SCREEN_ALBUM_TRACKS:
+                    display_manager.setBrowseMenuState(BrowseLevel::TRACKS, browse_album, album_track_menu_selected);
+                    break;
+                default: break;
+            }
+            break;
+        }
+
         case AppScreen::SCREEN_TRACK_SELECTION: {
             int track_count = playlist_manager.getTrackCount();
             switch (event) {
                 case InputEvent::INPUT_EVENT_UP:
                 case InputEvent::INPUT_EVENT_UP_LONG_PRESS:
                 case InputEvent::INPUT_EVENT_UP_REPEAT:
+                    // Held buttons move further per step; the ends wrap only from the very first/last track
                     if (track_count > 0) {
-                        playlist_menu_selected = (playlist_menu_selected > 0) ? playlist_menu_selected - 1 : track_count - 1;
+                        playlist_menu_selected = (playlist_menu_selected > 0)
+                            ? max(0, playlist_menu_selected - input_manager.getRepeatStep()) : track_count - 1;
                     }
                     break;
                 case InputEvent::INPUT_EVENT_DOWN:
                 case InputEvent::INPUT_EVENT_DOWN_LONG_PRESS:
                 case InputEvent::INPUT_EVENT_DOWN_REPEAT:
                     if (track_count > 0) {
-                        playlist_menu_selected = (playlist_menu_selected < track_count - 1) ? playlist_menu_selected + 1 : 0;
+                        playlist_menu_selected = (playlist_menu_selected < track_count - 1)
+                            ? min(track_count - 1, playlist_menu_selected + input_manager.getRepeatStep()) : 0;
                     }
                     break;
+                case InputEvent::INPUT_EVENT_LEFT_LONG_PRESS:
+                case InputEvent::INPUT_EVENT_LEFT_REPEAT:
+                    // Jump to the start of the current or previous letter group
+                    playlist_menu_selected = playlist_manager.getJumpTarget(playlist_menu_selected, -1);
+                    break;
+                case InputEvent::INPUT_EVENT_RIGHT_LONG_PRESS:
+                case InputEvent::INPUT_EVENT_RIGHT_REPEAT:
+                    playlist_menu_selected = playlist_manager.getJumpTarget(playlist_menu_selected, 1);
+                    break;
                 case InputEvent::INPUT_EVENT_RIGHT:
                     current_screen = AppScreen::SCREEN_NOW_PLAYING;
                     break;
                 case InputEvent::INPUT_EVENT_LEFT:
-                    current_screen = AppScreen::SCREEN_BLUETOOTH_SELECTION;
+                    current_screen = AppScreen::SCREEN_ARTIST_BROWSE;
+                    break;
+                case InputEvent::INPUT_EVENT_ENTER_LONG_PRESS:
+                    search_editing = true;
+                    restartSearch();
+                    current_screen = AppScreen::SCREEN_SEARCH;
                     break;
                 case InputEvent::INPUT_EVENT_ENTER:
                     if (track_count > 0 && playlist_menu_selected < track_count) {
-                        music_player.executeCommand(PlayerCommand::PLAY_TRACK, playlist_menu_selected);
+                        music_player.postCommand(PlayerCommand::PLAY_TRACK, playlist_menu_selected);
                         current_screen = AppScreen::SCREEN_NOW_PLAYING;
                     }
                     break;
@@ -180,17 +440,106 @@ void loop() {
             break;
         }
 
+        case AppScreen::SCREEN_SEARCH: {
+            static const int charset_size = sizeof(SEARCH_CHARSET) - 1;
+            if (search_editing) {
+                // Up/Down pick the current character, Right accepts it, Left deletes,
+                // Enter moves to the results
+                switch (event) {
+                    case InputEvent::INPUT_EVENT_UP:
+                    case InputEvent::INPUT_EVENT_UP_LONG_PRESS:
+                    case InputEvent::INPUT_EVENT_UP_REPEAT:
+                        search_char = (search_char > 0) ? search_char - 1 : charset_size - 1;
+                        restartSearch();
+                        break;
+                    case InputEvent::INPUT_EVENT_DOWN:
+                    case InputEvent::INPUT_EVENT_DOWN_LONG_PRESS:
+                    case InputEvent::INPUT_EVENT_DOWN_REPEAT:
+                        search_char = (search_char < charset_size - 1) ? search_char + 1 : 0;
+                        restartSearch();
+                        break;
+                    case InputEvent::INPUT_EVENT_RIGHT:
+                        if (search_query_len < PLAYLIST_SEARCH_MAX_QUERY - 1) {
+                            search_query_len++;
+                            restartSearch();
+                        }
+                        break;
+                    case InputEvent::INPUT_EVENT_LEFT:
+                        if (search_query_len == 0) {
+                            playlist_manager.stopSearch();
+                            current_screen = AppScreen::SCREEN_TRACK_SELECTION;
+                        } else {
+                            // Step back onto the previous character
+                            search_query_len--;
+                            const char* found = strchr(SEARCH_CHARSET, search_query[search_query_len]);
+                            search_char = found ? found - SEARCH_CHARSET : 0;
+                            restartSearch();
+                        }
+                        break;
+                    case InputEvent::INPUT_EVENT_LEFT_LONG_PRESS:
+                        playlist_manager.stopSearch();
+                        current_screen = AppScreen::SCREEN_TRACK_SELECTION;
+                        break;
+                    case InputEvent::INPUT_EVENT_ENTER:
+                        if (search_result_count > 0) {
+                            search_editing = false;
+                        }
+                        break;
+                    default: break;
+                }
+            } else {
+                switch (event) {
+                    case InputEvent::INPUT_EVENT_UP:
+                    case InputEvent::INPUT_EVENT_UP_LONG_PRESS:
+                    case InputEvent::INPUT_EVENT_UP_REPEAT:
+                        search_menu_selected = (search_menu_selected > 0) ? search_menu_selected - 1 : search_result_count - 1;
+                        break;
+                    case InputEvent::INPUT_EVENT_DOWN:
+                    case InputEvent::INPUT_EVENT_DOWN_LONG_PRESS:
+                    case InputEvent::INPUT_EVENT_DOWN_REPEAT:
+                        search_menu_selected = (search_menu_selected < search_result_count - 1) ? search_menu_selected + 1 : 0;
+                        break;
+                    case InputEvent::INPUT_EVENT_LEFT:
+                        search_editing = true;
+                        break;
+                    case InputEvent::INPUT_EVENT_ENTER:
+                        music_player.postCommand(PlayerCommand::PLAY_TRACK, search_results[search_menu_selected]);
+                        current_screen = AppScreen::SCREEN_NOW_PLAYING;
+                        break;
+                    case InputEvent::INPUT_EVENT_ENTER_LONG_PRESS:
+                        // Show the match in the full playlist
+                        playlist_menu_selected = search_results[search_menu_selected];
+                        current_screen = AppScreen::SCREEN_TRACK_SELECTION;
+                        break;
+                    default: break;
+                }
+            }
+
+            // Matches stream in a slice at a time, so the first ones show up right away
+            if (!playlist_manager.isSearchDone()) {
+                search_result_count += playlist_manager.continueSearch(search_results + search_result_count,
+                                                                       SEARCH_MAX_RESULTS - search_result_count,
+                                                                       SEARCH_SLICE_MS);
+                if (search_result_count == SEARCH_MAX_RESULTS) {
+                    playlist_manager.stopSearch();
+                }
+            }
+            display_manager.setSearchState(search_query, search_query_len, search_editing, search_id,
+                                           search_results, search_result_count, search_menu_selected);
+            break;
+        }
+
         case AppScreen::SCREEN_NOW_PLAYING: {
             switch (event) {
                 case InputEvent::INPUT_EVENT_UP:
                 case InputEvent::INPUT_EVENT_UP_LONG_PRESS:
                 case InputEvent::INPUT_EVENT_UP_REPEAT:
-                    music_player.executeCommand(PlayerCommand::PREV_TRACK);
+                    music_player.postCommand(PlayerCommand::PREV_TRACK);
                     break;
                 case InputEvent::INPUT_EVENT_DOWN:
                 case InputEvent::INPUT_EVENT_DOWN_LONG_PRESS:
                 case InputEvent::INPUT_EVENT_DOWN_REPEAT:
-                    music_player.executeCommand(PlayerCommand::NEXT_TRACK);
+                    music_player.postCommand(PlayerCommand::NEXT_TRACK);
                     break;
                 case InputEvent::INPUT_EVENT_RIGHT:
                     current_screen = AppScreen::SCREEN_VOLUME_CONTROL;
@@ -198,12 +547,24 @@ void loop() {
                 case InputEvent::INPUT_EVENT_LEFT:
                     current_screen = AppScreen::SCREEN_TRACK_SELECTION;
                     break;
-                case InputEvent::INPUT_EVENT_ENTER:
+                // Holding Left/Right scrubs through the track
+                case InputEvent::INPUT_EVENT_LEFT_LONG_PRESS:
+                case InputEvent::INPUT_EVENT_LEFT_REPEAT:
+                    scrub(-1);
+                    break;
+                case InputEvent::INPUT_EVENT_RIGHT_LONG_PRESS:
+                case InputEvent::INPUT_EVENT_RIGHT_REPEAT:
+                    scrub(1);
+                    break;
                 case InputEvent::INPUT_EVENT_ENTER_LONG_PRESS:
+                    // Each time it is turned on the order is new
+                    music_player.postCommand(PlayerCommand::SHUFFLE, !music_player.isShuffleEnabled());
+                    break;
+                case InputEvent::INPUT_EVENT_ENTER:
                     if (music_player.getState() == PlayerState::PLAYING) {
-                        music_player.executeCommand(PlayerCommand::PAUSE);
+                        music_player.postCommand(PlayerCommand::PAUSE);
                     } else {
-                        music_player.executeCommand(PlayerCommand::PLAY);
+                        music_player.postCommand(PlayerCommand::PLAY);
                     }
                     break;
                 default: break;
@@ -224,7 +585,7 @@ void loop() {
                     bluetooth_manager.volumeDown();
                     break;
                 case InputEvent::INPUT_EVENT_RIGHT:
-                    current_screen = AppScreen::SCREEN_BLUETOOTH_SELECTION;
+                    current_screen = AppScreen::SCREEN_SETTINGS;
                     break;
                 case InputEvent::INPUT_EVENT_LEFT:
                     current_screen = AppScreen::SCREEN_NOW_PLAYING;
@@ -236,6 +597,33 @@ void loop() {
             }
             break;
         }
+
+        case AppScreen::SCREEN_SETTINGS: {
+            // Up/Down step through the equaliser presets; the new one is heard right away
+            int preset_count = Equalizer::getPresetCount();
+            switch (event) {
+                case InputEvent::INPUT_EVENT_UP:
+                    eq_preset = (eq_preset > 0) ? eq_preset - 1 : preset_count - 1;
+                    audio_processor.setEqualizerPreset(eq_preset);
+                    break;
+                case InputEvent::INPUT_EVENT_DOWN:
+                    eq_preset = (eq_preset < preset_count - 1) ? eq_preset + 1 : 0;
+                    audio_processor.setEqualizerPreset(eq_preset);
+                    break;
+                case InputEvent::INPUT_EVENT_RIGHT:
+                    current_screen = AppScreen::SCREEN_BLUETOOTH_SELECTION;
+                    break;
+                case InputEvent::INPUT_EVENT_LEFT:
+                    current_screen = AppScreen::SCREEN_VOLUME_CONTROL;
+                    break;
+                case InputEvent::INPUT_EVENT_ENTER:
+                    current_screen = AppScreen::SCREEN_NOW_PLAYING;
+                    break;
+                default: break;
+            }
+            display_manager.setSettingsState(eq_preset);
+            break;
+        }
     }
 
     // Check for Bluetooth connection event to trigger screen transition
@@ -246,12 +634,34 @@ void loop() {
         bluetooth_manager.consumeConnectionEvent();
     }
 
+    // Gapless playback: pre-open the next track when the decoder asks, and follow it once it plays.
+    // A full queue leaves the request raised for the next pass.
+    if (audio_processor.hasNextFileRequest() && music_player.postCommand(PlayerCommand::QUEUE_NEXT_TRACK)) {
+        audio_processor.consumeNextFileRequest();
+    }
+    if (audio_processor.hasTrackChangeEvent() && music_player.postCommand(PlayerCommand::TRACK_ADVANCED)) {
+        audio_processor.consumeTrackChangeEvent();
+    }
+
     // Poll for remote volume changes (from headphones/speaker)
     if (bluetooth_manager.hasVolumeChanged()) {
         bluetooth_manager.consumeVolumeChangeEvent();
         // Display will automatically update with new volume on next update()
     }
 
+    logPlayerEvents();
+    savePlaybackState();
     display_manager.update(current_screen);
-    delay(100);
+    playlist_manager.prefetch();  // Warm the index cache for the next scroll step while idle
+
+    // A running search takes the next slice straight away instead of idling between them,
+    // and a held button is polled often enough for the accelerated repeats to come through
+    bool searching = current_screen == AppScreen::SCREEN_SEARCH && !playlist_manager.isSearchDone();
+    if (searching) {
+        delay(1);
+    } else if (input_manager.isButtonHeld()) {
+        delay(LONG_PRESS_POLL_INTERVAL);
+    } else {
+        delay(100);
+    }
 }
@@ -23,6 +23,27 @@
 // --- Menu Settings ---
 #define MENU_SCROLL_DELAY 500 // Milliseconds to wait before starting to scroll long text
 #define MENU_SCROLL_SPEED 75 // Milliseconds per pixel shift for scrolling text
+#define MENU_SETTLE_DELAY 250 // Selection changes closer than this count as fast scrolling (no SD reads)
+
+// --- Search ---
+#define SEARCH_MAX_RESULTS 64 // Matches kept per query
+#define SEARCH_SLICE_MS 20 // Search time per main loop pass, keeps the UI responsive
+#define SEARCH_CHARSET " abcdefghijklmnopqrstuvwxyz0123456789-'&" // Characters offered by Up/Down
+
+// --- Playback ---
+#define SCRUB_STEP_MS 5000 // Seek step of Left/Right held on the player screen, grows with the scroll acceleration
+#define PLAYER_SKIP_SETTLE_MS 400 // Next/Prev only open a track once presses stop for this long
+
+// --- ReplayGain ---
+// Tracks are levelled in software, ahead of the Bluetooth volume. Gains come from tags, the
+// LAME header or a background pass that measures tracks after each scan.
+#define REPLAYGAIN_ENABLED true
+#define REPLAYGAIN_PREFER_ALBUM true // Album gain keeps the level steps between tracks of an album
+#define REPLAYGAIN_PREAMP_DB 0 // Added to every gain; a limiter catches anything that would clip
+#define REPLAYGAIN_MISSING_DB 0 // For tracks the background pass has not measured yet; left as they are
+
+// --- Equaliser ---
+#define EQ_DEFAULT_PRESET 0 // Index into the presets of Equalizer.cpp; 0 is flat
 
 // -- Splash Screen Logo (56x56px)
 #define LOGO_WIDTH 56
@@ -74,6 +95,9 @@ const unsigned char splash_screen_logo[] PROGMEM = {
 
 // --- SD Card ---
 #define SD_CS_PIN 22
+#define SD_SPI_FREQUENCY 4000000
+// Index files, the background scanner's folder stack and the playing track are open at once
+#define SD_MAX_OPEN_FILES 16
 
 // --- OLED Display ---
 #define OLED_DC    27
@@ -101,6 +125,9 @@ const unsigned char splash_screen_logo[] PROGMEM = {
 #define DEBOUNCE_DELAY 50 // in milliseconds
 #define LONG_PRESS_DURATION 500 // ms to trigger a long press
 #define LONG_PRESS_REPEAT_DELAY 150 // ms between repeat events during long press
+#define LONG_PRESS_ACCEL_TIME 1500 // ms of holding before each speed-up of repeat events
+#define LONG_PRESS_ACCEL_LEVELS 3 // Speed-ups: each halves the repeat delay and multiplies the scroll step by 4
+#define LONG_PRESS_POLL_INTERVAL 5 // ms between main loop passes while a button is held, below the fastest repeat
 
 #endif // DEV_BOARD_REV_1_0
 
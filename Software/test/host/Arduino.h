@@ -0,0 +1,203 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino core the portable modules use. Header-only,
+// so the native test env needs nothing but this directory on the include path.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define IRAM_ATTR
+#define HIGH 1
+#define LOW 0
+#define INPUT_PULLUP 2
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+
+using std::min;
+using std::max;
+
+template <class T, class L, class H>
+T constrain(T x, L low, H high) { return x < low ? low : (x > high ? high : x); }
+
+inline std::chrono::steady_clock::time_point hostStartTime() {
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return start;
+}
+
+inline unsigned long millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - hostStartTime()).count();
+}
+
+inline unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - hostStartTime()).count();
+}
+
+inline void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+inline void delayMicroseconds(unsigned int us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+inline void yield() { std::this_thread::yield(); }
+inline int digitalRead(int) { return HIGH; }
+inline void pinMode(int, int) {}
+
+inline uint32_t esp_random() {
+    static std::mt19937 generator(12345);
+    return generator();
+}
+
+class String {
+public:
+    String(const char* text = "") : text(text ? text : "") {}
+    String(const std::string& text) : text(text) {}
+    explicit String(char c) : text(1, c) {}
+    String(int value) : text(std::to_string(value)) {}
+    String(unsigned int value) : text(std::to_string(value)) {}
+    String(long value) : text(std::to_string(value)) {}
+    String(unsigned long value) : text(std::to_string(value)) {}
+
+    const char* c_str() const { return text.c_str(); }
+    unsigned int length() const { return text.size(); }
+    bool isEmpty() const { return text.empty(); }
+    void reserve(unsigned int size) { text.reserve(size); }
+    char operator[](unsigned int index) const { return index < text.size() ? text[index] : 0; }
+    bool startsWith(const char* prefix) const { return text.compare(0, strlen(prefix), prefix) == 0; }
+    bool endsWith(const char* suffix) const {
+        size_t n = strlen(suffix);
+        return text.size() >= n && text.compare(text.size() - n, n, suffix) == 0;
+    }
+    String substring(unsigned int from, unsigned int to) const {
+        from = min(from, (unsigned int)text.size());
+        return String(text.substr(from, max(to, from) - from));
+    }
+    String substring(unsigned int from) const { return substring(from, text.size()); }
+    int indexOf(char c) const { size_t at = text.find(c); return at == std::string::npos ? -1 : (int)at; }
+    int lastIndexOf(char c) const { size_t at = text.rfind(c); return at == std::string::npos ? -1 : (int)at; }
+    void trim() {
+        size_t start = text.find_first_not_of(" \t\r\n");
+        size_t end = text.find_last_not_of(" \t\r\n");
+        text = start == std::string::npos ? "" : text.substr(start, end - start + 1);
+    }
+    void toLowerCase() { for (char& c : text) c = tolower((unsigned char)c); }
+
+    String& operator+=(const String& other) { text += other.text; return *this; }
+    String& operator+=(const char* other) { text += other; return *this; }
+    String& operator+=(char c) { text += c; return *this; }
+    friend String operator+(const String& a, const String& b) { return String(a.text + b.text); }
+    friend String operator+(const String& a, const char* b) { return String(a.text + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b.text); }
+    bool operator==(const String& other) const { return text == other.text; }
+    bool operator!=(const String& other) const { return text != other.text; }
+    bool operator==(const char* other) const { return text == other; }
+    bool operator!=(const char* other) const { return text != other; }
+    bool operator<(const String& other) const { return text < other.text; }
+
+private:
+    std::string text;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        for (size_t i = 0; i < size; i++) write(buffer[i]);
+        return size;
+    }
+    size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    virtual void flush() {}
+
+    size_t print(const char* text) { return write(text); }
+    size_t print(const String& text) { return write(text.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(long value) { return print(String(value)); }
+    size_t print(int value) { return print(String(value)); }
+    size_t print(unsigned long value) { return print(String(value)); }
+    size_t print(unsigned int value) { return print(String(value)); }
+    size_t println() { return write((uint8_t)'\n'); }
+    template <class T> size_t println(const T& value) { return print(value) + println(); }
+
+    int printf(const char* format, ...) {
+        char buffer[512];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        write((const uint8_t*)buffer, strlen(buffer));
+        return len;
+    }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t readBytes(uint8_t* buffer, size_t length) {
+        size_t count = 0;
+        while (count < length) {
+            int c = read();
+            if (c < 0) break;
+            buffer[count++] = (uint8_t)c;
+        }
+        return count;
+    }
+    size_t readBytes(char* buffer, size_t length) { return readBytes((uint8_t*)buffer, length); }
+    void setTimeout(unsigned long) {}
+};
+
+// Log output goes to stdout; set quiet to keep benchmarks readable
+class HardwareSerial : public Stream {
+public:
+    bool quiet = false;
+
+    void begin(unsigned long) {}
+    operator bool() const { return true; }
+    size_t write(uint8_t c) override {
+        if (!quiet) putchar(c);
+        return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (!quiet) fwrite(buffer, 1, size, stdout);
+        return size;
+    }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+inline HardwareSerial Serial;
+
+// Cycle counts are derived from the host clock as if it ran at the ESP32's 240 MHz; they
+// keep the modules' logging working, but only measurements on the board mean anything
+class EspClass {
+public:
+    uint32_t getFreeHeap() { return 200000; }
+    uint32_t getMinFreeHeap() { return 180000; }
+    uint32_t getMaxAllocHeap() { return 110000; }
+    uint32_t getCycleCount() {
+        return (uint32_t)(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - hostStartTime()).count() * 240 / 1000);
+    }
+};
+
+inline EspClass ESP;
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#endif
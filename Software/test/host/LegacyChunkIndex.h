@@ -0,0 +1,61 @@
+#ifndef HOST_LEGACY_CHUNK_INDEX_H
+#define HOST_LEGACY_CHUNK_INDEX_H
+
+// The chunked text index the binary track index replaced: "/legacy/all.NNNN" files of
+// LEGACY_CHUNK_SIZE full paths each, one per line, scanned line by line on lookup.
+// Written from a scanned playlist so both return the same path for an index.
+
+#include <SD.h>
+#include "PlaylistManager.h"
+
+#define LEGACY_DIR "/legacy"
+#define LEGACY_CHUNK_SIZE 10
+
+inline void legacyChunkPath(char* out, size_t size, int chunk) {
+    snprintf(out, size, "%s/all.%04d", LEGACY_DIR, chunk);
+}
+
+// The old getTrackPath(): open the chunk, skip lines a byte at a time, read the path
+inline size_t legacyTrackPath(int index, char* buffer, size_t buffer_size) {
+    char chunk_path[32];
+    legacyChunkPath(chunk_path, sizeof(chunk_path), index / LEGACY_CHUNK_SIZE);
+    File f = SD.open(chunk_path, FILE_READ);
+    if (!f) return 0;
+    int local = index % LEGACY_CHUNK_SIZE;
+    int line = 0;
+    while (line < local && f.available()) {
+        if (f.read() == '\n') line++;
+    }
+    size_t len = 0;
+    while (f.available() && len < buffer_size - 1) {
+        int c = f.read();
+        if (c == '\n' || c == '\r') break;
+        buffer[len++] = c;
+    }
+    buffer[len] = '\0';
+    f.close();
+    return line == local ? len : 0;
+}
+
+// Returns the bytes written: what the old index stored for the library
+inline uint64_t legacyWriteIndex(const PlaylistManager& playlist) {
+    SD.mkdir(LEGACY_DIR);
+    char path[PLAYLIST_MAX_PATH];
+    char chunk_path[32];
+    File chunk;
+    uint64_t bytes = 0;
+    for (int i = 0; i < (int)playlist.getTrackCount(); i++) {
+        if (i % LEGACY_CHUNK_SIZE == 0) {
+            chunk.close();
+            legacyChunkPath(chunk_path, sizeof(chunk_path), i / LEGACY_CHUNK_SIZE);
+            chunk = SD.open(chunk_path, FILE_WRITE);
+        }
+        bytes += playlist.getTrackPath(i, path, sizeof(path)) + 2;
+        chunk.print(path);
+        chunk.print("\r\n");
+    }
+    chunk.close();
+    return bytes;
+}
+
+#endif
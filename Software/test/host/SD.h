@@ -0,0 +1,222 @@
+#ifndef HOST_SD_H
+#define HOST_SD_H
+
+// Host stand-in for the ESP32 SD library. Paths map into a directory on the host, and
+// every read, write and seek is counted so tests can report the card traffic they cause.
+
+#include <Arduino.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+struct SdCounters {
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    uint32_t reads = 0;   // read() calls that reached the card
+    uint32_t writes = 0;
+    uint32_t seeks = 0;
+    uint32_t opens = 0;
+};
+
+struct HostFile {
+    FILE* stream = nullptr;
+    std::string path;  // Card path
+    std::string name;  // Last component
+    bool directory = false;
+    std::vector<std::string> entries;  // Listing of a directory, taken when it is opened
+    size_t next_entry = 0;
+
+    ~HostFile() {
+        if (stream) fclose(stream);
+    }
+};
+
+class File;
+
+class SDFS {
+public:
+    SdCounters counters;
+
+    SDFS() : root((std::filesystem::temp_directory_path() / "esp32-mp3-sd").string()) {}
+
+    bool begin(uint8_t = 5, ...) {
+        std::filesystem::create_directories(root);
+        return true;
+    }
+
+    // Points the card at a host directory, created if missing
+    void setRoot(const std::string& path) {
+        root = path;
+        std::filesystem::create_directories(root);
+    }
+    const std::string& getRoot() const { return root; }
+
+    // Empties the card
+    void format() {
+        std::error_code error;
+        std::filesystem::remove_all(root, error);
+        std::filesystem::create_directories(root);
+    }
+
+    void resetCounters() { counters = SdCounters(); }
+
+    std::string hostPath(const char* path) const {
+        return root + (path[0] == '/' ? "" : "/") + path;
+    }
+
+    File open(const char* path, const char* mode = FILE_READ, bool create = false);
+    File open(const String& path, const char* mode = FILE_READ, bool create = false);
+
+    bool exists(const char* path) {
+        struct stat st;
+        return stat(hostPath(path).c_str(), &st) == 0;
+    }
+    bool exists(const String& path) { return exists(path.c_str()); }
+    bool remove(const char* path) { return ::remove(hostPath(path).c_str()) == 0; }
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool mkdir(const char* path) { return ::mkdir(hostPath(path).c_str(), 0755) == 0; }
+    bool mkdir(const String& path) { return mkdir(path.c_str()); }
+    bool rmdir(const char* path) { return ::rmdir(hostPath(path).c_str()) == 0; }
+    bool rename(const char* from, const char* to) {
+        return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+    }
+    bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+
+    uint64_t usedBytes() {
+        uint64_t used = 0;
+        std::error_code error;
+        for (auto& entry : std::filesystem::recursive_directory_iterator(root, error)) {
+            if (entry.is_regular_file()) used += entry.file_size();
+        }
+        return used;
+    }
+    uint64_t totalBytes() { return 32ull << 30; }
+    uint64_t cardSize() { return 32ull << 30; }
+
+private:
+    std::string root;
+};
+
+inline SDFS SD;
+
+class File : public Stream {
+public:
+    File() {}
+    explicit File(std::shared_ptr<HostFile> impl) : impl(impl) {}
+
+    operator bool() const { return impl != nullptr; }
+    const char* name() const { return impl ? impl->name.c_str() : ""; }
+    const char* path() const { return impl ? impl->path.c_str() : ""; }
+    bool isDirectory() const { return impl && impl->directory; }
+
+    size_t read(uint8_t* buffer, size_t length) {
+        if (!impl || !impl->stream) return 0;
+        size_t count = fread(buffer, 1, length, impl->stream);
+        SD.counters.reads++;
+        SD.counters.bytes_read += count;
+        return count;
+    }
+    int read() override {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+    size_t readBytes(uint8_t* buffer, size_t length) override { return read(buffer, length); }
+    int peek() override {
+        if (!impl || !impl->stream) return -1;
+        int c = fgetc(impl->stream);
+        if (c >= 0) ungetc(c, impl->stream);
+        return c;
+    }
+    int available() override {
+        if (!impl || !impl->stream) return 0;
+        return (int)(size() - position());
+    }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t length) override {
+        if (!impl || !impl->stream) return 0;
+        size_t count = fwrite(buffer, 1, length, impl->stream);
+        SD.counters.writes++;
+        SD.counters.bytes_written += count;
+        return count;
+    }
+    void flush() override {
+        if (impl && impl->stream) fflush(impl->stream);
+    }
+
+    bool seek(uint32_t position, SeekMode mode = SeekSet) {
+        if (!impl || !impl->stream) return false;
+        SD.counters.seeks++;
+        int whence = mode == SeekCur ? SEEK_CUR : (mode == SeekEnd ? SEEK_END : SEEK_SET);
+        return fseek(impl->stream, (long)position, whence) == 0;
+    }
+    size_t position() const { return impl && impl->stream ? (size_t)ftell(impl->stream) : 0; }
+    // Flushes and stats the file on every call, as the ESP32 VFS does
+    size_t size() const {
+        if (!impl || !impl->stream) return 0;
+        fflush(impl->stream);
+        struct stat st;
+        return fstat(fileno(impl->stream), &st) == 0 ? (size_t)st.st_size : 0;
+    }
+    time_t getLastWrite() {
+        struct stat st;
+        return impl && stat(SD.hostPath(impl->path.c_str()).c_str(), &st) == 0 ? st.st_mtime : 0;
+    }
+
+    void close() { impl.reset(); }
+
+    File openNextFile(const char* mode = FILE_READ) {
+        if (!impl || !impl->directory || impl->next_entry >= impl->entries.size()) return File();
+        std::string child = impl->path + (impl->path.back() == '/' ? "" : "/") + impl->entries[impl->next_entry++];
+        return SD.open(child.c_str(), mode);
+    }
+    void rewindDirectory() {
+        if (impl) impl->next_entry = 0;
+    }
+
+private:
+    std::shared_ptr<HostFile> impl;
+};
+
+inline File SDFS::open(const char* path, const char* mode, bool create) {
+    std::string host = hostPath(path);
+    auto impl = std::make_shared<HostFile>();
+    impl->path = path;
+    const char* slash = strrchr(path, '/');
+    impl->name = slash ? slash + 1 : path;
+
+    struct stat st;
+    bool found = stat(host.c_str(), &st) == 0;
+    if (found && S_ISDIR(st.st_mode)) {
+        impl->directory = true;
+        DIR* dir = opendir(host.c_str());
+        if (!dir) return File();
+        while (struct dirent* entry = readdir(dir)) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                impl->entries.push_back(entry->d_name);
+            }
+        }
+        closedir(dir);
+    } else {
+        if (!found && mode[0] == 'r' && !create) return File();
+        const char* host_mode = mode[0] == 'w' ? "w+b" : (mode[0] == 'a' ? "a+b" : (mode[1] == '+' ? "r+b" : "rb"));
+        impl->stream = fopen(host.c_str(), host_mode);
+        if (!impl->stream) return File();
+    }
+    counters.opens++;
+    return File(impl);
+}
+
+inline File SDFS::open(const String& path, const char* mode, bool create) { return open(path.c_str(), mode, create); }
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef HOST_SYNTHETIC_LIBRARY_H
+#define HOST_SYNTHETIC_LIBRARY_H
+
+// Music folders full of short synthetic MP3s, for tests that need a library to scan
+
+#include "SyntheticMp3.h"
+#include "PlaylistManager.h"
+
+// Writes folder_count folders of tracks_per_folder tracks below root. Names come from
+// the callbacks (folder, track) so tests can shape the sort and search; a folder name
+// may hold '/' for artist/album trees. Every track has a LAME gain, so the loudness
+// pass after a scan has nothing to decode.
+typedef void (*SyntheticNamer)(char* out, size_t size, int folder, int track);
+
+inline void syntheticFolderName(char* out, size_t size, int folder, int) {
+    snprintf(out, size, "Artist %02d", folder);
+}
+
+inline void syntheticTrackName(char* out, size_t size, int folder, int track) {
+    snprintf(out, size, "%02d Song %d of folder %d.mp3", track + 1, track + 1, folder);
+}
+
+inline bool syntheticWriteLibrary(const char* root, int folder_count, int tracks_per_folder,
+                                  SyntheticNamer folder_namer = syntheticFolderName,
+                                  SyntheticNamer track_namer = syntheticTrackName) {
+    SyntheticTrack track;
+    track.samples = 1;  // One audio frame: the scan reads headers, not audio
+    track.has_track_gain = true;
+    track.track_gain = -300;
+
+    std::vector<uint8_t> data;
+    SD.mkdir(root);
+    for (int folder = 0; folder < folder_count; folder++) {
+        char folder_name[64];
+        char path[256];
+        folder_namer(folder_name, sizeof(folder_name), folder, 0);
+        snprintf(path, sizeof(path), "%s/%s", root, folder_name);
+        for (char* slash = strchr(path + strlen(root) + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+            *slash = '\0';
+            SD.mkdir(path);  // Parents first; one that already exists is fine
+            *slash = '/';
+        }
+        SD.mkdir(path);
+        for (int i = 0; i < tracks_per_folder; i++) {
+            char name[128];
+            track_namer(name, sizeof(name), folder, i);
+            snprintf(path, sizeof(path), "%s/%s/%s", root, folder_name, name);
+            if (!syntheticWriteMp3(path, track)) return false;
+        }
+    }
+    return true;
+}
+
+// Waits until the background scan and the loudness pass after it have both finished
+inline bool syntheticWaitIdle(PlaylistManager& playlist, unsigned long timeout_ms = 600000) {
+    unsigned long start = millis();
+    while (!playlist.isIdle()) {
+        if (millis() - start > timeout_ms) return false;
+        delay(5);
+    }
+    return true;
+}
+
+// Runs begin() and waits for the background work it starts
+inline bool syntheticScanLibrary(PlaylistManager& playlist, unsigned long timeout_ms = 600000) {
+    if (!playlist.begin()) return false;
+    return syntheticWaitIdle(playlist, timeout_ms) && playlist.getTrackCount() > 0;
+}
+
+#endif
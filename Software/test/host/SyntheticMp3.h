@@ -0,0 +1,307 @@
+#ifndef HOST_SYNTHETIC_MP3_H
+#define HOST_SYNTHETIC_MP3_H
+
+// MP3 files for host tests. Headers, ID3 tags and Xing/LAME info frames are real; the
+// audio frames carry a SyntheticFrame in place of Huffman data, which the host
+// libhelix-mp3 decodes to a known test signal. A track of N samples is laid out the way
+// an encoder would: encoder_delay samples of silence in front, then the signal, then
+// padding to the end of the last frame, and the decoder adds MP3_DECODER_DELAY more.
+
+#include <SD.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#define SYNTHETIC_DECODER_DELAY 529
+#define SYNTHETIC_MAGIC "SYNT"
+
+enum SyntheticWaveform : uint8_t {
+    SYNTHETIC_SINE,     // amplitude * sin(2 pi n / period) on every channel
+    SYNTHETIC_COUNTER   // The sample index itself: low 14 bits left, next 14 bits right
+};
+
+struct SyntheticHeader {
+    uint8_t version;  // 1 = MPEG-1, 2 = MPEG-2, 3 = MPEG-2.5
+    uint8_t channels;
+    uint16_t bitrate_kbps;
+    uint32_t sample_rate;
+    uint16_t samples_per_frame;
+    int frame_length;
+    int side_info_offset;  // Where the main data (here the SyntheticFrame) starts
+};
+
+// What an audio frame decodes to. Numbers are stored seven bits per byte, so a frame
+// never holds a byte that could be mistaken for a sync word.
+struct SyntheticFrame {
+    int64_t first_sample;    // Signal index of the frame's first output sample
+    int64_t signal_begin;    // Samples outside [begin, end) are silent
+    int64_t signal_end;
+    uint8_t waveform;
+    double period;
+    int16_t amplitude;
+    uint16_t main_data_begin;  // Bytes taken from the bit reservoir
+};
+
+#define SYNTHETIC_FRAME_BYTES (4 + 5 * 3 + 1 + 5 + 3 + 2)
+
+static const uint16_t SYNTHETIC_BITRATES[2][16] = {
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0},
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0}
+};
+
+inline bool syntheticParseHeader(const uint8_t* data, SyntheticHeader& header) {
+    if (data[0] != 0xFF || (data[1] & 0xE0) != 0xE0) return false;
+    uint8_t version_bits = (data[1] >> 3) & 0x03;
+    uint8_t bitrate_index = data[2] >> 4;
+    uint8_t rate_index = (data[2] >> 2) & 0x03;
+    if (version_bits == 1 || ((data[1] >> 1) & 0x03) != 1) return false;
+    if (bitrate_index == 0 || bitrate_index == 15 || rate_index == 3) return false;
+
+    static const uint32_t rates[3] = {44100, 48000, 32000};
+    header.version = version_bits == 3 ? 1 : (version_bits == 2 ? 2 : 3);
+    header.channels = (data[3] >> 6) == 3 ? 1 : 2;
+    header.bitrate_kbps = SYNTHETIC_BITRATES[header.version == 1 ? 0 : 1][bitrate_index];
+    header.sample_rate = rates[rate_index] >> (header.version - 1);
+    header.samples_per_frame = header.version == 1 ? 1152 : 576;
+    header.frame_length = (header.samples_per_frame / 8) * header.bitrate_kbps * 1000 / header.sample_rate +
+                          ((data[2] >> 1) & 0x01);
+    if (header.version == 1) {
+        header.side_info_offset = 4 + (header.channels == 1 ? 17 : 32);
+    } else {
+        header.side_info_offset = 4 + (header.channels == 1 ? 9 : 17);
+    }
+    return true;
+}
+
+inline void syntheticPutNumber(uint8_t*& out, uint64_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--) out[i] = value & 0x7F, value >>= 7;
+    out += bytes;
+}
+
+inline uint64_t syntheticGetNumber(const uint8_t*& in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) value = (value << 7) | (in[i] & 0x7F);
+    in += bytes;
+    return value;
+}
+
+#define SYNTHETIC_BIAS (1ll << 33)
+
+inline bool syntheticReadFrame(const uint8_t* data, const SyntheticHeader& header, SyntheticFrame& frame) {
+    if (header.frame_length < header.side_info_offset + SYNTHETIC_FRAME_BYTES) return false;
+    const uint8_t* in = data + header.side_info_offset;
+    if (memcmp(in, SYNTHETIC_MAGIC, 4) != 0) return false;
+    in += 4;
+    frame.first_sample = (int64_t)syntheticGetNumber(in, 5) - SYNTHETIC_BIAS;
+    frame.signal_begin = (int64_t)syntheticGetNumber(in, 5) - SYNTHETIC_BIAS;
+    frame.signal_end = (int64_t)syntheticGetNumber(in, 5) - SYNTHETIC_BIAS;
+    frame.waveform = syntheticGetNumber(in, 1);
+    frame.period = syntheticGetNumber(in, 5) / 1000.0;
+    frame.amplitude = syntheticGetNumber(in, 3);
+    frame.main_data_begin = syntheticGetNumber(in, 2);
+    return true;
+}
+
+inline void syntheticWriteFrame(uint8_t* data, const SyntheticHeader& header, const SyntheticFrame& frame) {
+    uint8_t* out = data + header.side_info_offset;
+    memcpy(out, SYNTHETIC_MAGIC, 4);
+    out += 4;
+    syntheticPutNumber(out, frame.first_sample + SYNTHETIC_BIAS, 5);
+    syntheticPutNumber(out, frame.signal_begin + SYNTHETIC_BIAS, 5);
+    syntheticPutNumber(out, frame.signal_end + SYNTHETIC_BIAS, 5);
+    syntheticPutNumber(out, frame.waveform, 1);
+    syntheticPutNumber(out, (uint64_t)llround(frame.period * 1000), 5);
+    syntheticPutNumber(out, frame.amplitude, 3);
+    syntheticPutNumber(out, frame.main_data_begin, 2);
+}
+
+// The test signal at index n, as the decoder outputs it
+inline int16_t syntheticSignal(uint8_t waveform, double period, int16_t amplitude, int64_t n, int channel) {
+    if (waveform == SYNTHETIC_COUNTER) {
+        return channel == 0 ? (n & 0x3FFF) : ((n >> 14) & 0x3FFF);
+    }
+    return (int16_t)lrint(amplitude * sin(2.0 * M_PI * (double)n / period));
+}
+
+inline int16_t syntheticSample(const SyntheticFrame& frame, int64_t n, int channel) {
+    if (n < frame.signal_begin || n >= frame.signal_end) return 0;
+    return syntheticSignal(frame.waveform, frame.period, frame.amplitude, n, channel);
+}
+
+// Sample index carried by a stereo SYNTHETIC_COUNTER frame
+inline int64_t syntheticCounterAt(const int16_t* stereo) {
+    return (int64_t)(stereo[0] & 0x3FFF) | ((int64_t)(stereo[1] & 0x3FFF) << 14);
+}
+
+struct SyntheticTrack {
+    uint32_t sample_rate = 44100;
+    uint8_t channels = 2;
+    uint16_t bitrate_kbps = 128;
+    uint16_t late_bitrate_kbps = 0;  // Bitrate of the second half, to make a VBR file; 0 = CBR
+    int64_t signal_begin = 0;        // Signal index of the track's first sample
+    uint32_t samples = 44100;        // Track length, delay and padding not included
+    uint8_t waveform = SYNTHETIC_SINE;
+    double period = 100.0;
+    int16_t amplitude = 8000;
+    uint16_t encoder_delay = 576;
+    bool info_frame = true;          // Xing/Info frame in front of the audio
+    bool lame_tag = true;            // LAME extension with delay and padding
+    bool has_track_gain = false;     // LAME radio gain, so the loudness pass skips the track
+    int16_t track_gain = 0;          // 1/100 dB, stored in 1/10 dB steps
+    bool toc = true;
+    uint16_t first_main_data_begin = 0;  // Reservoir bytes the first audio frame reaches back for
+    std::vector<uint8_t> prefix;     // Written before the first frame, e.g. ID3v2 tags
+    bool id3v1 = false;
+};
+
+// Where the writer put things, for tests to check against
+struct SyntheticLayout {
+    uint32_t first_frame;   // Offset of the info frame, or of the first audio frame
+    uint32_t audio_frames;
+    uint32_t stream_bytes;  // From first_frame to the end of the audio
+    uint16_t encoder_padding;
+    std::vector<uint32_t> frame_offsets;  // Audio frames only
+};
+
+inline bool syntheticMakeHeader(uint32_t sample_rate, uint8_t channels, uint16_t bitrate_kbps, uint8_t* out) {
+    static const uint32_t rates[3] = {44100, 48000, 32000};
+    int version = 0, rate_index = -1;
+    for (int v = 1; v <= 3 && rate_index < 0; v++) {
+        for (int r = 0; r < 3; r++) {
+            if ((rates[r] >> (v - 1)) == sample_rate) version = v, rate_index = r;
+        }
+    }
+    int bitrate_index = -1;
+    for (int i = 1; i < 15 && version; i++) {
+        if (SYNTHETIC_BITRATES[version == 1 ? 0 : 1][i] == bitrate_kbps) bitrate_index = i;
+    }
+    if (rate_index < 0 || bitrate_index < 0) return false;
+    uint8_t version_bits = version == 1 ? 3 : (version == 2 ? 2 : 0);
+    out[0] = 0xFF;
+    out[1] = 0xE0 | (version_bits << 3) | (1 << 1) | 1;  // Layer III, no CRC
+    out[2] = (bitrate_index << 4) | (rate_index << 2);
+    out[3] = channels == 1 ? 0xC0 : 0x00;
+    return true;
+}
+
+inline void syntheticPutBigEndian(uint8_t* out, uint32_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--) out[i] = value & 0xFF, value >>= 8;
+}
+
+// An ID3v2 tag of the given total size (header, padding and footer included). The body
+// is filled with bytes that look like frame headers, as cover art often does.
+inline std::vector<uint8_t> syntheticId3v2(uint32_t size, uint8_t major = 3, bool footer = false) {
+    std::vector<uint8_t> tag(size, 0);
+    uint32_t body = size - 10 - (footer ? 10 : 0);
+    memcpy(tag.data(), "ID3", 3);
+    tag[3] = major;
+    tag[5] = footer ? 0x10 : 0;
+    for (int i = 0; i < 4; i++) tag[6 + i] = (body >> (7 * (3 - i))) & 0x7F;
+    for (uint32_t i = 10; i + 4 <= 10 + body; i += 97) {
+        tag[i] = 0xFF;
+        tag[i + 1] = 0xFB;
+        tag[i + 2] = 0x90;
+        tag[i + 3] = 0x00;
+    }
+    if (footer) {
+        memcpy(tag.data() + size - 10, "3DI", 3);
+        memcpy(tag.data() + size - 7, tag.data() + 3, 7);
+    }
+    return tag;
+}
+
+inline bool syntheticWriteMp3(const char* path, const SyntheticTrack& track, SyntheticLayout* layout = nullptr) {
+    uint8_t header[4];
+    if (!syntheticMakeHeader(track.sample_rate, track.channels, track.bitrate_kbps, header)) return false;
+    SyntheticHeader info = {};
+    syntheticParseHeader(header, info);
+    const uint32_t spf = info.samples_per_frame;
+    const uint32_t frames = (track.encoder_delay + SYNTHETIC_DECODER_DELAY + track.samples + spf - 1) / spf;
+    const uint16_t padding = frames * spf - track.encoder_delay - track.samples;
+
+    // Audio frames first, so the info frame can describe them
+    std::vector<uint8_t> audio;
+    std::vector<uint32_t> offsets;
+    for (uint32_t k = 0; k < frames; k++) {
+        uint16_t bitrate = (track.late_bitrate_kbps && k >= frames / 2) ? track.late_bitrate_kbps : track.bitrate_kbps;
+        uint8_t frame_header[4];
+        if (!syntheticMakeHeader(track.sample_rate, track.channels, bitrate, frame_header)) return false;
+        SyntheticHeader parsed = {};
+        syntheticParseHeader(frame_header, parsed);
+        if (parsed.frame_length < parsed.side_info_offset + SYNTHETIC_FRAME_BYTES) return false;
+        size_t start = audio.size();
+        offsets.push_back(start);
+        audio.resize(start + parsed.frame_length, 0);
+        memcpy(audio.data() + start, frame_header, 4);
+        SyntheticFrame frame;
+        frame.first_sample = track.signal_begin + (int64_t)k * spf - track.encoder_delay - SYNTHETIC_DECODER_DELAY;
+        frame.signal_begin = track.signal_begin;
+        frame.signal_end = track.signal_begin + track.samples;
+        frame.waveform = track.waveform;
+        frame.period = track.period;
+        frame.amplitude = track.amplitude;
+        frame.main_data_begin = k == 0 ? track.first_main_data_begin : 0;
+        syntheticWriteFrame(audio.data() + start, parsed, frame);
+    }
+
+    std::vector<uint8_t> info_frame;
+    if (track.info_frame) {
+        info_frame.assign(info.frame_length, 0);
+        memcpy(info_frame.data(), header, 4);
+        uint8_t* xing = info_frame.data() + info.side_info_offset;
+        uint32_t stream_bytes = info.frame_length + audio.size();
+        memcpy(xing, track.late_bitrate_kbps ? "Xing" : "Info", 4);
+        syntheticPutBigEndian(xing + 4, 0x01 | 0x02 | (track.toc ? 0x04 : 0) | 0x08, 4);
+        uint8_t* field = xing + 8;
+        syntheticPutBigEndian(field, frames, 4);
+        syntheticPutBigEndian(field + 4, stream_bytes, 4);
+        field += 8;
+        if (track.toc) {
+            for (int percent = 0; percent < 100; percent++) {
+                uint32_t offset = info.frame_length + offsets[(uint64_t)frames * percent / 100];
+                field[percent] = std::min<uint64_t>(255, (uint64_t)offset * 256 / stream_bytes);
+            }
+            field += 100;
+        }
+        field += 4;  // Quality
+        if (track.lame_tag) {
+            memcpy(field, "LAME3.100", 9);
+            field[21] = track.encoder_delay >> 4;
+            field[22] = ((track.encoder_delay & 0x0F) << 4) | (padding >> 8);
+            field[23] = padding & 0xFF;
+            if (track.has_track_gain) {
+                // Radio gain, set by the user (originator 3), sign bit, then 1/10 dB
+                uint16_t gain = (1 << 13) | (3 << 10) | (track.track_gain < 0 ? 0x200 : 0) |
+                                ((abs(track.track_gain) / 10) & 0x1FF);
+                syntheticPutBigEndian(field + 15, gain, 2);
+            }
+        }
+        if ((size_t)(field + 36 - info_frame.data()) > info_frame.size()) return false;
+    }
+
+    File file = SD.open(path, FILE_WRITE);
+    if (!file) return false;
+    file.write(track.prefix.data(), track.prefix.size());
+    file.write(info_frame.data(), info_frame.size());
+    file.write(audio.data(), audio.size());
+    if (track.id3v1) {
+        uint8_t tag[128] = {'T', 'A', 'G'};
+        file.write(tag, sizeof(tag));
+    }
+    file.close();
+
+    if (layout) {
+        layout->first_frame = track.prefix.size();
+        layout->audio_frames = frames;
+        layout->stream_bytes = info_frame.size() + audio.size();
+        layout->encoder_padding = padding;
+        layout->frame_offsets.clear();
+        for (uint32_t offset : offsets) {
+            layout->frame_offsets.push_back(track.prefix.size() + info_frame.size() + offset);
+        }
+    }
+    return true;
+}
+
+#endif
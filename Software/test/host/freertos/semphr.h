@@ -0,0 +1,32 @@
+#ifndef HOST_FREERTOS_SEMPHR_H
+#define HOST_FREERTOS_SEMPHR_H
+
+#include "FreeRTOS.h"
+#include <chrono>
+#include <mutex>
+
+// Mutexes only; both kinds are recursive on the host
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return new std::recursive_timed_mutex(); }
+inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return new std::recursive_timed_mutex(); }
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    std::recursive_timed_mutex* mutex = (std::recursive_timed_mutex*)semaphore;
+    if (ticks == portMAX_DELAY) {
+        mutex->lock();
+        return pdTRUE;
+    }
+    return mutex->try_lock_for(std::chrono::milliseconds(ticks)) ? pdTRUE : pdFALSE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    ((std::recursive_timed_mutex*)semaphore)->unlock();
+    return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    return xSemaphoreTake(semaphore, ticks);
+}
+
+inline BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) { return xSemaphoreGive(semaphore); }
+
+#endif
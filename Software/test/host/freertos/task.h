@@ -0,0 +1,78 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+typedef void (*TaskFunction_t)(void*);
+
+// A task is a detached thread with a notification count
+struct HostTask {
+    std::mutex mutex;
+    std::condition_variable notified;
+    uint32_t notify_count = 0;
+};
+
+inline HostTask*& hostCurrentTask() {
+    thread_local HostTask* task = nullptr;
+    return task;
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+    if (!hostCurrentTask()) hostCurrentTask() = new HostTask();
+    return hostCurrentTask();
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char*, uint32_t, void* parameter,
+                                          UBaseType_t, TaskHandle_t* handle, BaseType_t) {
+    HostTask* task = new HostTask();
+    if (handle) *handle = task;
+    std::thread([function, parameter, task]() {
+        hostCurrentTask() = task;
+        function(parameter);
+    }).detach();
+    return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack, void* parameter,
+                              UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stack, parameter, priority, handle, tskNO_AFFINITY);
+}
+
+inline void vTaskDelay(TickType_t ticks) { std::this_thread::sleep_for(std::chrono::milliseconds(ticks)); }
+inline TickType_t xTaskGetTickCount() {
+    return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+inline void vTaskDelete(TaskHandle_t) {}  // The task function returns right after, ending the thread
+inline void vTaskPrioritySet(TaskHandle_t, UBaseType_t) {}
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 1024; }
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t handle) {
+    HostTask* task = (HostTask*)handle;
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notify_count++;
+    }
+    task->notified.notify_one();
+    return pdPASS;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    HostTask* task = (HostTask*)xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    auto ready = [task]() { return task->notify_count > 0; };
+    if (ticks == portMAX_DELAY) {
+        task->notified.wait(lock, ready);
+    } else {
+        task->notified.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+    }
+    uint32_t count = task->notify_count;
+    if (count > 0) task->notify_count = clear_on_exit ? 0 : count - 1;
+    return count;
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef HOST_MP3COMMON_H
+#define HOST_MP3COMMON_H
+
+#include "mp3dec.h"
+
+// Decoder state of the host stand-in. The fields the firmware touches have the same
+// names as in Helix's MP3DecInfo.
+typedef struct _MP3DecInfo {
+    int bitrate;
+    int nChans;
+    int samprate;
+    int nGrans;
+    int nGranSamps;
+    int layer;
+    int version;
+    int mainDataBegin;
+    int mainDataBytes;  // Bit reservoir: payload bytes carried over from earlier frames
+    int outputSamps;
+} MP3DecInfo;
+
+#endif
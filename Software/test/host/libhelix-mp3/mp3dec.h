@@ -0,0 +1,134 @@
+#ifndef HOST_MP3DEC_H
+#define HOST_MP3DEC_H
+
+// Host stand-in for the Helix MP3 decoder. It parses real Layer III frame headers, but
+// instead of Huffman data the frames carry a SyntheticFrame (see SyntheticMp3.h) that
+// says which samples of a test signal the frame decodes to. Frames without one decode to
+// silence. The bit reservoir is modelled: a frame whose main_data_begin reaches further
+// back than the payload decoded since the last reset fails with MAINDATA_UNDERFLOW.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define MAINBUF_SIZE 1940
+#define MAX_NCHAN 2
+#define MAX_NGRAN 2
+#define MAX_NSAMP 576
+
+enum {
+    ERR_MP3_NONE = 0,
+    ERR_MP3_INDATA_UNDERFLOW = -1,
+    ERR_MP3_MAINDATA_UNDERFLOW = -2,
+    ERR_MP3_FREE_BITRATE_SYNC = -3,
+    ERR_MP3_OUT_OF_MEMORY = -4,
+    ERR_MP3_NULL_POINTER = -5,
+    ERR_MP3_INVALID_FRAMEHEADER = -6,
+    ERR_MP3_INVALID_SIDEINFO = -7,
+    ERR_MP3_INVALID_SCALEFACT = -8,
+    ERR_MP3_INVALID_HUFFCODES = -9,
+    ERR_MP3_INVALID_DEQUANTIZE = -10,
+    ERR_MP3_INVALID_IMDCT = -11,
+    ERR_MP3_INVALID_SUBBAND = -12,
+    ERR_UNKNOWN = -9999
+};
+
+typedef void* HMP3Decoder;
+
+typedef struct _MP3FrameInfo {
+    int bitrate;
+    int nChans;
+    int samprate;
+    int bitsPerSample;
+    int outputSamps;
+    int layer;
+    int version;
+} MP3FrameInfo;
+
+#include "mp3common.h"
+#include "../SyntheticMp3.h"
+
+// Live decoders, so tests can check who allocates what
+inline int host_mp3_decoders_allocated = 0;
+inline int host_mp3_decoders_live = 0;
+inline int host_mp3_reservoir_underflows = 0;  // Frames dropped for want of reservoir data
+inline int64_t host_mp3_first_sample_seen = INT64_MAX;  // Earliest sample of any frame handed in
+
+inline HMP3Decoder MP3InitDecoder(void) {
+    MP3DecInfo* info = (MP3DecInfo*)calloc(1, sizeof(MP3DecInfo));
+    if (info) {
+        host_mp3_decoders_allocated++;
+        host_mp3_decoders_live++;
+    }
+    return info;
+}
+
+inline void MP3FreeDecoder(HMP3Decoder decoder) {
+    if (!decoder) return;
+    host_mp3_decoders_live--;
+    free(decoder);
+}
+
+inline int MP3FindSyncWord(unsigned char* buf, int nBytes) {
+    for (int i = 0; i + 1 < nBytes; i++) {
+        if (buf[i] == 0xFF && (buf[i + 1] & 0xE0) == 0xE0) return i;
+    }
+    return -1;
+}
+
+inline void MP3GetLastFrameInfo(HMP3Decoder decoder, MP3FrameInfo* frame) {
+    MP3DecInfo* info = (MP3DecInfo*)decoder;
+    frame->bitrate = info->bitrate;
+    frame->nChans = info->nChans;
+    frame->samprate = info->samprate;
+    frame->bitsPerSample = 16;
+    frame->outputSamps = info->outputSamps;
+    frame->layer = info->layer;
+    frame->version = info->version;
+}
+
+inline int MP3Decode(HMP3Decoder decoder, unsigned char** inbuf, int* bytesLeft, short* outbuf, int) {
+    MP3DecInfo* info = (MP3DecInfo*)decoder;
+    if (!info || !inbuf || !*inbuf || !bytesLeft || !outbuf) return ERR_MP3_NULL_POINTER;
+    if (*bytesLeft < 4) return ERR_MP3_INDATA_UNDERFLOW;
+
+    SyntheticHeader header = {};
+    if (!syntheticParseHeader(*inbuf, header)) return ERR_MP3_INVALID_FRAMEHEADER;
+    if (*bytesLeft < header.frame_length) return ERR_MP3_INDATA_UNDERFLOW;
+
+    SyntheticFrame frame = {};
+    bool has_signal = syntheticReadFrame(*inbuf, header, frame);
+    int payload = header.frame_length - header.side_info_offset;
+    *inbuf += header.frame_length;
+    *bytesLeft -= header.frame_length;
+
+    info->bitrate = header.bitrate_kbps * 1000;
+    info->nChans = header.channels;
+    info->samprate = header.sample_rate;
+    info->nGrans = header.samples_per_frame / 576;
+    info->nGranSamps = 576;
+    info->layer = 3;
+    info->version = header.version - 1;
+    info->outputSamps = header.samples_per_frame * header.channels;
+
+    if (has_signal && frame.first_sample < host_mp3_first_sample_seen) host_mp3_first_sample_seen = frame.first_sample;
+    int main_data_begin = has_signal ? frame.main_data_begin : 0;
+    bool underflow = main_data_begin > info->mainDataBytes;
+    info->mainDataBegin = main_data_begin;
+    info->mainDataBytes = payload > MAINBUF_SIZE - info->mainDataBytes ? MAINBUF_SIZE : info->mainDataBytes + payload;
+    if (underflow) {
+        host_mp3_reservoir_underflows++;
+        return ERR_MP3_MAINDATA_UNDERFLOW;
+    }
+
+    for (int i = 0; i < header.samples_per_frame; i++) {
+        int64_t n = (int64_t)(has_signal ? frame.first_sample : 0) + i;
+        for (int c = 0; c < header.channels; c++) {
+            outbuf[i * header.channels + c] = has_signal ? syntheticSample(frame, n, c) : 0;
+        }
+    }
+    return ERR_MP3_NONE;
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "PlayerCommandQueue.h"
+
+// The player command queue under the load it is built for: the Bluetooth task, the
+// main loop, the audio callback and the decoder all posting while the player task pops.
+// Build with -fsanitize=thread and a smaller count to check it for data races.
+
+#define PRODUCERS 4
+#ifndef MESSAGES_PER_PRODUCER
+#define MESSAGES_PER_PRODUCER 200000
+#endif
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_fifo_on_one_thread(void) {
+    PlayerCommandQueue queue;
+    PlayerMessage message;
+    TEST_ASSERT_FALSE(queue.pop(message));
+    // Several laps, so every slot is reused
+    for (int32_t i = 0; i < PLAYER_COMMAND_QUEUE_SIZE * 3; i++) {
+        TEST_ASSERT_TRUE(queue.push({PlayerCommand::SEEK, i}));
+        TEST_ASSERT_TRUE(queue.pop(message));
+        TEST_ASSERT_TRUE(message.command == PlayerCommand::SEEK);
+        TEST_ASSERT_EQUAL_INT32(i, message.parameter);
+    }
+    TEST_ASSERT_FALSE(queue.pop(message));
+}
+
+void test_full_queue_drops_and_counts(void) {
+    PlayerCommandQueue queue;
+    for (int32_t i = 0; i < PLAYER_COMMAND_QUEUE_SIZE; i++) {
+        TEST_ASSERT_TRUE(queue.push({PlayerCommand::PLAY_TRACK, i}));
+    }
+    TEST_ASSERT_FALSE(queue.push({PlayerCommand::NEXT_TRACK, 0}));
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getDroppedCount());
+
+    // Popping one frees exactly one slot, and the order is kept around the wrap
+    PlayerMessage message;
+    TEST_ASSERT_TRUE(queue.pop(message));
+    TEST_ASSERT_EQUAL_INT32(0, message.parameter);
+    TEST_ASSERT_TRUE(queue.push({PlayerCommand::PLAY_TRACK, PLAYER_COMMAND_QUEUE_SIZE}));
+    TEST_ASSERT_FALSE(queue.push({PlayerCommand::NEXT_TRACK, 0}));
+    for (int32_t i = 1; i <= PLAYER_COMMAND_QUEUE_SIZE; i++) {
+        TEST_ASSERT_TRUE(queue.pop(message));
+        TEST_ASSERT_EQUAL_INT32(i, message.parameter);
+    }
+    TEST_ASSERT_FALSE(queue.pop(message));
+    TEST_ASSERT_EQUAL_UINT32(2, queue.getDroppedCount());
+}
+
+// Each producer numbers its commands and retries when the queue is full, so every
+// command must arrive exactly once and in the order its producer posted it
+void test_four_producers_one_consumer(void) {
+    static PlayerCommandQueue queue;
+    std::atomic<int> started(0);
+    std::atomic<uint64_t> retries(0);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([&, p]() {
+            started++;
+            while (started.load() < PRODUCERS) std::this_thread::yield();
+            uint64_t full = 0;
+            for (int32_t i = 0; i < MESSAGES_PER_PRODUCER; i++) {
+                while (!queue.push({(PlayerCommand)p, i})) {
+                    full++;
+                    std::this_thread::yield();
+                }
+            }
+            retries += full;
+        });
+    }
+
+    int32_t next[PRODUCERS] = {};
+    uint64_t received = 0;
+    uint64_t out_of_order = 0;
+    PlayerMessage message;
+    while (received < (uint64_t)PRODUCERS * MESSAGES_PER_PRODUCER) {
+        if (!queue.pop(message)) {
+            std::this_thread::yield();  // Lets a producer preempted mid-push finish it
+            continue;
+        }
+        int p = (int)message.command;
+        TEST_ASSERT_LESS_THAN(PRODUCERS, p);
+        if (message.parameter != next[p]) out_of_order++;
+        next[p] = message.parameter + 1;
+        received++;
+    }
+    for (std::thread& producer : producers) producer.join();
+
+    char line[128];
+    snprintf(line, sizeof(line), "%llu commands from %d producers, %llu out of order, %llu pushes found the queue full",
+             (unsigned long long)received, PRODUCERS, (unsigned long long)out_of_order,
+             (unsigned long long)retries.load());
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT64(0, out_of_order);
+    for (int p = 0; p < PRODUCERS; p++) TEST_ASSERT_EQUAL_INT32(MESSAGES_PER_PRODUCER, next[p]);
+    TEST_ASSERT_EQUAL_UINT32(retries.load(), queue.getDroppedCount());
+    TEST_ASSERT_FALSE(queue.pop(message));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fifo_on_one_thread);
+    RUN_TEST(test_full_queue_drops_and_counts);
+    RUN_TEST(test_four_producers_one_consumer);
+    return UNITY_END();
+}
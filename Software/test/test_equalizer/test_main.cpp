@@ -0,0 +1,192 @@
+#include <unity.h>
+#include <chrono>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "Equalizer.h"
+
+// The slice kernel against the per-sample reference, the measured gain of every preset
+// against its designed response, and the cost per sample per band. Costs are host time
+// and host cycles; the ESP32 cost has to be measured on the device.
+
+#define SETTLE_FRAMES EQ_SAMPLE_RATE  // Long enough for the 80 Hz shelf to settle
+#define FIT_FRAMES EQ_SAMPLE_RATE
+#define TONE_AMPLITUDE 6000           // Below clipping after the largest boost
+#define MAX_RESPONSE_ERROR_DB 0.02
+#define BENCH_FRAMES 1152             // One MPEG-1 frame, the block size the decode task uses
+#define BENCH_BLOCKS 5000
+
+static Equalizer equalizer;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Tones, a sweep and noise, loud enough in places that the output saturates
+static std::vector<int16_t> testSignal(size_t frames) {
+    std::vector<int16_t> pcm(frames * 2);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < frames; i++) {
+        double t = (double)i / EQ_SAMPLE_RATE;
+        double sweep = sin(2 * M_PI * (20 + 2000 * t) * t);
+        seed = seed * 1664525 + 1013904223;
+        double noise = (int32_t)seed / 2147483648.0;
+        double left = 14000 * sin(2 * M_PI * 90 * t) + 12000 * sweep + 6000 * noise;
+        double right = 16000 * sin(2 * M_PI * 9000 * t) + 8000 * sweep - 6000 * noise;
+        pcm[i * 2] = (int16_t)constrain(lrint(left), -32768L, 32767L);
+        pcm[i * 2 + 1] = (int16_t)constrain(lrint(right), -32768L, 32767L);
+    }
+    return pcm;
+}
+
+void test_flat_leaves_samples_alone(void) {
+    equalizer.setPreset(0);
+    TEST_ASSERT_TRUE(equalizer.isFlat());
+    TEST_ASSERT_EQUAL_INT32(0, equalizer.getHeadroomCdb());
+    std::vector<int16_t> pcm = testSignal(1000);
+    std::vector<int16_t> original = pcm;
+    equalizer.process(pcm.data(), 1000);
+    TEST_ASSERT_TRUE(pcm == original);
+}
+
+// Calls of every size the decode task could make, across slice boundaries
+void test_kernel_matches_reference(void) {
+    const size_t chunks[] = {1, 7, EQ_SLICE_FRAMES - 1, EQ_SLICE_FRAMES, EQ_SLICE_FRAMES + 1, 1152, 3000};
+    const size_t frames = 2 * EQ_SAMPLE_RATE;
+    std::vector<int16_t> input = testSignal(frames);
+    for (int preset = 1; preset < Equalizer::getPresetCount(); preset++) {
+        std::vector<int16_t> expected = input;
+        equalizer.setPreset(preset);
+        equalizer.processReference(expected.data(), frames);
+
+        std::vector<int16_t> actual = input;
+        equalizer.setPreset(preset);
+        size_t done = 0;
+        for (int call = 0; done < frames; call++) {
+            size_t n = min(chunks[call % 7], frames - done);
+            equalizer.process(actual.data() + done * 2, n);
+            done += n;
+        }
+
+        size_t saturated = 0;
+        for (int16_t s : expected) saturated += s == 32767 || s == -32768;
+        char line[96];
+        snprintf(line, sizeof(line), "%-13s bit-exact over %u frames, %u saturated samples",
+                 Equalizer::getPreset(preset).name, (unsigned)frames, (unsigned)saturated);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_TRUE(actual == expected);
+    }
+}
+
+// Gain of a sine through the filters, from a least-squares fit after the filters settle
+static double measuredGainDb(int preset, double hz, int channel) {
+    std::vector<int16_t> pcm((SETTLE_FRAMES + FIT_FRAMES) * 2);
+    for (size_t i = 0; i < SETTLE_FRAMES + FIT_FRAMES; i++) {
+        // Each channel gets its own phase, so a channel mix-up shows
+        double w = 2 * M_PI * hz * i / EQ_SAMPLE_RATE;
+        pcm[i * 2] = (int16_t)lrint(TONE_AMPLITUDE * sin(w));
+        pcm[i * 2 + 1] = (int16_t)lrint(TONE_AMPLITUDE * cos(w));
+    }
+    std::vector<int16_t> input = pcm;
+    equalizer.setPreset(preset);
+    equalizer.process(pcm.data(), SETTLE_FRAMES + FIT_FRAMES);
+
+    double power[2] = {0, 0};
+    for (int pass = 0; pass < 2; pass++) {
+        const std::vector<int16_t>& signal = pass == 0 ? input : pcm;
+        double ss = 0, sc = 0, cc = 0, xs = 0, xc = 0;
+        for (size_t i = SETTLE_FRAMES; i < SETTLE_FRAMES + FIT_FRAMES; i++) {
+            double w = 2 * M_PI * hz * i / EQ_SAMPLE_RATE;
+            double s = sin(w), c = cos(w), x = signal[i * 2 + channel];
+            ss += s * s;
+            sc += s * c;
+            cc += c * c;
+            xs += x * s;
+            xc += x * c;
+        }
+        double det = ss * cc - sc * sc;
+        double a = (xs * cc - xc * sc) / det;
+        double b = (xc * ss - xs * sc) / det;
+        power[pass] = a * a + b * b;
+    }
+    return 10 * log10(power[1] / power[0]);
+}
+
+void test_gain_matches_design(void) {
+    for (int preset = 1; preset < Equalizer::getPresetCount(); preset++) {
+        const EqPreset& p = Equalizer::getPreset(preset);
+        for (int band = 0; band < p.band_count; band++) {
+            double hz = p.bands[band].frequency;
+            double designed = Equalizer::getResponseDb(preset, hz);
+            double left = measuredGainDb(preset, hz, 0);
+            double right = measuredGainDb(preset, hz, 1);
+
+            char line[128];
+            snprintf(line, sizeof(line), "%-13s %5.0f Hz: designed %+.3f dB, measured %+.3f / %+.3f dB",
+                     p.name, hz, designed, left, right);
+            TEST_MESSAGE(line);
+            TEST_ASSERT_FLOAT_WITHIN(MAX_RESPONSE_ERROR_DB, designed, left);
+            TEST_ASSERT_FLOAT_WITHIN(MAX_RESPONSE_ERROR_DB, designed, right);
+        }
+    }
+}
+
+// The headroom is the largest boost, so a full-scale tone there stays clear of clipping
+void test_headroom_covers_the_largest_boost(void) {
+    for (int preset = 1; preset < Equalizer::getPresetCount(); preset++) {
+        const EqPreset& p = Equalizer::getPreset(preset);
+        equalizer.setPreset(preset);
+        for (int band = 0; band < p.band_count; band++) {
+            double boost = Equalizer::getResponseDb(preset, p.bands[band].frequency);
+            TEST_ASSERT_LESS_OR_EQUAL(1, lround(boost * 100) + equalizer.getHeadroomCdb());  // Within 0.01 dB
+        }
+    }
+}
+
+// ns and host cycles per sample per band, processing frame-sized blocks
+static void bench(int preset) {
+    equalizer.setPreset(preset);
+    int bands = Equalizer::getPreset(preset).band_count;
+    std::vector<int16_t> source = testSignal(BENCH_FRAMES);
+    std::vector<int16_t> pcm(source.size());
+    double ns[2] = {0, 0};
+    uint64_t cycles[2] = {0, 0};
+    for (int block = 0; block < BENCH_BLOCKS * 2; block++) {
+        int kernel = block % 2;  // Interleaved, so both see the same machine state
+        pcm = source;
+        auto start = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+        uint64_t cycles_start = __rdtsc();
+#endif
+        if (kernel == 0) {
+            equalizer.process(pcm.data(), BENCH_FRAMES);
+        } else {
+            equalizer.processReference(pcm.data(), BENCH_FRAMES);
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        cycles[kernel] += __rdtsc() - cycles_start;
+#endif
+        ns[kernel] += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    double samples = (double)BENCH_BLOCKS * BENCH_FRAMES * 2 * bands;
+    char line[160];
+    snprintf(line, sizeof(line), "%-13s %d band%s: slices %.2f ns, %.1f cycles; reference %.2f ns, %.1f cycles per sample per band",
+             Equalizer::getPreset(preset).name, bands, bands == 1 ? " " : "s", ns[0] / samples,
+             cycles[0] / samples, ns[1] / samples, cycles[1] / samples);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_GREATER_THAN(0, ns[0]);
+}
+
+void test_cost_per_sample_per_band(void) {
+    for (int preset = 1; preset < Equalizer::getPresetCount(); preset++) bench(preset);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_flat_leaves_samples_alone);
+    RUN_TEST(test_kernel_matches_reference);
+    RUN_TEST(test_gain_matches_design);
+    RUN_TEST(test_headroom_covers_the_largest_boost);
+    RUN_TEST(test_cost_per_sample_per_band);
+    return UNITY_END();
+}
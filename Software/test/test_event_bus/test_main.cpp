@@ -0,0 +1,220 @@
+#include <unity.h>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "PlayerEventBus.h"
+
+// Who gets player events and in what order, that publishing allocates nothing, the queue
+// that hands events to a slower task, and what a publish costs next to the std::function
+// callbacks with a String copy it replaced. Costs are host time and host cycles; the
+// ESP32 cost has to be measured on the device.
+
+#define BENCH_EVENTS 2000000
+#define QUEUE_EVENTS 200000
+#define TRACK_NAME "Artist Name - A Fairly Long Track Title (Remastered).mp3"  // Past the small-string buffer
+
+// Every allocation in the process, so a publish can be checked for heap use
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+struct Recorder {
+    int id;
+    std::vector<int>* order;
+    PlayerEvent last;
+    uint32_t count;
+};
+
+static void record(const PlayerEvent& event, void* context) {
+    Recorder* recorder = (Recorder*)context;
+    recorder->last = event;
+    recorder->count++;
+    if (recorder->order) recorder->order->push_back(recorder->id);
+}
+
+// What a typical subscriber does with an event: look at it and keep a little state
+static void count(const PlayerEvent& event, void* context) {
+    *(int64_t*)context += event.track_index + event.value;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_subscribers_are_called_in_order(void) {
+    PlayerEventBus bus;
+    std::vector<int> order;
+    Recorder recorders[PLAYER_EVENT_MAX_SUBSCRIBERS];
+    for (int i = 0; i < PLAYER_EVENT_MAX_SUBSCRIBERS; i++) {
+        recorders[i] = {i, &order, {}, 0};
+        TEST_ASSERT_TRUE(bus.subscribe(record, &recorders[i]));
+    }
+    TEST_ASSERT_FALSE(bus.subscribe(record, &recorders[0]));  // Full
+    TEST_ASSERT_FALSE(PlayerEventBus().subscribe(nullptr));
+
+    order.reserve(PLAYER_EVENT_MAX_SUBSCRIBERS);
+    bus.publish({PlayerEventType::SEEKED, PlayerState::PLAYING, 12, 34567});
+    TEST_ASSERT_EQUAL_INT(PLAYER_EVENT_MAX_SUBSCRIBERS, order.size());
+    for (int i = 0; i < PLAYER_EVENT_MAX_SUBSCRIBERS; i++) {
+        TEST_ASSERT_EQUAL_INT(i, order[i]);
+        TEST_ASSERT_EQUAL_UINT32(1, recorders[i].count);
+        TEST_ASSERT_TRUE(recorders[i].last.type == PlayerEventType::SEEKED);
+        TEST_ASSERT_TRUE(recorders[i].last.state == PlayerState::PLAYING);
+        TEST_ASSERT_EQUAL_INT32(12, recorders[i].last.track_index);
+        TEST_ASSERT_EQUAL_INT32(34567, recorders[i].last.value);
+    }
+}
+
+void test_publish_does_not_allocate(void) {
+    PlayerEventBus bus;
+    Recorder recorders[PLAYER_EVENT_MAX_SUBSCRIBERS];
+    for (int i = 0; i < PLAYER_EVENT_MAX_SUBSCRIBERS; i++) {
+        recorders[i] = {i, nullptr, {}, 0};
+        bus.subscribe(record, &recorders[i]);
+    }
+    size_t before = allocations;
+    for (int32_t i = 0; i < 1000; i++) {
+        bus.publish({PlayerEventType::TRACK_STARTED, PlayerState::PLAYING, i, 0});
+    }
+    TEST_ASSERT_EQUAL_UINT32(before, allocations);
+    TEST_ASSERT_EQUAL_UINT32(1000, recorders[3].count);
+}
+
+void test_queue_keeps_order_and_drops_when_full(void) {
+    PlayerEventBus bus;
+    static PlayerEventQueue queue;
+    TEST_ASSERT_TRUE(bus.subscribe(PlayerEventQueue::handler, &queue));
+    PlayerEvent event;
+    TEST_ASSERT_FALSE(queue.pop(event));
+
+    size_t before = allocations;
+    for (int32_t i = 0; i < PLAYER_EVENT_QUEUE_SIZE + 3; i++) {
+        bus.publish({PlayerEventType::SEEKED, PlayerState::PLAYING, 1, i});
+    }
+    TEST_ASSERT_EQUAL_UINT32(before, allocations);
+    TEST_ASSERT_EQUAL_UINT32(3, queue.getDroppedCount());
+
+    // Several laps, so every slot is reused
+    for (int32_t i = 0; i < PLAYER_EVENT_QUEUE_SIZE * 3; i++) {
+        TEST_ASSERT_TRUE(queue.pop(event));
+        TEST_ASSERT_EQUAL_INT32(i % PLAYER_EVENT_QUEUE_SIZE + (i < PLAYER_EVENT_QUEUE_SIZE ? 0 : 100), event.value);
+        bus.publish({PlayerEventType::SEEKED, PlayerState::PLAYING, 1, i % PLAYER_EVENT_QUEUE_SIZE + 100});
+    }
+    for (int32_t i = 0; i < PLAYER_EVENT_QUEUE_SIZE; i++) TEST_ASSERT_TRUE(queue.pop(event));
+    TEST_ASSERT_FALSE(queue.pop(event));
+    TEST_ASSERT_EQUAL_UINT32(3, queue.getDroppedCount());
+}
+
+// The player task publishing while the UI loop drains, as the Serial log does
+void test_queue_across_threads(void) {
+    static PlayerEventQueue queue;
+    std::thread producer([]() {
+        for (int32_t i = 0; i < QUEUE_EVENTS; i++) {
+            while (!queue.push({PlayerEventType::TRACK_STARTED, PlayerState::PLAYING, i, -i})) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    int32_t next = 0;
+    PlayerEvent event;
+    while (next < QUEUE_EVENTS) {
+        if (!queue.pop(event)) {
+            std::this_thread::yield();
+            continue;
+        }
+        TEST_ASSERT_EQUAL_INT32(next, event.track_index);
+        TEST_ASSERT_EQUAL_INT32(-next, event.value);
+        next++;
+    }
+    producer.join();
+    TEST_ASSERT_FALSE(queue.pop(event));
+}
+
+struct Cost {
+    double ns;
+    double cycles;
+    size_t allocations;
+};
+
+template <typename Publish>
+static Cost measure(Publish publish) {
+    size_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t cycles_start = __rdtsc();
+#endif
+    for (int32_t i = 0; i < BENCH_EVENTS; i++) publish(i);
+#if defined(__x86_64__) || defined(__i386__)
+    double cycles = (double)(__rdtsc() - cycles_start) / BENCH_EVENTS;
+#else
+    double cycles = 0;
+#endif
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return {ns / BENCH_EVENTS, cycles, (allocations - before) / BENCH_EVENTS};
+}
+
+// ns per publish against the old dispatch: a fresh String of the track name handed to
+// every std::function in a vector, each running the same handler
+static void bench(int subscribers) {
+    int64_t sink = 0;
+    PlayerEventBus bus;
+    for (int i = 0; i < subscribers; i++) bus.subscribe(count, &sink);
+    Cost current = measure([&](int32_t i) {
+        bus.publish({PlayerEventType::STATE_CHANGED, PlayerState::PLAYING, i, 0});
+    });
+
+    typedef std::function<void(PlayerState state, int track_index, const String& track_name)> StateChangeCallback;
+    std::vector<StateChangeCallback> callbacks;
+    for (int i = 0; i < subscribers; i++) {
+        callbacks.push_back([&sink](PlayerState state, int track_index, const String& track_name) {
+            count({PlayerEventType::STATE_CHANGED, state, track_index, (int32_t)track_name.length()}, &sink);
+        });
+    }
+    String current_track_name = TRACK_NAME;
+    Cost old = measure([&](int32_t i) {
+        String track_name = current_track_name;
+        for (auto& callback : callbacks) callback(PlayerState::PLAYING, i, track_name);
+    });
+
+    char line[160];
+    snprintf(line, sizeof(line), "%d subscriber%s: bus %.1f ns, %.0f cycles, %u allocations; "
+             "std::function + String %.1f ns, %.0f cycles, %u allocations per publish",
+             subscribers, subscribers == 1 ? " " : "s", current.ns, current.cycles, (unsigned)current.allocations,
+             old.ns, old.cycles, (unsigned)old.allocations);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(0, current.allocations);
+    TEST_ASSERT_NOT_EQUAL(0, sink);
+}
+
+void test_dispatch_cost(void) {
+    bench(1);
+    bench(2);
+    bench(PLAYER_EVENT_MAX_SUBSCRIBERS);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_subscribers_are_called_in_order);
+    RUN_TEST(test_publish_does_not_allocate);
+    RUN_TEST(test_queue_keeps_order_and_drops_when_full);
+    RUN_TEST(test_queue_across_threads);
+    RUN_TEST(test_dispatch_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,97 @@
+#include <unity.h>
+#include <chrono>
+#include <random>
+#include "ExternalSort.h"
+#include "PlaylistManager.h"
+
+// Cost of sorting the playlist keys on the card. Keys are TrackSortKey-sized records
+// with random path prefixes, sorted through the same buffer size the scan uses. Time
+// is a host figure; the SD traffic counts are what carry over to the card.
+
+#define RUN_TMP    "/sort1.tmp"
+#define MERGE_TMP  "/sort2.tmp"
+#define SORTED_TMP "/sorted.tmp"
+
+static uint8_t buffer[PLAYLIST_SORT_BUFFER_SIZE];
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static int compareKeys(const void* a, const void* b) {
+    const TrackSortKey* key_a = (const TrackSortKey*)a;
+    const TrackSortKey* key_b = (const TrackSortKey*)b;
+    int result = memcmp(key_a->prefix, key_b->prefix, sizeof(key_a->prefix));
+    if (result != 0) return result;
+    return key_a->track < key_b->track ? -1 : key_a->track > key_b->track;
+}
+
+static void randomKey(std::mt19937& random, uint32_t track, TrackSortKey& key) {
+    memset(&key, 0, sizeof(key));
+    snprintf(key.prefix, sizeof(key.prefix), "Artist %03u/%02u Song %u.mp3",
+             (unsigned)(random() % 500), (unsigned)(random() % 30), (unsigned)random());
+    key.track = track;
+}
+
+static void sortAndReport(uint32_t tracks) {
+    SD.format();
+    SD.resetCounters();
+    std::mt19937 random(tracks);
+    TrackSortKey key;
+
+    auto start = std::chrono::steady_clock::now();
+    ExternalSorter sorter(sizeof(TrackSortKey), compareKeys, buffer, sizeof(buffer));
+    TEST_ASSERT_TRUE(sorter.begin(RUN_TMP, MERGE_TMP));
+    for (uint32_t i = 0; i < tracks; i++) {
+        randomKey(random, i, key);
+        TEST_ASSERT_TRUE(sorter.add(&key));
+    }
+    TEST_ASSERT_TRUE(sorter.finish(SORTED_TMP));
+    double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    SdCounters sort_io = SD.counters;
+
+    // Every key comes back, in order
+    File sorted = SD.open(SORTED_TMP, FILE_READ);
+    TEST_ASSERT_TRUE((bool)sorted);
+    TEST_ASSERT_EQUAL_UINT32(tracks * sizeof(TrackSortKey), sorted.size());
+    TrackSortKey previous;
+    for (uint32_t i = 0; i < tracks; i++) {
+        TEST_ASSERT_EQUAL_UINT32(sizeof(key), sorted.read((uint8_t*)&key, sizeof(key)));
+        if (i > 0) TEST_ASSERT_LESS_OR_EQUAL(0, compareKeys(&previous, &key));
+        previous = key;
+    }
+    sorted.close();
+
+    double data = (double)tracks * sizeof(TrackSortKey);
+    char line[256];
+    snprintf(line, sizeof(line), "%6u tracks: %8.1f ms, SD read %9llu bytes (%.1fx data) in %u calls, "
+             "written %9llu bytes (%.1fx data) in %u calls",
+             (unsigned)tracks, millis, (unsigned long long)sort_io.bytes_read, sort_io.bytes_read / data,
+             (unsigned)sort_io.reads, (unsigned long long)sort_io.bytes_written,
+             sort_io.bytes_written / data, (unsigned)sort_io.writes);
+    TEST_MESSAGE(line);
+
+    // The sorter's own accounting matches what reached the card
+    TEST_ASSERT_EQUAL_UINT32(sort_io.bytes_read, sorter.getBytesRead());
+    TEST_ASSERT_EQUAL_UINT32(sort_io.bytes_written, sorter.getBytesWritten());
+
+    // Each key is written once into a run, then once per merge pass
+    uint32_t passes = 1;
+    for (uint32_t run_length = sizeof(buffer) / sizeof(TrackSortKey); run_length < tracks;
+         run_length *= EXTERNAL_SORT_FAN_IN) {
+        passes++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(passes * tracks * sizeof(TrackSortKey), sort_io.bytes_written);
+}
+
+void test_sort_1k_tracks(void) { sortAndReport(1000); }
+void test_sort_10k_tracks(void) { sortAndReport(10000); }
+void test_sort_50k_tracks(void) { sortAndReport(50000); }
+
+int main() {
+    SD.setRoot((std::filesystem::temp_directory_path() / "test_external_sort").string());
+    UNITY_BEGIN();
+    RUN_TEST(test_sort_1k_tracks);
+    RUN_TEST(test_sort_10k_tracks);
+    RUN_TEST(test_sort_50k_tracks);
+    return UNITY_END();
+}
@@ -0,0 +1,129 @@
+#include <unity.h>
+#include <vector>
+#include "AudioProcessor.h"
+#include "Mp3Parser.h"
+#include "SyntheticMp3.h"
+
+// Frame headers, the chain check that rejects false sync words in junk, and the decode
+// path that writes frames straight into the ring starting from the frame found
+
+#define JUNK_PATH "/junk.mp3"
+#define JUNK_SIZE 1000
+#define SAMPLE_RATE 44100
+#define TRACK_SAMPLES (3 * SAMPLE_RATE)  // Several times round the ring
+
+// The decode task runs until the process ends, so the processor is never destroyed
+static AudioProcessor* audio = new AudioProcessor();
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void assertHeader(const uint8_t* data, uint8_t version, uint8_t channels, uint16_t kbps,
+                         uint32_t sample_rate, uint16_t samples_per_frame, uint16_t frame_length) {
+    Mp3FrameHeader header;
+    TEST_ASSERT_TRUE(Mp3Parser::parseFrameHeader(data, header));
+    TEST_ASSERT_EQUAL_UINT8(version, header.version);
+    TEST_ASSERT_EQUAL_UINT8(3, header.layer);
+    TEST_ASSERT_EQUAL_UINT8(channels, header.channels);
+    TEST_ASSERT_EQUAL_UINT16(kbps, header.bitrate_kbps);
+    TEST_ASSERT_EQUAL_UINT32(sample_rate, header.sample_rate);
+    TEST_ASSERT_EQUAL_UINT16(samples_per_frame, header.samples_per_frame);
+    TEST_ASSERT_EQUAL_UINT16(frame_length, header.frame_length);
+}
+
+void test_valid_headers(void) {
+    const uint8_t mpeg1[] = {0xFF, 0xFB, 0x90, 0x00};
+    const uint8_t padded[] = {0xFF, 0xFB, 0x92, 0x00};
+    const uint8_t mono[] = {0xFF, 0xFB, 0x90, 0xC0};
+    const uint8_t mpeg2[] = {0xFF, 0xF3, 0x90, 0x00};
+    const uint8_t mpeg25[] = {0xFF, 0xE3, 0x90, 0x00};
+    assertHeader(mpeg1, 1, 2, 128, 44100, 1152, 417);
+    assertHeader(padded, 1, 2, 128, 44100, 1152, 418);
+    assertHeader(mono, 1, 1, 128, 44100, 1152, 417);
+    assertHeader(mpeg2, 2, 2, 80, 22050, 576, 261);  // Same index, lower bitrate table
+    assertHeader(mpeg25, 3, 2, 80, 11025, 576, 522);
+}
+
+void test_invalid_headers(void) {
+    const uint8_t invalid[][4] = {
+        {0xFE, 0xFB, 0x90, 0x00},  // No sync
+        {0xFF, 0xDB, 0x90, 0x00},  // Sync cut short
+        {0xFF, 0xEB, 0x90, 0x00},  // Reserved version
+        {0xFF, 0xFD, 0x90, 0x00},  // Layer II
+        {0xFF, 0xF9, 0x90, 0x00},  // Reserved layer
+        {0xFF, 0xFB, 0x00, 0x00},  // Free format
+        {0xFF, 0xFB, 0xF0, 0x00},  // Bad bitrate
+        {0xFF, 0xFB, 0x9C, 0x00},  // Reserved sample rate
+    };
+    Mp3FrameHeader header;
+    for (const auto& data : invalid) {
+        TEST_ASSERT_FALSE(Mp3Parser::parseFrameHeader(data, header));
+    }
+}
+
+// Junk in front of the stream with false headers: a lone one, and a pair one frame
+// apart that only the third link of the chain gives away
+void test_false_sync_in_junk_is_rejected(void) {
+    SD.setRoot((std::filesystem::temp_directory_path() / "test_frame_sync").string());
+    SD.format();
+
+    std::vector<uint8_t> junk(JUNK_SIZE, 0x55);
+    const uint8_t fake[] = {0xFF, 0xFB, 0x90, 0x00};
+    memcpy(junk.data() + 10, fake, 4);
+    memcpy(junk.data() + 100, fake, 4);
+    memcpy(junk.data() + 100 + 417, fake, 4);
+
+    SyntheticTrack track;
+    track.waveform = SYNTHETIC_COUNTER;
+    track.samples = TRACK_SAMPLES;
+    track.prefix = junk;
+    SyntheticLayout layout;
+    TEST_ASSERT_TRUE(syntheticWriteMp3(JUNK_PATH, track, &layout));
+
+    File file = SD.open(JUNK_PATH, FILE_READ);
+    Mp3StreamInfo info;
+    TEST_ASSERT_TRUE(Mp3Parser::readStreamInfo(file, info));
+    file.close();
+    TEST_ASSERT_EQUAL_UINT32(0, info.audio_start);
+    TEST_ASSERT_EQUAL_UINT32(JUNK_SIZE, info.first_frame);
+    TEST_ASSERT_EQUAL_UINT32(layout.first_frame, info.first_frame);
+    TEST_ASSERT_TRUE(info.has_info_frame);
+    TEST_ASSERT_EQUAL_UINT32(TRACK_SAMPLES * 1000ull / SAMPLE_RATE, info.duration_ms);
+}
+
+// Every sample of the track comes out once and in order, across many ring wraps
+void test_frames_decode_straight_into_the_ring(void) {
+    TEST_ASSERT_TRUE(audio->begin());
+    TEST_ASSERT_TRUE(audio->openFile(JUNK_PATH));
+    uint8_t buffer[4096];
+    audio->readAudioData(buffer, 4);  // Takes the flush that opening a file asks for
+
+    int64_t expected = 0;
+    unsigned long start = millis();
+    while (!audio->isFinished()) {
+        TEST_ASSERT_LESS_THAN(20000, millis() - start);
+        int32_t len = min(audio->getBufferedBytes(), sizeof(buffer)) & ~3;
+        if (len == 0) {
+            delay(1);
+            continue;
+        }
+        TEST_ASSERT_EQUAL_INT(len, audio->readAudioData(buffer, len));
+        const int16_t* samples = (const int16_t*)buffer;
+        for (int32_t i = 0; i < len / 4; i++) {
+            TEST_ASSERT_EQUAL_INT64(expected, syntheticCounterAt(samples + i * 2));
+            expected++;
+        }
+    }
+    audio->closeFile();
+    TEST_ASSERT_EQUAL_INT64(TRACK_SAMPLES, expected);
+    TEST_ASSERT_EQUAL_UINT32(0, audio->getUnderrunCount());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_valid_headers);
+    RUN_TEST(test_invalid_headers);
+    RUN_TEST(test_false_sync_in_junk_is_rejected);
+    RUN_TEST(test_frames_decode_straight_into_the_ring);
+    return UNITY_END();
+}
@@ -0,0 +1,112 @@
+#include <unity.h>
+#include <chrono>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "GainStage.h"
+
+// What the gain stage does to a decoded frame, and what it costs per sample. Costs are
+// host time and host cycles; the ESP32 cost has to be measured on the device.
+
+#define FRAME_SAMPLES 1152  // One MPEG-1 frame, the block size the decode task uses
+#define BENCH_BLOCKS 20000
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static std::vector<int16_t> sine(int16_t amplitude, uint8_t channels) {
+    std::vector<int16_t> pcm(FRAME_SAMPLES * channels);
+    for (size_t i = 0; i < FRAME_SAMPLES; i++) {
+        for (int c = 0; c < channels; c++) {
+            pcm[i * channels + c] = (int16_t)lrint(amplitude * sin(2 * M_PI * i / 100.0));
+        }
+    }
+    return pcm;
+}
+
+static int16_t peakOf(const std::vector<int16_t>& pcm) {
+    int32_t peak = 0;
+    for (int16_t s : pcm) peak = max(peak, (int32_t)abs(s));
+    return peak;
+}
+
+void test_unity_leaves_samples_alone(void) {
+    GainStage gain;
+    std::vector<int16_t> pcm = sine(20000, 2);
+    std::vector<int16_t> original = pcm;
+    gain.setGain(0);
+    gain.process(pcm.data(), FRAME_SAMPLES, 2);
+    TEST_ASSERT_TRUE(pcm == original);
+}
+
+void test_cut_scales_samples(void) {
+    GainStage gain;
+    gain.setGain(-600);
+    gain.reset();
+    std::vector<int16_t> pcm = sine(20000, 2);
+    gain.process(pcm.data(), FRAME_SAMPLES, 2);
+    TEST_ASSERT_INT_WITHIN(20, 10024, peakOf(pcm));  // 20000 at -6 dB
+    TEST_ASSERT_EQUAL_UINT32(0, gain.getLimitedBlocks());
+}
+
+// +12 dB on a near full-scale block would clip; the limiter turns it down instead
+void test_boost_never_wraps(void) {
+    GainStage gain;
+    gain.setGain(1200);
+    gain.reset();
+    for (int block = 0; block < 10; block++) {
+        std::vector<int16_t> input = sine(30000, 2);
+        std::vector<int16_t> pcm = input;
+        gain.process(pcm.data(), FRAME_SAMPLES, 2);
+        for (size_t i = 0; i < pcm.size(); i++) {
+            TEST_ASSERT_TRUE((int32_t)pcm[i] * input[i] >= 0);  // No sign flip from overflow
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(10, gain.getLimitedBlocks());
+}
+
+// ns and host cycles per sample, processing frame-sized blocks
+static void bench(const char* name, int32_t gain_cdb, int16_t amplitude, uint8_t channels, bool ramp) {
+    GainStage gain;
+    gain.setGain(gain_cdb);
+    gain.reset();
+    std::vector<int16_t> source = sine(amplitude, channels);
+    std::vector<int16_t> pcm(source.size());
+    double ns = 0;
+    uint64_t cycles = 0;
+    for (int block = 0; block < BENCH_BLOCKS; block++) {
+        pcm = source;  // Fresh input each time, copied outside the timed part
+        if (ramp) gain.setGain(block % 2 ? gain_cdb : gain_cdb - 300);
+        auto start = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+        uint64_t cycles_start = __rdtsc();
+#endif
+        gain.process(pcm.data(), FRAME_SAMPLES, channels);
+#if defined(__x86_64__) || defined(__i386__)
+        cycles += __rdtsc() - cycles_start;
+#endif
+        ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    double samples = (double)BENCH_BLOCKS * FRAME_SAMPLES * channels;
+    char line[128];
+    snprintf(line, sizeof(line), "%-22s %.2f ns, %.2f host TSC cycles per sample", name, ns / samples, cycles / samples);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_GREATER_THAN(0, ns);
+}
+
+void test_cost_per_sample(void) {
+    bench("-6 dB stereo:", -600, 20000, 2, false);
+    bench("-6 dB mono:", -600, 20000, 1, false);
+    bench("Ramping each block:", -600, 20000, 2, true);
+    bench("+12 dB, limiting:", 1200, 30000, 2, false);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_unity_leaves_samples_alone);
+    RUN_TEST(test_cut_scales_samples);
+    RUN_TEST(test_boost_never_wraps);
+    RUN_TEST(test_cost_per_sample);
+    return UNITY_END();
+}
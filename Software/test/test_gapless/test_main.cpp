@@ -0,0 +1,108 @@
+#include <unity.h>
+#include <vector>
+#include "AudioProcessor.h"
+#include "SyntheticMp3.h"
+
+// Gapless handover: one sine split across two files, each with its own encoder delay
+// and padding, must come out of the ring as the unbroken sine
+
+#define FIRST_PATH "/first.mp3"
+#define SECOND_PATH "/second.mp3"
+#define FIRST_SAMPLES 44223   // Neither half ends on a frame boundary
+#define SECOND_SAMPLES 30011
+#define PERIOD 100.37
+#define AMPLITUDE 8000
+
+// The decode task runs until the process ends, so the processor is never destroyed
+static AudioProcessor* audio = new AudioProcessor();
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void writeHalves() {
+    SD.setRoot((std::filesystem::temp_directory_path() / "test_gapless").string());
+    SD.format();
+
+    SyntheticTrack track;
+    track.period = PERIOD;
+    track.amplitude = AMPLITUDE;
+    track.signal_begin = 0;
+    track.samples = FIRST_SAMPLES;
+    SyntheticLayout layout;
+    TEST_ASSERT_TRUE(syntheticWriteMp3(FIRST_PATH, track, &layout));
+    TEST_ASSERT_NOT_EQUAL(0, layout.encoder_padding);
+
+    track.signal_begin = FIRST_SAMPLES;
+    track.samples = SECOND_SAMPLES;
+    track.encoder_delay = 1105;  // A different encoder setting on the second file
+    TEST_ASSERT_TRUE(syntheticWriteMp3(SECOND_PATH, track, &layout));
+    TEST_ASSERT_NOT_EQUAL(0, layout.encoder_padding);
+}
+
+// Plays both files as the A2DP callback and the main loop would, without underruns
+static std::vector<int16_t> playBoth() {
+    std::vector<int16_t> output;
+    uint8_t buffer[4096];
+    TEST_ASSERT_TRUE(audio->openFile(FIRST_PATH));
+    audio->readAudioData(buffer, 4);  // Takes the flush that opening a file asks for
+
+    bool queued = false;
+    unsigned long start = millis();
+    while (!audio->isFinished()) {
+        TEST_ASSERT_LESS_THAN(20000, millis() - start);
+        // The second file asks for a follower too; the playlist ends there
+        if (audio->hasNextFileRequest()) {
+            if (!queued) TEST_ASSERT_TRUE(audio->queueFile(SECOND_PATH));
+            audio->consumeNextFileRequest();
+            queued = true;
+        }
+        int32_t len = min(audio->getBufferedBytes(), sizeof(buffer)) & ~3;
+        if (len == 0) {
+            delay(1);
+            continue;
+        }
+        TEST_ASSERT_EQUAL_INT(len, audio->readAudioData(buffer, len));
+        const int16_t* samples = (const int16_t*)buffer;
+        output.insert(output.end(), samples, samples + len / sizeof(int16_t));
+    }
+    TEST_ASSERT_TRUE(queued);
+    TEST_ASSERT_TRUE(audio->hasTrackChangeEvent());
+    audio->consumeTrackChangeEvent();
+    audio->closeFile();
+    return output;
+}
+
+void test_split_sine_plays_without_a_seam(void) {
+    writeHalves();
+    TEST_ASSERT_TRUE(audio->begin());
+    std::vector<int16_t> output = playBoth();
+
+    // Delay and padding of both files trimmed: not one sample more or less
+    TEST_ASSERT_EQUAL_UINT32((FIRST_SAMPLES + SECOND_SAMPLES) * 2, output.size());
+
+    int max_error = 0;
+    int worst = 0;
+    for (size_t frame = 0; frame < output.size() / 2; frame++) {
+        int16_t expected = syntheticSignal(SYNTHETIC_SINE, PERIOD, AMPLITUDE, frame, 0);
+        for (int channel = 0; channel < 2; channel++) {
+            int error = abs(output[frame * 2 + channel] - expected);
+            if (error > max_error) max_error = error, worst = frame;
+        }
+    }
+
+    // The step across the join is one the sine itself takes
+    int max_step = (int)ceil(2 * M_PI * AMPLITUDE / PERIOD);
+    int join_step = abs(output[FIRST_SAMPLES * 2] - output[(FIRST_SAMPLES - 1) * 2]);
+    char line[128];
+    snprintf(line, sizeof(line), "Largest error %d at frame %d; step across the join %d, sine's largest %d",
+             max_error, worst, join_step, max_step);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_LESS_OR_EQUAL(1, max_error);
+    TEST_ASSERT_LESS_OR_EQUAL(max_step, join_step);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_split_sine_plays_without_a_seam);
+    return UNITY_END();
+}
@@ -0,0 +1,135 @@
+#include <unity.h>
+#include "AudioProcessor.h"
+#include "Mp3Parser.h"
+#include "SyntheticMp3.h"
+
+// ID3v2 tags are skipped by their size field, never searched through. Every synthetic
+// tag body is full of byte patterns that look like frame headers, as cover art is.
+
+#define PLAIN_PATH "/plain.mp3"
+#define TAGGED_PATH "/tagged.mp3"
+#define SAMPLE_RATE 44100
+#define COVER_ART_TAG_SIZE (1024 * 1024)
+#define FIRST_SAMPLE_READ_LIMIT 16384  // Info frame, the first frames and the input buffer fill
+
+// The decode task runs until the process ends, so the processor is never destroyed
+static AudioProcessor* audio = new AudioProcessor();
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static SyntheticLayout writeTrack(const char* path, const std::vector<uint8_t>& prefix) {
+    SyntheticTrack track;
+    track.waveform = SYNTHETIC_COUNTER;
+    track.samples = 2 * SAMPLE_RATE;
+    track.prefix = prefix;
+    SyntheticLayout layout;
+    TEST_ASSERT_TRUE(syntheticWriteMp3(path, track, &layout));
+    return layout;
+}
+
+static void readInfo(const char* path, Mp3StreamInfo& info) {
+    File file = SD.open(path, FILE_READ);
+    TEST_ASSERT_TRUE((bool)file);
+    TEST_ASSERT_TRUE(Mp3Parser::readStreamInfo(file, info));
+    file.close();
+}
+
+void test_tag_sizes(void) {
+    SD.setRoot((std::filesystem::temp_directory_path() / "test_id3_skip").string());
+    SD.format();
+
+    struct { uint32_t size; uint8_t major; bool footer; } tags[] = {
+        {ID3V2_HEADER_SIZE, 3, false},
+        {5000, 3, false},
+        {5000, 4, false},
+        {6000, 4, true},  // The footer is not counted in the size field
+    };
+    for (const auto& tag : tags) {
+        writeTrack(TAGGED_PATH, syntheticId3v2(tag.size, tag.major, tag.footer));
+        File file = SD.open(TAGGED_PATH, FILE_READ);
+        TEST_ASSERT_EQUAL_UINT32(tag.size, Mp3Parser::readId3v2Size(file));
+        TEST_ASSERT_EQUAL_UINT32(0, Mp3Parser::readId3v2Size(file, tag.size));
+        file.close();
+    }
+
+    // A size byte with its top bit set is not syncsafe, so this is no tag
+    std::vector<uint8_t> broken = syntheticId3v2(5000);
+    broken[7] |= 0x80;
+    writeTrack(TAGGED_PATH, broken);
+    File file = SD.open(TAGGED_PATH, FILE_READ);
+    TEST_ASSERT_EQUAL_UINT32(0, Mp3Parser::readId3v2Size(file));
+    file.close();
+}
+
+// Some taggers write a new tag in front of the old one
+void test_stacked_tags_are_all_skipped(void) {
+    std::vector<uint8_t> prefix = syntheticId3v2(3000, 3);
+    std::vector<uint8_t> second = syntheticId3v2(4000, 4, true);
+    prefix.insert(prefix.end(), second.begin(), second.end());
+    SyntheticLayout layout = writeTrack(TAGGED_PATH, prefix);
+
+    Mp3StreamInfo info;
+    readInfo(TAGGED_PATH, info);
+    TEST_ASSERT_EQUAL_UINT32(7000, info.audio_start);
+    TEST_ASSERT_EQUAL_UINT32(layout.first_frame, info.first_frame);
+    TEST_ASSERT_TRUE(info.has_info_frame);
+}
+
+// A cover-art-sized tag costs a header read, and the stream looks the same as without it
+void test_large_tag_is_seeked_past(void) {
+    writeTrack(PLAIN_PATH, std::vector<uint8_t>());
+    SyntheticLayout layout = writeTrack(TAGGED_PATH, syntheticId3v2(COVER_ART_TAG_SIZE));
+
+    Mp3StreamInfo plain;
+    Mp3StreamInfo tagged;
+    readInfo(PLAIN_PATH, plain);
+    SD.resetCounters();
+    readInfo(TAGGED_PATH, tagged);
+    char line[96];
+    snprintf(line, sizeof(line), "readStreamInfo past a %u byte tag read %llu bytes",
+             COVER_ART_TAG_SIZE, (unsigned long long)SD.counters.bytes_read);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_LESS_THAN(2048, SD.counters.bytes_read);
+
+    TEST_ASSERT_EQUAL_UINT32(COVER_ART_TAG_SIZE, tagged.first_frame);
+    TEST_ASSERT_EQUAL_UINT32(layout.first_frame, tagged.first_frame);
+    TEST_ASSERT_EQUAL_UINT32(plain.duration_ms, tagged.duration_ms);
+    TEST_ASSERT_EQUAL_UINT32(plain.stream_bytes, tagged.stream_bytes);
+    TEST_ASSERT_EQUAL_UINT32(plain.frame_count, tagged.frame_count);
+}
+
+// Playback starts on the first sample of the track without reading the tag
+void test_first_sample_without_reading_the_tag(void) {
+    TEST_ASSERT_TRUE(audio->begin());
+    uint8_t buffer[16];
+    SD.resetCounters();
+    unsigned long start = micros();
+    TEST_ASSERT_TRUE(audio->openFile(TAGGED_PATH));
+    audio->readAudioData(buffer, 4);  // Takes the flush that opening a file asks for
+    while (audio->getBufferedBytes() < sizeof(buffer)) {
+        TEST_ASSERT_LESS_THAN(5000000, micros() - start);
+        delayMicroseconds(50);
+    }
+    unsigned long elapsed = micros() - start;
+    uint64_t bytes_read = SD.counters.bytes_read;
+    TEST_ASSERT_EQUAL_INT(sizeof(buffer), audio->readAudioData(buffer, sizeof(buffer)));
+    audio->closeFile();
+
+    char line[128];
+    snprintf(line, sizeof(line), "First sample after %lu us and %llu bytes read; scanning the tag would read %u",
+             elapsed, (unsigned long long)bytes_read, COVER_ART_TAG_SIZE);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_LESS_THAN(FIRST_SAMPLE_READ_LIMIT, bytes_read);
+    TEST_ASSERT_EQUAL_INT64(0, syntheticCounterAt((const int16_t*)buffer));
+    TEST_ASSERT_EQUAL_INT64(1, syntheticCounterAt((const int16_t*)buffer + 2));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_tag_sizes);
+    RUN_TEST(test_stacked_tags_are_all_skipped);
+    RUN_TEST(test_large_tag_is_seeked_past);
+    RUN_TEST(test_first_sample_without_reading_the_tag);
+    return UNITY_END();
+}
@@ -0,0 +1,73 @@
+#include <unity.h>
+#include "PlaylistManager.h"
+#include "SyntheticLibrary.h"
+
+// The boot-time check against the card, and rebuilds that keep the old index usable
+
+#define LIBRARY_ROOT "/Music"
+
+static PlaylistManager playlist(LIBRARY_ROOT);
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_fresh_index_is_current(void) {
+    SD.setRoot((std::filesystem::temp_directory_path() / "test_index_refresh").string());
+    SD.format();
+    TEST_ASSERT_TRUE(syntheticWriteLibrary(LIBRARY_ROOT, 20, 20));
+    Serial.quiet = true;
+    TEST_ASSERT_TRUE(syntheticScanLibrary(playlist));
+    TEST_ASSERT_EQUAL_UINT32(400, playlist.getTrackCount());
+    TEST_ASSERT_TRUE(playlist.isIndexCurrent());
+}
+
+// A rename deep in the tree keeps the card's used space, so only the folder's own
+// fingerprint shows it
+void test_rename_in_subfolder_is_noticed(void) {
+    TEST_ASSERT_TRUE(SD.rename(LIBRARY_ROOT "/Artist 07/03 Song 3 of folder 7.mp3",
+                               LIBRARY_ROOT "/Artist 07/03 Renamed.mp3"));
+    TEST_ASSERT_FALSE(playlist.isIndexCurrent());
+
+    TEST_ASSERT_TRUE(playlist.updateIndex());
+    TEST_ASSERT_TRUE(syntheticWaitIdle(playlist));
+    TEST_ASSERT_TRUE(playlist.isIndexCurrent());
+    TEST_ASSERT_EQUAL_UINT32(400, playlist.getTrackCount());
+}
+
+// Until a full rebuild is swapped in, lookups keep answering from the old index
+void test_full_rebuild_keeps_old_index(void) {
+    char before[PLAYLIST_MAX_PATH];
+    char during[PLAYLIST_MAX_PATH];
+    TEST_ASSERT_GREATER_THAN(0, playlist.getTrackPath(123, before, sizeof(before)));
+
+    // The library is the same, so the count never changes, not even for a moment
+    TEST_ASSERT_TRUE(playlist.scanForMP3Files());
+    int checks = 0;
+    while (playlist.isScanning()) {
+        TEST_ASSERT_EQUAL_UINT32(400, playlist.getTrackCount());
+        TEST_ASSERT_GREATER_THAN(0, playlist.getTrackPath(123, during, sizeof(during)));
+        TEST_ASSERT_EQUAL_STRING(before, during);
+        checks++;
+        delay(1);
+    }
+    TEST_ASSERT_TRUE(syntheticWaitIdle(playlist));
+    TEST_ASSERT_GREATER_THAN(0, checks);
+    TEST_ASSERT_FALSE(SD.exists(PLAYLIST_NAMES_TMP));
+    TEST_ASSERT_GREATER_THAN(0, playlist.getTrackPath(123, during, sizeof(during)));
+    TEST_ASSERT_EQUAL_STRING(before, during);
+    TEST_ASSERT_TRUE(playlist.isIndexCurrent());
+
+    // And the swapped-in files are what the next boot loads
+    TEST_ASSERT_TRUE(playlist.loadIndex());
+    TEST_ASSERT_EQUAL_UINT32(400, playlist.getTrackCount());
+    TEST_ASSERT_GREATER_THAN(0, playlist.getTrackPath(123, during, sizeof(during)));
+    TEST_ASSERT_EQUAL_STRING(before, during);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fresh_index_is_current);
+    RUN_TEST(test_rename_in_subfolder_is_noticed);
+    RUN_TEST(test_full_rebuild_keeps_old_index);
+    return UNITY_END();
+}
@@ -0,0 +1,93 @@
+#include <unity.h>
+#include "PlaylistManager.h"
+#include "SyntheticLibrary.h"
+
+// Letter groups of the sorted playlist: labelled by file name, one set per folder, and
+// none dropped however many folders there are
+
+#define LIBRARY_ROOT "/Music"
+#define FOLDERS 30
+#define TRACKS_PER_FOLDER 6
+#define GROUPS_PER_FOLDER 5
+
+static PlaylistManager playlist(LIBRARY_ROOT);
+static const char* track_names[TRACKS_PER_FOLDER] = {
+    "3 Doors.mp3", "Alpha.mp3", "Bravo.mp3", "bravo two.mp3", "Charlie.mp3", "Delta.mp3"
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Every folder starts with Z, and every other one runs past the sort key's path prefix
+static void folderName(char* out, size_t size, int folder, int) {
+    if (folder % 2) {
+        snprintf(out, size, "Zed %02d with a folder name longer than the sort prefix", folder);
+    } else {
+        snprintf(out, size, "Zed %02d", folder);
+    }
+}
+
+static void trackName(char* out, size_t size, int, int track) {
+    snprintf(out, size, "%s", track_names[track]);
+}
+
+static char expectedLabel(int index) {
+    char path[PLAYLIST_MAX_PATH];
+    TEST_ASSERT_GREATER_THAN(0, playlist.getTrackPath(index, path, sizeof(path)));
+    char first = strrchr(path, '/')[1];
+    if (isalpha((uint8_t)first)) return toupper((uint8_t)first);
+    return isdigit((uint8_t)first) ? '#' : '*';
+}
+
+void test_library_scans(void) {
+    SD.setRoot((std::filesystem::temp_directory_path() / "test_jump_table").string());
+    SD.format();
+    TEST_ASSERT_TRUE(syntheticWriteLibrary(LIBRARY_ROOT, FOLDERS, TRACKS_PER_FOLDER, folderName, trackName));
+    Serial.quiet = true;
+    TEST_ASSERT_TRUE(syntheticScanLibrary(playlist));
+    TEST_ASSERT_EQUAL_UINT32(FOLDERS * TRACKS_PER_FOLDER, playlist.getTrackCount());
+}
+
+void test_labels_come_from_file_names(void) {
+    for (int i = 0; i < (int)playlist.getTrackCount(); i++) {
+        TEST_ASSERT_EQUAL_INT(expectedLabel(i), playlist.getJumpLabel(i));
+    }
+}
+
+// More groups than the old fixed table held, and stepping visits each one in turn
+void test_every_group_is_kept(void) {
+    TEST_ASSERT_EQUAL_INT(FOLDERS * GROUPS_PER_FOLDER, playlist.getJumpCount());
+
+    int index = 0;
+    for (int group = 1; group < playlist.getJumpCount(); group++) {
+        int next = playlist.getJumpTarget(index, 1);
+        TEST_ASSERT_GREATER_THAN(index, next);
+        bool same_folder = next % TRACKS_PER_FOLDER != 0;
+        TEST_ASSERT_TRUE(!same_folder || expectedLabel(next) != expectedLabel(next - 1));
+        index = next;
+    }
+    TEST_ASSERT_EQUAL_INT(0, playlist.getJumpTarget(index, 1));
+}
+
+void test_backward_steps_to_group_starts(void) {
+    // "bravo two" shares the B group, so going back from it lands on "Bravo"
+    int bravo = 2 * TRACKS_PER_FOLDER + 2;
+    TEST_ASSERT_EQUAL_INT(bravo, playlist.getJumpTarget(bravo + 1, -1));
+    TEST_ASSERT_EQUAL_INT(bravo - 1, playlist.getJumpTarget(bravo, -1));
+    TEST_ASSERT_EQUAL_INT(bravo - 2, playlist.getJumpTarget(bravo - 1, -1));
+    TEST_ASSERT_EQUAL_INT(bravo - 3, playlist.getJumpTarget(bravo - 2, -1));
+
+    // And the jump table survives a reload from the card
+    TEST_ASSERT_TRUE(playlist.loadIndex());
+    TEST_ASSERT_EQUAL_INT(FOLDERS * GROUPS_PER_FOLDER, playlist.getJumpCount());
+    TEST_ASSERT_EQUAL_INT('B', playlist.getJumpLabel(bravo + 1));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_library_scans);
+    RUN_TEST(test_labels_come_from_file_names);
+    RUN_TEST(test_every_group_is_kept);
+    RUN_TEST(test_backward_steps_to_group_starts);
+    return UNITY_END();
+}
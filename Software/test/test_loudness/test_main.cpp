@@ -0,0 +1,71 @@
+#include <unity.h>
+#include "LoudnessAnalyzer.h"
+#include "SyntheticMp3.h"
+
+// The loudness pass keeps one decoder for every file it measures, and no file decodes
+// its first frames from the bit reservoir the previous file left behind
+
+#define FIRST_PATH "/first.mp3"
+#define SECOND_PATH "/second.mp3"
+#define AMPLITUDE 8000
+#define EXPECTED_GAIN -506  // 441 Hz sine at 8000 in both channels: -12.94 LUFS against -18
+
+static LoudnessAnalyzer analyzer;
+static const volatile bool not_cancelled = false;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void writeTrack(const char* path, uint16_t first_main_data_begin) {
+    SyntheticTrack track;
+    track.samples = 3 * 44100;
+    track.amplitude = AMPLITUDE;
+    track.first_main_data_begin = first_main_data_begin;
+    TEST_ASSERT_TRUE(syntheticWriteMp3(path, track));
+}
+
+void test_decoder_is_allocated_once(void) {
+    SD.setRoot((std::filesystem::temp_directory_path() / "test_loudness").string());
+    SD.format();
+    writeTrack(FIRST_PATH, 0);
+    writeTrack(SECOND_PATH, 300);  // Its first frame reaches back into the reservoir
+
+    int allocated = host_mp3_decoders_allocated;
+    TEST_ASSERT_TRUE(analyzer.begin());
+    TEST_ASSERT_TRUE(analyzer.begin());  // A later pass
+    TEST_ASSERT_EQUAL_INT(allocated + 1, host_mp3_decoders_allocated);
+}
+
+void test_each_file_starts_with_an_empty_reservoir(void) {
+    int16_t gain;
+    uint16_t peak;
+    TEST_ASSERT_TRUE(analyzer.analyze(FIRST_PATH, gain, peak, &not_cancelled));
+    TEST_ASSERT_INT_WITHIN(20, EXPECTED_GAIN, gain);
+    TEST_ASSERT_EQUAL_UINT16(AMPLITUDE, peak);
+
+    // The second file's first frame is dropped, not decoded from the first file's bytes
+    int underflows = host_mp3_reservoir_underflows;
+    TEST_ASSERT_TRUE(analyzer.analyze(SECOND_PATH, gain, peak, &not_cancelled));
+    TEST_ASSERT_EQUAL_INT(underflows + 1, host_mp3_reservoir_underflows);
+    TEST_ASSERT_INT_WITHIN(20, EXPECTED_GAIN, gain);
+
+    // Measuring it again gives the same result
+    int16_t again;
+    TEST_ASSERT_TRUE(analyzer.analyze(SECOND_PATH, again, peak, &not_cancelled));
+    TEST_ASSERT_EQUAL_INT(underflows + 2, host_mp3_reservoir_underflows);
+    TEST_ASSERT_EQUAL_INT(gain, again);
+}
+
+void test_end_frees_the_decoder(void) {
+    int live = host_mp3_decoders_live;
+    analyzer.end();
+    TEST_ASSERT_EQUAL_INT(live - 1, host_mp3_decoders_live);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_decoder_is_allocated_once);
+    RUN_TEST(test_each_file_starts_with_an_empty_reservoir);
+    RUN_TEST(test_end_frees_the_decoder);
+    return UNITY_END();
+}
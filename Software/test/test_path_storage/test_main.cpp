@@ -0,0 +1,115 @@
+#include <unity.h>
+#include <random>
+#include <vector>
+#include "PlaylistManager.h"
+#include "LegacyChunkIndex.h"
+#include "SyntheticLibrary.h"
+
+// Size of the path storage (file names in the string heap, each folder path once in the
+// directory manifest) against the full paths the chunked text index repeated for every
+// track, on an artist/album/track tree shaped like a real library. Lookup cost is counted
+// in SD calls, which is what carries over to the card.
+
+#define LIBRARY_ROOT "/Music"
+#define ARTISTS 40
+#define ALBUMS_PER_ARTIST 3
+#define TRACKS_PER_ALBUM 12
+#define LOOKUPS 5000
+#define MIN_COMPRESSION 2.0
+
+static PlaylistManager playlist(LIBRARY_ROOT);
+static uint64_t full_path_bytes = 0;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void albumFolder(char* out, size_t size, int folder, int) {
+    int artist = folder / ALBUMS_PER_ARTIST;
+    int album = folder % ALBUMS_PER_ARTIST;
+    snprintf(out, size, "The Artist Number %02d/%d - Album Title Number %d (Remastered Edition)",
+             artist, 1990 + album * 7, album + 1);
+}
+
+static void albumTrack(char* out, size_t size, int folder, int track) {
+    snprintf(out, size, "%02d - Song Title %d From Album %d.mp3", track + 1, track + 1, folder);
+}
+
+static uint32_t fileSize(const char* path) {
+    File file = SD.open(path, FILE_READ);
+    TEST_ASSERT_TRUE((bool)file);
+    uint32_t size = file.size();
+    file.close();
+    return size;
+}
+
+void test_library_scans(void) {
+    SD.setRoot((std::filesystem::temp_directory_path() / "test_path_storage").string());
+    SD.format();
+    TEST_ASSERT_TRUE(syntheticWriteLibrary(LIBRARY_ROOT, ARTISTS * ALBUMS_PER_ARTIST, TRACKS_PER_ALBUM,
+                                           albumFolder, albumTrack));
+    Serial.quiet = true;
+    TEST_ASSERT_TRUE(syntheticScanLibrary(playlist));
+    Serial.quiet = false;
+    TEST_ASSERT_EQUAL_UINT32(ARTISTS * ALBUMS_PER_ARTIST * TRACKS_PER_ALBUM, playlist.getTrackCount());
+
+    full_path_bytes = legacyWriteIndex(playlist);
+    char binary[PLAYLIST_MAX_PATH];
+    char legacy[PLAYLIST_MAX_PATH];
+    for (int i = 0; i < (int)playlist.getTrackCount(); i += 29) {
+        TEST_ASSERT_GREATER_THAN(0, playlist.getTrackPath(i, binary, sizeof(binary)));
+        TEST_ASSERT_GREATER_THAN(0, legacyTrackPath(i, legacy, sizeof(legacy)));
+        TEST_ASSERT_EQUAL_STRING(legacy, binary);
+    }
+}
+
+void test_paths_are_stored_compactly(void) {
+    uint32_t names = fileSize(PLAYLIST_NAMES_FILE);
+    uint32_t dirs = fileSize(PLAYLIST_DIRS_FILE);
+    double ratio = (double)full_path_bytes / (names + dirs);
+
+    char line[192];
+    snprintf(line, sizeof(line), "%u tracks: names.dat %u + dirs.idx %u bytes against %llu bytes of "
+             "full paths, %.2fx smaller", (unsigned)playlist.getTrackCount(), (unsigned)names,
+             (unsigned)dirs, (unsigned long long)full_path_bytes, ratio);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_GREATER_THAN(MIN_COMPRESSION * 100, (int)(ratio * 100));
+}
+
+template <class Lookup>
+static void measure(const std::vector<int>& indexes, Lookup lookup, double& reads, double& bytes) {
+    char path[PLAYLIST_MAX_PATH];
+    SD.resetCounters();
+    for (int index : indexes) {
+        TEST_ASSERT_GREATER_THAN(0, lookup(index, path, sizeof(path)));
+    }
+    reads = (double)SD.counters.reads / indexes.size();
+    bytes = (double)SD.counters.bytes_read / indexes.size();
+}
+
+// Jumping around the list, as shuffle and resume do, so the block cache helps least.
+// A lookup is a track record, its folder record and two heap reads at most.
+void test_lookup_cost(void) {
+    std::mt19937 random(1);
+    std::vector<int> indexes(LOOKUPS);
+    for (int& index : indexes) index = random() % playlist.getTrackCount();
+
+    double binary_reads, binary_bytes, legacy_reads, legacy_bytes;
+    measure(indexes, [](int i, char* out, size_t size) { return playlist.getTrackPath(i, out, size); },
+            binary_reads, binary_bytes);
+    measure(indexes, legacyTrackPath, legacy_reads, legacy_bytes);
+
+    char line[192];
+    snprintf(line, sizeof(line), "Random getTrackPath: %.2f SD reads, %.0f bytes; chunk lines: %.2f SD reads, "
+             "%.0f bytes", binary_reads, binary_bytes, legacy_reads, legacy_bytes);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_LESS_OR_EQUAL(4 * 100, (int)(binary_reads * 100));
+    TEST_ASSERT_LESS_THAN(legacy_reads, binary_reads);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_library_scans);
+    RUN_TEST(test_paths_are_stored_compactly);
+    RUN_TEST(test_lookup_cost);
+    return UNITY_END();
+}
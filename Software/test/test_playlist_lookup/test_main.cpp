@@ -0,0 +1,111 @@
+#include <unity.h>
+#include <vector>
+#include "PlaylistManager.h"
+#include "LegacyChunkIndex.h"
+#include "SyntheticLibrary.h"
+
+// Lookup cost of the binary track index against the chunked text index it replaced
+// (ten "/.playlist/all.NNNN" files of full paths per hundred tracks, scanned line by
+// line). Both are timed on the host over the same 10k-track library; the SD traffic
+// counts are what carry over to the card.
+
+#define LIBRARY_ROOT "/Music"
+#define FOLDERS 100
+#define TRACKS_PER_FOLDER 100
+#define LOOKUPS 5000
+
+static PlaylistManager playlist(LIBRARY_ROOT);
+
+struct LookupCost {
+    double micros_per_lookup;
+    double reads_per_lookup;  // Calls into the SD library
+    double bytes_per_lookup;
+    double opens_per_lookup;
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+template <class Lookup>
+static LookupCost measure(const std::vector<int>& indexes, Lookup lookup) {
+    char path[PLAYLIST_MAX_PATH];
+    SD.resetCounters();
+    auto start = std::chrono::steady_clock::now();
+    for (int index : indexes) {
+        TEST_ASSERT_GREATER_THAN(0, lookup(index, path, sizeof(path)));
+    }
+    double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    double n = indexes.size();
+    return {micros / n, SD.counters.reads / n, SD.counters.bytes_read / n, SD.counters.opens / n};
+}
+
+static void report(const char* pattern, const LookupCost& binary, const LookupCost& legacy) {
+    char line[256];
+    snprintf(line, sizeof(line), "%s lookups: binary %.2f us, %.2f reads, %.0f bytes, %.2f opens; "
+             "chunked %.2f us, %.2f reads, %.0f bytes, %.2f opens",
+             pattern, binary.micros_per_lookup, binary.reads_per_lookup, binary.bytes_per_lookup,
+             binary.opens_per_lookup, legacy.micros_per_lookup, legacy.reads_per_lookup,
+             legacy.bytes_per_lookup, legacy.opens_per_lookup);
+    TEST_MESSAGE(line);
+}
+
+void test_library_scans_to_binary_index(void) {
+    SD.setRoot((std::filesystem::temp_directory_path() / "test_playlist_lookup").string());
+    SD.format();
+    TEST_ASSERT_TRUE(syntheticWriteLibrary(LIBRARY_ROOT, FOLDERS, TRACKS_PER_FOLDER));
+    Serial.quiet = true;
+    TEST_ASSERT_TRUE(syntheticScanLibrary(playlist));
+    Serial.quiet = false;
+    TEST_ASSERT_EQUAL_UINT32(FOLDERS * TRACKS_PER_FOLDER, playlist.getTrackCount());
+    legacyWriteIndex(playlist);
+}
+
+void test_both_formats_agree(void) {
+    char binary[PLAYLIST_MAX_PATH];
+    char legacy[PLAYLIST_MAX_PATH];
+    for (int i = 0; i < (int)playlist.getTrackCount(); i += 37) {
+        TEST_ASSERT_GREATER_THAN(0, playlist.getTrackPath(i, binary, sizeof(binary)));
+        TEST_ASSERT_GREATER_THAN(0, legacyTrackPath(i, legacy, sizeof(legacy)));
+        TEST_ASSERT_EQUAL_STRING(legacy, binary);
+    }
+}
+
+// Jumping around the list, as the player does when shuffling or resuming
+void test_random_lookup_cost(void) {
+    std::mt19937 random(1);
+    std::vector<int> indexes(LOOKUPS);
+    for (int& index : indexes) index = random() % playlist.getTrackCount();
+
+    auto binary_lookup = [](int i, char* out, size_t size) { return playlist.getTrackPath(i, out, size); };
+    LookupCost binary = measure(indexes, binary_lookup);
+    LookupCost legacy = measure(indexes, legacyTrackPath);
+    report("Random", binary, legacy);
+
+    // Index files stay open, so a lookup never walks the card's directory for a file
+    TEST_ASSERT_EQUAL_FLOAT(0, binary.opens_per_lookup);
+    TEST_ASSERT_EQUAL_FLOAT(1, legacy.opens_per_lookup);
+    TEST_ASSERT_LESS_THAN(legacy.reads_per_lookup, binary.reads_per_lookup);
+}
+
+// Scrolling the list: neighbouring records share cached blocks
+void test_sequential_lookup_cost(void) {
+    std::vector<int> indexes;
+    for (int i = 0; i < LOOKUPS; i++) indexes.push_back(i % playlist.getTrackCount());
+
+    auto binary_lookup = [](int i, char* out, size_t size) { return playlist.getTrackPath(i, out, size); };
+    LookupCost binary = measure(indexes, binary_lookup);
+    LookupCost legacy = measure(indexes, legacyTrackPath);
+    report("Sequential", binary, legacy);
+
+    TEST_ASSERT_LESS_THAN(legacy.bytes_per_lookup, binary.bytes_per_lookup);
+    TEST_ASSERT_LESS_THAN(legacy.micros_per_lookup, binary.micros_per_lookup);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_library_scans_to_binary_index);
+    RUN_TEST(test_both_formats_agree);
+    RUN_TEST(test_random_lookup_cost);
+    RUN_TEST(test_sequential_lookup_cost);
+    return UNITY_END();
+}
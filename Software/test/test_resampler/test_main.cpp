@@ -0,0 +1,145 @@
+#include <unity.h>
+#include <chrono>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "PcmNormalizer.h"
+
+// Quality and cost of PcmNormalizer's resampler. A -6 dBFS 1 kHz sine is converted from
+// each rate the decoder can produce; THD+N is what is left after fitting the ideal sine
+// to the 44.1 kHz output. Speed is host time and host cycles per output frame: the
+// ESP32 cost has to be measured on the device.
+
+#define TONE_HZ 1000.0
+#define TONE_AMPLITUDE 16384
+#define SETTLE_FRAMES 4410        // Filter start-up left out of the fit
+#define FIT_FRAMES 44100          // A whole number of tone periods at 44.1 kHz
+#define SPEED_SECONDS 20
+#define MAX_THD_N_DB -70.0
+
+static PcmNormalizer normalizer;
+static const uint32_t rates[] = {8000, 11025, 16000, 22050, 24000, 32000, 48000};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static std::vector<int16_t> tone(uint32_t rate, uint8_t channels, double hz, size_t frames) {
+    std::vector<int16_t> pcm(frames * channels);
+    for (size_t i = 0; i < frames; i++) {
+        int16_t sample = (int16_t)lrint(TONE_AMPLITUDE * sin(2 * M_PI * hz * i / rate));
+        for (int c = 0; c < channels; c++) pcm[i * channels + c] = sample;
+    }
+    return pcm;
+}
+
+static std::vector<int16_t> convert(const std::vector<int16_t>& in, uint32_t rate, uint8_t channels) {
+    normalizer.configure(rate, channels);
+    normalizer.reset();
+    std::vector<int16_t> out;
+    std::vector<int16_t> chunk(normalizer.maxOutputFrames(PCM_NORMALIZER_MAX_INPUT) * PCM_OUTPUT_CHANNELS);
+    size_t frames = in.size() / channels;
+    for (size_t i = 0; i < frames; i += PCM_NORMALIZER_MAX_INPUT) {
+        size_t n = min(frames - i, (size_t)PCM_NORMALIZER_MAX_INPUT);
+        size_t written = normalizer.process(in.data() + i * channels, n, chunk.data());
+        out.insert(out.end(), chunk.begin(), chunk.begin() + written * PCM_OUTPUT_CHANNELS);
+    }
+    return out;
+}
+
+// Residual after removing the best-fitting 1 kHz sine and DC, relative to that sine
+static double thdPlusNoiseDb(const std::vector<int16_t>& out, int channel) {
+    double s = 0, c = 0, dc = 0;
+    for (size_t i = 0; i < FIT_FRAMES; i++) {
+        double x = out[(SETTLE_FRAMES + i) * 2 + channel];
+        double w = 2 * M_PI * TONE_HZ * i / PCM_OUTPUT_SAMPLE_RATE;
+        s += x * sin(w);
+        c += x * cos(w);
+        dc += x;
+    }
+    s *= 2.0 / FIT_FRAMES;
+    c *= 2.0 / FIT_FRAMES;
+    dc /= FIT_FRAMES;
+    double residual = 0;
+    for (size_t i = 0; i < FIT_FRAMES; i++) {
+        double w = 2 * M_PI * TONE_HZ * i / PCM_OUTPUT_SAMPLE_RATE;
+        double e = out[(SETTLE_FRAMES + i) * 2 + channel] - (s * sin(w) + c * cos(w) + dc);
+        residual += e * e;
+    }
+    double signal_power = (s * s + c * c) / 2;
+    return 10 * log10(residual / FIT_FRAMES / signal_power);
+}
+
+void test_thd_plus_noise(void) {
+    Serial.quiet = true;
+    size_t output_frames = SETTLE_FRAMES + FIT_FRAMES + 1000;
+    for (uint32_t rate : rates) {
+        for (uint8_t channels = 1; channels <= 2; channels++) {
+            size_t in_frames = (uint64_t)output_frames * rate / PCM_OUTPUT_SAMPLE_RATE + PCM_RESAMPLER_TAPS;
+            std::vector<int16_t> out = convert(tone(rate, channels, TONE_HZ, in_frames), rate, channels);
+            TEST_ASSERT_GREATER_OR_EQUAL((SETTLE_FRAMES + FIT_FRAMES) * 2, out.size());
+            double left = thdPlusNoiseDb(out, 0);
+            double right = thdPlusNoiseDb(out, 1);
+
+            char line[96];
+            snprintf(line, sizeof(line), "%5u Hz %s: THD+N %.1f dB", (unsigned)rate,
+                     channels == 1 ? "mono  " : "stereo", max(left, right));
+            TEST_MESSAGE(line);
+            TEST_ASSERT_LESS_THAN(MAX_THD_N_DB, left);
+            TEST_ASSERT_LESS_THAN(MAX_THD_N_DB, right);
+        }
+    }
+}
+
+// Content above 22.05 kHz in a 48 kHz file must not fold back into the audible band
+void test_alias_rejection(void) {
+    const double hz = 23000;
+    size_t in_frames = 48000;
+    std::vector<int16_t> out = convert(tone(48000, 2, hz, in_frames), 48000, 2);
+    double power = 0;
+    size_t frames = out.size() / 2 - SETTLE_FRAMES;
+    for (size_t i = SETTLE_FRAMES; i < out.size() / 2; i++) power += (double)out[i * 2] * out[i * 2];
+    double db = 10 * log10(power / frames / ((double)TONE_AMPLITUDE * TONE_AMPLITUDE / 2));
+
+    char line[96];
+    snprintf(line, sizeof(line), "48000 Hz: a %.0f Hz tone comes out at %.1f dB", hz, db);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_LESS_THAN(-40.0, db);
+}
+
+void test_speed(void) {
+    for (uint32_t rate : rates) {
+        std::vector<int16_t> in = tone(rate, 2, TONE_HZ, PCM_NORMALIZER_MAX_INPUT);
+        normalizer.configure(rate, 2);
+        normalizer.reset();
+        std::vector<int16_t> out(normalizer.maxOutputFrames(PCM_NORMALIZER_MAX_INPUT) * PCM_OUTPUT_CHANNELS);
+        size_t calls = (uint64_t)SPEED_SECONDS * rate / PCM_NORMALIZER_MAX_INPUT;
+        uint64_t frames = 0;
+
+        auto start = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+        uint64_t cycles_start = __rdtsc();
+#endif
+        for (size_t i = 0; i < calls; i++) frames += normalizer.process(in.data(), PCM_NORMALIZER_MAX_INPUT, out.data());
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+#if defined(__x86_64__) || defined(__i386__)
+        double cycles = (double)(__rdtsc() - cycles_start) / frames;
+#else
+        double cycles = 0;
+#endif
+
+        char line[128];
+        snprintf(line, sizeof(line), "%5u Hz stereo: %.1f ns, %.0f host TSC cycles per output frame (%.0fx real time)",
+                 (unsigned)rate, ns / frames, cycles, SPEED_SECONDS * 1e9 / ns);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_UINT64_WITHIN(frames / 100, (uint64_t)SPEED_SECONDS * PCM_OUTPUT_SAMPLE_RATE, frames);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_thd_plus_noise);
+    RUN_TEST(test_alias_rejection);
+    RUN_TEST(test_speed);
+    return UNITY_END();
+}
@@ -0,0 +1,97 @@
+#include <unity.h>
+#include <chrono>
+#include <vector>
+#include "PlaylistManager.h"
+#include "SyntheticLibrary.h"
+#include "settings.h"
+
+// Throughput of the streamed name search over a 20k-track index, run in the same
+// SEARCH_SLICE_MS slices the UI loop gives it. Times are host figures; the SD traffic
+// counts carry over to the card.
+
+#define LIBRARY_ROOT "/Music"
+#define FOLDERS 200
+#define TRACKS_PER_FOLDER 100
+
+static PlaylistManager playlist(LIBRARY_ROOT);
+
+void setUp(void) {}
+void tearDown(void) {}
+
+struct SearchCost {
+    int matches;
+    int slices;
+    double millis;
+};
+
+static SearchCost runSearch(const char* query) {
+    std::vector<int> results(playlist.getTrackCount() + 1);  // Room left over, or the last slice could not finish
+    SearchCost cost = {0, 0, 0};
+    SD.resetCounters();
+    auto start = std::chrono::steady_clock::now();
+    TEST_ASSERT_TRUE(playlist.startSearch(query));
+    while (!playlist.isSearchDone()) {
+        cost.matches += playlist.continueSearch(results.data() + cost.matches, results.size() - cost.matches,
+                                                SEARCH_SLICE_MS);
+        cost.slices++;
+    }
+    cost.millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Matches come back in playlist order, each once
+    for (int i = 1; i < cost.matches; i++) TEST_ASSERT_GREATER_THAN(results[i - 1], results[i]);
+
+    char line[256];
+    snprintf(line, sizeof(line), "\"%s\": %5d matches in %7.2f ms over %d slices: %9.0f matches/s, "
+             "%9.0f names/s, %llu bytes read in %u calls",
+             query, cost.matches, cost.millis, cost.slices, cost.matches * 1000.0 / cost.millis,
+             playlist.getTrackCount() * 1000.0 / cost.millis,
+             (unsigned long long)SD.counters.bytes_read, (unsigned)SD.counters.reads);
+    TEST_MESSAGE(line);
+    return cost;
+}
+
+void test_library_scans(void) {
+    SD.setRoot((std::filesystem::temp_directory_path() / "test_search").string());
+    SD.format();
+    TEST_ASSERT_TRUE(syntheticWriteLibrary(LIBRARY_ROOT, FOLDERS, TRACKS_PER_FOLDER));
+    Serial.quiet = true;
+    TEST_ASSERT_TRUE(syntheticScanLibrary(playlist));
+    TEST_ASSERT_EQUAL_UINT32(FOLDERS * TRACKS_PER_FOLDER, playlist.getTrackCount());
+}
+
+// Names look like "07 Song 7 of folder 123.mp3"
+void test_every_name_matches(void) {
+    TEST_ASSERT_EQUAL_INT(FOLDERS * TRACKS_PER_FOLDER, runSearch("song").matches);
+}
+
+// Matches counted the slow way, over the display names the library was written with
+static int expectedMatches(const char* query) {
+    int count = 0;
+    char name[128];
+    for (int folder = 0; folder < FOLDERS; folder++) {
+        for (int track = 0; track < TRACKS_PER_FOLDER; track++) {
+            syntheticTrackName(name, sizeof(name), folder, track);
+            *strrchr(name, '.') = '\0';
+            if (strcasestr(name, query)) count++;
+        }
+    }
+    return count;
+}
+
+void test_some_names_match(void) {
+    TEST_ASSERT_EQUAL_INT(expectedMatches("12"), runSearch("12").matches);
+    TEST_ASSERT_EQUAL_INT(TRACKS_PER_FOLDER, runSearch("folder 123").matches);
+}
+
+void test_no_name_matches(void) {
+    TEST_ASSERT_EQUAL_INT(0, runSearch("zzz").matches);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_library_scans);
+    RUN_TEST(test_every_name_matches);
+    RUN_TEST(test_some_names_match);
+    RUN_TEST(test_no_name_matches);
+    return UNITY_END();
+}
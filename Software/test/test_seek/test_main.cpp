@@ -0,0 +1,121 @@
+#include <unity.h>
+#include "AudioProcessor.h"
+#include "SyntheticMp3.h"
+
+// Seeking in a VBR file: the Xing TOC maps time to bytes, where the byte ratio alone
+// lands seconds off. Every sample carries its own index (SYNTHETIC_COUNTER), so the
+// first one heard after a seek, or after opening at a position, says exactly where
+// playback landed.
+
+#define TOC_PATH "/toc.mp3"
+#define NO_TOC_PATH "/no_toc.mp3"
+#define SAMPLE_RATE 44100
+#define TRACK_SECONDS 20
+#define TOC_TOLERANCE_MS 100  // TOC entries are 1/256 of the stream, plus frames dropped for the bit reservoir
+
+// The decode task runs until the process ends, so the processor is never destroyed
+static AudioProcessor* audio = new AudioProcessor();
+static const uint32_t targets_ms[] = {1000, 5000, 9000, 11000, 15000, 19000};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// How far the first sample played is from the target
+static int landingError(uint32_t target_ms) {
+    uint8_t buffer[64];
+    audio->readAudioData(buffer, 4);  // Takes the flush a seek or an open asks for
+    unsigned long start = millis();
+    while (audio->getBufferedBytes() < sizeof(buffer)) {
+        TEST_ASSERT_LESS_THAN(5000, millis() - start);
+        delay(1);
+    }
+    TEST_ASSERT_EQUAL_INT(sizeof(buffer), audio->readAudioData(buffer, sizeof(buffer)));
+
+    // Consecutive samples, so this is decoded audio and not silence
+    const int16_t* samples = (const int16_t*)buffer;
+    int64_t landed = syntheticCounterAt(samples);
+    TEST_ASSERT_EQUAL_INT64(landed + 1, syntheticCounterAt(samples + 2));
+    return (int)((landed - (int64_t)target_ms * SAMPLE_RATE / 1000) * 1000 / SAMPLE_RATE);
+}
+
+static int seekError(uint32_t target_ms) {
+    TEST_ASSERT_TRUE(audio->seek(target_ms));
+    return landingError(target_ms);
+}
+
+static void writeTrack(const char* path, bool toc) {
+    SyntheticTrack track;
+    track.waveform = SYNTHETIC_COUNTER;
+    track.samples = TRACK_SECONDS * SAMPLE_RATE;
+    track.bitrate_kbps = 64;
+    track.late_bitrate_kbps = 320;  // Second half takes five times the bytes per second
+    track.toc = toc;
+    track.first_main_data_begin = 200;
+    TEST_ASSERT_TRUE(syntheticWriteMp3(path, track));
+}
+
+void test_files_open(void) {
+    SD.setRoot((std::filesystem::temp_directory_path() / "test_seek").string());
+    SD.format();
+    writeTrack(TOC_PATH, true);
+    writeTrack(NO_TOC_PATH, false);
+    TEST_ASSERT_TRUE(audio->begin());
+}
+
+void test_toc_seek_lands_on_time(void) {
+    TEST_ASSERT_TRUE(audio->openFile(TOC_PATH));
+    for (uint32_t target : targets_ms) {
+        int error = seekError(target);
+        char line[64];
+        snprintf(line, sizeof(line), "TOC seek to %5u ms landed %+d ms off", (unsigned)target, error);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_LESS_OR_EQUAL(TOC_TOLERANCE_MS, abs(error));
+
+        // The position shown follows the audio heard
+        TEST_ASSERT_LESS_OR_EQUAL(TOC_TOLERANCE_MS, abs((int)audio->getPositionMs() - (int)target));
+    }
+}
+
+// Without a TOC and without having played through, only the average bitrate is known
+void test_byte_ratio_seek_is_worse(void) {
+    TEST_ASSERT_TRUE(audio->openFile(NO_TOC_PATH));
+    int worst = 0;
+    for (uint32_t target : targets_ms) {
+        int error = seekError(target);
+        char line[64];
+        snprintf(line, sizeof(line), "Ratio seek to %5u ms landed %+d ms off", (unsigned)target, error);
+        TEST_MESSAGE(line);
+        worst = max(worst, abs(error));
+    }
+    TEST_ASSERT_GREATER_THAN(10 * TOC_TOLERANCE_MS, worst);
+    audio->closeFile();
+}
+
+// Resuming after a reboot: the file opens at the saved place and the decoder never sees
+// the frames before it. Opening and then seeking decodes from the start as soon as the
+// audio callback takes the flush in between.
+void test_open_at_position(void) {
+    for (uint32_t target : targets_ms) {
+        host_mp3_first_sample_seen = INT64_MAX;  // Nothing is open, so nothing is decoding
+        TEST_ASSERT_TRUE(audio->openFile(TOC_PATH, 0, target));
+        int error = landingError(target);
+        int64_t first_ms = host_mp3_first_sample_seen * 1000 / SAMPLE_RATE;
+        char line[96];
+        snprintf(line, sizeof(line), "Open at %5u ms landed %+d ms off, first frame decoded at %5d ms",
+                 (unsigned)target, error, (int)first_ms);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_LESS_OR_EQUAL(TOC_TOLERANCE_MS, abs(error));
+        TEST_ASSERT_LESS_OR_EQUAL(TOC_TOLERANCE_MS, abs((int)(first_ms - target)));
+        TEST_ASSERT_LESS_OR_EQUAL(TOC_TOLERANCE_MS, abs((int)audio->getPositionMs() - (int)target));
+        audio->closeFile();
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_files_open);
+    RUN_TEST(test_toc_seek_lands_on_time);
+    RUN_TEST(test_byte_ratio_seek_is_worse);
+    RUN_TEST(test_open_at_position);
+    return UNITY_END();
+}
@@ -0,0 +1,85 @@
+#include <unity.h>
+#include <vector>
+#include "TrackShuffle.h"
+
+// Track counts around every awkward case: nothing to shuffle, a single swap, counts just
+// under, at and over a power of four, and a library larger than any real card holds
+static const uint32_t COUNTS[] = {1, 2, 3, 4, 5, 7, 15, 16, 17, 100, 1000, 4095, 4096, 4097, 50000};
+static const uint32_t SEEDS[] = {0, 1, 0xDEADBEEF};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Every position maps to a different track, so the order plays each track exactly once
+static void checkPermutation(TrackShuffle& shuffle, uint32_t count) {
+    std::vector<uint8_t> seen(count, 0);
+    for (uint32_t position = 0; position < count; position++) {
+        uint32_t track = shuffle.trackAt(position, count);
+        TEST_ASSERT_LESS_THAN(count, track);
+        TEST_ASSERT_EQUAL_UINT8(0, seen[track]);
+        seen[track] = 1;
+        TEST_ASSERT_EQUAL_UINT32(position, shuffle.positionOf(track, count));
+    }
+}
+
+void test_every_count_is_a_permutation(void) {
+    TrackShuffle shuffle;
+    for (uint32_t seed : SEEDS) {
+        shuffle.setSeed(seed);
+        for (uint32_t count : COUNTS) {
+            checkPermutation(shuffle, count);
+        }
+    }
+}
+
+// Next from any track visits all of them before coming back, and previous undoes next
+void test_step_walks_one_cycle(void) {
+    TrackShuffle shuffle;
+    shuffle.setSeed(42);
+    for (uint32_t count : COUNTS) {
+        std::vector<uint8_t> seen(count, 0);
+        uint32_t track = shuffle.trackAt(0, count);
+        for (uint32_t i = 0; i < count; i++) {
+            TEST_ASSERT_EQUAL_UINT8(0, seen[track]);
+            seen[track] = 1;
+            uint32_t next = shuffle.step(track, 1, count);
+            TEST_ASSERT_EQUAL_UINT32(track, shuffle.step(next, -1, count));
+            track = next;
+        }
+        TEST_ASSERT_EQUAL_UINT32(shuffle.trackAt(0, count), track);
+    }
+}
+
+// The count can change between calls, as it does while a scan adds tracks
+void test_count_changes_between_calls(void) {
+    TrackShuffle shuffle;
+    shuffle.setSeed(7);
+    checkPermutation(shuffle, 1000);
+    checkPermutation(shuffle, 17);
+    checkPermutation(shuffle, 1000);
+}
+
+void test_seeds_give_different_orders(void) {
+    TrackShuffle first, second;
+    first.setSeed(1);
+    second.setSeed(2);
+    uint32_t same = 0;
+    for (uint32_t position = 0; position < 1000; position++) {
+        if (first.trackAt(position, 1000) == second.trackAt(position, 1000)) same++;
+    }
+    TEST_ASSERT_LESS_THAN(50, same);
+
+    second.setSeed(1);
+    for (uint32_t position = 0; position < 1000; position++) {
+        TEST_ASSERT_EQUAL_UINT32(first.trackAt(position, 1000), second.trackAt(position, 1000));
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_every_count_is_a_permutation);
+    RUN_TEST(test_step_walks_one_cycle);
+    RUN_TEST(test_count_changes_between_calls);
+    RUN_TEST(test_seeds_give_different_orders);
+    return UNITY_END();
+}
@@ -0,0 +1,97 @@
+#include <unity.h>
+#include <vector>
+#include "AudioProcessor.h"
+#include "SyntheticMp3.h"
+
+// Two files played back to back through the one decoder, opened one after the other and
+// queued for a gapless handover. The second file's first frame reaches back into the
+// bit reservoir, which must be empty: that frame is dropped rather than decoded from
+// the first file's bytes, and the rest of the track keeps its place in time.
+
+#define FIRST_PATH "/first.mp3"
+#define SECOND_PATH "/second.mp3"
+#define TRACK_SAMPLES (2 * 44100)
+#define RESERVOIR_BYTES 300
+// Samples of the signal in the dropped first frame: the rest of it is delay
+#define DROPPED_SAMPLES (1152 - 576 - SYNTHETIC_DECODER_DELAY)
+
+// The decode task runs until the process ends, so the processor is never destroyed
+static AudioProcessor* audio = new AudioProcessor();
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Counter values in the order they come out of the ring, until the player runs dry
+static std::vector<int64_t> play(const char* queued_path) {
+    std::vector<int64_t> counters;
+    uint8_t buffer[4096];
+    audio->readAudioData(buffer, 4);  // Takes the flush that opening a file asks for
+
+    bool queued = false;
+    unsigned long start = millis();
+    while (!audio->isFinished()) {
+        TEST_ASSERT_LESS_THAN(20000, millis() - start);
+        if (audio->hasNextFileRequest()) {
+            if (queued_path && !queued) TEST_ASSERT_TRUE(audio->queueFile(queued_path));
+            audio->consumeNextFileRequest();
+            queued = true;
+        }
+        int32_t len = min(audio->getBufferedBytes(), sizeof(buffer)) & ~3;
+        if (len == 0) {
+            delay(1);
+            continue;
+        }
+        TEST_ASSERT_EQUAL_INT(len, audio->readAudioData(buffer, len));
+        const int16_t* samples = (const int16_t*)buffer;
+        for (int32_t i = 0; i < len / 4; i++) counters.push_back(syntheticCounterAt(samples + i * 2));
+    }
+    if (audio->hasTrackChangeEvent()) audio->consumeTrackChangeEvent();
+    audio->closeFile();
+    return counters;
+}
+
+static void assertRun(const std::vector<int64_t>& counters, size_t from, int64_t first, int64_t last) {
+    TEST_ASSERT_EQUAL_UINT32(from + (last - first + 1), counters.size());
+    for (int64_t n = first; n <= last; n++) {
+        TEST_ASSERT_EQUAL_INT64(n, counters[from + (n - first)]);
+    }
+}
+
+void test_reopening_starts_with_an_empty_reservoir(void) {
+    SD.setRoot((std::filesystem::temp_directory_path() / "test_track_switch").string());
+    SD.format();
+    SyntheticTrack track;
+    track.waveform = SYNTHETIC_COUNTER;
+    track.samples = TRACK_SAMPLES;
+    TEST_ASSERT_TRUE(syntheticWriteMp3(FIRST_PATH, track));
+    track.first_main_data_begin = RESERVOIR_BYTES;
+    TEST_ASSERT_TRUE(syntheticWriteMp3(SECOND_PATH, track));
+
+    TEST_ASSERT_TRUE(audio->begin());
+    TEST_ASSERT_TRUE(audio->openFile(FIRST_PATH));
+    assertRun(play(nullptr), 0, 0, TRACK_SAMPLES - 1);
+
+    int underflows = host_mp3_reservoir_underflows;
+    TEST_ASSERT_TRUE(audio->openFile(SECOND_PATH));
+    std::vector<int64_t> counters = play(nullptr);
+    TEST_ASSERT_EQUAL_INT(underflows + 1, host_mp3_reservoir_underflows);
+    assertRun(counters, 0, DROPPED_SAMPLES, TRACK_SAMPLES - 1);
+}
+
+void test_gapless_handover_starts_with_an_empty_reservoir(void) {
+    int underflows = host_mp3_reservoir_underflows;
+    TEST_ASSERT_TRUE(audio->openFile(FIRST_PATH));
+    std::vector<int64_t> counters = play(SECOND_PATH);
+    TEST_ASSERT_EQUAL_INT(underflows + 1, host_mp3_reservoir_underflows);
+    TEST_ASSERT_GREATER_OR_EQUAL(TRACK_SAMPLES, counters.size());
+    assertRun(std::vector<int64_t>(counters.begin(), counters.begin() + TRACK_SAMPLES), 0, 0, TRACK_SAMPLES - 1);
+    assertRun(counters, TRACK_SAMPLES, DROPPED_SAMPLES, TRACK_SAMPLES - 1);
+    TEST_ASSERT_EQUAL_UINT32(0, audio->getUnderrunCount());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_reopening_starts_with_an_empty_reservoir);
+    RUN_TEST(test_gapless_handover_starts_with_an_empty_reservoir);
+    return UNITY_END();
+}